@@ -43,6 +43,12 @@
 //       methods an application will need to call are `ggkNofifyUpdatedCharacteristic` and `ggkNofifyUpdatedDescriptor`. The other
 //       methods are provided in case an application requies extended functionality.
 //
+//     * Data store
+//
+//       An optional alternative to the data delegates for values that change often. The application registers a named slot once
+//       and then publishes new values to it by handle (`ggkPublish`). Publishing is lock-free and, for slots bound to a
+//       characteristic in the server description, also takes care of notifying subscribers.
+//
 //     * Server control
 //
 //       A small set of methods for starting and stopping the server.
@@ -61,6 +67,21 @@
 //           EOk         - the server is A-OK
 //           EFailedInit - the server had a failure prior to the ERunning state
 //           EFailedRun  - the server had a failure during the ERunning state
+//
+//     * Instances
+//
+//       Several independent servers may run in one process, each on its own thread. The methods above work with the calling
+//       thread's current instance (`ggkSelectInstance`), and a handful have variants that take an instance (`ggkStartInstance`.)
+//
+//     * Statistics
+//
+//       Lock-free performance counters and latency histograms for the server's hot paths (`ggkGetStats`). The same values are
+//       also available on D-Bus, from the `GetStats` method of the `com.gobbledegook.Stats` interface at the root object path.
+//
+//     * Memory footprint
+//
+//       A low-memory profile for constrained devices (`ggkSetLowMemoryMode`) and a breakdown of the memory each part of the server
+//       uses (`ggkGetMemoryStats`.)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #pragma once
@@ -88,6 +109,14 @@ extern "C"
 	void ggkLogRegisterAlways(GGKLogReceiver receiver);
 	void ggkLogRegisterTrace(GGKLogReceiver receiver);
 
+	// Enables (non-zero) or disables (zero) asynchronous log delivery
+	//
+	// By default, receivers are called on the thread that logged the entry, which is often the server's own thread. With async
+	// delivery enabled, entries are queued and receivers are called from a dedicated logging thread instead, so a slow receiver
+	// cannot hold up the server. Receivers must then be safe to call from that thread. Disabling delivers any queued entries
+	// before returning. FATAL entries are always delivered immediately.
+	void ggkLogSetAsync(int enabled);
+
 	// -----------------------------------------------------------------------------------------------------------------------------
 	// SERVER DATA
 	// -----------------------------------------------------------------------------------------------------------------------------
@@ -100,6 +129,9 @@ extern "C"
 	//
 	// Similarly, the pointer to data returned to the server should point to non-volatile memory so that the server can use it
 	// safely for an indefinite period of time.
+	//
+	// Applications that keep all of their values in the data store (see DATA STORE below) may pass nullptr for this delegate and
+	// for the setter.
 	typedef const void *(*GGKServerDataGetter)(const char *pName);
 
 	// Type definition for a delegate that the server will use when it needs to notify the host application that data has changed
@@ -121,12 +153,88 @@ extern "C"
 	//   * Any other failure, as deemed by the delegate handler
 	typedef int (*GGKServerDataSetter)(const char *pName, const void *pData);
 
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// DATA STORE
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Registers a named slot in the server's data store that can hold values of up to `maxSize` bytes
+	//
+	// If a slot with this name already exists (for example, because the server description bound a characteristic to it), the
+	// existing slot's handle is returned. Slots may be registered before the server is started.
+	//
+	// Returns the slot's handle, or -1 on failure.
+	int ggkRegisterDataSlot(const char *pName, int maxSize);
+
+	// Returns the handle of the slot with the given name, or -1 if there is no such slot
+	int ggkFindDataSlot(const char *pName);
+
+	// Stores a new value in a data slot
+	//
+	// The value is copied, so the caller's buffer may be reused immediately. If the slot is bound to a characteristic and a client
+	// is subscribed to that characteristic, the characteristic is queued for an update (as with `ggkNofifyUpdatedCharacteristic`.)
+	//
+	// This may be called from any thread and never blocks readers of the slot.
+	//
+	// Returns non-zero value on success or 0 on failure (an invalid handle or a value larger than the slot.)
+	int ggkPublish(int handle, const void *pData, int dataLength);
+
+	// Copies the current value of a data slot into `pBuffer`
+	//
+	// Returns the length of the value, or -1 on failure (an invalid handle or a buffer too small to hold the value.)
+	int ggkReadDataSlot(int handle, void *pBuffer, int bufferLength);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// CONNECTIONS
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// A device that is connected to one of our adapters
+	struct GGKConnection
+	{
+		// The index of the controller the device is connected to (ex: 0 for "hci0")
+		int controllerIndex;
+
+		// The device's address (ex: "01:23:45:67:89:AB") and address type (0 = BR/EDR, 1 = LE public, 2 = LE random)
+		char address[18];
+		int addressType;
+
+		// The latest connection parameters requested for this connection, or zeros if none have been received. Intervals are in
+		// units of 1.25ms and the supervision timeout is in units of 10ms.
+		int minConnectionInterval;
+		int maxConnectionInterval;
+		int connectionLatency;
+		int supervisionTimeout;
+	};
+
+	// Type definitions for delegates that are told when a device connects or disconnects
+	//
+	// These are called from the server's thread, never from the thread that receives events from the adapter, so a slow delegate
+	// will not hold up the server's handling of the adapter. The connection pointer is only valid for the duration of the call.
+	//
+	// The disconnection reason is the reason code from the Bluetooth Management API's Device Disconnected event.
+	typedef void (*GGKConnectDelegate)(const struct GGKConnection *pConnection);
+	typedef void (*GGKDisconnectDelegate)(const struct GGKConnection *pConnection, int reason);
+
+	// Each of these methods registers a connection delegate. To unregister a delegate, simply register with `nullptr`.
+	void ggkRegisterConnectDelegate(GGKConnectDelegate delegate);
+	void ggkRegisterDisconnectDelegate(GGKDisconnectDelegate delegate);
+
+	// Returns the number of devices currently connected to any of our adapters
+	int ggkGetConnectionCount();
+
+	// Copies up to `maxConnections` of the currently connected devices into `pConnections`
+	//
+	// Returns the number of connections copied
+	int ggkGetConnections(struct GGKConnection *pConnections, int maxConnections);
+
 	// -----------------------------------------------------------------------------------------------------------------------------
 	// SERVER DATA UPDATE MANAGEMENT
 	// -----------------------------------------------------------------------------------------------------------------------------
 
 	// Adds an update to the front of the queue for a characteristic at the given object path
 	//
+	// If no client is currently subscribed to the characteristic's notifications, there is nobody to notify, so the update is
+	// not queued (this still counts as success.)
+	//
 	// Returns non-zero value on success or 0 on failure.
 	int ggkNofifyUpdatedCharacteristic(const char *pObjectPath);
 
@@ -135,23 +243,58 @@ extern "C"
 	// Returns non-zero value on success or 0 on failure.
 	int ggkNofifyUpdatedDescriptor(const char *pObjectPath);
 
-	// Adds a named update to the front of the queue. Generally, this routine should not be used directly. Instead, use the
+	// Adds updates for `count` characteristics, given by their object paths, to the queue all at once
+	//
+	// This works like calling `ggkNofifyUpdatedCharacteristic()` for each path, except that the whole batch is queued together
+	// (with a single wakeup of the server) and is processed by the server in a single pass. If any of the paths is not a
+	// characteristic, or the queue doesn't have room for the batch, nothing is queued.
+	//
+	// Returns non-zero value on success or 0 on failure.
+	int ggkNotifyUpdatedCharacteristics(const char **ppObjectPaths, int count);
+
+	// Resolves the characteristic at the given object path to a handle, for use with `ggkNotifyUpdatedCharacteristicHandles()`
+	//
+	// Resolving the same characteristic again returns the same handle. The server must be started first. If the characteristic's
+	// service is removed (and added again), resolve it again.
+	//
+	// Returns the handle, or -1 if there is no such characteristic (or no more handles are available)
+	int ggkResolveCharacteristic(const char *pObjectPath);
+
+	// Adds updates for `count` characteristics, given by handles from `ggkResolveCharacteristic()`, to the queue all at once
+	//
+	// This is the fastest way to notify of many updates: nothing is looked up and nothing is locked. Otherwise, it works like
+	// `ggkNotifyUpdatedCharacteristics()`. If any of the handles is invalid, nothing is queued.
+	//
+	// Returns non-zero value on success or 0 on failure.
+	int ggkNotifyUpdatedCharacteristicHandles(const int *pHandles, int count);
+
+	// Adds a named update to the queue. Generally, this routine should not be used directly. Instead, use the
 	// `ggkNofifyUpdatedCharacteristic()` instead.
 	//
+	// The object path and interface name are resolved to an interface when the update is pushed, so the server must be started
+	// before updates can be posted. If the interface already has an update pending, this update is coalesced with it.
+	//
+	// Unlike `ggkNofifyUpdatedCharacteristic()`, updates are queued whether or not a client is subscribed.
+	//
 	// Returns non-zero value on success or 0 on failure.
 	int ggkPushUpdateQueue(const char *pObjectPath, const char *pInterfaceName);
 
-	// Get the next update from the back of the queue and returns the element in `element` as a string in the format:
+	// Get the next update from the front of the queue and returns the element in `element` as a string in the format:
 	//
 	//     "com/object/path|com.interface.name"
 	//
 	// If the queue is empty, this method returns `0` and does nothing.
 	//
 	// `elementLen` is the size of the `element` buffer in bytes. If the resulting string (including the null terminator) will not
-	// fit within `elementLen` bytes, the method returns `-1` and does nothing.
+	// fit within `elementLen` bytes, the method returns `-1` and the entry stays queued (if it was being removed, it goes to the
+	// back of the queue.)
 	//
-	// If `keep` is set to non-zero, the entry is not removed and will be retrieved again on the next call. Otherwise, the element
-	// is removed.
+	// If `keep` is set to non-zero, the entry is not removed. Since other threads (including the server itself) may take it at any
+	// time, the result is only a snapshot of the front of the queue: the next call may well return a different entry. Otherwise,
+	// the element is removed and returned in a single step.
+	//
+	// Note that the server processes its own queue internally, without going through this method. This method is retained for
+	// applications that wish to inspect or drain the queue themselves.
 	//
 	// Returns 1 on success, 0 if the queue is empty, -1 on error (such as the length too small to store the element)
 	int ggkPopUpdateQueue(char *pElement, int elementLen, int keep);
@@ -223,6 +366,192 @@ extern "C"
 	int ggkStart(const char *pServiceName, const char *pAdvertisingName, const char *pAdvertisingShortName, 
 		GGKServerDataGetter getter, GGKServerDataSetter setter, int maxAsyncInitTimeoutMS);
 
+	// Adds a Bluetooth adapter (ex: "hci0") to serve the GATT application on
+	//
+	// By default, the server uses the first adapter provided by BlueZ. Call this method once for each adapter you want to use
+	// before calling `ggkStart()`. All adapters share the same services and every notification is sent on each of them, but each
+	// adapter is configured separately, with its own connections.
+	//
+	// advertisingName/advertisingShortName: The names this adapter advertises over LE. Pass empty strings (or nullptr) to use
+	//     the names given to `ggkStart()`.
+	//
+	// Returns non-zero on success, or 0 if the server has already been started.
+	int ggkAddAdapter(const char *pAdapterName, const char *pAdvertisingName, const char *pAdvertisingShortName);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// LINK TUNING
+	// -----------------------------------------------------------------------------------------------------------------------------
+	//
+	// By default, the kernel chooses the connection parameters, PHY and data length for each connection. These often limit
+	// throughput to a trickle. These methods request better ones. They are applied to each adapter as it is configured, so they
+	// must be called before `ggkStart()`.
+	//
+	// These are requests, not guarantees: the central has the final say on connection parameters, and anything the adapter (or
+	// kernel) doesn't support is logged and skipped.
+	//
+	// Each method returns non-zero on success, or 0 if a parameter is out of range or the server has already been started.
+
+	// Sets the preferred connection parameters for all devices
+	//
+	// Intervals are in units of 1.25ms [6, 3200], latency is a number of connection events [0, 499] and the supervision timeout
+	// is in units of 10ms [10, 3200]. This requires Linux 5.9 or later.
+	int ggkSetConnectionParameters(int minInterval, int maxInterval, int latency, int supervisionTimeout);
+
+	// Sets the preferred connection parameters for a specific device (ex: "01:23:45:67:89:AB"), overriding those set with
+	// `ggkSetConnectionParameters()`
+	//
+	// The address type is 1 for an LE public address or 2 for an LE random address. Parameters are as described for
+	// `ggkSetConnectionParameters()`. This may be called once for each device.
+	int ggkSetDeviceConnectionParameters(const char *pAddress, int addressType, int minInterval, int maxInterval, int latency, int supervisionTimeout);
+
+	// Enables (non-zero) or disables (0) the LE 2M PHY, which roughly doubles the raw data rate on supporting devices
+	int ggkSetLE2MPhy(int enable);
+
+	// Sets the suggested LL data length for new connections, in octets [27, 251] and microseconds [328, 17040]
+	//
+	// For the best throughput, use 251 octets and 2120us.
+	int ggkSetDataLength(int txOctets, int txTimeUS);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// BONDING
+	// -----------------------------------------------------------------------------------------------------------------------------
+	//
+	// By default, the server is not bondable, so a returning central goes through security setup on every connection. With a bond
+	// store, the server is bondable and keeps the keys exchanged when a central bonds, restoring them into the kernel whenever an
+	// adapter is set up, so a returning central can resume encryption right away.
+
+	// Keeps bonds in the file at `pPath` (which is created when the first device bonds), restoring any that are already there
+	//
+	// The file holds secret keys, so it is only readable by its owner. Restoring replaces the kernel's keys for the adapter,
+	// including any bluetoothd loaded for it, so the bond store should be the one place bonds are kept for the adapters the
+	// server uses. This must be called before `ggkStart()`.
+	//
+	// Returns non-zero on success, or 0 if the file exists but is not a bond store or the server has already been started.
+	int ggkSetBondStore(const char *pPath);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// ADVERTISING
+	// -----------------------------------------------------------------------------------------------------------------------------
+	//
+	// By default, each adapter advertises its name at the kernel's default interval. These methods advertise the application's
+	// own data instead (so a phone can tell what we are without connecting) and control how often we advertise. Like the link
+	// tuning methods, they are applied to each adapter as it is configured, so they must be called before `ggkStart()`.
+	//
+	// Each method returns non-zero on success, or 0 if a parameter is out of range or the server has already been started.
+
+	// Flags for an advertising instance
+	//
+	// The kernel fills in (and keeps up to date) the fields for the flags, TX power, appearance and local name when asked for, so
+	// those fields shouldn't also be in the instance's data.
+	enum GGKAdvertisingFlags
+	{
+		EAdvertiseConnectable = 0x01,
+		EAdvertiseDiscoverable = 0x02,
+		EAdvertiseLimitedDiscoverable = 0x04,
+		EAdvertiseFlagsField = 0x08,
+		EAdvertiseTxPower = 0x10,
+		EAdvertiseAppearance = 0x20,
+		EAdvertiseLocalName = 0x40
+	};
+
+	// Adds an advertising instance, numbered from 1
+	//
+	// Adapters support a handful of instances (often 5) and rotate between them. The data are sequences of AD structures (length,
+	// type, value), up to 31 bytes each for the advertisement and the scan response (pass nullptr and 0 for none.) `flags` is a
+	// combination of `GGKAdvertisingFlags`. The instance is advertised for `durationSeconds` at a time when rotating (0 for the
+	// kernel's default) and stops being advertised after `timeoutSeconds` (0 to advertise it for as long as the server runs.)
+	//
+	// Once an instance is added, the adapter's plain advertising (see `ggkStart()`) is disabled in favor of the instances.
+	int ggkAddAdvertisingInstance(int instance, int flags, const void *pAdvertisingData, int advertisingDataLength,
+		const void *pScanResponseData, int scanResponseLength, int durationSeconds, int timeoutSeconds);
+
+	// Sets the advertising intervals, in units of 0.625ms [32, 16384]
+	//
+	// Each adapter advertises with the fast intervals for `fastPeriodSeconds` after it is configured, then with the slow intervals.
+	// Pass 0 for `fastPeriodSeconds` to keep advertising with the fast intervals (the slow intervals are then ignored.) This
+	// requires Linux 5.9 or later.
+	int ggkSetAdvertisingIntervals(int fastMinInterval, int fastMaxInterval, int fastPeriodSeconds, int slowMinInterval, int slowMaxInterval);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// WORKER THREADS
+	// -----------------------------------------------------------------------------------------------------------------------------
+	//
+	// Characteristic handlers registered with `onReadValueAsync()` or `onWriteValueAsync()` run on a small pool of worker threads
+	// rather than the server's main loop. The pool is bounded: once every thread is busy and the queue is full, further requests
+	// to those handlers are refused with an error until the pool catches up.
+
+	// Sets the number of worker threads [1, 64] and the number of requests that may wait for one (at least 1)
+	//
+	// The defaults are 2 threads and 64 waiting requests. This must be called before `ggkStart()`. Returns non-zero on success, or 0
+	// if a parameter is out of range or the server has already been started.
+	int ggkSetWorkerThreads(int threadCount, int maxPendingJobs);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// MEMORY FOOTPRINT
+	// -----------------------------------------------------------------------------------------------------------------------------
+	//
+	// By default, the server trades memory for speed: it keeps lookup tables over every interface and caches what it sends to
+	// BlueZ. On small devices, the low-memory profile gives some of that back. These methods must be called before `ggkStart()`
+	// and each returns non-zero on success, or 0 if a parameter is out of range or the server has already been started.
+
+	// What the update queue does with an update that arrives when it is full
+	enum GGKUpdateDropPolicy
+	{
+		// The new update is refused (and the call that pushed it fails)
+		EUpdateDropNewest = 0,
+
+		// The oldest pending update is dropped to make room for the new one
+		EUpdateDropOldest = 1
+	};
+
+	// Enables (non-zero) or disables (0) the low-memory profile
+	//
+	// In the low-memory profile, the update queue holds 64 updates (rather than 1024), the adapter's events are read into a 4KB
+	// buffer (rather than 64KB), the per-interface lookup tables are dropped in favor of a search, and the introspection and
+	// `GetManagedObjects` caches are released once BlueZ has what it needs (they are rebuilt if BlueZ asks again.) Building with
+	// GGK_LOW_MEMORY defined makes this profile the default.
+	//
+	// This replaces the update queue, so any call to `ggkSetUpdateQueue()` should come after it.
+	int ggkSetLowMemoryMode(int enable);
+
+	// Sets the number of updates the update queue can hold [2, 65536] (rounded up to a power of two) and, as a
+	// `GGKUpdateDropPolicy`, what happens to an update that arrives when it is full
+	//
+	// The default is 1024 updates (64 in the low-memory profile), dropping the newest.
+	int ggkSetUpdateQueue(int capacity, int dropPolicy);
+
+	// The memory used by the current instance, in bytes, broken down by subsystem
+	//
+	// These are estimates: they count what each subsystem allocates for its own structures, but not the allocator's overhead or
+	// GLib's own data (except for the GVariants we cache.) Process-wide facilities (logging, statistics, tracing and the bond
+	// store) are not included.
+	struct GGKMemoryStats
+	{
+		// The server description: objects, interfaces, methods, properties (including any cached values) and the indexes over them
+		unsigned long long serverDescription;
+
+		// Parsed introspection kept for re-registering with BlueZ (counted as the size of the XML it was parsed from) and the
+		// cached `GetManagedObjects` reply, as of the last registration or reply
+		unsigned long long introspectionCache;
+		unsigned long long managedObjectsCache;
+
+		// The update queue, the data store (including the storage for each slot) and the characteristic handle table
+		unsigned long long updateQueue;
+		unsigned long long dataStore;
+		unsigned long long characteristicHandles;
+
+		// The buffer the adapter's events are read into
+		unsigned long long hciBuffers;
+
+		// The sum of the above
+		unsigned long long total;
+	};
+
+	// Copies the current instance's memory usage into `pStats`
+	//
+	// This may be called from any thread at any time. Returns 1 on success, or 0 if `pStats` is null.
+	int ggkGetMemoryStats(struct GGKMemoryStats *pStats);
+
 	// Blocks for up to maxAsyncInitTimeoutMS milliseconds until the server shuts down.
 	//
 	// If shutdown is successful, this method will return a non-zero value. Otherwise, it will return 0.
@@ -308,6 +637,142 @@ extern "C"
 	// Convert a `GGKServerHealth` into a human-readable string
 	const char *ggkGetServerHealthString(enum GGKServerHealth state);
 
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// INSTANCES
+	// -----------------------------------------------------------------------------------------------------------------------------
+	//
+	// A process may run several independent servers (one for each adapter, for example), each with its own thread, bus
+	// connection and services. Every method in this file works with the calling thread's current instance, which is the default
+	// instance unless another one has been selected with `ggkSelectInstance()`. Applications that only ever run one server can
+	// ignore instances altogether.
+	//
+	// The methods below that take an instance work with that instance, whichever instance the calling thread has selected.
+	//
+	// Logging, statistics, the bond store and tracing are shared by every instance in the process.
+
+	// An independent server, created with `ggkCreate()`
+	typedef struct GGKInstance GGKInstance;
+
+	// Creates a new instance, ready to be configured and started
+	//
+	// Returns the new instance, or nullptr on failure.
+	GGKInstance *ggkCreate();
+
+	// Destroys an instance created with `ggkCreate()`
+	//
+	// The instance must have been stopped (or never started) and must not be selected on any thread.
+	//
+	// Returns non-zero on success, or 0 if the instance is still running.
+	int ggkDestroy(GGKInstance *pInstance);
+
+	// Makes `pInstance` the current instance of the calling thread, so that every other method called from this thread works with
+	// it (pass nullptr to return to the default instance)
+	//
+	// This is how an instance is configured before it is started: select it, then call `ggkAddAdapter()`,
+	// `ggkAddAdvertisingInstance()` and the rest as you would for the default instance.
+	void ggkSelectInstance(GGKInstance *pInstance);
+
+	// Returns the current instance of the calling thread, or nullptr for the default instance
+	GGKInstance *ggkGetSelectedInstance();
+
+	// Each of these works like its counterpart that doesn't take an instance (see `ggkStart()`, `ggkTriggerShutdown()`,
+	// `ggkWait()`, `ggkShutdownAndWait()`, `ggkGetServerRunState()`, `ggkGetServerHealth()`, `ggkNofifyUpdatedCharacteristic()`
+	// and `ggkPublish()`), on the given instance
+	int ggkStartInstance(GGKInstance *pInstance, const char *pServiceName, const char *pAdvertisingName, const char *pAdvertisingShortName,
+		GGKServerDataGetter getter, GGKServerDataSetter setter, int maxAsyncInitTimeoutMS);
+	void ggkTriggerShutdownInstance(GGKInstance *pInstance);
+	int ggkWaitInstance(GGKInstance *pInstance);
+	int ggkShutdownAndWaitInstance(GGKInstance *pInstance);
+	enum GGKServerRunState ggkGetInstanceRunState(GGKInstance *pInstance);
+	enum GGKServerHealth ggkGetInstanceHealth(GGKInstance *pInstance);
+	int ggkNotifyUpdatedCharacteristicInstance(GGKInstance *pInstance, const char *pObjectPath);
+	int ggkPublishInstance(GGKInstance *pInstance, int handle, const void *pData, int dataLength);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// STATISTICS
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// The number of buckets in a `GGKHistogram`
+	#define GGK_STATS_HISTOGRAM_BUCKETS 24
+
+	// A histogram of durations, in microseconds
+	//
+	// Bucket 0 counts samples under 1us, and each bucket after that doubles the limit (bucket `n` counts samples under 2^n us.)
+	// The last bucket counts everything else.
+	struct GGKHistogram
+	{
+		unsigned long long count;
+		unsigned long long totalMicroseconds;
+		unsigned long long maxMicroseconds;
+		unsigned long long buckets[GGK_STATS_HISTOGRAM_BUCKETS];
+	};
+
+	// The server's performance counters
+	//
+	// All counters run from the time the process starts (or from the last call to `ggkResetStats`.)
+	struct GGKStats
+	{
+		// Time taken to handle D-Bus method calls and property gets (from the moment they reach us until our handler returns)
+		struct GGKHistogram methodCallLatency;
+		struct GGKHistogram propertyGetLatency;
+
+		// Updates pushed onto the update queue, updates that were already pending (and were merged with the pending one), updates
+		// dropped because the queue was full, the current and largest number of pending updates and the time updates spent in
+		// the queue before being processed
+		unsigned long long updatesQueued;
+		unsigned long long updatesCoalesced;
+		unsigned long long updatesDropped;
+		unsigned long long updateQueueDepth;
+		unsigned long long updateQueueMaxDepth;
+		struct GGKHistogram updateQueueLatency;
+
+		// Change notifications sent to subscribers, notifications replaced by a newer value before they were sent (see rate
+		// limiting and batching) and notifications that could not be sent
+		unsigned long long notificationsSent;
+		unsigned long long notificationsCoalesced;
+		unsigned long long notificationsDropped;
+
+		// Round-trip time for commands sent to the adapter over the HCI management socket, and commands that timed out
+		struct GGKHistogram hciCommandLatency;
+		unsigned long long hciCommandTimeouts;
+
+		// How late the server's main loop was in running a periodic probe, which is a measure of how long it was blocked
+		struct GGKHistogram mainLoopStall;
+	};
+
+	// Copies the current performance counters into `pStats`
+	//
+	// This may be called from any thread at any time. Returns 1 on success, or 0 if `pStats` is null.
+	int ggkGetStats(struct GGKStats *pStats);
+
+	// Resets all performance counters, including the per-method histograms
+	void ggkResetStats();
+
+	// Type definition for a delegate that receives the latency histogram for a single D-Bus method
+	typedef void (*GGKMethodStatsReceiver)(const char *pObjectPath, const char *pInterfaceName, const char *pMethodName, const struct GGKHistogram *pLatency, void *pUserData);
+
+	// Calls `receiver` with the latency histogram of every D-Bus method in the server description that has been called at least
+	// once. The strings are only valid for the duration of each call.
+	//
+	// Returns the number of methods reported, or -1 if the server has not been started.
+	int ggkEnumerateMethodStats(GGKMethodStatsReceiver receiver, void *pUserData);
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// TRACING
+	// -----------------------------------------------------------------------------------------------------------------------------
+	//
+	// A trace records the management events the server reads from the adapter and the D-Bus requests that reach its objects, with
+	// their timing, so that a real session can be replayed later without a radio (see the `replay` program.) Keys exchanged during
+	// pairing are blanked out before they are written.
+
+	// Starts recording a trace to the file at `pTraceFile`, replacing anything already there (and finishing any trace in progress)
+	//
+	// This may be called at any time, from any thread. Returns 1 on success, or 0 if the file could not be written.
+	int ggkStartTrace(const char *pTraceFile);
+
+	// Finishes the trace in progress, if any
+	void ggkStopTrace();
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
@@ -0,0 +1,247 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Advertising instances and interval profiles, applied to each adapter as it is configured
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Left to itself, an adapter advertises its name (and little else) at the kernel's default interval, which leaves a phone
+// scanning for a second or more before it finds us and then connecting just to learn what we are. The advertising options let
+// the application do better:
+//
+//     * Advertising instances carry the application's own AD structures (service UUIDs, manufacturer data and so on) in the
+//       advertisement and the scan response. The kernel rotates between the instances, advertising each for its duration, and
+//       removes an instance once its timeout expires. Instances replace the adapter's advertising setting: the kernel won't
+//       advertise them while that setting is enabled, so `configureAdapter()` leaves it disabled when there are instances.
+//
+//     * An interval profile advertises quickly (say, every 30ms) for a while after the adapter comes up, when a phone is most
+//       likely to be looking for us, then slowly (say, every second) to save power and airtime. The intervals are set through
+//       the kernel's default system configuration, which the kernel only reads when it starts advertising. To switch to the slow
+//       intervals, we therefore restart advertising: each instance is added again (with whatever remains of its timeout), or the
+//       adapter's advertising setting is toggled.
+//
+// Each adapter runs its own profile, starting when it is configured (see `startAdvertising()`.) Everything here runs on the
+// server thread, and each server instance advertises with options of its own.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <algorithm>
+#include <glib.h>
+
+#include "Advertising.h"
+#include "MainContext.h"
+#include "Instance.h"
+#include "Mgmt.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// An adapter we've started advertising on
+struct AdvertisingController
+{
+	uint16_t controllerIndex;
+
+	// Set if the adapter advertises with its own advertising setting, which we restart to change the intervals
+	bool restartAdvertising;
+
+	// The pending switch to the slow intervals (or 0 if there is none)
+	guint slowTimerId;
+};
+
+// Our advertising options and the adapters we advertise on, for a server instance (see Instance.cpp)
+struct AdvertisingState
+{
+	AdvertisingOptions advertisingOptions;
+	std::vector<AdvertisingController> advertisingControllers;
+};
+
+// Returns the state of the current instance
+static AdvertisingState &state()
+{
+	return *Instance::current().pAdvertisingState;
+}
+
+// Creates the state for a new server instance (see Instance.cpp)
+std::shared_ptr<AdvertisingState> createAdvertisingState()
+{
+	return std::make_shared<AdvertisingState>();
+}
+
+// Returns the advertising options, which may only be changed before the server is started
+AdvertisingOptions &getAdvertisingOptions()
+{
+	return state().advertisingOptions;
+}
+
+// Returns true if we advertise with our own instances rather than the adapter's advertising setting
+bool usesAdvertisingInstances()
+{
+	return !state().advertisingOptions.instances.empty();
+}
+
+// Adds our instances to an adapter
+//
+// `elapsedSeconds` is how long the instances have already been advertised, which is taken off their timeouts. Instances whose
+// timeouts have expired are left out.
+static void addInstances(Mgmt &mgmt, uint16_t elapsedSeconds)
+{
+	for (const AdvertisingInstance &instance : state().advertisingOptions.instances)
+	{
+		uint16_t timeout = instance.timeout;
+		if (timeout != 0)
+		{
+			if (timeout <= elapsedSeconds)
+			{
+				continue;
+			}
+
+			timeout -= elapsedSeconds;
+		}
+
+		LOG_DEBUG("Adding advertising instance " << static_cast<int>(instance.instance));
+		mgmt.addAdvertising(instance.instance, instance.flags, instance.duration, timeout, instance.advertisingData, instance.scanResponseData);
+	}
+}
+
+// Restarts advertising on an adapter, so that it picks up new default intervals
+static void restart(Mgmt &mgmt, const AdvertisingController &controller, uint16_t elapsedSeconds)
+{
+	if (usesAdvertisingInstances())
+	{
+		mgmt.removeAdvertising(0);
+		addInstances(mgmt, elapsedSeconds);
+	}
+	else if (controller.restartAdvertising)
+	{
+		mgmt.setAdvertising(0);
+		mgmt.setAdvertising(1);
+	}
+}
+
+// Switches an adapter from the fast intervals to the slow ones, once its fast period is over
+static gboolean onSlowTimer(gpointer pUserData)
+{
+	uint16_t controllerIndex = static_cast<uint16_t>(GPOINTER_TO_UINT(pUserData));
+
+	for (AdvertisingController &controller : state().advertisingControllers)
+	{
+		if (controller.controllerIndex != controllerIndex)
+		{
+			continue;
+		}
+
+		controller.slowTimerId = 0;
+
+		LOG_DEBUG("Switching controller " << controllerIndex << " to the slow advertising intervals");
+		Mgmt mgmt(controllerIndex);
+		if (mgmt.setDefaultAdvertisingIntervals(state().advertisingOptions.slowMinInterval, state().advertisingOptions.slowMaxInterval))
+		{
+			restart(mgmt, controller, state().advertisingOptions.fastPeriodSeconds);
+		}
+		break;
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+// Starts advertising on a freshly configured adapter
+//
+// This sets the fast intervals, adds our instances (or restarts the adapter's own advertising if `restartAdvertising` is set, so
+// it picks up the new intervals) and schedules the switch to the slow intervals. Failures are logged, but advertising is an
+// optimization as far as the adapter's configuration is concerned, so nothing here stops us from serving on the adapter.
+//
+// This must be called from the server thread.
+void startAdvertising(uint16_t controllerIndex, bool restartAdvertising)
+{
+	bool hasIntervals = state().advertisingOptions.fastMaxInterval != 0;
+	if (!hasIntervals && !usesAdvertisingInstances())
+	{
+		return;
+	}
+
+	// An adapter that is configured again (after a BlueZ restart, for example) starts its profile over
+	std::vector<AdvertisingController>::iterator it = std::find_if(state().advertisingControllers.begin(), state().advertisingControllers.end(),
+		[controllerIndex](const AdvertisingController &controller) { return controller.controllerIndex == controllerIndex; });
+	if (it == state().advertisingControllers.end())
+	{
+		AdvertisingController controller;
+		controller.controllerIndex = controllerIndex;
+		controller.slowTimerId = 0;
+		it = state().advertisingControllers.insert(state().advertisingControllers.end(), controller);
+	}
+	else if (0 != it->slowTimerId)
+	{
+		MainContext::removeSource(it->slowTimerId);
+		it->slowTimerId = 0;
+	}
+
+	it->restartAdvertising = restartAdvertising;
+
+	Mgmt mgmt(controllerIndex);
+	if (hasIntervals)
+	{
+		LOG_DEBUG("Setting the fast advertising intervals");
+		hasIntervals = mgmt.setDefaultAdvertisingIntervals(state().advertisingOptions.fastMinInterval, state().advertisingOptions.fastMaxInterval);
+	}
+
+	if (usesAdvertisingInstances())
+	{
+		HciAdapter::AdvertisingFeatures features;
+		if (mgmt.readAdvertisingFeatures(features) && features.maxInstances < state().advertisingOptions.instances.size())
+		{
+			Logger::warn(SSTR << "  + The adapter only supports " << static_cast<int>(features.maxInstances) << " of our " << state().advertisingOptions.instances.size() << " advertising instances");
+		}
+
+		addInstances(mgmt, 0);
+	}
+	else if (hasIntervals)
+	{
+		restart(mgmt, *it, 0);
+	}
+
+	if (hasIntervals && state().advertisingOptions.fastPeriodSeconds != 0 && state().advertisingOptions.slowMaxInterval != 0)
+	{
+		it->slowTimerId = MainContext::addTimeoutSeconds(state().advertisingOptions.fastPeriodSeconds, onSlowTimer, GUINT_TO_POINTER(controllerIndex));
+	}
+}
+
+// Cancels any pending switches to the slow intervals and forgets our adapters
+//
+// Like the adapter's advertising setting, our instances are left with the adapter (the kernel keeps them until they time out,
+// the adapter is reset or they are replaced when the adapter is configured again.)
+void stopAdvertising()
+{
+	for (const AdvertisingController &controller : state().advertisingControllers)
+	{
+		if (0 != controller.slowTimerId)
+		{
+			MainContext::removeSource(controller.slowTimerId);
+		}
+	}
+
+	state().advertisingControllers.clear();
+}
+
+}; // namespace ggk
@@ -0,0 +1,117 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Advertising instances and interval profiles, applied to each adapter as it is configured
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Advertising.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+namespace ggk {
+
+// An advertising instance, as added with `Mgmt::addAdvertising()`
+struct AdvertisingInstance
+{
+	AdvertisingInstance()
+	: instance(0), flags(0), duration(0), timeout(0)
+	{
+	}
+
+	// The instance number [1, the adapter's maximum]
+	uint8_t instance;
+
+	// A combination of `Mgmt::AdvertisingFlags`
+	uint32_t flags;
+
+	// Seconds to advertise at a time when rotating between instances (0 for the kernel's default) and seconds until the instance
+	// is removed (0 to keep it)
+	uint16_t duration;
+	uint16_t timeout;
+
+	// AD structures for the advertisement and the scan response
+	std::vector<uint8_t> advertisingData;
+	std::vector<uint8_t> scanResponseData;
+};
+
+// How we advertise, applied to each adapter as it is configured
+//
+// With no instances, the adapter advertises the way the server is configured to (see `Server::getEnableAdvertising()`.) Zero
+// intervals leave the kernel's defaults alone.
+struct AdvertisingOptions
+{
+	AdvertisingOptions()
+	: fastMinInterval(0), fastMaxInterval(0), fastPeriodSeconds(0), slowMinInterval(0), slowMaxInterval(0)
+	{
+	}
+
+	std::vector<AdvertisingInstance> instances;
+
+	// The interval range (in units of 0.625ms) to advertise with once the adapter is configured
+	uint16_t fastMinInterval;
+	uint16_t fastMaxInterval;
+
+	// How long to use the fast intervals before switching to the slow ones (0 to keep the fast intervals)
+	uint16_t fastPeriodSeconds;
+
+	// The interval range (in units of 0.625ms) to advertise with after the fast period
+	uint16_t slowMinInterval;
+	uint16_t slowMaxInterval;
+};
+
+struct AdvertisingState;
+
+// Creates the state for a new server instance (see Instance.cpp)
+std::shared_ptr<AdvertisingState> createAdvertisingState();
+
+// Returns the advertising options, which may only be changed before the server is started
+AdvertisingOptions &getAdvertisingOptions();
+
+// Returns true if we advertise with our own instances rather than the adapter's advertising setting
+bool usesAdvertisingInstances();
+
+// Starts advertising on a freshly configured adapter
+//
+// This sets the fast intervals, adds our instances (or restarts the adapter's own advertising if `restartAdvertising` is set, so
+// it picks up the new intervals) and schedules the switch to the slow intervals. Failures are logged, but advertising is an
+// optimization as far as the adapter's configuration is concerned, so nothing here stops us from serving on the adapter.
+//
+// This must be called from the server thread.
+void startAdvertising(uint16_t controllerIndex, bool restartAdvertising);
+
+// Cancels any pending switches to the slow intervals and forgets our adapters
+//
+// Like the adapter's advertising setting, our instances are left with the adapter (the kernel keeps them until they time out,
+// the adapter is reset or they are replaced when the adapter is configured again.)
+void stopAdvertising();
+
+}; // namespace ggk
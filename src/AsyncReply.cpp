@@ -0,0 +1,133 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Ownership of a D-Bus method invocation that will be answered later, possibly from another thread
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// A D-Bus method handler is handed a `GDBusMethodInvocation` that it must eventually answer exactly once. Most handlers answer
+// before they return. An `AsyncReply` lets the answer come later instead: it takes over the invocation and is typically held by a
+// `std::shared_ptr` that travels with the work (see `GattCharacteristic::onReadValueAsync()`, `onWriteValueAsync()` and
+// WorkerPool.cpp.)
+//
+// Replies may be made from any thread. They are passed to the main loop to be sent, so that the rest of the server only ever
+// sees the invocation on the thread it came from. That is the main loop of the instance the invocation arrived on, which is
+// captured when the reply is created: the thread that completes it may have no instance selected at all (see Instance.cpp.)
+//
+// If the last reference to an unanswered reply goes away (a handler returned early, or its job was discarded at shutdown), an
+// error is sent in its place so that BlueZ and the remote device aren't left to time out.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "AsyncReply.h"
+#include "WorkerPool.h"
+#include "MainContext.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// Takes ownership of `pInvocation`
+//
+// From here on, the invocation must only be answered through this object.
+AsyncReply::AsyncReply(GDBusMethodInvocation *pInvocation)
+: pInvocation(pInvocation), pMainContext(g_main_context_ref(MainContext::get())),
+  methodName(g_dbus_method_invocation_get_method_name(pInvocation)), completed(false)
+{
+}
+
+// If no reply was sent, replies with an error so the caller isn't left waiting
+AsyncReply::~AsyncReply()
+{
+	if (!isComplete())
+	{
+		Logger::warn(SSTR << "Async " << methodName << " finished without replying");
+		returnError("org.bluez.Error.Failed", "No reply from handler");
+	}
+
+	g_main_context_unref(pMainContext);
+}
+
+// Replies with a GVariant, optionally wrapping it in a tuple (a ReadValue reply is "(ay)")
+//
+// A floating reference is sunk. This may be called from any thread; the reply is sent from the main loop. Only the first
+// reply counts; later replies are logged and released.
+void AsyncReply::returnVariant(GVariant *pVariant, bool wrapInTuple)
+{
+	if (nullptr != pVariant)
+	{
+		pVariant = g_variant_ref_sink(wrapInTuple ? g_variant_new_tuple(&pVariant, 1) : pVariant);
+	}
+
+	if (!claim())
+	{
+		if (nullptr != pVariant) { g_variant_unref(pVariant); }
+		return;
+	}
+
+	GDBusMethodInvocation *pPendingInvocation = pInvocation;
+	WorkerPool::invokeOnMainContext(pMainContext, [pPendingInvocation, pVariant]()
+	{
+		// The invocation is consumed by the reply, but the value is not
+		g_dbus_method_invocation_return_value(pPendingInvocation, pVariant);
+		if (nullptr != pVariant) { g_variant_unref(pVariant); }
+	});
+}
+
+// Replies with a D-Bus error (ex: "org.bluez.Error.Failed")
+//
+// This may be called from any thread; the reply is sent from the main loop.
+void AsyncReply::returnError(const std::string &errorName, const std::string &errorMessage)
+{
+	if (!claim())
+	{
+		return;
+	}
+
+	GDBusMethodInvocation *pPendingInvocation = pInvocation;
+	WorkerPool::invokeOnMainContext(pMainContext, [pPendingInvocation, errorName, errorMessage]()
+	{
+		g_dbus_method_invocation_return_dbus_error(pPendingInvocation, errorName.c_str(), errorMessage.c_str());
+	});
+}
+
+// Claims the right to reply, returning false if somebody already has
+bool AsyncReply::claim()
+{
+	bool expected = false;
+	if (!completed.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+	{
+		Logger::warn(SSTR << "Ignoring second reply to async " << methodName);
+		return false;
+	}
+
+	if (completionHandler)
+	{
+		completionHandler();
+	}
+
+	return true;
+}
+
+}; // namespace ggk
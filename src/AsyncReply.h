@@ -0,0 +1,102 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Ownership of a D-Bus method invocation that will be answered later, possibly from another thread
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of AsyncReply.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <gio/gio.h>
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "Utils.h"
+
+namespace ggk {
+
+struct AsyncReply
+{
+	// Takes ownership of `pInvocation`
+	//
+	// From here on, the invocation must only be answered through this object.
+	explicit AsyncReply(GDBusMethodInvocation *pInvocation);
+
+	// If no reply was sent, replies with an error so the caller isn't left waiting
+	~AsyncReply();
+
+	AsyncReply(const AsyncReply &) = delete;
+	AsyncReply &operator =(const AsyncReply &) = delete;
+
+	// Replies with a GVariant, optionally wrapping it in a tuple (a ReadValue reply is "(ay)")
+	//
+	// A floating reference is sunk. This may be called from any thread; the reply is sent from the main loop. Only the first
+	// reply counts; later replies are logged and released.
+	void returnVariant(GVariant *pVariant, bool wrapInTuple = false);
+
+	// Replies with a value of a common type, sent as an array of bytes (see `Utils::gvariantFromByteArray()`)
+	template<typename T>
+	void returnValue(T value, bool wrapInTuple = false)
+	{
+		returnVariant(Utils::gvariantFromByteArray(value), wrapInTuple);
+	}
+
+	// Replies with a D-Bus error (ex: "org.bluez.Error.Failed")
+	//
+	// This may be called from any thread; the reply is sent from the main loop.
+	void returnError(const std::string &errorName, const std::string &errorMessage);
+
+	// Sets a function to be called (on whichever thread replies) as soon as the reply is claimed, before it is sent
+	//
+	// This must be set before the reply is handed to another thread. `GattCharacteristic` uses it to drop a cached value that an
+	// async write has just replaced.
+	void setCompletionHandler(std::function<void()> handler) { completionHandler = std::move(handler); }
+
+	// Returns true once a reply has been sent (or queued to be sent)
+	bool isComplete() const { return completed.load(std::memory_order_acquire); }
+
+	// Returns the name of the method being answered
+	const std::string &getMethodName() const { return methodName; }
+
+private:
+
+	// Claims the right to reply, returning false if somebody already has
+	bool claim();
+
+	GDBusMethodInvocation *pInvocation;
+
+	// The main context of the instance the invocation arrived on, which the reply is sent from
+	GMainContext *pMainContext;
+	std::string methodName;
+	std::function<void()> completionHandler;
+	std::atomic<bool> completed;
+};
+
+}; // namespace ggk
@@ -0,0 +1,347 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// An optional, persistent store of the keys exchanged when devices bond with us.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// When a central connects to a device it has bonded with, it can resume encryption straight away with the long term key (LTK)
+// they agreed on, rather than pairing again. That only works if the kernel still has the key. The kernel forgets its keys when
+// the adapter is reset or bluetoothd restarts, and bluetoothd only keeps keys for devices it is managing. The bond store keeps
+// them for us:
+//
+//     * The kernel reports each new LTK and identity resolving key (IRK) as a management event (see
+//       `HciAdapter::runEventThread()`.) Keys that the kernel hints should be stored are added to the store, which writes them to
+//       its file straight away. Unpairing a device removes its keys.
+//
+//     * Each time an adapter is set up (see `configureAdapters()` in Init.cpp), the keys for that adapter are loaded back into the
+//       kernel with the Load Identity Resolving Keys and Load Long Term Keys commands. The IRKs let the kernel resolve a phone's
+//       private address back to the identity address that its LTK belongs to.
+//
+// Loading keys replaces the kernel's entire set for the adapter, so when the store is in use it should be the one place bonds
+// are kept for that adapter.
+//
+// The file is compact and binary: a four byte magic number and a version, followed by one record per key. Each record is a
+// type byte, the little-endian controller index and the key exactly as the kernel reported it. The file holds secrets, so it is
+// only readable by its owner, and it is rewritten in full (to a temporary file that is renamed over it) on every change, so a
+// crash never leaves it half written.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BondStore.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// Our one and only bond store. It's a global.
+BondStore TheBondStore;
+
+// The file's magic number and version
+static const uint8_t kMagic[4] = { 'G', 'G', 'K', 'B' };
+static const uint8_t kVersion = 1;
+
+// Record types
+static const uint8_t kLongTermKeyRecord = 1;
+static const uint8_t kIdentityResolvingKeyRecord = 2;
+
+// Key types we keep (the debug key type, 0x04, uses a publicly known key pair and is never worth keeping)
+static const uint8_t kMaxLongTermKeyType = 0x03;
+
+// Returns true if the kernel will accept a key for this address (an LE public address or an LE static random address)
+static bool isLoadableAddress(const uint8_t *pAddress, uint8_t addressType)
+{
+	return addressType == 1 || (addressType == 2 && (pAddress[5] & 0xc0) == 0xc0);
+}
+
+BondStore::BondStore()
+{
+}
+
+// Keeps our bonds in the file at `path`, reading any that are already there
+//
+// Until this is called, the store is disabled and keys are neither kept nor restored. This must be called before the server
+// is started.
+//
+// Returns false if the file exists but is not a bond store (in which case the store stays disabled), otherwise true
+bool BondStore::open(const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	longTermKeys.clear();
+	identityResolvingKeys.clear();
+
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		// No file yet is fine: it will be created when the first key arrives
+		if (errno != ENOENT)
+		{
+			Logger::warn(SSTR << "Unable to open bond store '" << path << "' (errno " << errno << ")");
+			return false;
+		}
+
+		LOG_DEBUG("Starting a new bond store at '" << path << "'");
+		this->path = path;
+		return true;
+	}
+
+	std::vector<uint8_t> contents;
+	uint8_t buffer[4096];
+	ssize_t length;
+	while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		contents.insert(contents.end(), buffer, buffer + length);
+	}
+	close(fd);
+
+	if (length < 0 || contents.size() < sizeof(kMagic) + 1 || memcmp(contents.data(), kMagic, sizeof(kMagic)) != 0 || contents[sizeof(kMagic)] != kVersion)
+	{
+		Logger::warn(SSTR << "Unable to use bond store '" << path << "': it is not a bond store (or is from a newer version)");
+		return false;
+	}
+
+	size_t offset = sizeof(kMagic) + 1;
+	while (offset + 3 <= contents.size())
+	{
+		uint8_t type = contents[offset];
+		uint16_t controllerIndex = static_cast<uint16_t>(contents[offset + 1] | (contents[offset + 2] << 8));
+		offset += 3;
+
+		if (type == kLongTermKeyRecord && offset + sizeof(HciAdapter::LongTermKey) <= contents.size())
+		{
+			Entry<HciAdapter::LongTermKey> entry;
+			entry.controllerIndex = controllerIndex;
+			memcpy(&entry.key, contents.data() + offset, sizeof(entry.key));
+			longTermKeys.push_back(entry);
+			offset += sizeof(entry.key);
+		}
+		else if (type == kIdentityResolvingKeyRecord && offset + sizeof(HciAdapter::IdentityResolvingKey) <= contents.size())
+		{
+			Entry<HciAdapter::IdentityResolvingKey> entry;
+			entry.controllerIndex = controllerIndex;
+			memcpy(&entry.key, contents.data() + offset, sizeof(entry.key));
+			identityResolvingKeys.push_back(entry);
+			offset += sizeof(entry.key);
+		}
+		else
+		{
+			Logger::warn(SSTR << "Ignoring the rest of bond store '" << path << "': unexpected record at offset " << (offset - 3));
+			break;
+		}
+	}
+
+	Logger::info(SSTR << "Loaded " << longTermKeys.size() << " long term key(s) and " << identityResolvingKeys.size() << " identity resolving key(s) from '" << path << "'");
+	this->path = path;
+	return true;
+}
+
+// Keeps a long term key, replacing any we had for the same device and role
+//
+// Keys that the kernel would refuse to load again (debug keys and keys for private addresses) are ignored.
+void BondStore::addLongTermKey(uint16_t controllerIndex, const HciAdapter::LongTermKey &key)
+{
+	if (!isEnabled() || key.keyType > kMaxLongTermKeyType || key.central > 1 || !isLoadableAddress(key.address, key.addressType))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	bool replaced = false;
+	for (Entry<HciAdapter::LongTermKey> &entry : longTermKeys)
+	{
+		if (entry.controllerIndex == controllerIndex && entry.key.addressType == key.addressType && entry.key.central == key.central &&
+			memcmp(entry.key.address, key.address, sizeof(key.address)) == 0)
+		{
+			entry.key = key;
+			replaced = true;
+		}
+	}
+
+	if (!replaced)
+	{
+		Entry<HciAdapter::LongTermKey> entry;
+		entry.controllerIndex = controllerIndex;
+		entry.key = key;
+		longTermKeys.push_back(entry);
+	}
+
+	save();
+}
+
+// Keeps an identity resolving key, replacing any we had for the same device
+void BondStore::addIdentityResolvingKey(uint16_t controllerIndex, const HciAdapter::IdentityResolvingKey &key)
+{
+	if (!isEnabled() || !isLoadableAddress(key.address, key.addressType))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	bool replaced = false;
+	for (Entry<HciAdapter::IdentityResolvingKey> &entry : identityResolvingKeys)
+	{
+		if (entry.controllerIndex == controllerIndex && entry.key.addressType == key.addressType &&
+			memcmp(entry.key.address, key.address, sizeof(key.address)) == 0)
+		{
+			entry.key = key;
+			replaced = true;
+		}
+	}
+
+	if (!replaced)
+	{
+		Entry<HciAdapter::IdentityResolvingKey> entry;
+		entry.controllerIndex = controllerIndex;
+		entry.key = key;
+		identityResolvingKeys.push_back(entry);
+	}
+
+	save();
+}
+
+// Forgets all keys for a device that is no longer bonded
+void BondStore::removeDevice(uint16_t controllerIndex, const uint8_t *pAddress, uint8_t addressType)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t before = longTermKeys.size() + identityResolvingKeys.size();
+
+	for (size_t i = longTermKeys.size(); i-- > 0;)
+	{
+		const HciAdapter::LongTermKey &key = longTermKeys[i].key;
+		if (longTermKeys[i].controllerIndex == controllerIndex && key.addressType == addressType && memcmp(key.address, pAddress, sizeof(key.address)) == 0)
+		{
+			longTermKeys.erase(longTermKeys.begin() + i);
+		}
+	}
+
+	for (size_t i = identityResolvingKeys.size(); i-- > 0;)
+	{
+		const HciAdapter::IdentityResolvingKey &key = identityResolvingKeys[i].key;
+		if (identityResolvingKeys[i].controllerIndex == controllerIndex && key.addressType == addressType && memcmp(key.address, pAddress, sizeof(key.address)) == 0)
+		{
+			identityResolvingKeys.erase(identityResolvingKeys.begin() + i);
+		}
+	}
+
+	if (longTermKeys.size() + identityResolvingKeys.size() != before)
+	{
+		save();
+	}
+}
+
+// Returns the long term keys we have for the given controller, ready to be loaded with `Mgmt::loadLongTermKeys()`
+std::vector<HciAdapter::LongTermKey> BondStore::getLongTermKeys(uint16_t controllerIndex) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<HciAdapter::LongTermKey> keys;
+	for (const Entry<HciAdapter::LongTermKey> &entry : longTermKeys)
+	{
+		if (entry.controllerIndex == controllerIndex) { keys.push_back(entry.key); }
+	}
+
+	return keys;
+}
+
+// Returns the identity resolving keys we have for the given controller, ready to be loaded with
+// `Mgmt::loadIdentityResolvingKeys()`
+std::vector<HciAdapter::IdentityResolvingKey> BondStore::getIdentityResolvingKeys(uint16_t controllerIndex) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<HciAdapter::IdentityResolvingKey> keys;
+	for (const Entry<HciAdapter::IdentityResolvingKey> &entry : identityResolvingKeys)
+	{
+		if (entry.controllerIndex == controllerIndex) { keys.push_back(entry.key); }
+	}
+
+	return keys;
+}
+
+// Writes every key to our file, replacing it in one step
+//
+// The caller must hold `mutex`.
+//
+// Returns true on success, otherwise false
+bool BondStore::save() const
+{
+	std::vector<uint8_t> contents(kMagic, kMagic + sizeof(kMagic));
+	contents.push_back(kVersion);
+
+	for (const Entry<HciAdapter::LongTermKey> &entry : longTermKeys)
+	{
+		const uint8_t *pKey = reinterpret_cast<const uint8_t *>(&entry.key);
+		contents.push_back(kLongTermKeyRecord);
+		contents.push_back(entry.controllerIndex & 0xff);
+		contents.push_back(entry.controllerIndex >> 8);
+		contents.insert(contents.end(), pKey, pKey + sizeof(entry.key));
+	}
+
+	for (const Entry<HciAdapter::IdentityResolvingKey> &entry : identityResolvingKeys)
+	{
+		const uint8_t *pKey = reinterpret_cast<const uint8_t *>(&entry.key);
+		contents.push_back(kIdentityResolvingKeyRecord);
+		contents.push_back(entry.controllerIndex & 0xff);
+		contents.push_back(entry.controllerIndex >> 8);
+		contents.insert(contents.end(), pKey, pKey + sizeof(entry.key));
+	}
+
+	std::string temporaryPath = path + ".tmp";
+	int fd = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+	{
+		Logger::warn(SSTR << "Unable to write bond store '" << temporaryPath << "' (errno " << errno << ")");
+		return false;
+	}
+
+	bool written = write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size()) && fsync(fd) == 0;
+	close(fd);
+
+	if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		Logger::warn(SSTR << "Unable to write bond store '" << path << "' (errno " << errno << ")");
+		unlink(temporaryPath.c_str());
+		return false;
+	}
+
+	LOG_DEBUG("Saved " << longTermKeys.size() << " long term key(s) and " << identityResolvingKeys.size() << " identity resolving key(s) to '" << path << "'");
+	return true;
+}
+
+}; // namespace ggk
@@ -0,0 +1,114 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// An optional, persistent store of the keys exchanged when devices bond with us.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of BondStore.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "HciAdapter.h"
+
+namespace ggk {
+
+struct BondStore
+{
+	BondStore();
+
+	// Keeps our bonds in the file at `path`, reading any that are already there
+	//
+	// Until this is called, the store is disabled and keys are neither kept nor restored. This must be called before the server
+	// is started.
+	//
+	// Returns false if the file exists but is not a bond store (in which case the store stays disabled), otherwise true
+	bool open(const std::string &path);
+
+	// Returns true if the store has been opened (see `open()`)
+	bool isEnabled() const { return !path.empty(); }
+
+	//
+	// Capture
+	//
+	// These are called from the HciAdapter event thread as keys arrive. Each change is written to the file before returning.
+	//
+
+	// Keeps a long term key, replacing any we had for the same device and role
+	//
+	// Keys that the kernel would refuse to load again (debug keys and keys for private addresses) are ignored.
+	void addLongTermKey(uint16_t controllerIndex, const HciAdapter::LongTermKey &key);
+
+	// Keeps an identity resolving key, replacing any we had for the same device
+	void addIdentityResolvingKey(uint16_t controllerIndex, const HciAdapter::IdentityResolvingKey &key);
+
+	// Forgets all keys for a device that is no longer bonded
+	void removeDevice(uint16_t controllerIndex, const uint8_t *pAddress, uint8_t addressType);
+
+	//
+	// Restore
+	//
+
+	// Returns the keys we have for the given controller, ready to be loaded with `Mgmt::loadLongTermKeys()` and
+	// `Mgmt::loadIdentityResolvingKeys()`
+	std::vector<HciAdapter::LongTermKey> getLongTermKeys(uint16_t controllerIndex) const;
+	std::vector<HciAdapter::IdentityResolvingKey> getIdentityResolvingKeys(uint16_t controllerIndex) const;
+
+private:
+
+	// A key and the controller it was exchanged on
+	template<typename T>
+	struct Entry
+	{
+		uint16_t controllerIndex;
+		T key;
+	};
+
+	// Writes every key to our file, replacing it in one step
+	//
+	// The caller must hold `mutex`.
+	//
+	// Returns true on success, otherwise false
+	bool save() const;
+
+	std::string path;
+	std::vector<Entry<HciAdapter::LongTermKey> > longTermKeys;
+	std::vector<Entry<HciAdapter::IdentityResolvingKey> > identityResolvingKeys;
+
+	// Guards the keys and the file (keys arrive on the event thread and are read on the server thread)
+	mutable std::mutex mutex;
+};
+
+// Our one and only bond store. It's a global.
+extern BondStore TheBondStore;
+
+}; // namespace ggk
@@ -0,0 +1,692 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A ready-made GATT service for streaming large files (firmware images, log archives) to and from a client.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Moving a large file over GATT means cutting it into MTU-sized chunks, numbering them, making sure the sender doesn't run too
+// far ahead of the receiver and picking up where we left off after a dropped connection. Rather than have every server do this
+// with its own characteristics, `DBusObject::bulkTransferService()` adds a service that does it once:
+//
+//     * The control characteristic ("write", "notify") carries requests from the client and status from us. Each request is
+//       an opcode followed by little-endian arguments (see the kOp* constants in BulkTransfer.h.)
+//
+//     * The data characteristic ("write-without-response", "notify", and acquirable in both directions) carries the chunks.
+//       Each chunk is a little-endian u32 offset followed by the payload, so the receiver always knows where a chunk belongs.
+//
+// Files are memory-mapped, so chunks are copied straight between the file and the packet. To read, the client writes
+// BeginRead with the offset it wants to start from and we stream chunks (sized to fit the MTU) until `windowChunks` chunks are
+// waiting to be acknowledged. The client acknowledges with Ack (ideally every half window, to keep the pipe full.) To write, the
+// client writes BeginWrite with the file's size and a starting offset, then streams chunks; we answer with WriteAck every
+// half window. A chunk that doesn't start where we expect (one was lost) is dropped, and we answer with a WriteAck carrying
+// the offset we are waiting for, so the client can go back to it.
+//
+// Resuming works the same way in both directions: the client begins again from the offset it last had acknowledged. We keep a
+// partly written sink file mapped (even across a disconnect) until it completes, a new write begins at offset 0 or the client
+// aborts.
+//
+// Everything happens on the main loop. Chunks are sent from an idle source, a window at a time, so a transfer never holds the
+// main loop for longer than one window, and a full notification socket is retried shortly after rather than waited on.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "BulkTransfer.h"
+#include "GattCharacteristic.h"
+#include "GattUuid.h"
+#include "DBusObject.h"
+#include "MainContext.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// There's a good chance there will be a bunch of unused parameters from the lambda macros
+#if defined(__GNUC__) && defined(__clang__)
+	#pragma clang diagnostic push
+	#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif
+
+// The largest notification we'll build (the largest ATT MTU is 517)
+static const size_t kMaxFrameSize = 517;
+
+// How long to wait before retrying when our acquired notification socket is full
+static const guint kRetryDelayMS = 5;
+
+// Reads a little-endian u32
+static guint32 readLE32(const guint8 *pData)
+{
+	return static_cast<guint32>(pData[0]) | (static_cast<guint32>(pData[1]) << 8) | (static_cast<guint32>(pData[2]) << 16) | (static_cast<guint32>(pData[3]) << 24);
+}
+
+// Writes a little-endian u32
+static void writeLE32(guint8 *pData, guint32 value)
+{
+	pData[0] = static_cast<guint8>(value);
+	pData[1] = static_cast<guint8>(value >> 8);
+	pData[2] = static_cast<guint8>(value >> 16);
+	pData[3] = static_cast<guint8>(value >> 24);
+}
+
+// Returns the "mtu" option from a WriteValue method's parameters, or 0 if there is none
+static guint16 getWriteMtu(GVariant *pParameters)
+{
+	guint16 mtu = 0;
+	GVariant *pOptions = g_variant_get_child_value(pParameters, 1);
+	g_variant_lookup(pOptions, "mtu", "q", &mtu);
+	g_variant_unref(pOptions);
+	return mtu;
+}
+
+// Construct a BulkTransferService
+//
+// Generally speaking, these objects should not be constructed directly. Rather, use `DBusObject::bulkTransferService()`.
+BulkTransferService::BulkTransferService(DBusObject &owner, const std::string &name, const BulkTransferConfig &config)
+: GattService(owner, name), config(config), pControlCharacteristic(nullptr), pDataCharacteristic(nullptr),
+  pNotifyConnection(nullptr), pCompletedUserData(nullptr), mtu(23), state(EIdle), currentSourcePath(config.sourcePath),
+  pSourceMap(nullptr), sourceSize(0), sentOffset(0), ackedOffset(0), pumpSourceId(0), pSinkMap(nullptr), sinkSize(0),
+  receivedOffset(0), chunksSinceAck(0), gapReported(false)
+{
+	this->config.windowChunks = std::max(this->config.windowChunks, 1);
+}
+
+BulkTransferService::~BulkTransferService()
+{
+	if (0 != pumpSourceId)
+	{
+		MainContext::removeSource(pumpSourceId);
+		pumpSourceId = 0;
+	}
+
+	releaseSource();
+	releaseSink();
+}
+
+// Adds our control and data characteristics beneath this service
+void BulkTransferService::addCharacteristics(const GattUuid &controlUuid, const GattUuid &dataUuid)
+{
+	GattCharacteristic &control = gattCharacteristicBegin("control", controlUuid, {"write", "notify"})
+
+		.onWriteValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+		{
+			const BulkTransferService &service = static_cast<const BulkTransferService &>(self.getService());
+
+			guint16 mtu = getWriteMtu(pParameters);
+			if (mtu != 0)
+			{
+				service.mtu = mtu;
+			}
+
+			GVariant *pValue = g_variant_get_child_value(pParameters, 0);
+			gsize length = 0;
+			const guint8 *pData = static_cast<const guint8 *>(g_variant_get_fixed_array(pValue, &length, 1));
+
+			// Answer first, so the client sees the write complete before any notification it causes
+			g_dbus_method_invocation_return_value(pInvocation, nullptr);
+			service.onControlWrite(pConnection, pData, length, pUserData);
+			g_variant_unref(pValue);
+		});
+
+	pControlCharacteristic = &control;
+
+	GattCharacteristic &data = gattCharacteristicBegin("data", dataUuid, {"write-without-response", "notify", "acquire-notify", "acquire-write"})
+
+		.onWriteValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+		{
+			const BulkTransferService &service = static_cast<const BulkTransferService &>(self.getService());
+
+			GVariant *pValue = g_variant_get_child_value(pParameters, 0);
+			gsize length = 0;
+			const guint8 *pData = static_cast<const guint8 *>(g_variant_get_fixed_array(pValue, &length, 1));
+			service.onDataWrite(pData, length);
+			g_variant_unref(pValue);
+
+			g_dbus_method_invocation_return_value(pInvocation, nullptr);
+		})
+
+		.onAcquiredWrite([](const GattCharacteristic &self, const guint8 *pData, size_t length, void * /*pUserData*/)
+		{
+			static_cast<const BulkTransferService &>(self.getService()).onDataWrite(pData, length);
+		});
+
+	pDataCharacteristic = &data;
+}
+
+// Replaces the file a client may read
+//
+// A read that is in progress is aborted. This method must be called from the main loop thread.
+void BulkTransferService::setSourcePath(const std::string &path) const
+{
+	if (state == EReading)
+	{
+		finish(false);
+	}
+
+	releaseSource();
+	currentSourcePath = path;
+}
+
+// Handles a request written to our control characteristic
+void BulkTransferService::onControlWrite(GDBusConnection *pConnection, const guint8 *pData, size_t length, void *pUserData) const
+{
+	pNotifyConnection = pConnection;
+	pCompletedUserData = pUserData;
+
+	guint8 op = length > 0 ? pData[0] : 0;
+	switch (op)
+	{
+		case kOpBeginRead:
+			if (length >= 5)
+			{
+				beginRead(readLE32(pData + 1));
+				return;
+			}
+			break;
+		case kOpBeginWrite:
+			if (length >= 9)
+			{
+				beginWrite(readLE32(pData + 1), readLE32(pData + 5));
+				return;
+			}
+			break;
+		case kOpAck:
+			if (length >= 5)
+			{
+				acknowledgeRead(readLE32(pData + 1));
+				return;
+			}
+			break;
+		case kOpAbort:
+			finish(false);
+			releaseSink();
+			notifyStatus();
+			return;
+		case kOpQuery:
+			notifyStatus();
+			return;
+		default:
+			break;
+	}
+
+	Logger::warn(SSTR << "Invalid bulk transfer request (opcode " << static_cast<int>(op) << ", " << length << " bytes) on '" << getPath() << "'");
+	notifyError(EBadRequest);
+}
+
+// Handles a chunk written to our data characteristic (either through WriteValue or our acquired write socket)
+void BulkTransferService::onDataWrite(const guint8 *pData, size_t length) const
+{
+	if (state != EWriting || length < kChunkHeaderSize)
+	{
+		LOG_DEBUG("Ignoring " << length << " byte bulk transfer chunk on '" << getPath() << "'");
+		return;
+	}
+
+	guint32 offset = readLE32(pData);
+	size_t payloadSize = length - kChunkHeaderSize;
+
+	// We lost a chunk somewhere; tell the client (once) where to go back to
+	if (offset != receivedOffset)
+	{
+		if (!gapReported)
+		{
+			notifyOffset(kOpWriteAck, static_cast<guint32>(receivedOffset));
+			gapReported = true;
+		}
+		return;
+	}
+
+	if (receivedOffset + payloadSize > sinkSize)
+	{
+		notifyError(EBadOffset);
+		return;
+	}
+
+	if (payloadSize != 0)
+	{
+		memcpy(pSinkMap + receivedOffset, pData + kChunkHeaderSize, payloadSize);
+	}
+	receivedOffset += payloadSize;
+	gapReported = false;
+
+	if (receivedOffset == sinkSize)
+	{
+		if (nullptr != pSinkMap && msync(pSinkMap, sinkSize, MS_SYNC) < 0)
+		{
+			Logger::error(SSTR << "Unable to write bulk transfer sink file '" << config.sinkPath << "': " << strerror(errno));
+			notifyError(EIoError);
+			return;
+		}
+
+		finish(true);
+		return;
+	}
+
+	if (++chunksSinceAck >= std::max(config.windowChunks / 2, 1))
+	{
+		chunksSinceAck = 0;
+		notifyOffset(kOpWriteAck, static_cast<guint32>(receivedOffset));
+	}
+}
+
+// Begins (or resumes) streaming the source file from `offset`
+void BulkTransferService::beginRead(guint32 offset) const
+{
+	if (state == EWriting)
+	{
+		notifyError(EBusy);
+		return;
+	}
+
+	Error error = ENoSource;
+	if (!mapSource(error))
+	{
+		notifyError(error);
+		return;
+	}
+
+	if (offset > sourceSize)
+	{
+		notifyError(EBadOffset);
+		return;
+	}
+
+	state = EReading;
+	sentOffset = offset;
+	ackedOffset = offset;
+	notifyStatus();
+
+	if (ackedOffset == sourceSize)
+	{
+		finish(true);
+		return;
+	}
+
+	schedulePump();
+}
+
+// Begins (or resumes) receiving a sink file of `size` bytes from `offset`
+//
+// A write can only resume (begin at a non-zero offset) into the same sink file, at or before the point we've received.
+void BulkTransferService::beginWrite(guint32 size, guint32 offset) const
+{
+	if (state == EReading)
+	{
+		notifyError(EBusy);
+		return;
+	}
+
+	if (config.sinkPath.empty())
+	{
+		notifyError(ENoSink);
+		return;
+	}
+
+	if (size > config.maxSinkSize)
+	{
+		notifyError(ETooLarge);
+		return;
+	}
+
+	if (offset != 0)
+	{
+		if (nullptr == pSinkMap || size != sinkSize || offset > receivedOffset)
+		{
+			notifyError(EBadOffset);
+			return;
+		}
+	}
+	else if (!mapSink(size))
+	{
+		notifyError(EIoError);
+		return;
+	}
+
+	state = EWriting;
+	receivedOffset = offset;
+	chunksSinceAck = 0;
+	gapReported = false;
+	notifyOffset(kOpWriteAck, offset);
+
+	if (receivedOffset == sinkSize)
+	{
+		finish(true);
+	}
+}
+
+// Records the client's acknowledgement of everything before `offset`, opening our window
+void BulkTransferService::acknowledgeRead(guint32 offset) const
+{
+	if (state != EReading)
+	{
+		return;
+	}
+
+	// Acknowledgements can cross in flight, so an old one is harmless
+	if (offset <= ackedOffset)
+	{
+		return;
+	}
+
+	if (offset > sentOffset)
+	{
+		notifyError(EBadOffset);
+		return;
+	}
+
+	ackedOffset = offset;
+	if (ackedOffset == sourceSize)
+	{
+		finish(true);
+		return;
+	}
+
+	schedulePump();
+}
+
+// Arranges for `pump()` to run on the main loop
+void BulkTransferService::schedulePump(guint delayMS) const
+{
+	if (0 != pumpSourceId)
+	{
+		return;
+	}
+
+	GSourceFunc callback = [](gpointer pUserData) -> gboolean
+	{
+		const BulkTransferService *pService = static_cast<const BulkTransferService *>(pUserData);
+
+		// The source is removed by returning G_SOURCE_REMOVE, so forget its ID before pumping (which may schedule another)
+		pService->pumpSourceId = 0;
+		pService->pump();
+		return G_SOURCE_REMOVE;
+	};
+
+	gpointer pUserData = const_cast<BulkTransferService *>(this);
+	pumpSourceId = delayMS == 0 ? MainContext::addIdle(callback, pUserData) : MainContext::addTimeout(delayMS, callback, pUserData);
+}
+
+// Sends as many chunks of the source file as our window allows
+//
+// Once the window is full we simply stop; the next acknowledgement schedules us again. If the client isn't subscribed to our
+// data characteristic we stop as well, and the client can pick up again with BeginRead once it is.
+void BulkTransferService::pump() const
+{
+	if (state != EReading)
+	{
+		return;
+	}
+
+	size_t payloadSize = getChunkPayloadSize();
+	size_t window = static_cast<size_t>(config.windowChunks) * payloadSize;
+
+	guint8 frame[kMaxFrameSize];
+	while (sentOffset < sourceSize && sentOffset - ackedOffset < window)
+	{
+		size_t length = std::min(payloadSize, sourceSize - sentOffset);
+		writeLE32(frame, static_cast<guint32>(sentOffset));
+		memcpy(frame + kChunkHeaderSize, pSourceMap + sentOffset, length);
+
+		if (!pDataCharacteristic->sendChangeNotificationNow(pNotifyConnection, frame, kChunkHeaderSize + length))
+		{
+			if (pDataCharacteristic->isNotifying())
+			{
+				schedulePump(kRetryDelayMS);
+			}
+			return;
+		}
+
+		sentOffset += length;
+	}
+}
+
+// Finishes the current transfer, reporting it to the application if it completed
+//
+// A completed transfer releases its file. An abandoned one releases the source file but leaves the sink file mapped, since a
+// write may yet be resumed (see `kOpAbort` for forgetting it.)
+void BulkTransferService::finish(bool completed) const
+{
+	if (0 != pumpSourceId)
+	{
+		MainContext::removeSource(pumpSourceId);
+		pumpSourceId = 0;
+	}
+
+	State finishedState = state;
+	state = EIdle;
+
+	bool isWrite = finishedState == EWriting;
+	size_t size = isWrite ? sinkSize : sourceSize;
+
+	releaseSource();
+	if (completed && isWrite)
+	{
+		releaseSink();
+	}
+
+	if (!completed || finishedState == EIdle)
+	{
+		return;
+	}
+
+	notifyOffset(kOpComplete, static_cast<guint32>(size));
+
+	const std::string &path = isWrite ? config.sinkPath : currentSourcePath;
+	Logger::info(SSTR << "Bulk transfer " << (isWrite ? "received '" : "sent '") << path << "' (" << size << " bytes)");
+
+	if (nullptr != config.pOnCompleted)
+	{
+		config.pOnCompleted(*this, isWrite, path, size, pCompletedUserData);
+	}
+}
+
+// Maps the source file for reading, returning false (with the error to report in `error`) if it can't be read
+bool BulkTransferService::mapSource(Error &error) const
+{
+	releaseSource();
+
+	if (currentSourcePath.empty())
+	{
+		error = ENoSource;
+		return false;
+	}
+
+	int fd = open(currentSourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		Logger::warn(SSTR << "Unable to open bulk transfer source file '" << currentSourcePath << "': " << strerror(errno));
+		error = ENoSource;
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		Logger::warn(SSTR << "Unable to read bulk transfer source file '" << currentSourcePath << "': " << strerror(errno));
+		close(fd);
+		error = EIoError;
+		return false;
+	}
+
+	// An empty file can't be mapped, but there's nothing to send anyway
+	sourceSize = static_cast<size_t>(st.st_size);
+	if (sourceSize != 0)
+	{
+		void *pMap = mmap(nullptr, sourceSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == pMap)
+		{
+			Logger::warn(SSTR << "Unable to map bulk transfer source file '" << currentSourcePath << "': " << strerror(errno));
+			close(fd);
+			sourceSize = 0;
+			error = EIoError;
+			return false;
+		}
+
+		// We read the whole file in order
+		madvise(pMap, sourceSize, MADV_SEQUENTIAL);
+		pSourceMap = static_cast<const guint8 *>(pMap);
+	}
+
+	// The mapping keeps the file open for us
+	close(fd);
+	return true;
+}
+
+// Creates the sink file with `size` bytes and maps it for writing, returning false if it can't be
+bool BulkTransferService::mapSink(size_t size) const
+{
+	releaseSink();
+
+	int fd = open(config.sinkPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		Logger::warn(SSTR << "Unable to create bulk transfer sink file '" << config.sinkPath << "': " << strerror(errno));
+		return false;
+	}
+
+	if (size != 0)
+	{
+		if (ftruncate(fd, static_cast<off_t>(size)) < 0)
+		{
+			Logger::warn(SSTR << "Unable to size bulk transfer sink file '" << config.sinkPath << "': " << strerror(errno));
+			close(fd);
+			return false;
+		}
+
+		void *pMap = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (MAP_FAILED == pMap)
+		{
+			Logger::warn(SSTR << "Unable to map bulk transfer sink file '" << config.sinkPath << "': " << strerror(errno));
+			close(fd);
+			return false;
+		}
+
+		pSinkMap = static_cast<guint8 *>(pMap);
+	}
+
+	close(fd);
+	sinkSize = size;
+	receivedOffset = 0;
+	return true;
+}
+
+// Unmaps the source file
+void BulkTransferService::releaseSource() const
+{
+	if (nullptr != pSourceMap)
+	{
+		munmap(const_cast<guint8 *>(pSourceMap), sourceSize);
+		pSourceMap = nullptr;
+	}
+
+	sourceSize = 0;
+	sentOffset = 0;
+	ackedOffset = 0;
+}
+
+// Unmaps the sink file
+void BulkTransferService::releaseSink() const
+{
+	if (nullptr != pSinkMap)
+	{
+		munmap(pSinkMap, sinkSize);
+		pSinkMap = nullptr;
+	}
+
+	sinkSize = 0;
+	receivedOffset = 0;
+}
+
+// Sends a notification on our control characteristic
+//
+// Control notifications are never coalesced; the client needs to see every one of them.
+void BulkTransferService::notifyControl(const guint8 *pData, size_t length) const
+{
+	if (!pControlCharacteristic->sendChangeNotificationNow(pNotifyConnection, pData, length))
+	{
+		LOG_DEBUG("Bulk transfer control notification not sent on '" << getPath() << "' (not subscribed)");
+	}
+}
+
+// Sends a status notification: [kOpStatus][u8 state][u32 size][u32 offset]
+//
+// While idle, the size and offset describe a write that may be resumed (or are zero if there is none.)
+void BulkTransferService::notifyStatus() const
+{
+	guint8 buffer[10];
+	buffer[0] = kOpStatus;
+	buffer[1] = static_cast<guint8>(state);
+
+	bool reading = state == EReading;
+	writeLE32(buffer + 2, static_cast<guint32>(reading ? sourceSize : sinkSize));
+	writeLE32(buffer + 6, static_cast<guint32>(reading ? ackedOffset : receivedOffset));
+	notifyControl(buffer, sizeof(buffer));
+}
+
+// Sends an error notification: [kOpError][u8 error]
+void BulkTransferService::notifyError(Error error) const
+{
+	guint8 buffer[2] = { kOpError, static_cast<guint8>(error) };
+	notifyControl(buffer, sizeof(buffer));
+}
+
+// Sends a notification carrying a single offset or size: [op][u32 offset]
+void BulkTransferService::notifyOffset(guint8 op, guint32 offset) const
+{
+	guint8 buffer[5];
+	buffer[0] = op;
+	writeLE32(buffer + 1, offset);
+	notifyControl(buffer, sizeof(buffer));
+}
+
+// Returns the largest chunk payload that fits a single notification
+//
+// A notification carries up to MTU - 3 bytes. We use the data characteristic's notify MTU (see
+// `GattCharacteristic::getNotifyMtu()`) unless it only knows the minimum, in which case we go by the MTU from the client's most
+// recent control write.
+size_t BulkTransferService::getChunkPayloadSize() const
+{
+	size_t notifyMtu = pDataCharacteristic->getNotifyMtu();
+	if (notifyMtu <= 23)
+	{
+		notifyMtu = mtu;
+	}
+	notifyMtu = std::min(std::max(notifyMtu, static_cast<size_t>(23)), kMaxFrameSize);
+
+	size_t payloadSize = notifyMtu - 3 - kChunkHeaderSize;
+	return std::max(std::min(payloadSize, config.maxChunkSize), static_cast<size_t>(1));
+}
+
+}; // namespace ggk
@@ -0,0 +1,231 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A ready-made GATT service for streaming large files (firmware images, log archives) to and from a client.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of BulkTransfer.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "GattService.h"
+
+namespace ggk {
+
+struct BulkTransferService;
+struct GattCharacteristic;
+struct GattUuid;
+struct DBusObject;
+
+// Describes the files behind a bulk transfer service and how it streams them
+struct BulkTransferConfig
+{
+	// Called from the main loop thread when a transfer completes. `isWrite` is true if the client wrote `path`, false if it read it.
+	typedef void (*CompletedCallback)(const BulkTransferService &service, bool isWrite, const std::string &path, size_t size, void *pUserData);
+
+	BulkTransferConfig()
+	: maxSinkSize(16 * 1024 * 1024), windowChunks(16), maxChunkSize(512), pOnCompleted(nullptr)
+	{
+	}
+
+	// The file a client may read (empty to refuse reads.) It is mapped when a read begins, so it may be replaced between reads.
+	std::string sourcePath;
+
+	// The file a client may write (empty to refuse writes.) It is created (or truncated) when a write begins at offset 0.
+	std::string sinkPath;
+
+	// The largest file a client may write, in bytes
+	size_t maxSinkSize;
+
+	// How many chunks may be in flight before the receiving side must acknowledge them
+	int windowChunks;
+
+	// The largest chunk payload we will send, in bytes (chunks are also limited by the MTU)
+	size_t maxChunkSize;
+
+	// Called when a transfer completes (may be nullptr)
+	CompletedCallback pOnCompleted;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// A GATT service with a control characteristic and a data characteristic that streams a file in either direction
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+struct BulkTransferService : GattService
+{
+	//
+	// Control opcodes written by the client
+	//
+
+	// Begin (or resume) streaming the source file to the client: [u32 offset]
+	static const guint8 kOpBeginRead = 0x01;
+
+	// Begin (or resume) receiving the sink file from the client: [u32 size][u32 offset]
+	static const guint8 kOpBeginWrite = 0x02;
+
+	// The client has received everything before this offset of the source file: [u32 offset]
+	static const guint8 kOpAck = 0x03;
+
+	// Stop the current transfer and forget its resume point
+	static const guint8 kOpAbort = 0x04;
+
+	// Ask for a status notification
+	static const guint8 kOpQuery = 0x05;
+
+	//
+	// Control notifications sent to the client
+	//
+
+	// Our current state: [u8 state][u32 size][u32 offset]
+	static const guint8 kOpStatus = 0x81;
+
+	// We have received everything before this offset of the sink file: [u32 offset]
+	static const guint8 kOpWriteAck = 0x83;
+
+	// The transfer is complete: [u32 size]
+	static const guint8 kOpComplete = 0x84;
+
+	// The last request failed: [u8 error]
+	static const guint8 kOpError = 0x85;
+
+	// Transfer states, as reported in a status notification
+	enum State
+	{
+		EIdle = 0,
+		EReading = 1,
+		EWriting = 2
+	};
+
+	// Error codes, as reported in an error notification
+	enum Error
+	{
+		ENoSource = 1,
+		ENoSink = 2,
+		ETooLarge = 3,
+		EBadOffset = 4,
+		EIoError = 5,
+		EBusy = 6,
+		EBadRequest = 7
+	};
+
+	// Each data chunk starts with the offset of its payload: [u32 offset][payload]
+	static const size_t kChunkHeaderSize = 4;
+
+	// Construct a BulkTransferService
+	//
+	// Generally speaking, these objects should not be constructed directly. Rather, use `DBusObject::bulkTransferService()`.
+	BulkTransferService(DBusObject &owner, const std::string &name, const BulkTransferConfig &config);
+	virtual ~BulkTransferService();
+
+	// Adds our control and data characteristics beneath this service
+	void addCharacteristics(const GattUuid &controlUuid, const GattUuid &dataUuid);
+
+	// Returns the configuration this service was built with
+	const BulkTransferConfig &getConfig() const { return config; }
+
+	// Returns the current transfer state
+	State getState() const { return state; }
+
+	// Replaces the file a client may read
+	//
+	// A read that is in progress is aborted. This method must be called from the main loop thread.
+	void setSourcePath(const std::string &path) const;
+
+private:
+
+	// Handlers for writes to our characteristics (each fragment of data is one chunk)
+	void onControlWrite(GDBusConnection *pConnection, const guint8 *pData, size_t length, void *pUserData) const;
+	void onDataWrite(const guint8 *pData, size_t length) const;
+
+	// Control requests
+	void beginRead(guint32 offset) const;
+	void beginWrite(guint32 size, guint32 offset) const;
+	void acknowledgeRead(guint32 offset) const;
+
+	// Sends as many chunks of the source file as our window allows, then waits for an acknowledgement (see BulkTransfer.cpp)
+	void schedulePump(guint delayMS = 0) const;
+	void pump() const;
+
+	// Finishes the current transfer, reporting it to the application if it completed
+	void finish(bool completed) const;
+
+	// Maps the source file for reading, returning false (with the error to report in `error`) if it can't be read
+	bool mapSource(Error &error) const;
+
+	// Creates the sink file with `size` bytes and maps it for writing, returning false if it can't be
+	bool mapSink(size_t size) const;
+
+	// Unmaps the source and sink files
+	void releaseSource() const;
+	void releaseSink() const;
+
+	// Sends a notification on our control characteristic
+	void notifyControl(const guint8 *pData, size_t length) const;
+	void notifyStatus() const;
+	void notifyError(Error error) const;
+	void notifyOffset(guint8 op, guint32 offset) const;
+
+	// Returns the largest chunk payload that fits a single notification
+	size_t getChunkPayloadSize() const;
+
+	BulkTransferConfig config;
+	GattCharacteristic *pControlCharacteristic;
+	GattCharacteristic *pDataCharacteristic;
+
+	// Where our notifications go and the user data for our completion callback (both from the last control write)
+	mutable GDBusConnection *pNotifyConnection;
+	mutable void *pCompletedUserData;
+
+	// The MTU BlueZ last reported (see `getChunkPayloadSize()`)
+	mutable guint16 mtu;
+
+	mutable State state;
+
+	// The mapped source file, how far we've sent it and how far the client has acknowledged it
+	mutable std::string currentSourcePath;
+	mutable const guint8 *pSourceMap;
+	mutable size_t sourceSize;
+	mutable size_t sentOffset;
+	mutable size_t ackedOffset;
+	mutable guint pumpSourceId;
+
+	// The mapped sink file, its size and how much of it we have received
+	mutable guint8 *pSinkMap;
+	mutable size_t sinkSize;
+	mutable size_t receivedOffset;
+	mutable int chunksSinceAck;
+	mutable bool gapReported;
+};
+
+}; // namespace ggk
@@ -57,6 +57,7 @@
 #include "GattProperty.h"
 #include "DBusObject.h"
 #include "Logger.h"
+#include "Utils.h"
 
 namespace ggk {
 
@@ -65,7 +66,7 @@ namespace ggk {
 //
 
 DBusInterface::DBusInterface(DBusObject &owner, const std::string &name)
-: owner(owner), name(name)
+: owner(owner), name(name), updatePending(false)
 {
 }
 
@@ -101,13 +102,15 @@ DBusObject &DBusInterface::getOwner() const
 }
 
 // Returns the path node of this interface's owner
-DBusObjectPath DBusInterface::getPathNode() const
+const DBusObjectPath &DBusInterface::getPathNode() const
 {
 	return owner.getPathNode();
 }
 
 // Returns the full path of this interface's owner
-DBusObjectPath DBusInterface::getPath() const
+//
+// This is the path stored on the owner (see `DBusObject::getPath()`), so no path is built.
+const DBusObjectPath &DBusInterface::getPath() const
 {
 	return owner.getPath();
 }
@@ -122,9 +125,49 @@ DBusObjectPath DBusInterface::getPath() const
 DBusInterface &DBusInterface::addMethod(const std::string &name, const char *pInArgs[], const char *pOutArgs, DBusMethod::Callback callback)
 {
 	methods.push_back(DBusMethod(this, name, pInArgs, pOutArgs, callback));
+
+	// Adding a method may have moved the others, so the index is rebuilt rather than extended
+	rebuildMethodIndex();
 	return *this;
 }
 
+// Rebuilds `methodIndex` from `methods` (the keys and values point into `methods`, so this is required when it reallocates)
+//
+// If more than one method shares a name, the first one remains in the index so that the first method added is the one that
+// gets called.
+void DBusInterface::rebuildMethodIndex()
+{
+	methodIndex.clear();
+	methodIndex.reserve(methods.size());
+	for (const DBusMethod &method : methods)
+	{
+		methodIndex.emplace(StringKey(method.getName()), &method);
+	}
+}
+
+// Locates a D-Bus method within this interface with a single hash probe (or, once the index has been released by `compact()`,
+// a search of its methods)
+//
+// This method returns a pointer to the method or nullptr if not found
+const DBusMethod *DBusInterface::findMethod(const StringKey &methodName) const
+{
+	if (methodIndex.empty())
+	{
+		for (const DBusMethod &method : methods)
+		{
+			if (StringKey(method.getName()) == methodName)
+			{
+				return &method;
+			}
+		}
+
+		return nullptr;
+	}
+
+	auto iter = methodIndex.find(methodName);
+	return iter == methodIndex.end() ? nullptr : iter->second;
+}
+
 // Calls a named method on this interface
 //
 // This method returns false if the method could not be found, otherwise it returns true. Note that the return value is not related
@@ -132,18 +175,16 @@ DBusInterface &DBusInterface::addMethod(const std::string &name, const char *pIn
 //
 // NOTE: Subclasses are encouraged to override this method in order to support different callback types that are specific to
 // their subclass type.
-bool DBusInterface::callMethod(const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
+bool DBusInterface::callMethod(const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
 {
-	for (const DBusMethod &method : methods)
+	const DBusMethod *pMethod = findMethod(methodName);
+	if (nullptr == pMethod)
 	{
-		if (methodName == method.getName())
-		{
-			method.call<DBusInterface>(pConnection, getPath(), getName(), methodName, pParameters, pInvocation, pUserData);
-			return true;
-		}
+		return false;
 	}
 
-	return false;
+	pMethod->call<DBusInterface>(pConnection, getPath(), getName(), pMethod->getName(), pParameters, pInvocation, pUserData);
+	return true;
 }
 
 // Add an event to this interface
@@ -157,50 +198,101 @@ bool DBusInterface::callMethod(const std::string &methodName, GDBusConnection *p
 // calls to chain.
 DBusInterface &DBusInterface::onEvent(int tickFrequency, void *pUserData, TickEvent::Callback callback)
 {
-	events.push_back(TickEvent(this, tickFrequency, callback, pUserData));
+	events.push_back(TickEvent(this, tickFrequency * TickEvent::kTickPeriodMS, callback, pUserData));
+	return *this;
+}
+
+// Add an event to this interface that fires every `periodMS` milliseconds
+//
+// NOTE: Subclasses are encouraged to overload this method for the same reasons as `onEvent()`
+DBusInterface &DBusInterface::onEventMS(int periodMS, void *pUserData, TickEvent::Callback callback)
+{
+	events.push_back(TickEvent(this, periodMS, callback, pUserData));
 	return *this;
 }
 
-// Ticks each event within this interface
+// Fires one of this interface's events (called by the EventScheduler when the event's period elapses)
 //
 // For details on events, see TickEvent.cpp.
 //
 // NOTE: Subclasses are encouraged to override this method in order to support different callback types that are specific to
 // their subclass type.
-void DBusInterface::tickEvents(GDBusConnection *pConnection, void *pUserData) const
+void DBusInterface::fireEvent(const TickEvent &event, GDBusConnection *pConnection, void *pUserData) const
 {
-	for (const TickEvent &event : events)
-	{
-		event.tick<DBusInterface>(getPath(), pConnection, pUserData);
-	}
+	event.fire<DBusInterface>(getPath(), pConnection, pUserData);
 }
 
-// Internal method used to generate introspection XML used to describe our services on D-Bus
-std::string DBusInterface::generateIntrospectionXML(int depth) const
+// Called by our framework to process an update that was posted via the update queue (see UpdateQueue.cpp)
+//
+// Returns false if this interface does not handle updates, otherwise, returns the boolean result of the update.
+//
+// NOTE: Subclasses that support updates (such as characteristics and descriptors) override this method.
+bool DBusInterface::callOnUpdatedValue(GDBusConnection * /*pConnection*/, void * /*pUserData*/) const
 {
-	std::string prefix;
-	prefix.insert(0, depth * 2, ' ');
+	return false;
+}
 
-	std::string xml = std::string();
+// Internal method used to generate introspection XML used to describe our services on D-Bus
+//
+// The XML is appended to `xml`, indented for the given `depth`.
+void DBusInterface::generateIntrospectionXML(std::string &xml, int depth) const
+{
+	size_t indent = depth * 2;
 
 	if (methods.empty())
 	{
-		xml += prefix + "<interface name='" + getName() + "' />\n";
+		xml.append(indent, ' ').append("<interface name='").append(getName()).append("' />\n");
 	}
 	else
 	{
-		xml += prefix + "<interface name='" + getName() + "'>\n";
+		xml.append(indent, ' ').append("<interface name='").append(getName()).append("'>\n");
 
 		// Describe our methods
 		for (const DBusMethod &method : methods)
 		{
-			xml += method.generateIntrospectionXML(depth + 1);
+			method.generateIntrospectionXML(xml, depth + 1);
 		}
 
-		xml += prefix + "</interface>\n";
+		xml.append(indent, ' ').append("</interface>\n");
+	}
+}
+
+// Releases any spare capacity held by this interface's methods and events once the server description is complete
+//
+// If `releaseIndexes` is set (see `Instance::setLowMemory()`), the method lookup table is released as well and methods are
+// found by a search instead. Interfaces only have a handful of methods, so that costs little.
+//
+// Called by `DBusObject::compact()`. Subclasses that store their own collections should override this (and call up to us.)
+void DBusInterface::compact(bool releaseIndexes)
+{
+	methods.shrink_to_fit();
+	events.shrink_to_fit();
+
+	if (releaseIndexes)
+	{
+		decltype(methodIndex)().swap(methodIndex);
+	}
+	else
+	{
+		rebuildMethodIndex();
+	}
+}
+
+// Returns the number of bytes of memory used by this interface, including its methods, events and lookup table (see
+// `ggkGetMemoryStats()`)
+//
+// Subclasses that store their own data should override this (and call up to us.)
+size_t DBusInterface::getMemoryUsage() const
+{
+	size_t bytes = sizeof(DBusInterface) + Utils::memoryUsage(name) + methods.capacity() * sizeof(DBusMethod) +
+		events.capacity() * sizeof(TickEvent) + Utils::hashTableMemoryUsage(methodIndex);
+
+	for (const DBusMethod &method : methods)
+	{
+		bytes += method.getMemoryUsage();
 	}
 
-	return xml;
+	return bytes;
 }
 
 }; // namespace ggk
\ No newline at end of file
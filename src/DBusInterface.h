@@ -34,10 +34,13 @@
 
 #include <gio/gio.h>
 #include <string>
-#include <list>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
 
 #include "TickEvent.h"
 #include "DBusMethod.h"
+#include "StringKey.h"
 
 namespace ggk {
 
@@ -105,8 +108,8 @@ struct DBusInterface
 	//
 
 	DBusObject &getOwner() const;
-	DBusObjectPath getPathNode() const;
-	DBusObjectPath getPath() const;
+	const DBusObjectPath &getPathNode() const;
+	const DBusObjectPath &getPath() const;
 
 	//
 	// D-Bus interface methods
@@ -114,9 +117,18 @@ struct DBusInterface
 
 	DBusInterface &addMethod(const std::string &name, const char *pInArgs[], const char *pOutArgs, DBusMethod::Callback callback);
 
+	// Locates a D-Bus method within this interface with a single hash probe (or, once the index has been released by `compact()`,
+	// a search of its methods)
+	//
+	// This method returns a pointer to the method or nullptr if not found
+	const DBusMethod *findMethod(const StringKey &methodName) const;
+
+	// Returns the list of D-Bus methods on this interface
+	const std::vector<DBusMethod> &getMethods() const { return methods; }
+
 	// NOTE: Subclasses are encouraged to override this method in order to support different callback types that are specific to
 	// their subclass type.
-	virtual bool callMethod(const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
+	virtual bool callMethod(const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
 
 	//
 	// Interface events (our home-grown poor-mans's method of allowing interfaces to do things periodically)
@@ -127,18 +139,73 @@ struct DBusInterface
 	// calls to chain.
 	DBusInterface &onEvent(int tickFrequency, void *pUserData, TickEvent::Callback callback);
 
+	// Add an event to this interface that fires every `periodMS` milliseconds
+	//
+	// NOTE: Subclasses are encouraged to overload this method for the same reasons as `onEvent()`
+	DBusInterface &onEventMS(int periodMS, void *pUserData, TickEvent::Callback callback);
+
+	// Returns the events for this interface
+	const std::vector<TickEvent> &getEvents() const { return events; }
+
+	// Fires one of this interface's events (called by the EventScheduler when the event's period elapses)
+	//
 	// NOTE: Subclasses are encouraged to override this method in order to support different callback types that are specific to
 	// their subclass type.
-	virtual void tickEvents(GDBusConnection *pConnection, void *pUserData) const;
+	virtual void fireEvent(const TickEvent &event, GDBusConnection *pConnection, void *pUserData) const;
+
+	//
+	// Data updates
+	//
+
+	// Called by our framework to process an update that was posted via the update queue (see UpdateQueue.cpp)
+	//
+	// Returns false if this interface does not handle updates, otherwise, returns the boolean result of the update.
+	//
+	// NOTE: Subclasses that support updates (such as characteristics and descriptors) override this method.
+	virtual bool callOnUpdatedValue(GDBusConnection *pConnection, void *pUserData) const;
+
+	// Marks this interface as pending within the update queue
+	//
+	// Returns true if the interface was not already pending (in which case, the caller must add it to the queue.)
+	bool markUpdatePending() const { return !updatePending.exchange(true, std::memory_order_acq_rel); }
+
+	// Clears this interface's pending state within the update queue
+	void clearUpdatePending() const { updatePending.store(false, std::memory_order_release); }
 
 	// Internal method used to generate introspection XML used to describe our services on D-Bus
-	virtual std::string generateIntrospectionXML(int depth) const;
+	//
+	// The XML is appended to `xml`, indented for the given `depth`.
+	virtual void generateIntrospectionXML(std::string &xml, int depth) const;
+
+	// Releases any spare capacity held by this interface's methods and events once the server description is complete
+	//
+	// If `releaseIndexes` is set (see `Instance::setLowMemory()`), the method lookup table is released as well and methods are
+	// found by a search instead. Interfaces only have a handful of methods, so that costs little.
+	//
+	// Called by `DBusObject::compact()`. Subclasses that store their own collections should override this (and call up to us.)
+	virtual void compact(bool releaseIndexes);
+
+	// Returns the number of bytes of memory used by this interface, including its methods, events and lookup table (see
+	// `ggkGetMemoryStats()`)
+	//
+	// Subclasses that store their own data should override this (and call up to us.)
+	virtual size_t getMemoryUsage() const;
 
 protected:
+	// Rebuilds `methodIndex` from `methods` (the keys and values point into `methods`, so this is required when it reallocates)
+	void rebuildMethodIndex();
+
 	DBusObject &owner;
 	std::string name;
-	std::list<DBusMethod> methods;
-	std::list<TickEvent> events;
+	std::vector<DBusMethod> methods;
+	std::vector<TickEvent> events;
+
+	// Method lookup table keyed by method name (the keys reference the names of the methods stored in `methods`, see
+	// `rebuildMethodIndex()`)
+	std::unordered_map<StringKey, const DBusMethod *, StringKey::Hash> methodIndex;
+
+	// Set while this interface is waiting in the update queue (used to coalesce repeated updates)
+	mutable std::atomic<bool> updatePending;
 };
 
 }; // namespace ggk
\ No newline at end of file
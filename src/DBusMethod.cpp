@@ -38,6 +38,8 @@
 #include <vector>
 
 #include "DBusMethod.h"
+#include "Logger.h"
+#include "Utils.h"
 
 namespace ggk {
 
@@ -59,34 +61,59 @@ DBusMethod::DBusMethod(const DBusInterface *pOwner, const std::string &name, con
 }
 
 // Internal method used to generate introspection XML used to describe our services on D-Bus
-std::string DBusMethod::generateIntrospectionXML(int depth) const
+//
+// The XML is appended to `xml`, indented for the given `depth`.
+void DBusMethod::generateIntrospectionXML(std::string &xml, int depth) const
 {
-	std::string prefix;
-	prefix.insert(0, depth * 2, ' ');
-
-	std::string xml = std::string();
+	size_t indent = depth * 2;
 
-	xml += prefix + "<method name='" + getName() + "'>\n";
+	xml.append(indent, ' ').append("<method name='").append(getName()).append("'>\n");
 
 	// Add our input arguments
 	for (const std::string &inArg : getInArgs())
 	{
-		xml += prefix + "  <arg type='" + inArg + "' direction='in'>\n";
-		xml += prefix + "    <annotation name='org.gtk.GDBus.C.ForceGVariant' value='true' />\n";
-		xml += prefix + "  </arg>\n";
+		xml.append(indent, ' ').append("  <arg type='").append(inArg).append("' direction='in'>\n");
+		xml.append(indent, ' ').append("    <annotation name='org.gtk.GDBus.C.ForceGVariant' value='true' />\n");
+		xml.append(indent, ' ').append("  </arg>\n");
 	}
 
+	// Add our output arguments
+	//
+	// The output arguments are stored as a single signature (such as "hq" for a method returning a handle and a uint16), so we
+	// split them into one argument per complete type.
 	const std::string &outArgs = getOutArgs();
-	if (!outArgs.empty())
+	const gchar *pOutArg = outArgs.c_str();
+	const gchar *pEnd = pOutArg + outArgs.length();
+	while (pOutArg < pEnd)
 	{
-		xml += prefix + "  <arg type='" + outArgs + "' direction='out'>\n";
-		xml += prefix + "    <annotation name='org.gtk.GDBus.C.ForceGVariant' value='true' />\n";
-		xml += prefix + "  </arg>\n";
+		const gchar *pNext = nullptr;
+		if (!g_variant_type_string_scan(pOutArg, pEnd, &pNext))
+		{
+			Logger::error(SSTR << "Invalid output signature '" << outArgs << "' for method '" << getName() << "'");
+			break;
+		}
+
+		xml.append(indent, ' ').append("  <arg type='").append(pOutArg, pNext - pOutArg).append("' direction='out'>\n");
+		xml.append(indent, ' ').append("    <annotation name='org.gtk.GDBus.C.ForceGVariant' value='true' />\n");
+		xml.append(indent, ' ').append("  </arg>\n");
+		pOutArg = pNext;
 	}
 
-	xml += prefix + "</method>\n";
+	xml.append(indent, ' ').append("</method>\n");
+}
+
+// Returns the number of bytes this method has allocated for its name and arguments (see `ggkGetMemoryStats()`)
+//
+// The method itself is stored (and counted) by its interface.
+size_t DBusMethod::getMemoryUsage() const
+{
+	size_t bytes = Utils::memoryUsage(name) + Utils::memoryUsage(outArgs) + inArgs.capacity() * sizeof(std::string);
+	for (const std::string &inArg : inArgs)
+	{
+		bytes += Utils::memoryUsage(inArg);
+	}
 
-	return xml;
+	return bytes;
 }
 
 }; // namespace ggk
\ No newline at end of file
@@ -46,6 +46,7 @@
 #include "DBusObjectPath.h"
 #include "Logger.h"
 #include "Server.h"
+#include "Stats.h"
 
 namespace ggk {
 
@@ -105,12 +106,26 @@ struct DBusMethod
 			return;
 		}
 
-		Logger::info(SSTR << "Calling method: [" << path << "]:[" << interfaceName << "]:[" << methodName << "]");
+		LOG_INFO("Calling method: [" << path << "]:[" << interfaceName << "]:[" << methodName << "]");
+		LatencyTimer timer(latency);
 		callback(*static_cast<const T *>(pOwner), pConnection, methodName, pParameters, pInvocation, pUserData);
 	}
 
+	// Returns the histogram of time spent in this method's callback
+	const LatencyHistogram &getLatency() const { return latency; }
+
+	// Discards the samples in this method's latency histogram
+	void resetLatency() const { latency.reset(); }
+
 	// Internal method used to generate introspection XML used to describe our services on D-Bus
-	std::string generateIntrospectionXML(int depth) const;
+	//
+	// The XML is appended to `xml`, indented for the given `depth`.
+	void generateIntrospectionXML(std::string &xml, int depth) const;
+
+	// Returns the number of bytes this method has allocated for its name and arguments (see `ggkGetMemoryStats()`)
+	//
+	// The method itself is stored (and counted) by its interface.
+	size_t getMemoryUsage() const;
 
 private:
 	const DBusInterface *pOwner;
@@ -118,6 +133,7 @@ private:
 	std::vector<std::string> inArgs;
 	std::string outArgs;
 	Callback callback;
+	mutable LatencyHistogram latency;
 };
 
 }; // namespace ggk
\ No newline at end of file
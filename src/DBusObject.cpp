@@ -51,6 +51,8 @@
 #include "GattProperty.h"
 #include "DBusInterface.h"
 #include "GattService.h"
+#include "GattTable.h"
+#include "BulkTransfer.h"
 #include "DBusObject.h"
 #include "Utils.h"
 #include "GattUuid.h"
@@ -58,11 +60,14 @@
 
 namespace ggk {
 
+// The initial buffer size used when generating introspection XML (later generations reserve the size of the previous one)
+static const size_t kInitialIntrospectionXMLReserve = 16 * 1024;
+
 // Construct a root object with no parent
 //
 // We'll include a publish flag since only root objects can be published
 DBusObject::DBusObject(const DBusObjectPath &path, bool publish)
-: publish(publish), path(path), pParent(nullptr)
+: publish(publish), path(path), fullPath(path), pParent(nullptr), retired(false), introspectionXMLLength(0), managedObjectEntryValid(false), managedObjectsSubtreeValid(false)
 {
 }
 
@@ -70,7 +75,7 @@ DBusObject::DBusObject(const DBusObjectPath &path, bool publish)
 //
 // Nodes inherit their parent's publish path
 DBusObject::DBusObject(DBusObject *pParent, const DBusObjectPath &pathElement)
-: publish(pParent->publish), path(pathElement), pParent(pParent)
+: publish(pParent->publish), path(pathElement), fullPath(pParent->fullPath + pathElement), pParent(pParent), retired(false), introspectionXMLLength(0), managedObjectEntryValid(false), managedObjectsSubtreeValid(false)
 {
 }
 
@@ -95,19 +100,11 @@ const DBusObjectPath &DBusObject::getPathNode() const
 // Returns the full path for this object within the hierarchy
 //
 // This method returns the full path. To get the current node, use `getPathNode()`
-DBusObjectPath DBusObject::getPath() const
+//
+// The full path is built once, when the object is constructed, so this does not allocate.
+const DBusObjectPath &DBusObject::getPath() const
 {
-	DBusObjectPath path = getPathNode();
-	const DBusObject *pCurrent = pParent;
-
-	// Traverse up my chain, adding nodes to the path until we have the full thing
-	while(nullptr != pCurrent)
-	{
-		path = pCurrent->getPathNode() + path;
-		pCurrent = pCurrent->pParent;
-	}
-
-	return path;
+	return fullPath;
 }
 
 // Returns the parent object in the hierarchy
@@ -117,18 +114,67 @@ DBusObject &DBusObject::getParent()
 }
 
 // Returns the list of children objects
-const std::list<DBusObject> &DBusObject::getChildren() const
+const DBusObject::ChildList &DBusObject::getChildren() const
 {
 	return children;
 }
 
 // Add a child to this object
+//
+// If a child with this path element was retired (see `retire()`), that child is brought back into use rather than adding a
+// new one.
 DBusObject &DBusObject::addChild(const DBusObjectPath &pathElement)
 {
+	invalidateIntrospection();
+	invalidateManagedObjects();
+
+	for (DBusObject &child : children)
+	{
+		if (child.retired && child.path == pathElement)
+		{
+			child.retired = false;
+			return child;
+		}
+	}
+
 	children.push_back(DBusObject(this, pathElement));
 	return children.back();
 }
 
+// Returns the child with the given path element, or nullptr if there is no such child (retired children are not returned)
+DBusObject *DBusObject::findChild(const DBusObjectPath &pathElement)
+{
+	for (DBusObject &child : children)
+	{
+		if (!child.retired && child.path == pathElement)
+		{
+			return &child;
+		}
+	}
+
+	return nullptr;
+}
+
+// Removes this object from the description, along with everything beneath it
+//
+// Objects can't be erased (interfaces refer to their owners by address), so this object and its children stay where they are,
+// but with no interfaces they have nothing to report and are skipped everywhere. The interfaces are moved to
+// `retiredInterfaces` rather than destroyed, since updates that are already queued may still refer to them.
+void DBusObject::retire(InterfaceList &retiredInterfaces)
+{
+	for (DBusObject &child : children)
+	{
+		child.retire(retiredInterfaces);
+	}
+
+	invalidateIntrospection();
+	invalidateManagedObjects();
+
+	retiredInterfaces.insert(retiredInterfaces.end(), interfaces.begin(), interfaces.end());
+	interfaces.clear();
+	retired = true;
+}
+
 // Returns a list of interfaces for this object
 const DBusObject::InterfaceList &DBusObject::getInterfaces() const
 {
@@ -142,23 +188,112 @@ GattService &DBusObject::gattServiceBegin(const std::string &pathElement, const
 {
 	DBusObject &child = addChild(DBusObjectPath(pathElement));
 	GattService &service = *child.addInterface(std::make_shared<GattService>(child, "org.bluez.GattService1"));
-	service.addProperty<GattService>("UUID", uuid);
+	service.setUuid<GattService>(uuid);
 	service.addProperty<GattService>("Primary", true);
 	return service;
 }
 
+// Adds a bulk transfer service to the hierarchy (see BulkTransfer.cpp)
+//
+// The service streams the files named in `config` to and from a client, through a control characteristic ("control") and a
+// data characteristic ("data") which are added for us.
+//
+// Returns this object, so that further services can be chained.
+DBusObject &DBusObject::bulkTransferService(const std::string &pathElement, const GattUuid &serviceUuid, const GattUuid &controlUuid, const GattUuid &dataUuid, const BulkTransferConfig &config)
+{
+	DBusObject &child = addChild(DBusObjectPath(pathElement));
+	BulkTransferService &service = *child.addInterface(std::make_shared<BulkTransferService>(child, "org.bluez.GattService1", config));
+	service.setUuid<GattService>(serviceUuid);
+	service.addProperty<GattService>("Primary", true);
+	service.addCharacteristics(controlUuid, dataUuid);
+	return *this;
+}
+
+// Adds the services described by a GATT table to the hierarchy (see GattTable.h)
+//
+// The table is walked once, creating the same objects that the equivalent `gattServiceBegin()` chain would. A table that is
+// not well formed is rejected with an error before anything is added.
+//
+// Returns this object, so that further services can be chained.
+DBusObject &DBusObject::gattTable(const GattTableEntry *pEntries, size_t count)
+{
+	if (!GattTable::isWellFormed(pEntries, count))
+	{
+		Logger::error(SSTR << "GATT table at '" << getPath() << "' is not well formed; ignoring it");
+		return *this;
+	}
+
+	GattService *pService = nullptr;
+	GattCharacteristic *pCharacteristic = nullptr;
+	GattDescriptor *pDescriptor = nullptr;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const GattTableEntry &entry = pEntries[i];
+		switch (entry.kind)
+		{
+			case GattTableEntry::EService:
+				pService = &gattServiceBegin(entry.pPathElement, GattUuid(entry.uuid));
+				break;
+			case GattTableEntry::ECharacteristic:
+				pCharacteristic = &pService->gattCharacteristicBegin(entry.pPathElement, GattUuid(entry.uuid), GattTable::flagNames(entry.flags));
+				if (nullptr != entry.onCharacteristicRead) { pCharacteristic->onReadValue(entry.onCharacteristicRead); }
+				if (nullptr != entry.onCharacteristicWrite) { pCharacteristic->onWriteValue(entry.onCharacteristicWrite); }
+				if (nullptr != entry.onCharacteristicUpdated) { pCharacteristic->onUpdatedValue(entry.onCharacteristicUpdated); }
+				if (entry.readCacheTTLMS > 0) { pCharacteristic->cacheReadValue(entry.readCacheTTLMS); }
+				break;
+			case GattTableEntry::EDescriptor:
+				pDescriptor = &pCharacteristic->gattDescriptorBegin(entry.pPathElement, GattUuid(entry.uuid), GattTable::flagNames(entry.flags));
+				if (nullptr != entry.onDescriptorRead) { pDescriptor->onReadValue(entry.onDescriptorRead); }
+				if (nullptr != entry.onDescriptorWrite) { pDescriptor->onWriteValue(entry.onDescriptorWrite); }
+				if (nullptr != entry.onDescriptorUpdated) { pDescriptor->onUpdatedValue(entry.onDescriptorUpdated); }
+				if (entry.readCacheTTLMS > 0) { pDescriptor->cacheReadValue(entry.readCacheTTLMS); }
+				break;
+			case GattTableEntry::EEnd:
+				// Close the innermost open item
+				if (nullptr != pDescriptor) { pDescriptor = nullptr; }
+				else if (nullptr != pCharacteristic) { pCharacteristic = nullptr; }
+				else { pService = nullptr; }
+				break;
+		}
+	}
+
+	return *this;
+}
+
 //
 // Helpful routines for searching objects
 //
 
-// Finds an interface by name within this D-Bus object
-std::shared_ptr<const DBusInterface> DBusObject::findInterface(const DBusObjectPath &path, const std::string &interfaceName, const DBusObjectPath &basePath) const
+// Returns true if `path` is our path or the path of one of our descendants
+bool DBusObject::containsPath(const StringKey &path) const
 {
-	if ((basePath + getPathNode()) == path)
+	const std::string &ours = fullPath.toString();
+	if (path.getLength() < ours.length() || 0 != memcmp(path.data(), ours.c_str(), ours.length()))
 	{
-		for (std::shared_ptr<const DBusInterface> interface : interfaces)
+		return false;
+	}
+
+	// "/com/foo" contains "/com/foo/bar" but not "/com/foobar"
+	return path.getLength() == ours.length() || ours.back() == '/' || path.data()[ours.length()] == '/';
+}
+
+// Finds an interface by name within this D-Bus object or its children
+//
+// Paths are compared against each object's stored full path and only subtrees whose path is a prefix of `path` are searched,
+// so nothing is allocated. The server's dispatch uses its interface index instead (see `Server::findInterface()`.)
+std::shared_ptr<const DBusInterface> DBusObject::findInterface(const StringKey &path, const StringKey &interfaceName) const
+{
+	if (!containsPath(path))
+	{
+		return nullptr;
+	}
+
+	if (StringKey(fullPath) == path)
+	{
+		for (const std::shared_ptr<DBusInterface> &interface : interfaces)
 		{
-			if (interfaceName == interface->getName())
+			if (interfaceName == StringKey(interface->getName()))
 			{
 				return interface;
 			}
@@ -167,7 +302,7 @@ std::shared_ptr<const DBusInterface> DBusObject::findInterface(const DBusObjectP
 
 	for (const DBusObject &child : getChildren())
 	{
-		std::shared_ptr<const DBusInterface> pInterface = child.findInterface(path, interfaceName, basePath + getPathNode());
+		std::shared_ptr<const DBusInterface> pInterface = child.findInterface(path, interfaceName);
 		if (nullptr != pInterface)
 		{
 			return pInterface;
@@ -178,13 +313,18 @@ std::shared_ptr<const DBusInterface> DBusObject::findInterface(const DBusObjectP
 }
 
 // Finds a BlueZ method by name within the specified D-Bus interface
-bool DBusObject::callMethod(const DBusObjectPath &path, const std::string &interfaceName, const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData, const DBusObjectPath &basePath) const
+bool DBusObject::callMethod(const StringKey &path, const StringKey &interfaceName, const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
 {
-	if ((basePath + getPathNode()) == path)
+	if (!containsPath(path))
+	{
+		return false;
+	}
+
+	if (StringKey(fullPath) == path)
 	{
-		for (std::shared_ptr<const DBusInterface> interface : interfaces)
+		for (const std::shared_ptr<DBusInterface> &interface : interfaces)
 		{
-			if (interfaceName == interface->getName())
+			if (interfaceName == StringKey(interface->getName()))
 			{
 				if (interface->callMethod(methodName, pConnection, pParameters, pInvocation, pUserData))
 				{
@@ -196,7 +336,7 @@ bool DBusObject::callMethod(const DBusObjectPath &path, const std::string &inter
 
 	for (const DBusObject &child : getChildren())
 	{
-		if (child.callMethod(path, interfaceName, methodName, pConnection, pParameters, pInvocation, pUserData, basePath + getPathNode()))
+		if (child.callMethod(path, interfaceName, methodName, pConnection, pParameters, pInvocation, pUserData))
 		{
 			return true;
 		}
@@ -205,60 +345,210 @@ bool DBusObject::callMethod(const DBusObjectPath &path, const std::string &inter
 	return false;
 }
 
-// Periodic timer tick propagation
-void DBusObject::tickEvents(GDBusConnection *pConnection, void *pUserData) const
+// ---------------------------------------------------------------------------------------------------------------------------------
+// XML generation for a D-Bus introspection
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Internal method used to generate introspection XML used to describe our services on D-Bus
+//
+// This generates the complete XML document for this object and its children. Generally, you'll want to use
+// `getIntrospectionNodeInfo()` instead, which caches the parsed result.
+std::string DBusObject::generateIntrospectionXML() const
 {
-	for (std::shared_ptr<const DBusInterface> interface : interfaces)
+	std::string xml;
+	xml.reserve(introspectionXMLLength > 0 ? introspectionXMLLength : kInitialIntrospectionXMLReserve);
+
+	xml.append("<?xml version='1.0'?>\n");
+	xml.append("<!DOCTYPE node PUBLIC '-//freedesktop//DTD D-BUS Object Introspection 1.0//EN' 'http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd'>\n");
+	generateIntrospectionXML(xml, 0);
+
+	LOG_DEBUG("Generated " << xml.length() << " bytes of XML for object '" << getPath() << "'");
+	LOG_TRACE(xml);
+
+	return xml;
+}
+
+// Internal method used to generate introspection XML used to describe our services on D-Bus
+//
+// The XML is appended to `xml`, indented for the given `depth`.
+void DBusObject::generateIntrospectionXML(std::string &xml, int depth) const
+{
+	size_t indent = depth * 2;
+
+	xml.append(indent, ' ').append("<node name='").append(getPathNode().toString()).append("'>\n");
+	xml.append(indent, ' ').append("  <annotation name='").append(TheServer->getServiceName()).append(".DBusObject.path' value='").append(getPath().toString()).append("' />\n");
+
+	for (const std::shared_ptr<DBusInterface> &interface : interfaces)
 	{
-		interface->tickEvents(pConnection, pUserData);
+		interface->generateIntrospectionXML(xml, depth + 1);
 	}
 
 	for (const DBusObject &child : getChildren())
 	{
-		child.tickEvents(pConnection, pUserData);
+		if (!child.isRetired())
+		{
+			child.generateIntrospectionXML(xml, depth + 1);
+		}
+	}
+
+	xml.append(indent, ' ').append("</node>\n");
+}
+
+// Returns the parsed introspection of this object and its children, used to register our objects with D-Bus
+//
+// The introspection is generated and parsed on first use, then cached and reused (for example, each time we re-register with
+// BlueZ after it restarts) until the description of this object changes. See `invalidateIntrospection()`.
+//
+// The returned node info is owned by this object and should not be unreferenced by the caller. Returns nullptr if the
+// introspection could not be parsed.
+GDBusNodeInfo *DBusObject::getIntrospectionNodeInfo() const
+{
+	if (nullptr != pIntrospectionNodeInfo)
+	{
+		return pIntrospectionNodeInfo.get();
+	}
+
+	std::string xml = generateIntrospectionXML();
+
+	GError *pError = nullptr;
+	GDBusNodeInfo *pNode = g_dbus_node_info_new_for_xml(xml.c_str(), &pError);
+	if (nullptr == pNode)
+	{
+		Logger::error(SSTR << "Failed to introspect XML: " << (nullptr == pError ? "Unknown" : pError->message));
+		return nullptr;
+	}
+
+	pIntrospectionNodeInfo = std::shared_ptr<GDBusNodeInfo>(pNode, g_dbus_node_info_unref);
+	introspectionXMLLength = xml.length();
+	return pNode;
+}
+
+// Discards the cached introspection for this object and all of its parents
+//
+// This is called automatically when children or interfaces are added. Call it directly after making any other change to the
+// description that would affect the introspection.
+void DBusObject::invalidateIntrospection()
+{
+	for (DBusObject *pObject = this; nullptr != pObject; pObject = pObject->pParent)
+	{
+		pObject->pIntrospectionNodeInfo.reset();
+	}
+}
+
+// Releases any spare capacity held by this object, its interfaces and all of its children
+//
+// This is called once the server description is complete, after which the description is treated as frozen. If
+// `releaseIndexes` is set, the interfaces' lookup tables are released as well (see `DBusInterface::compact()`.)
+//
+// The children themselves are never reallocated here: interfaces refer to their owners (and children to their parents) by
+// address, so only the storage inside each object is trimmed.
+void DBusObject::compact(bool releaseIndexes)
+{
+	interfaces.shrink_to_fit();
+	for (const std::shared_ptr<DBusInterface> &interface : interfaces)
+	{
+		interface->compact(releaseIndexes);
+	}
+
+	for (DBusObject &child : children)
+	{
+		child.compact(releaseIndexes);
+	}
+}
+
+// Discards the cached introspection and `GetManagedObjects` entries for this object and all of its children
+//
+// Both are rebuilt the next time they are needed. This is how the low-memory profile gives them back once BlueZ has what it
+// needs (see `Server::trimCaches()`.)
+void DBusObject::releaseCaches() const
+{
+	pIntrospectionNodeInfo.reset();
+	pManagedObjectEntry.reset();
+	managedObjectEntryValid = false;
+	managedObjectsSubtreeValid = false;
+
+	for (const DBusObject &child : children)
+	{
+		child.releaseCaches();
 	}
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
-// XML generation for a D-Bus introspection
+// Memory accounting
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Internal method used to generate introspection XML used to describe our services on D-Bus
-std::string DBusObject::generateIntrospectionXML(int depth) const
+// Returns the number of bytes of memory used by this object, its interfaces and all of its children (not counting their
+// caches)
+//
+// Our own size is counted by whoever stores us (our parent's list of children, or the server's list of objects.)
+size_t DBusObject::getMemoryUsage() const
 {
-	std::string prefix;
-	prefix.insert(0, depth * 2, ' ');
+	size_t bytes = Utils::memoryUsage(path.toString()) + Utils::memoryUsage(fullPath.toString()) +
+		interfaces.capacity() * sizeof(std::shared_ptr<DBusInterface>);
 
-	std::string xml = std::string();
+	for (const std::shared_ptr<DBusInterface> &interface : interfaces)
+	{
+		bytes += interface->getMemoryUsage();
+	}
 
-	if (depth == 0)
+	for (const DBusObject &child : children)
 	{
-		xml += "<?xml version='1.0'?>\n";
-		xml += "<!DOCTYPE node PUBLIC '-//freedesktop//DTD D-BUS Object Introspection 1.0//EN' 'http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd'>\n";
+		bytes += sizeof(DBusObject) + child.getMemoryUsage();
 	}
 
-	xml += prefix + "<node name='" + getPathNode().toString() + "'>\n";
-	xml += prefix + "  <annotation name='" + TheServer->getServiceName() + ".DBusObject.path' value='" + getPath().toString() + "' />\n";
+	return bytes;
+}
 
-	for (std::shared_ptr<const DBusInterface> interface : interfaces)
+// Adds the size of the cached introspection (counted as the size of the XML it was parsed from) and `GetManagedObjects`
+// entries for this object and all of its children to `introspectionBytes` and `managedObjectsBytes`
+void DBusObject::getCacheMemoryUsage(size_t &introspectionBytes, size_t &managedObjectsBytes) const
+{
+	if (nullptr != pIntrospectionNodeInfo)
 	{
-		xml += interface->generateIntrospectionXML(depth + 1);
+		introspectionBytes += introspectionXMLLength;
 	}
 
-	for (DBusObject child : getChildren())
+	managedObjectsBytes += Utils::memoryUsage(pManagedObjectEntry.get());
+
+	for (const DBusObject &child : children)
 	{
-		xml += child.generateIntrospectionXML(depth + 1);
+		child.getCacheMemoryUsage(introspectionBytes, managedObjectsBytes);
 	}
+}
 
-	xml += prefix + "</node>\n";
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Cached `GetManagedObjects` entries
+// ---------------------------------------------------------------------------------------------------------------------------------
 
-	if (depth == 0)
+// Caches this object's entry in the `GetManagedObjects` reply. A floating reference is sunk.
+void DBusObject::setManagedObjectEntry(GVariant *pEntry) const
+{
+	if (nullptr == pEntry)
 	{
-		Logger::debug("Generated XML:");
-		Logger::debug(xml);
+		pManagedObjectEntry.reset();
+	}
+	else
+	{
+		pManagedObjectEntry = std::shared_ptr<GVariant>(g_variant_ref_sink(pEntry), g_variant_unref);
 	}
 
-	return xml;
+	managedObjectEntryValid = true;
+}
+
+// Discards this object's cached `GetManagedObjects` entry, so that it is rebuilt the next time BlueZ (or anybody else) asks
+//
+// This is called automatically when children or interfaces are added and when a PropertiesChanged signal is emitted from this
+// object (see `emitSignal()`.)
+void DBusObject::invalidateManagedObjects()
+{
+	managedObjectEntryValid = false;
+	pManagedObjectEntry.reset();
+
+	// Our parents' subtrees include us
+	for (DBusObject *pObject = this; nullptr != pObject; pObject = pObject->pParent)
+	{
+		pObject->managedObjectsSubtreeValid = false;
+	}
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -266,8 +556,15 @@ std::string DBusObject::generateIntrospectionXML(int depth) const
 // ---------------------------------------------------------------------------------------------------------------------------------
 
 // Emits a signal on the bus from the given path, interface name and signal name, containing a GVariant set of parameters
+//
+// Emitting PropertiesChanged invalidates our cached `GetManagedObjects` entry.
 void DBusObject::emitSignal(GDBusConnection *pBusConnection, const std::string &interfaceName, const std::string &signalName, GVariant *pParameters)
 {
+	if (signalName == "PropertiesChanged" && interfaceName == "org.freedesktop.DBus.Properties")
+	{
+		invalidateManagedObjects();
+	}
+
 	GError *pError = nullptr;
 	gboolean result = g_dbus_connection_emit_signal
 	(
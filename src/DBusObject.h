@@ -34,22 +34,30 @@
 
 #include <gio/gio.h>
 #include <string>
-#include <list>
+#include <deque>
+#include <vector>
 #include <memory>
 
 #include "DBusObjectPath.h"
+#include "StringKey.h"
 
 namespace ggk {
 
 struct GattProperty;
 struct GattService;
 struct GattUuid;
+struct GattTableEntry;
+struct BulkTransferConfig;
 struct DBusInterface;
 
 struct DBusObject
 {
 	// A convenience typedef for describing our list of interface
-	typedef std::list<std::shared_ptr<DBusInterface> > InterfaceList;
+	typedef std::vector<std::shared_ptr<DBusInterface> > InterfaceList;
+
+	// Our children are stored in a deque, which keeps them in contiguous blocks but never moves an existing child when another
+	// is added (the server description holds references to objects while it adds their siblings)
+	typedef std::deque<DBusObject> ChildList;
 
 	// Construct a root object with no parent
 	//
@@ -76,17 +84,35 @@ struct DBusObject
 	// Returns the full path for this object within the hierarchy
 	//
 	// This method returns the full path. To get the current node, use `getPathNode()`
-	DBusObjectPath getPath() const;
+	//
+	// The full path is built once, when the object is constructed, so this does not allocate.
+	const DBusObjectPath &getPath() const;
 
 	// Returns the parent object in the hierarchy
 	DBusObject &getParent();
 
 	// Returns the list of children objects
-	const std::list<DBusObject> &getChildren() const;
+	const ChildList &getChildren() const;
 
 	// Add a child to this object
+	//
+	// If a child with this path element was retired (see `retire()`), that child is brought back into use rather than adding a
+	// new one.
 	DBusObject &addChild(const DBusObjectPath &pathElement);
 
+	// Returns the child with the given path element, or nullptr if there is no such child (retired children are not returned)
+	DBusObject *findChild(const DBusObjectPath &pathElement);
+
+	// Removes this object from the description, along with everything beneath it
+	//
+	// Objects can't be erased (interfaces refer to their owners by address), so this object and its children stay where they are,
+	// but with no interfaces they have nothing to report and are skipped everywhere. The interfaces are moved to
+	// `retiredInterfaces` rather than destroyed, since updates that are already queued may still refer to them.
+	void retire(InterfaceList &retiredInterfaces);
+
+	// Returns true if this object has been retired (see `retire()`)
+	bool isRetired() const { return retired; }
+
 	// Returns a list of interfaces for this object
 	const InterfaceList &getInterfaces() const;
 
@@ -94,12 +120,83 @@ struct DBusObject
 	template<typename T>
 	std::shared_ptr<T> addInterface(std::shared_ptr<T> interface)
 	{
+		invalidateIntrospection();
+		invalidateManagedObjects();
 		interfaces.push_back(interface);
 		return std::static_pointer_cast<T>(interfaces.back());
 	}
 
 	// Internal method used to generate introspection XML used to describe our services on D-Bus
-	std::string generateIntrospectionXML(int depth = 0) const;
+	//
+	// This generates the complete XML document for this object and its children. Generally, you'll want to use
+	// `getIntrospectionNodeInfo()` instead, which caches the parsed result.
+	std::string generateIntrospectionXML() const;
+
+	// Returns the parsed introspection of this object and its children, used to register our objects with D-Bus
+	//
+	// The introspection is generated and parsed on first use, then cached and reused (for example, each time we re-register with
+	// BlueZ after it restarts) until the description of this object changes. See `invalidateIntrospection()`.
+	//
+	// The returned node info is owned by this object and should not be unreferenced by the caller. Returns nullptr if the
+	// introspection could not be parsed.
+	GDBusNodeInfo *getIntrospectionNodeInfo() const;
+
+	// Discards the cached introspection for this object and all of its parents
+	//
+	// This is called automatically when children or interfaces are added. Call it directly after making any other change to the
+	// description that would affect the introspection.
+	void invalidateIntrospection();
+
+	// Releases any spare capacity held by this object, its interfaces and all of its children
+	//
+	// This is called once the server description is complete, after which the description is treated as frozen. If
+	// `releaseIndexes` is set, the interfaces' lookup tables are released as well (see `DBusInterface::compact()`.)
+	void compact(bool releaseIndexes = false);
+
+	// Discards the cached introspection and `GetManagedObjects` entries for this object and all of its children
+	//
+	// Both are rebuilt the next time they are needed. This is how the low-memory profile gives them back once BlueZ has what it
+	// needs (see `Server::trimCaches()`.)
+	void releaseCaches() const;
+
+	//
+	// Memory accounting (see `ggkGetMemoryStats()`)
+	//
+
+	// Returns the number of bytes of memory used by this object, its interfaces and all of its children (not counting their
+	// caches)
+	size_t getMemoryUsage() const;
+
+	// Adds the size of the cached introspection (counted as the size of the XML it was parsed from) and `GetManagedObjects`
+	// entries for this object and all of its children to `introspectionBytes` and `managedObjectsBytes`
+	void getCacheMemoryUsage(size_t &introspectionBytes, size_t &managedObjectsBytes) const;
+
+	//
+	// Cached `GetManagedObjects` entries (see `ServerUtils::getManagedObjects()`)
+	//
+
+	// Returns true if this object's entry in the `GetManagedObjects` reply is cached (see `getManagedObjectEntry()`)
+	bool isManagedObjectEntryValid() const { return managedObjectEntryValid; }
+
+	// Returns true if the entries for this object and all of its children are cached
+	bool isManagedObjectsSubtreeValid() const { return managedObjectsSubtreeValid; }
+
+	// Returns this object's cached entry (`{oa{sa{sv}}}`) in the `GetManagedObjects` reply
+	//
+	// This may return nullptr for a valid entry if the object has nothing to report (for example, an object without interfaces.)
+	GVariant *getManagedObjectEntry() const { return pManagedObjectEntry.get(); }
+
+	// Caches this object's entry in the `GetManagedObjects` reply. A floating reference is sunk.
+	void setManagedObjectEntry(GVariant *pEntry) const;
+
+	// Marks the entries for this object and all of its children as cached
+	void setManagedObjectsSubtreeValid() const { managedObjectsSubtreeValid = true; }
+
+	// Discards this object's cached `GetManagedObjects` entry, so that it is rebuilt the next time BlueZ (or anybody else) asks
+	//
+	// This is called automatically when children or interfaces are added and when a PropertiesChanged signal is emitted from this
+	// object (see `emitSignal()`.)
+	void invalidateManagedObjects();
 
 	// Convenience functions to add a GATT service to the hierarchy
 	//
@@ -108,32 +205,72 @@ struct DBusObject
 	// To end a service, call `gattServiceEnd()`
 	GattService &gattServiceBegin(const std::string &pathElement, const GattUuid &uuid);
 
+	// Adds the services described by a GATT table to the hierarchy (see GattTable.h)
+	//
+	// The table is walked once, creating the same objects that the equivalent `gattServiceBegin()` chain would. A table that is
+	// not well formed is rejected with an error before anything is added.
+	//
+	// Returns this object, so that further services can be chained.
+	DBusObject &gattTable(const GattTableEntry *pEntries, size_t count);
+
+	// Adds a bulk transfer service to the hierarchy (see BulkTransfer.cpp)
+	//
+	// The service streams the files named in `config` to and from a client, through a control characteristic ("control") and a
+	// data characteristic ("data") which are added for us.
+	//
+	// Returns this object, so that further services can be chained.
+	DBusObject &bulkTransferService(const std::string &pathElement, const GattUuid &serviceUuid, const GattUuid &controlUuid, const GattUuid &dataUuid, const BulkTransferConfig &config);
+
 	//
 	// Helpful routines for searching objects
 	//
 
-	// Finds an interface by name within this D-Bus object
-	std::shared_ptr<const DBusInterface> findInterface(const DBusObjectPath &path, const std::string &interfaceName, const DBusObjectPath &basePath = DBusObjectPath()) const;
+	// Finds an interface by name within this D-Bus object or its children
+	//
+	// Paths are compared against each object's stored full path and only subtrees whose path is a prefix of `path` are searched,
+	// so nothing is allocated. The server's dispatch uses its interface index instead (see `Server::findInterface()`.)
+	std::shared_ptr<const DBusInterface> findInterface(const StringKey &path, const StringKey &interfaceName) const;
 
 	// Finds a BlueZ method by name within the specified D-Bus interface
-	bool callMethod(const DBusObjectPath &path, const std::string &interfaceName, const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData, const DBusObjectPath &basePath = DBusObjectPath()) const;
-
-	// Periodic timer tick propagation
-	void tickEvents(GDBusConnection *pConnection, void *pUserData = nullptr) const;
+	bool callMethod(const StringKey &path, const StringKey &interfaceName, const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
 
 	// -----------------------------------------------------------------------------------------------------------------------------
 	// D-Bus signals
 	// -----------------------------------------------------------------------------------------------------------------------------
 
 	// Emits a signal on the bus from the given path, interface name and signal name, containing a GVariant set of parameters
+	//
+	// Emitting PropertiesChanged invalidates our cached `GetManagedObjects` entry.
 	void emitSignal(GDBusConnection *pBusConnection, const std::string &interfaceName, const std::string &signalName, GVariant *pParameters);
 
 private:
+
+	// Internal method used to generate introspection XML used to describe our services on D-Bus
+	//
+	// The XML is appended to `xml`, indented for the given `depth`.
+	void generateIntrospectionXML(std::string &xml, int depth) const;
+
+	// Returns true if `path` is our path or the path of one of our descendants
+	bool containsPath(const StringKey &path) const;
+
 	bool publish;
 	DBusObjectPath path;
+
+	// Our full path (our parent's full path followed by `path`), built once at construction
+	DBusObjectPath fullPath;
 	InterfaceList interfaces;
-	std::list<DBusObject> children;
+	ChildList children;
 	DBusObject *pParent;
+	bool retired;
+
+	// Our cached introspection (see `getIntrospectionNodeInfo()`) and the size of the XML it was parsed from
+	mutable std::shared_ptr<GDBusNodeInfo> pIntrospectionNodeInfo;
+	mutable size_t introspectionXMLLength;
+
+	// Our cached `GetManagedObjects` entry
+	mutable std::shared_ptr<GVariant> pManagedObjectEntry;
+	mutable bool managedObjectEntryValid;
+	mutable bool managedObjectsSubtreeValid;
 };
 
 }; // namespace ggk
\ No newline at end of file
@@ -0,0 +1,293 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A built-in store of named data values, shared between the application's threads and the server.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// The traditional way for the server to get at the application's data is through the `GGKServerDataGetter` and
+// `GGKServerDataSetter` delegates passed to `ggkStart()`. Those identify values by name, so every access costs a string
+// comparison (or several) in the application. The data store is an optional alternative:
+//
+//     * Values live in named slots. A slot is registered once and from then on is referred to by an integer handle, so there is
+//       no name lookup on the data path.
+//
+//     * Each slot is guarded by a seqlock. A writer bumps the slot's sequence number to an odd value, copies the new value in,
+//       then bumps it back to even. A reader copies the value out and checks that the sequence number was even and unchanged
+//       over the copy, retrying if not. Readers never take a lock and never block writers.
+//
+//     * Slots are cache-line aligned, so unrelated values don't share cache lines between threads.
+//
+//     * A slot can be bound to a characteristic (see `GattCharacteristic::bindDataSlot()`.) Publishing a value to a bound slot
+//       queues that characteristic's update directly, without resolving its path.
+//
+// Concurrent writers to the same slot are serialized by the seqlock itself (a writer waits for the sequence number to become
+// even before claiming it), so any thread may publish. Slot storage is allocated when the slot is registered and never moves.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <thread>
+
+#include "DataStore.h"
+#include "DBusInterface.h"
+#include "GattCharacteristic.h"
+#include "UpdateQueue.h"
+#include "Logger.h"
+
+namespace ggk {
+
+DataStore::DataStore()
+: slotCount(0)
+{
+}
+
+// Allocates (and frees) a store with the alignment its members ask for, which `new` doesn't do for us in C++11 (each instance
+// allocates its own, see Instance.cpp)
+void *DataStore::operator new(size_t size)
+{
+	void *pMemory = nullptr;
+	if (0 != posix_memalign(&pMemory, alignof(DataStore), size))
+	{
+		throw std::bad_alloc();
+	}
+
+	return pMemory;
+}
+
+void DataStore::operator delete(void *pMemory)
+{
+	free(pMemory);
+}
+
+// Registers a slot named `name` that can hold values up to `capacity` bytes and returns its handle
+//
+// If a slot with this name already exists, its handle is returned (its capacity is not changed.)
+//
+// Returns kInvalidHandle if the name is empty, the capacity is out of range or there are no more slots available.
+int DataStore::registerSlot(const std::string &name, size_t capacity)
+{
+	if (name.empty() || capacity == 0 || capacity > kMaxSlotSize)
+	{
+		Logger::warn(SSTR << "Unable to register data slot '" << name << "' with capacity " << capacity);
+		return kInvalidHandle;
+	}
+
+	std::lock_guard<std::mutex> lock(registrationMutex);
+
+	int count = slotCount.load(std::memory_order_relaxed);
+	for (int handle = 0; handle < count; ++handle)
+	{
+		if (slots[handle].name == name)
+		{
+			return handle;
+		}
+	}
+
+	if (count == kMaxSlots)
+	{
+		Logger::warn(SSTR << "Unable to register data slot '" << name << "': all " << kMaxSlots << " slots are in use");
+		return kInvalidHandle;
+	}
+
+	Slot &slot = slots[count];
+	slot.name = name;
+	slot.capacity = capacity;
+	slot.data.reset(new uint8_t[capacity]);
+
+	// Publish the slot only once it's ready
+	slotCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+// Returns the handle of the slot named `name`, or kInvalidHandle if there is no such slot
+int DataStore::findSlot(const std::string &name) const
+{
+	std::lock_guard<std::mutex> lock(registrationMutex);
+
+	int count = slotCount.load(std::memory_order_relaxed);
+	for (int handle = 0; handle < count; ++handle)
+	{
+		if (slots[handle].name == name)
+		{
+			return handle;
+		}
+	}
+
+	return kInvalidHandle;
+}
+
+// Returns the capacity of the slot, or 0 for an invalid handle
+size_t DataStore::getCapacity(int handle) const
+{
+	return isValidHandle(handle) ? slots[handle].capacity : 0;
+}
+
+// Binds the slot to the interface that should be notified when a value is published (see `publish()`)
+void DataStore::bindInterface(int handle, const DBusInterface *pInterface)
+{
+	if (isValidHandle(handle))
+	{
+		slots[handle].pCharacteristic.store(dynamic_cast<const GattCharacteristic *>(pInterface), std::memory_order_release);
+		slots[handle].pInterface.store(pInterface, std::memory_order_release);
+	}
+}
+
+// Returns the number of bytes of memory used by the store, including the storage for each registered slot
+size_t DataStore::getMemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(registrationMutex);
+
+	size_t bytes = sizeof(*this);
+	int count = slotCount.load(std::memory_order_relaxed);
+	for (int handle = 0; handle < count; ++handle)
+	{
+		bytes += slots[handle].capacity + slots[handle].name.capacity();
+	}
+
+	return bytes;
+}
+
+// Stores a copy of a new value in the slot
+//
+// This method is lock-free for readers and may be called from any thread. If the slot is bound to an interface (see
+// `bindInterface()`), that interface is added to the update queue so that its `onUpdatedValue()` is called with the new value.
+// Characteristics that nobody is subscribed to are not queued (there is nobody to notify.)
+//
+// Returns false if the handle is invalid or the value is larger than the slot's capacity.
+bool DataStore::publish(int handle, const void *pData, size_t length)
+{
+	if (!write(handle, pData, length))
+	{
+		return false;
+	}
+
+	const DBusInterface *pInterface = slots[handle].pInterface.load(std::memory_order_acquire);
+	if (nullptr == pInterface)
+	{
+		return true;
+	}
+
+	const GattCharacteristic *pCharacteristic = slots[handle].pCharacteristic.load(std::memory_order_acquire);
+	if (nullptr != pCharacteristic)
+	{
+		pCharacteristic->invalidateReadCache();
+		if (!pCharacteristic->isNotifying())
+		{
+			return true;
+		}
+	}
+
+	if (!TheUpdateQueue.push(pInterface))
+	{
+		Logger::warn(SSTR << "Update queue is full; dropping update for data slot '" << slots[handle].name << "'");
+	}
+
+	return true;
+}
+
+// Stores a copy of a new value in the slot without notifying anybody
+//
+// Returns false if the handle is invalid or the value is larger than the slot's capacity.
+bool DataStore::write(int handle, const void *pData, size_t length)
+{
+	if (!isValidHandle(handle) || (nullptr == pData && length != 0))
+	{
+		return false;
+	}
+
+	Slot &slot = slots[handle];
+	if (length > slot.capacity)
+	{
+		Logger::warn(SSTR << "Value of " << length << " bytes is too large for data slot '" << slot.name << "' (capacity " << slot.capacity << ")");
+		return false;
+	}
+
+	// Claim the slot by moving its sequence from even to odd (waiting out any other writer)
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		if ((sequence & 1) == 0 && slot.sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+		{
+			break;
+		}
+
+		std::this_thread::yield();
+		sequence = slot.sequence.load(std::memory_order_relaxed);
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (length != 0)
+	{
+		memcpy(slot.data.get(), pData, length);
+	}
+	slot.length.store(length, std::memory_order_relaxed);
+
+	// Release the slot
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	return true;
+}
+
+// Copies a consistent snapshot of the slot's value into `pBuffer`
+//
+// This never blocks a writer and is never blocked by one (a read that overlaps a write is simply retried.)
+//
+// Returns the length of the value, or -1 if the handle is invalid or the buffer is too small to hold the value. Slots that
+// have never been written have a length of 0.
+int DataStore::read(int handle, void *pBuffer, size_t bufferSize) const
+{
+	if (!isValidHandle(handle))
+	{
+		return -1;
+	}
+
+	const Slot &slot = slots[handle];
+	for (;;)
+	{
+		uint32_t before = slot.sequence.load(std::memory_order_acquire);
+		if ((before & 1) != 0)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		size_t length = slot.length.load(std::memory_order_relaxed);
+		bool fits = length <= bufferSize;
+		if (fits && length != 0)
+		{
+			memcpy(pBuffer, slot.data.get(), length);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) == before)
+		{
+			return fits ? static_cast<int>(length) : -1;
+		}
+	}
+}
+
+}; // namespace ggk
@@ -0,0 +1,162 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A built-in store of named data values, shared between the application's threads and the server.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of DataStore.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Instance.h"
+
+namespace ggk {
+
+struct DBusInterface;
+struct GattCharacteristic;
+
+struct DataStore
+{
+	// The maximum number of slots that can be registered
+	static const int kMaxSlots = 256;
+
+	// The largest value a slot can hold, in bytes
+	static const size_t kMaxSlotSize = 4096;
+
+	// A handle that refers to no slot
+	static const int kInvalidHandle = -1;
+
+	DataStore();
+
+	// Allocates (and frees) a store with the alignment its members ask for, which `new` doesn't do for us in C++11 (each instance
+	// allocates its own, see Instance.cpp)
+	static void *operator new(size_t size);
+	static void operator delete(void *pMemory);
+
+	//
+	// Registration
+	//
+	// Slots are registered once (typically before the server starts) and are never removed, so a handle stays valid for the
+	// life of the instance.
+	//
+
+	// Registers a slot named `name` that can hold values up to `capacity` bytes and returns its handle
+	//
+	// If a slot with this name already exists, its handle is returned (its capacity is not changed.)
+	//
+	// Returns kInvalidHandle if the name is empty, the capacity is out of range or there are no more slots available.
+	int registerSlot(const std::string &name, size_t capacity);
+
+	// Returns the handle of the slot named `name`, or kInvalidHandle if there is no such slot
+	int findSlot(const std::string &name) const;
+
+	// Returns true if `handle` refers to a registered slot
+	bool isValidHandle(int handle) const { return handle >= 0 && handle < slotCount.load(std::memory_order_acquire); }
+
+	// Returns the capacity of the slot, or 0 for an invalid handle
+	size_t getCapacity(int handle) const;
+
+	// Binds the slot to the interface that should be notified when a value is published (see `publish()`)
+	void bindInterface(int handle, const DBusInterface *pInterface);
+
+	// Returns the number of bytes of memory used by the store, including the storage for each registered slot
+	size_t getMemoryUsage() const;
+
+	//
+	// Values
+	//
+
+	// Stores a copy of a new value in the slot
+	//
+	// This method is lock-free for readers and may be called from any thread. If the slot is bound to an interface (see
+	// `bindInterface()`), that interface is added to the update queue so that its `onUpdatedValue()` is called with the new value.
+	// Characteristics that nobody is subscribed to are not queued (there is nobody to notify.)
+	//
+	// Returns false if the handle is invalid or the value is larger than the slot's capacity.
+	bool publish(int handle, const void *pData, size_t length);
+
+	// Stores a copy of a new value in the slot without notifying anybody
+	//
+	// Returns false if the handle is invalid or the value is larger than the slot's capacity.
+	bool write(int handle, const void *pData, size_t length);
+
+	// Copies a consistent snapshot of the slot's value into `pBuffer`
+	//
+	// This never blocks a writer and is never blocked by one (a read that overlaps a write is simply retried.)
+	//
+	// Returns the length of the value, or -1 if the handle is invalid or the buffer is too small to hold the value. Slots that
+	// have never been written have a length of 0.
+	int read(int handle, void *pBuffer, size_t bufferSize) const;
+
+	// Reads a value of a plain type, returning `defaultValue` if the slot doesn't currently hold a value of exactly that size
+	template<typename T>
+	T readValue(int handle, const T defaultValue) const
+	{
+		T value;
+		return read(handle, &value, sizeof(T)) == static_cast<int>(sizeof(T)) ? value : defaultValue;
+	}
+
+private:
+
+	// A single value, along with the seqlock that guards it
+	//
+	// Each slot sits on its own cache line(s) so that publishing one value never disturbs readers of another.
+	struct alignas(64) Slot
+	{
+		Slot() : sequence(0), length(0), capacity(0), pInterface(nullptr), pCharacteristic(nullptr) {}
+
+		// Odd while a write is in progress
+		std::atomic<uint32_t> sequence;
+		std::atomic<size_t> length;
+		size_t capacity;
+		std::unique_ptr<uint8_t[]> data;
+
+		// The interface we notify on publish and, if that interface is a characteristic, the characteristic itself (so we can check
+		// for subscribers without a cast on every publish)
+		std::atomic<const DBusInterface *> pInterface;
+		std::atomic<const GattCharacteristic *> pCharacteristic;
+		std::string name;
+	};
+
+	Slot slots[kMaxSlots];
+	std::atomic<int> slotCount;
+
+	// Serializes registration (values are never locked)
+	mutable std::mutex registrationMutex;
+};
+
+// The data store of the current instance (see Instance.cpp)
+#define TheDataStore (*ggk::Instance::current().pDataStore)
+
+}; // namespace ggk
@@ -0,0 +1,257 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The scheduler that fires the TickEvents in our server description.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Events (see TickEvent.h) are added to interfaces in the server description through `onEvent()` and `onEventMS()`. Most
+// interfaces have no events at all, so rather than walking the entire object hierarchy on every tick, the scheduler collects the
+// events once (when we are registered with BlueZ, see `start()`) and keeps them in a min-heap ordered by the time each event is
+// next due.
+//
+// A single GLib timeout is armed for the earliest deadline. When it fires, every event that is due is fired and rescheduled for
+// its next period. Events that share a period start together, so they share deadlines and are fired from the same timeout.
+//
+// If an event falls behind (for example, because a callback took longer than the event's period), the missed firings are dropped
+// rather than delivered in a burst.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <algorithm>
+
+#include "EventScheduler.h"
+#include "DBusObject.h"
+#include "DBusInterface.h"
+#include "TickEvent.h"
+#include "Server.h"
+#include "Logger.h"
+#include "MainContext.h"
+
+namespace ggk {
+
+// Returns the current monotonic time in milliseconds
+static gint64 getMonotonicTimeMS()
+{
+	return g_get_monotonic_time() / 1000;
+}
+
+EventScheduler::EventScheduler()
+: running(false), firing(false), refreshPending(false), timerId(0), pConnection(nullptr), pUserData(nullptr)
+{
+}
+
+// Collects the events from every published object in the server description and begins firing them
+//
+// Each event first fires one period after this call. Calling this method while the scheduler is running restarts it.
+//
+// This method must be called from the main loop thread.
+void EventScheduler::start(GDBusConnection *pConnection, void *pUserData)
+{
+	stop();
+
+	this->pConnection = pConnection;
+	this->pUserData = pUserData;
+
+	gint64 nowMS = getMonotonicTimeMS();
+	for (const DBusObject &object : TheServer->getObjects())
+	{
+		if (object.isPublished())
+		{
+			addObjectEvents(object, nowMS);
+		}
+	}
+
+	std::make_heap(schedule.begin(), schedule.end(), isLater);
+	running = true;
+
+	LOG_DEBUG("Scheduling " << schedule.size() << " event(s)");
+	armTimer(nowMS);
+}
+
+// Stops firing events and forgets them
+void EventScheduler::stop()
+{
+	if (0 != timerId)
+	{
+		MainContext::removeSource(timerId);
+		timerId = 0;
+	}
+
+	schedule.clear();
+	running = false;
+}
+
+// Collects the events again after the server description has changed (see `Server::addService()`)
+//
+// Events that were already scheduled keep their deadlines and new events first fire one period after this call. Does
+// nothing if the scheduler isn't running.
+//
+// This method must be called from the main loop thread.
+void EventScheduler::refresh()
+{
+	if (!running)
+	{
+		return;
+	}
+
+	// An event callback changed the description, so we wait until the events that are due have been fired
+	if (firing)
+	{
+		refreshPending = true;
+		return;
+	}
+
+	std::vector<ScheduledEvent> previous;
+	previous.swap(schedule);
+
+	gint64 nowMS = getMonotonicTimeMS();
+	for (const DBusObject &object : TheServer->getObjects())
+	{
+		if (object.isPublished())
+		{
+			addObjectEvents(object, nowMS);
+		}
+	}
+
+	for (ScheduledEvent &scheduled : schedule)
+	{
+		for (const ScheduledEvent &old : previous)
+		{
+			if (old.pEvent == scheduled.pEvent)
+			{
+				scheduled.deadlineMS = old.deadlineMS;
+				break;
+			}
+		}
+	}
+
+	std::make_heap(schedule.begin(), schedule.end(), isLater);
+
+	LOG_DEBUG("Rescheduling " << schedule.size() << " event(s)");
+	if (0 != timerId)
+	{
+		MainContext::removeSource(timerId);
+		timerId = 0;
+	}
+	armTimer(nowMS);
+}
+
+// Adds the events from an object and its children to the schedule
+void EventScheduler::addObjectEvents(const DBusObject &object, gint64 nowMS)
+{
+	for (const std::shared_ptr<DBusInterface> &pInterface : object.getInterfaces())
+	{
+		for (const TickEvent &event : pInterface->getEvents())
+		{
+			if (event.getPeriodMS() <= 0)
+			{
+				Logger::warn(SSTR << "Ignoring event with invalid period (" << event.getPeriodMS() << "ms) at path '" << pInterface->getPath() << "'");
+				continue;
+			}
+
+			schedule.push_back({nowMS + event.getPeriodMS(), pInterface.get(), &event});
+		}
+	}
+
+	for (const DBusObject &child : object.getChildren())
+	{
+		addObjectEvents(child, nowMS);
+	}
+}
+
+// Arms our timer for the earliest deadline in the schedule
+void EventScheduler::armTimer(gint64 nowMS)
+{
+	if (schedule.empty())
+	{
+		return;
+	}
+
+	gint64 delayMS = std::max<gint64>(0, schedule.front().deadlineMS - nowMS);
+	timerId = MainContext::addTimeout(static_cast<guint>(delayMS), onTimer, this);
+}
+
+// Fires every event that is due, then re-arms the timer
+void EventScheduler::fireDueEvents()
+{
+	firing = true;
+
+	gint64 nowMS = getMonotonicTimeMS();
+	while (!schedule.empty() && schedule.front().deadlineMS <= nowMS)
+	{
+		std::pop_heap(schedule.begin(), schedule.end(), isLater);
+		ScheduledEvent entry = schedule.back();
+		schedule.pop_back();
+
+		entry.pInterface->fireEvent(*entry.pEvent, pConnection, pUserData);
+
+		// The callback may have stopped us
+		if (!running)
+		{
+			firing = false;
+			return;
+		}
+
+		// Schedule the next firing, dropping any that we've already missed
+		int periodMS = entry.pEvent->getPeriodMS();
+		entry.deadlineMS += periodMS;
+		if (entry.deadlineMS <= nowMS)
+		{
+			entry.deadlineMS = nowMS + periodMS;
+		}
+
+		schedule.push_back(entry);
+		std::push_heap(schedule.begin(), schedule.end(), isLater);
+	}
+
+	firing = false;
+	if (refreshPending)
+	{
+		refreshPending = false;
+		refresh();
+		return;
+	}
+
+	armTimer(getMonotonicTimeMS());
+}
+
+// Our GLib timeout handler
+gboolean EventScheduler::onTimer(gpointer pUserData)
+{
+	EventScheduler *pScheduler = static_cast<EventScheduler *>(pUserData);
+	pScheduler->timerId = 0;
+
+	// If we're shutting down, don't do anything and stop the scheduler
+	if (ggkGetServerRunState() > ERunning)
+	{
+		pScheduler->stop();
+		return FALSE;
+	}
+
+	pScheduler->fireDueEvents();
+	return FALSE;
+}
+
+}; // namespace ggk
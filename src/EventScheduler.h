@@ -0,0 +1,113 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The scheduler that fires the TickEvents in our server description.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of EventScheduler.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <gio/gio.h>
+#include <vector>
+
+#include "Instance.h"
+
+namespace ggk {
+
+struct DBusObject;
+struct DBusInterface;
+struct TickEvent;
+
+struct EventScheduler
+{
+	EventScheduler();
+
+	// Collects the events from every published object in the server description and begins firing them
+	//
+	// Each event first fires one period after this call. Calling this method while the scheduler is running restarts it.
+	//
+	// This method must be called from the main loop thread.
+	void start(GDBusConnection *pConnection, void *pUserData);
+
+	// Stops firing events and forgets them
+	void stop();
+
+	// Collects the events again after the server description has changed (see `Server::addService()`)
+	//
+	// Events that were already scheduled keep their deadlines and new events first fire one period after this call. Does
+	// nothing if the scheduler isn't running.
+	//
+	// This method must be called from the main loop thread.
+	void refresh();
+
+	// Returns true if the scheduler has been started
+	bool isRunning() const { return running; }
+
+	// Returns the number of events being scheduled
+	size_t getEventCount() const { return schedule.size(); }
+
+private:
+
+	// An event along with the next time it should fire (in monotonic milliseconds)
+	struct ScheduledEvent
+	{
+		gint64 deadlineMS;
+		const DBusInterface *pInterface;
+		const TickEvent *pEvent;
+	};
+
+	// Ordering for our min-heap (the earliest deadline sits at the front)
+	static bool isLater(const ScheduledEvent &lhs, const ScheduledEvent &rhs) { return lhs.deadlineMS > rhs.deadlineMS; }
+
+	// Adds the events from an object and its children to the schedule
+	void addObjectEvents(const DBusObject &object, gint64 nowMS);
+
+	// Arms our timer for the earliest deadline in the schedule
+	void armTimer(gint64 nowMS);
+
+	// Fires every event that is due, then re-arms the timer
+	void fireDueEvents();
+
+	// Our GLib timeout handler
+	static gboolean onTimer(gpointer pUserData);
+
+	std::vector<ScheduledEvent> schedule;
+	bool running;
+
+	// Set while we're firing events (a refresh requested by an event callback is deferred until we're done)
+	bool firing;
+	bool refreshPending;
+	guint timerId;
+	GDBusConnection *pConnection;
+	void *pUserData;
+};
+
+// The event scheduler of the current instance (see Instance.cpp)
+#define TheEventScheduler (*ggk::Instance::current().pEventScheduler)
+
+}; // namespace ggk
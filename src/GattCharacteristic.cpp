@@ -30,8 +30,24 @@
 // A GATT characteristic is the component within the Bluetooth LE standard that holds and serves data over Bluetooth. This class
 // is intended to be used within the server description. For an explanation of how this class is used, see the detailed discussion
 // in Server.cpp.
+//
+// Characteristics also send change notifications (the PropertiesChanged signal) that BlueZ forwards to subscribed clients. Each
+// signal is a separate D-Bus message, so when many values change at once we'd rather not fire them off one at a time while the
+// values are still changing. When notification batching is enabled, notifications are held in a batch until the end of the
+// current main loop cycle (we use an idle source for this, which runs once the main loop has nothing more urgent to do) and then
+// sent together. A characteristic may also be given a minimum notify interval, which holds back notifications that arrive too
+// quickly. A held notification only ever carries the latest value, so neither mechanism can queue up stale values.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+#include <algorithm>
+#include <vector>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glib-unix.h>
+#include <gio/gunixfdlist.h>
+
 #include "GattCharacteristic.h"
 #include "GattDescriptor.h"
 #include "GattProperty.h"
@@ -40,9 +56,73 @@
 #include "GattService.h"
 #include "Utils.h"
 #include "Logger.h"
+#include "Stats.h"
+#include "WorkerPool.h"
+#include "MainContext.h"
+#include "Instance.h"
 
 namespace ggk {
 
+// The largest packet we'll read from an acquired write socket (the largest ATT MTU is 517)
+static const size_t kMaxAcquiredPacketSize = 517;
+
+// The smallest ATT MTU a connection can have
+static const guint16 kMinimumAttMtu = 23;
+
+// Records the MTU BlueZ reports in a method's options for the device making the call (see `HciAdapter::setConnectionMtu()`)
+//
+// The options are always the last of a method's parameters.
+static void recordConnectionMtu(GVariant *pParameters)
+{
+	if (nullptr == pParameters || !g_variant_is_container(pParameters) || g_variant_n_children(pParameters) == 0)
+	{
+		return;
+	}
+
+	GVariant *pOptions = g_variant_get_child_value(pParameters, g_variant_n_children(pParameters) - 1);
+	guint16 mtu = 0;
+	const gchar *pDevice = nullptr;
+	if (g_variant_is_of_type(pOptions, G_VARIANT_TYPE("a{sv}")) && g_variant_lookup(pOptions, "mtu", "q", &mtu) && g_variant_lookup(pOptions, "device", "&o", &pDevice))
+	{
+		HciAdapter::getInstance().setConnectionMtu(pDevice, mtu);
+	}
+	g_variant_unref(pOptions);
+}
+
+// Returns the "mtu" option from an AcquireNotify/AcquireWrite method's parameters, or the minimum ATT MTU if there is none
+static guint16 getAcquireMtu(GVariant *pParameters)
+{
+	guint16 mtu = 23;
+	if (nullptr != pParameters && g_variant_is_of_type(pParameters, G_VARIANT_TYPE("(a{sv})")))
+	{
+		GVariant *pOptions = g_variant_get_child_value(pParameters, 0);
+		g_variant_lookup(pOptions, "mtu", "q", &mtu);
+		g_variant_unref(pOptions);
+	}
+	return mtu;
+}
+
+// Creates the socket pair for an acquired characteristic, handing one end to BlueZ in the method response
+//
+// Returns our end of the socket pair, or -1 on failure (in which case an error has been returned to BlueZ.)
+static int returnAcquiredSocket(GDBusMethodInvocation *pInvocation, guint16 mtu)
+{
+	int fds[2];
+	if (socketpair(AF_LOCAL, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0)
+	{
+		Logger::error(SSTR << "Unable to create socket pair for acquired characteristic: " << strerror(errno));
+		g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.Failed", "Unable to create socket");
+		return -1;
+	}
+
+	// The fd list takes ownership of BlueZ's end
+	GUnixFDList *pFdList = g_unix_fd_list_new_from_array(&fds[1], 1);
+	g_dbus_method_invocation_return_value_with_unix_fd_list(pInvocation, g_variant_new("(hq)", 0, mtu), pFdList);
+	g_object_unref(pFdList);
+
+	return fds[0];
+}
+
 //
 // Standard constructor
 //
@@ -52,10 +132,55 @@ namespace ggk {
 // Genreally speaking, these objects should not be constructed directly. Rather, use the `gattCharacteristicBegin()` method
 // in `GattService`.
 GattCharacteristic::GattCharacteristic(DBusObject &owner, GattService &service, const std::string &name)
-: GattInterface(owner, name), service(service), pOnUpdatedValueFunc(nullptr)
+: GattInterface(owner, name), service(service), pOnUpdatedValueFunc(nullptr), pOnReadValueAsyncFunc(nullptr),
+  pOnWriteValueAsyncFunc(nullptr), notifying(false), minimumNotifyIntervalMS(0),
+  dataSlot(DataStore::kInvalidHandle), pValueBuffer(nullptr), pHeldNotifyValue(nullptr), pHeldNotifyConnection(nullptr),
+  lastNotifyTime(0), notifyTimerId(0), notifyBatched(false), notifyFd(-1), notifyMtu(0), notifyFdSourceId(0), writeFd(-1),
+  writeMtu(0), writeFdSourceId(0), pOnAcquiredWriteFunc(nullptr), pAcquiredWriteUserData(nullptr),
+  pOnAssembledWriteFunc(nullptr), assemblyCapacity(0), assemblyLength(0), assemblyPending(false), pAssemblyConnection(nullptr),
+  pAssemblyUserData(nullptr), assemblyTimerId(0), notifyFraming(ENotifyFramingNone), fragmentSequence(0), packLength(0),
+  pPackConnection(nullptr), packFlushSourceId(0)
 {
 }
 
+GattCharacteristic::~GattCharacteristic()
+{
+	if (0 != notifyTimerId)
+	{
+		MainContext::removeSource(notifyTimerId);
+		notifyTimerId = 0;
+	}
+
+	if (notifyBatched)
+	{
+		std::vector<const GattCharacteristic *> &batchedNotifications = Instance::current().batchedNotifications;
+		batchedNotifications.erase(std::remove(batchedNotifications.begin(), batchedNotifications.end(), this), batchedNotifications.end());
+		notifyBatched = false;
+	}
+
+	if (nullptr != pHeldNotifyValue)
+	{
+		g_variant_unref(pHeldNotifyValue);
+		pHeldNotifyValue = nullptr;
+	}
+
+	if (nullptr != pValueBuffer)
+	{
+		g_bytes_unref(pValueBuffer);
+		pValueBuffer = nullptr;
+	}
+
+	releaseAcquiredNotify();
+	releaseAcquiredWrite();
+	discardAssembledWrite();
+
+	if (0 != packFlushSourceId)
+	{
+		MainContext::removeSource(packFlushSourceId);
+		packFlushSourceId = 0;
+	}
+}
+
 // Returning the owner pops us one level up the hierarchy
 //
 // This method compliments `GattService::gattCharacteristicBegin()`
@@ -65,18 +190,43 @@ GattService &GattCharacteristic::gattCharacteristicEnd()
 }
 
 // Locates a D-Bus method within this D-Bus interface and invokes the method
-bool GattCharacteristic::callMethod(const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
+bool GattCharacteristic::callMethod(const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
 {
-	for (const DBusMethod &method : methods)
+	const DBusMethod *pMethod = findMethod(methodName);
+	if (nullptr == pMethod)
 	{
-		if (methodName == method.getName())
+		return false;
+	}
+
+	// A write changes our value, so whatever we have cached is stale (async and assembled writes change it later, and invalidate
+	// again when they do, see `dispatchAsync()` and `deliverAssembledWrite()`)
+	if (methodName == "WriteValue")
+	{
+		invalidateReadCache();
+	}
+
+	// BlueZ tells us each device's MTU in the options of these methods (see `getNotifyMtu()`)
+	if (methodName == "WriteValue" || methodName == "ReadValue" || methodName == "AcquireNotify" || methodName == "AcquireWrite")
+	{
+		recordConnectionMtu(pParameters);
+	}
+
+	// Serve reads from the cache if we can, otherwise capture what the handler returns
+	if (isReadCacheEnabled() && methodName == "ReadValue")
+	{
+		if (replyFromReadCache(pParameters, pInvocation))
 		{
-			method.call<GattCharacteristic>(pConnection, getPath(), getName(), methodName, pParameters, pInvocation, pUserData);
 			return true;
 		}
+
+		beginReadCapture(pParameters, pInvocation);
+		pMethod->call<GattCharacteristic>(pConnection, getPath(), getName(), pMethod->getName(), pParameters, pInvocation, pUserData);
+		endReadCapture();
+		return true;
 	}
 
-	return false;
+	pMethod->call<GattCharacteristic>(pConnection, getPath(), getName(), pMethod->getName(), pParameters, pInvocation, pUserData);
+	return true;
 }
 
 // Adds an event to the characteristic and returns a refereence to 'this` to enable method chaining in the server description
@@ -85,19 +235,25 @@ bool GattCharacteristic::callMethod(const std::string &methodName, GDBusConnecti
 // TickEvent::Callback type. We also return our own type. This simplifies the server description by allowing call to chain.
 GattCharacteristic &GattCharacteristic::onEvent(int tickFrequency, void *pUserData, EventCallback callback)
 {
-	events.push_back(TickEvent(this, tickFrequency, reinterpret_cast<TickEvent::Callback>(callback), pUserData));
+	events.push_back(TickEvent(this, tickFrequency * TickEvent::kTickPeriodMS, reinterpret_cast<TickEvent::Callback>(callback), pUserData));
+	return *this;
+}
+
+// Adds an event to the characteristic that fires every `periodMS` milliseconds
+//
+// NOTE: Like `onEvent()`, this is overloaded to accept our custom EventCallback type and return our own type.
+GattCharacteristic &GattCharacteristic::onEventMS(int periodMS, void *pUserData, EventCallback callback)
+{
+	events.push_back(TickEvent(this, periodMS, reinterpret_cast<TickEvent::Callback>(callback), pUserData));
 	return *this;
 }
 
-// Ticks events within this characteristic
+// Fires one of this characteristic's events
 //
 // Note: we specifically override this method in order to translate the generic TickEvent::Callback into our own EventCallback
-void GattCharacteristic::tickEvents(GDBusConnection *pConnection, void *pUserData) const
+void GattCharacteristic::fireEvent(const TickEvent &event, GDBusConnection *pConnection, void *pUserData) const
 {
-	for (const TickEvent &event : events)
-	{
-		event.tick<GattCharacteristic>(getPath(), pConnection, pUserData);
-	}
+	event.fire<GattCharacteristic>(getPath(), pConnection, pUserData);
 }
 
 // Specialized support for ReadlValue method
@@ -132,6 +288,264 @@ GattCharacteristic &GattCharacteristic::onWriteValue(MethodCallback callback)
 	return *this;
 }
 
+// Support for a Characteristic ReadValue method whose handler may take a while
+//
+// The handler is run on a worker thread (see WorkerPool.cpp) rather than on the main loop, so it may block without stalling
+// the rest of the server. It answers through `pReply` (see AsyncReply.h), which it may hold on to and complete later from any
+// thread. If every worker is busy and the queue is full, the read is refused with an error without calling the handler.
+//
+// Because it runs on another thread, the handler must not send notifications or touch the server description; anything that
+// needs the main loop can be handed back with `WorkerPool::invokeOnMainContext()`. Async reads are not cached.
+GattCharacteristic &GattCharacteristic::onReadValueAsync(AsyncMethodCallback callback)
+{
+	pOnReadValueAsyncFunc = callback;
+	return onReadValue(asyncMethodTrampoline);
+}
+
+// Support for a Characteristic WriteValue method whose handler may take a while
+//
+// This is the WriteValue counterpart to `onReadValueAsync()`; see that method for details. The reply to a WriteValue carries
+// no value, so the handler should complete with `pReply->returnVariant(nullptr)` (or an error.)
+GattCharacteristic &GattCharacteristic::onWriteValueAsync(AsyncMethodCallback callback)
+{
+	pOnWriteValueAsyncFunc = callback;
+	return onWriteValue(asyncMethodTrampoline);
+}
+
+// The DBusMethod callback for methods added with `onReadValueAsync()` and `onWriteValueAsync()`
+void GattCharacteristic::asyncMethodTrampoline(const GattCharacteristic &self, GDBusConnection */*pConnection*/, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData)
+{
+	AsyncMethodCallback callback = methodName == "ReadValue" ? self.pOnReadValueAsyncFunc : self.pOnWriteValueAsyncFunc;
+	self.dispatchAsync(callback, methodName, pParameters, pInvocation, pUserData);
+}
+
+// Hands a method call to an async handler on the worker pool
+//
+// The reply takes over the invocation right away, so from here on every path (including a refused job) answers through it.
+void GattCharacteristic::dispatchAsync(AsyncMethodCallback callback, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData) const
+{
+	std::shared_ptr<AsyncReply> pReply = std::make_shared<AsyncReply>(pInvocation);
+
+	// An async write changes our value whenever the handler gets around to it, so the invalidation in `callMethod()` may be
+	// followed by a read that caches the old value. The handler replies once the value has changed, so we invalidate again then.
+	if (methodName == "WriteValue")
+	{
+		const GattCharacteristic *pSelf = this;
+		pReply->setCompletionHandler([pSelf]() { pSelf->invalidateReadCache(); });
+	}
+
+	if (nullptr == callback)
+	{
+		pReply->returnError("org.bluez.Error.NotSupported", "No handler for " + methodName);
+		return;
+	}
+
+	// Parameters are immutable and reference counted, so the worker can safely hold on to them
+	std::shared_ptr<GVariant> pSharedParameters(g_variant_ref(pParameters), g_variant_unref);
+	const GattCharacteristic *pSelf = this;
+
+	bool queued = TheWorkerPool.submit([callback, pSelf, methodName, pSharedParameters, pReply, pUserData]()
+	{
+		callback(*pSelf, methodName, pSharedParameters.get(), pReply, pUserData);
+	});
+
+	if (!queued)
+	{
+		pReply->returnError("org.bluez.Error.InProgress", "The server is busy; try again");
+	}
+}
+
+// Support for a Characteristic WriteValue method that reassembles long writes before handing them over
+//
+// A client writes a value longer than its MTU allows in fragments (prepared writes), and BlueZ passes each fragment to
+// WriteValue with an "offset" option. Rather than leave every handler to stitch those together, we copy each fragment in place
+// into a buffer of `capacity` bytes that is allocated here, once, and answer the fragment right away. Once the value is
+// complete, `callback` is called one time with a view of the whole value. The data pointer is only valid for the duration of
+// the call.
+//
+// BlueZ doesn't mark the last fragment, so a value is considered complete when the next value starts (a fragment at offset
+// 0) or when no fragment has arrived for `kAssembledWriteSettleMS`. Writes without response are never fragmented and are
+// delivered immediately, as are writes at offset 0 that are shorter than the largest fragment the MTU allows (mtu - 5), since
+// a client only splits a value it can't send whole. Fragments that leave a gap or overrun `capacity` are refused and the
+// partial value is discarded.
+//
+// The callback is called from the main loop thread, after the write has been answered, so it has no way to fail the write.
+//
+// This method returns a reference to `this` in order to enable chaining inside the server description.
+GattCharacteristic &GattCharacteristic::onAssembledWrite(AssembledWriteCallback callback, size_t capacity)
+{
+	discardAssembledWrite();
+
+	pOnAssembledWriteFunc = callback;
+	pAssemblyBuffer.reset(new guint8[capacity]);
+	assemblyCapacity = capacity;
+	return onWriteValue(assembledWriteTrampoline);
+}
+
+// Returns the "offset" option from a WriteValue method's parameters, or 0 if there is none
+//
+// Handlers set with `onWriteValue()` can use this to place a fragment of a long write. See also `onAssembledWrite()`.
+guint16 GattCharacteristic::getWriteOffset(GVariant *pParameters)
+{
+	guint16 offset = 0;
+	if (nullptr != pParameters && g_variant_is_of_type(pParameters, G_VARIANT_TYPE("(aya{sv})")))
+	{
+		GVariant *pOptions = g_variant_get_child_value(pParameters, 1);
+		g_variant_lookup(pOptions, "offset", "q", &offset);
+		g_variant_unref(pOptions);
+	}
+	return offset;
+}
+
+// The DBusMethod callback for WriteValue methods added with `onAssembledWrite()`
+//
+// Each fragment is answered here, before the value is delivered. A fragment may rewrite part of what we already have, but it
+// may not start beyond the end of it.
+void GattCharacteristic::assembledWriteTrampoline(const GattCharacteristic &self, GDBusConnection *pConnection, const std::string &/*methodName*/, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData)
+{
+	guint16 offset = 0;
+	guint16 mtu = 0;
+	gboolean prepareAuthorize = FALSE;
+	bool isCommand = false;
+
+	GVariant *pOptions = g_variant_get_child_value(pParameters, 1);
+	const gchar *pType = nullptr;
+	g_variant_lookup(pOptions, "offset", "q", &offset);
+	g_variant_lookup(pOptions, "mtu", "q", &mtu);
+	g_variant_lookup(pOptions, "prepare-authorize", "b", &prepareAuthorize);
+	if (g_variant_lookup(pOptions, "type", "&s", &pType))
+	{
+		isCommand = strcmp(pType, "command") == 0;
+	}
+	g_variant_unref(pOptions);
+
+	// BlueZ asks us to authorize each prepared write as it is queued; the data itself arrives again when the writes are executed
+	if (prepareAuthorize)
+	{
+		g_dbus_method_invocation_return_value(pInvocation, nullptr);
+		return;
+	}
+
+	// A fragment at offset 0 starts a new value, so whatever we were holding is complete
+	if (offset == 0)
+	{
+		self.deliverAssembledWrite();
+	}
+
+	GVariant *pValue = g_variant_get_child_value(pParameters, 0);
+	gsize length = 0;
+	const guint8 *pData = static_cast<const guint8 *>(g_variant_get_fixed_array(pValue, &length, 1));
+
+	if (offset > self.assemblyLength)
+	{
+		self.discardAssembledWrite();
+		g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.InvalidOffset", "Write offset is beyond the end of the value");
+		g_variant_unref(pValue);
+		return;
+	}
+
+	if (offset + length > self.assemblyCapacity)
+	{
+		Logger::warn(SSTR << "Write of " << (offset + length) << " bytes is too long for '" << self.getPath() << "' (capacity " << self.assemblyCapacity << ")");
+		self.discardAssembledWrite();
+		g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.InvalidValueLength", "Value is too long");
+		g_variant_unref(pValue);
+		return;
+	}
+
+	if (length != 0)
+	{
+		memcpy(self.pAssemblyBuffer.get() + offset, pData, length);
+	}
+	g_variant_unref(pValue);
+
+	self.assemblyLength = std::max(self.assemblyLength, static_cast<size_t>(offset + length));
+	self.assemblyPending = true;
+	self.pAssemblyConnection = pConnection;
+	self.pAssemblyUserData = pUserData;
+
+	g_dbus_method_invocation_return_value(pInvocation, nullptr);
+
+	// A Prepare Write carries at most mtu - 5 bytes of value, and a client only splits a value that doesn't fit in one, so a
+	// shorter write at offset 0 is the whole value (without an "mtu" option, we can't tell and wait as usual)
+	bool isWhole = offset == 0 && mtu > kAttPrepareWriteHeaderSize && length < static_cast<gsize>(mtu - kAttPrepareWriteHeaderSize);
+
+	if (isCommand || isWhole)
+	{
+		self.deliverAssembledWrite();
+		return;
+	}
+
+	// Wait a little longer for the next fragment
+	if (0 != self.assemblyTimerId)
+	{
+		MainContext::removeSource(self.assemblyTimerId);
+	}
+
+	self.assemblyTimerId = MainContext::addTimeout
+	(
+		kAssembledWriteSettleMS,
+		[](gpointer pUserData) -> gboolean
+		{
+			const GattCharacteristic *pCharacteristic = static_cast<const GattCharacteristic *>(pUserData);
+			pCharacteristic->assemblyTimerId = 0;
+			pCharacteristic->deliverAssembledWrite();
+			return G_SOURCE_REMOVE;
+		},
+		const_cast<GattCharacteristic *>(&self)
+	);
+}
+
+// Hands our assembled value (if any) to our `onAssembledWrite()` callback and starts over with an empty buffer
+void GattCharacteristic::deliverAssembledWrite() const
+{
+	if (!assemblyPending)
+	{
+		return;
+	}
+
+	size_t length = assemblyLength;
+	discardAssembledWrite();
+
+	if (nullptr != pOnAssembledWriteFunc)
+	{
+		pOnAssembledWriteFunc(*this, pAssemblyConnection, pAssemblyBuffer.get(), length, pAssemblyUserData);
+	}
+
+	// The value only changes now, well after the write that started it (see `callMethod()`), so a read in between may have
+	// cached the old one
+	invalidateReadCache();
+}
+
+// Throws away any partially assembled value without delivering it
+void GattCharacteristic::discardAssembledWrite() const
+{
+	if (0 != assemblyTimerId)
+	{
+		MainContext::removeSource(assemblyTimerId);
+		assemblyTimerId = 0;
+	}
+
+	assemblyLength = 0;
+	assemblyPending = false;
+}
+
+// Caches the result of this characteristic's `onReadValue` handler for `milliseconds`
+//
+// While the cached value is fresh, ReadValue methods are answered from the cache without calling the handler. This includes
+// long reads: BlueZ reads a long value in pieces, each with an "offset" option, and each piece is served from the one cached
+// value. Because the cache applies the offset, a handler on a cached characteristic should always return the complete value.
+//
+// The cache is discarded when an update is posted for this characteristic (see `ggkNofifyUpdatedCharacteristic()`), when a client
+// writes to it, or explicitly with `invalidateReadCache()`. Handlers that reply asynchronously are not cached.
+//
+// This method returns a reference to `this` in order to enable chaining inside the server description.
+GattCharacteristic &GattCharacteristic::cacheReadValue(int milliseconds)
+{
+	setReadCacheTTL(milliseconds);
+	return *this;
+}
+
 // Custom support for handling updates to our characteristic's value
 //
 // Defined as: (NOT defined by Bluetooth or BlueZ - this method is internal only)
@@ -172,10 +586,28 @@ bool GattCharacteristic::callOnUpdatedValue(GDBusConnection *pConnection, void *
 		return false;
 	}
 
-	Logger::debug(SSTR << "Calling OnUpdatedValue function for interface at path '" << getPath() << "'");
+	LOG_DEBUG("Calling OnUpdatedValue function for interface at path '" << getPath() << "'");
 	return pOnUpdatedValueFunc(*this, pConnection, pUserData);
 }
 
+// Returns the number of bytes of memory used by this characteristic, including its value and write assembly buffers
+size_t GattCharacteristic::getMemoryUsage() const
+{
+	size_t bytes = GattInterface::getMemoryUsage() + sizeof(GattCharacteristic) - sizeof(GattInterface) + assemblyCapacity;
+	if (nullptr != pPackBuffer)
+	{
+		bytes += kMaxAcquiredPacketSize;
+	}
+
+	std::lock_guard<std::mutex> lock(valueBufferMutex);
+	if (nullptr != pValueBuffer)
+	{
+		bytes += g_bytes_get_size(pValueBuffer);
+	}
+
+	return bytes;
+}
+
 // Convenience functions to add a GATT descriptor to the hierarchy
 //
 // We simply add a new child at the given path and add an interface configured as a GATT descriptor to it. The
@@ -199,26 +631,764 @@ GattDescriptor &GattCharacteristic::gattDescriptorBegin(const std::string &pathE
 {
 	DBusObject &child = owner.addChild(DBusObjectPath(pathElement));
 	GattDescriptor &descriptor = *child.addInterface(std::make_shared<GattDescriptor>(child, *this, "org.bluez.GattDescriptor1"));
-	descriptor.addProperty<GattDescriptor>("UUID", uuid);
+	descriptor.setUuid<GattDescriptor>(uuid);
 	descriptor.addProperty<GattDescriptor>("Characteristic", getPath());
 	descriptor.addProperty<GattDescriptor>("Flags", flags);
 	return descriptor;
 }
 
+// Adds the BlueZ methods used by clients to subscribe to change notifications for this characteristic
+//
+// Defined as: void StartNotify()
+//             void StopNotify()
+//
+// BlueZ calls StartNotify when the first client subscribes to notifications (or indications) and StopNotify when the last
+// client unsubscribes or disconnects. We use these to track whether anybody is listening (see `isNotifying()`) so that we
+// can avoid the work of sending notifications that nobody will receive.
+//
+// This is called automatically by `GattService::gattCharacteristicBegin()` for characteristics with the "notify" or
+// "indicate" flag, so there is generally no need to call it from the server description.
+GattCharacteristic &GattCharacteristic::addNotifyMethods()
+{
+	static const char *inArgs[] = {nullptr};
+
+	MethodCallback startNotify = [](const GattCharacteristic &self, GDBusConnection * /*pConnection*/, const std::string & /*methodName*/, GVariant * /*pParameters*/, GDBusMethodInvocation *pInvocation, void * /*pUserData*/)
+	{
+		self.setNotifying(true);
+		g_dbus_method_invocation_return_value(pInvocation, nullptr);
+	};
+
+	MethodCallback stopNotify = [](const GattCharacteristic &self, GDBusConnection * /*pConnection*/, const std::string & /*methodName*/, GVariant * /*pParameters*/, GDBusMethodInvocation *pInvocation, void * /*pUserData*/)
+	{
+		self.setNotifying(false);
+		g_dbus_method_invocation_return_value(pInvocation, nullptr);
+	};
+
+	addMethod("StartNotify", inArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(startNotify));
+	addMethod("StopNotify", inArgs, nullptr, reinterpret_cast<DBusMethod::Callback>(stopNotify));
+	return *this;
+}
+
+// Adds BlueZ's AcquireNotify method, which lets BlueZ receive this characteristic's notifications over a socket
+//
+// Defined as: fd, uint16 mtu AcquireNotify(dict options)
+//
+// Rather than subscribing with StartNotify, BlueZ may call AcquireNotify and take one end of a socket pair. While a socket is
+// acquired, change notifications are written straight to it instead of being sent as PropertiesChanged signals, and
+// `sendNotificationData()` can write raw values without building a GVariant at all. BlueZ closes the socket when the last
+// client unsubscribes.
+//
+// This is called automatically by `GattService::gattCharacteristicBegin()` for characteristics with the "acquire-notify" flag.
+GattCharacteristic &GattCharacteristic::addAcquireNotify()
+{
+	static const char *inArgs[] = {"a{sv}", nullptr};
+
+	if (nullptr != findMethod("AcquireNotify"))
+	{
+		return *this;
+	}
+
+	MethodCallback acquireNotify = [](const GattCharacteristic &self, GDBusConnection * /*pConnection*/, const std::string & /*methodName*/, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void * /*pUserData*/)
+	{
+		if (self.isNotifyAcquired())
+		{
+			g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.NotPermitted", "Notifications already acquired");
+			return;
+		}
+
+		guint16 mtu = getAcquireMtu(pParameters);
+		int fd = returnAcquiredSocket(pInvocation, mtu);
+		if (fd < 0)
+		{
+			return;
+		}
+
+		// We only need to hear about BlueZ closing its end
+		self.notifyFd = fd;
+		self.notifyMtu = mtu;
+		self.notifyFdSourceId = MainContext::addUnixFd(fd, static_cast<GIOCondition>(G_IO_HUP | G_IO_ERR), onAcquiredNotifySocket, const_cast<GattCharacteristic *>(&self));
+
+		LOG_DEBUG("Notifications acquired (MTU " << mtu << ") for characteristic at path '" << self.getPath() << "'");
+		self.setNotifying(true);
+	};
+
+	addMethod("AcquireNotify", inArgs, "hq", reinterpret_cast<DBusMethod::Callback>(acquireNotify));
+
+	// BlueZ only looks for the presence of this property to decide whether to use AcquireNotify
+	addProperty<GattCharacteristic>("NotifyAcquired", false);
+	return *this;
+}
+
+// Adds BlueZ's AcquireWrite method, which lets BlueZ deliver writes to this characteristic over a socket
+//
+// Defined as: fd, uint16 mtu AcquireWrite(dict options)
+//
+// Each packet BlueZ writes to the socket is passed to the callback set with `onAcquiredWrite()`, with no D-Bus message or
+// options dictionary to unpack. This is typically used with "write-without-response".
+//
+// This is called automatically by `GattService::gattCharacteristicBegin()` for characteristics with the "acquire-write" flag.
+GattCharacteristic &GattCharacteristic::addAcquireWrite()
+{
+	static const char *inArgs[] = {"a{sv}", nullptr};
+
+	if (nullptr != findMethod("AcquireWrite"))
+	{
+		return *this;
+	}
+
+	MethodCallback acquireWrite = [](const GattCharacteristic &self, GDBusConnection * /*pConnection*/, const std::string & /*methodName*/, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void * /*pUserData*/)
+	{
+		if (self.writeFd >= 0)
+		{
+			g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.NotPermitted", "Write already acquired");
+			return;
+		}
+
+		guint16 mtu = getAcquireMtu(pParameters);
+		int fd = returnAcquiredSocket(pInvocation, mtu);
+		if (fd < 0)
+		{
+			return;
+		}
+
+		self.writeFd = fd;
+		self.writeMtu = mtu;
+		self.writeFdSourceId = MainContext::addUnixFd(fd, static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR), onAcquiredWriteSocket, const_cast<GattCharacteristic *>(&self));
+
+		LOG_DEBUG("Write acquired (MTU " << mtu << ") for characteristic at path '" << self.getPath() << "'");
+	};
+
+	addMethod("AcquireWrite", inArgs, "hq", reinterpret_cast<DBusMethod::Callback>(acquireWrite));
+
+	// BlueZ only looks for the presence of this property to decide whether to use AcquireWrite
+	addProperty<GattCharacteristic>("WriteAcquired", false);
+	return *this;
+}
+
+// Sets the callback that receives writes made through an acquired write socket (see `addAcquireWrite()`)
+//
+// The callback is called from the main loop thread. The data pointer is only valid for the duration of the call. If the
+// AcquireWrite method has not been added, this adds it.
+//
+// This method returns a reference to `this` in order to enable chaining inside the server description.
+GattCharacteristic &GattCharacteristic::onAcquiredWrite(AcquiredWriteCallback callback, void *pUserData)
+{
+	pOnAcquiredWriteFunc = callback;
+	pAcquiredWriteUserData = pUserData;
+	return addAcquireWrite();
+}
+
+// Writes a raw value straight to our acquired notification socket
+//
+// This is the fastest way to notify: there is no GVariant, no D-Bus message, and no batching or rate limiting. Returns false
+// if the notification socket is not acquired (use `sendChangeNotificationValue()` in that case) or the write failed.
+//
+// This method must be called from the main loop thread.
+bool GattCharacteristic::sendNotificationData(const void *pData, size_t length) const
+{
+	if (notifyFd < 0)
+	{
+		return false;
+	}
+
+	if (send(notifyFd, pData, length, MSG_NOSIGNAL) < 0)
+	{
+		// A full socket means BlueZ isn't keeping up; like a notification lost over the air, this one is simply dropped
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			Logger::warn(SSTR << "Acquired notification socket is full; dropping notification for '" << getPath() << "'");
+			TheStats.notificationsDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		Logger::warn(SSTR << "Unable to write to acquired notification socket for '" << getPath() << "': " << strerror(errno));
+		TheStats.notificationsDropped.fetch_add(1, std::memory_order_relaxed);
+		releaseAcquiredNotify();
+		setNotifying(false);
+		return false;
+	}
+
+	TheStats.notificationsSent.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+// Main loop handler for our acquired notification socket
+//
+// We never read from this socket; we only watch it to learn when BlueZ closes its end (the last client has unsubscribed.)
+gboolean GattCharacteristic::onAcquiredNotifySocket(gint /*fd*/, GIOCondition /*condition*/, gpointer pUserData)
+{
+	const GattCharacteristic *pSelf = static_cast<const GattCharacteristic *>(pUserData);
+
+	LOG_DEBUG("Acquired notifications released for characteristic at path '" << pSelf->getPath() << "'");
+
+	// Returning G_SOURCE_REMOVE removes the watch, so make sure we don't remove it again
+	pSelf->notifyFdSourceId = 0;
+	pSelf->releaseAcquiredNotify();
+	pSelf->setNotifying(false);
+	return G_SOURCE_REMOVE;
+}
+
+// Main loop handler for our acquired write socket
+//
+// Each packet BlueZ writes is one ATT write, which we pass along to our `onAcquiredWrite()` callback.
+gboolean GattCharacteristic::onAcquiredWriteSocket(gint fd, GIOCondition condition, gpointer pUserData)
+{
+	const GattCharacteristic *pSelf = static_cast<const GattCharacteristic *>(pUserData);
+
+	if ((condition & G_IO_IN) != 0)
+	{
+		guint8 buffer[kMaxAcquiredPacketSize];
+		for (;;)
+		{
+			ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+			if (length > 0)
+			{
+				if (nullptr != pSelf->pOnAcquiredWriteFunc)
+				{
+					pSelf->pOnAcquiredWriteFunc(*pSelf, buffer, static_cast<size_t>(length), pSelf->pAcquiredWriteUserData);
+				}
+				else
+				{
+					Logger::warn(SSTR << "No onAcquiredWrite callback; dropping write to '" << pSelf->getPath() << "'");
+				}
+				continue;
+			}
+
+			// No more packets for now
+			if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			{
+				break;
+			}
+
+			// End of stream or a socket error; either way, we're done with this socket
+			condition = static_cast<GIOCondition>(condition | G_IO_HUP);
+			break;
+		}
+	}
+
+	if ((condition & (G_IO_HUP | G_IO_ERR)) != 0)
+	{
+		LOG_DEBUG("Acquired write released for characteristic at path '" << pSelf->getPath() << "'");
+
+		// Returning G_SOURCE_REMOVE removes the watch, so make sure we don't remove it again
+		pSelf->writeFdSourceId = 0;
+		pSelf->releaseAcquiredWrite();
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+// Closes our acquired notification socket (and removes its main loop watch)
+void GattCharacteristic::releaseAcquiredNotify() const
+{
+	if (0 != notifyFdSourceId)
+	{
+		MainContext::removeSource(notifyFdSourceId);
+		notifyFdSourceId = 0;
+	}
+
+	if (notifyFd >= 0)
+	{
+		close(notifyFd);
+		notifyFd = -1;
+	}
+}
+
+// Closes our acquired write socket (and removes its main loop watch)
+void GattCharacteristic::releaseAcquiredWrite() const
+{
+	if (0 != writeFdSourceId)
+	{
+		MainContext::removeSource(writeFdSourceId);
+		writeFdSourceId = 0;
+	}
+
+	if (writeFd >= 0)
+	{
+		close(writeFd);
+		writeFd = -1;
+	}
+}
+
+// Sets the subscription state of this characteristic
+//
+// This is called by our framework in response to the StartNotify and StopNotify methods (see `addNotifyMethods()`.)
+void GattCharacteristic::setNotifying(bool enabled) const
+{
+	LOG_DEBUG("Notifications " << (enabled ? "started" : "stopped") << " for characteristic at path '" << getPath() << "'");
+	notifying.store(enabled, std::memory_order_release);
+
+	// Nobody is listening any more, so there's no point in holding on to a notification
+	if (!enabled && nullptr != pHeldNotifyValue)
+	{
+		g_variant_unref(pHeldNotifyValue);
+		pHeldNotifyValue = nullptr;
+	}
+}
+
+// Sets the minimum interval between change notifications sent for this characteristic
+//
+// Change notifications sent more frequently than this are held back. When the interval expires, only the most recent value is
+// sent. This prevents a high-frequency sensor from flooding the bus. A value of 0 (the default) disables rate limiting.
+//
+// This method returns a reference to `this` in order to enable chaining inside the server description.
+GattCharacteristic &GattCharacteristic::setMinimumNotifyInterval(int milliseconds)
+{
+	minimumNotifyIntervalMS = milliseconds > 0 ? milliseconds : 0;
+	return *this;
+}
+
+// Binds this characteristic to a slot in the data store (see DataStore.cpp)
+//
+// The slot is registered with `capacity` bytes if it does not already exist. Once bound, publishing a value to the slot (see
+// `ggkPublish()`) queues this characteristic's `onUpdatedValue()` callback directly, without resolving its object path, and
+// the characteristic's callbacks can read the value with `getSlotValue()` or `getDataSlotVariant()`.
+//
+// This method returns a reference to `this` in order to enable chaining inside the server description.
+GattCharacteristic &GattCharacteristic::bindDataSlot(const std::string &name, size_t capacity)
+{
+	dataSlot = TheDataStore.registerSlot(name, capacity);
+	if (DataStore::kInvalidHandle == dataSlot)
+	{
+		Logger::error(SSTR << "Unable to bind characteristic " << getPath().toString() << " to data slot '" << name << "'");
+		return *this;
+	}
+
+	TheDataStore.bindInterface(dataSlot, this);
+	return *this;
+}
+
+// Returns the value of our bound data slot as a floating "ay" GVariant, or nullptr if no slot is bound
+GVariant *GattCharacteristic::getDataSlotVariant() const
+{
+	size_t capacity = TheDataStore.getCapacity(dataSlot);
+	if (0 == capacity)
+	{
+		return nullptr;
+	}
+
+	// Read straight into the storage that the GVariant will own
+	guint8 *pBuffer = static_cast<guint8 *>(g_malloc(capacity));
+	int length = TheDataStore.read(dataSlot, pBuffer, capacity);
+	if (length < 0)
+	{
+		g_free(pBuffer);
+		return nullptr;
+	}
+
+	GBytes *pBytes = g_bytes_new_take(pBuffer, length);
+	GVariant *pVariant = Utils::gvariantFromBytes(pBytes);
+	g_bytes_unref(pBytes);
+	return pVariant;
+}
+
+// Replaces this characteristic's shared value buffer
+//
+// The value buffer is an optional, reference-counted copy of the characteristic's current value. It is intended for large
+// values (firmware chunks, log dumps, etc.) where copying on every read and notification adds up: `methodReturnBytes()` and
+// `sendChangeNotificationBytes()` hand the buffer to D-Bus without copying it.
+//
+// We take our own reference to `pBytes` (pass nullptr to clear the buffer.) This method may be called from any thread.
+void GattCharacteristic::setValueBuffer(GBytes *pBytes) const
+{
+	if (nullptr != pBytes)
+	{
+		g_bytes_ref(pBytes);
+	}
+
+	GBytes *pOldBuffer;
+	{
+		std::lock_guard<std::mutex> lock(valueBufferMutex);
+		pOldBuffer = pValueBuffer;
+		pValueBuffer = pBytes;
+	}
+
+	if (nullptr != pOldBuffer)
+	{
+		g_bytes_unref(pOldBuffer);
+	}
+}
+
+// Returns a new reference to this characteristic's shared value buffer, or nullptr if none has been set
+//
+// The caller must release the reference with `g_bytes_unref()`. This method may be called from any thread.
+GBytes *GattCharacteristic::getValueBuffer() const
+{
+	std::lock_guard<std::mutex> lock(valueBufferMutex);
+	return nullptr == pValueBuffer ? nullptr : g_bytes_ref(pValueBuffer);
+}
+
+// Responds to a ReadValue method with the contents of our shared value buffer (see `setValueBuffer()`), without copying it
+//
+// If no buffer has been set, an empty array is returned.
+void GattCharacteristic::methodReturnValueBuffer(GDBusMethodInvocation *pInvocation) const
+{
+	GBytes *pBytes = getValueBuffer();
+	if (nullptr == pBytes)
+	{
+		methodReturnVariant(pInvocation, g_variant_new("ay", nullptr), true);
+		return;
+	}
+
+	methodReturnBytes(pInvocation, pBytes, true);
+	g_bytes_unref(pBytes);
+}
+
 // Sends a change notification to subscribers to this characteristic
 //
 // This is a generalized method that accepts a `GVariant *`. A templated version is available that supports common types called
 // `sendChangeNotificationValue()`.
 //
-// The caller may choose to consult HciAdapter::getInstance().getActiveConnectionCount() in order to determine if there are any
-// active connections before sending a change notification.
+// If notification batching is enabled (see `Server::getEnableNotificationBatching()`), the notification is held until the end
+// of the current main loop cycle and sent along with all other notifications from that cycle. If the minimum notify interval
+// has not elapsed since the last notification (see `setMinimumNotifyInterval()`), the notification is held until it has. In
+// either case, if the value changes again while the notification is held, only the latest value is sent.
+//
+// If no client is subscribed to this characteristic (see `isNotifying()`), this method does nothing other than release the
+// value.
+//
+// This method must be called from the main loop thread, which is where all of our callbacks are made.
 void GattCharacteristic::sendChangeNotificationVariant(GDBusConnection *pBusConnection, GVariant *pNewValue) const
 {
+	// Nobody is listening
+	if (!isNotifying())
+	{
+		g_variant_unref(g_variant_ref_sink(pNewValue));
+		return;
+	}
+
+	bool batching = nullptr != TheServer && TheServer->getEnableNotificationBatching();
+
+	// The simple case: no batching, no rate limit and nothing held, so just send it
+	if (!batching && 0 == minimumNotifyIntervalMS && nullptr == pHeldNotifyValue)
+	{
+		emitChangeNotification(pBusConnection, pNewValue);
+		lastNotifyTime = g_get_monotonic_time();
+		return;
+	}
+
+	// Hold on to the latest value, replacing any value that was waiting to be sent
+	GVariant *pValue = g_variant_ref_sink(pNewValue);
+	if (nullptr != pHeldNotifyValue)
+	{
+		g_variant_unref(pHeldNotifyValue);
+		TheStats.notificationsCoalesced.fetch_add(1, std::memory_order_relaxed);
+	}
+	pHeldNotifyValue = pValue;
+	pHeldNotifyConnection = pBusConnection;
+
+	scheduleChangeNotification();
+}
+
+// Sends a change notification to subscribers to this characteristic with the contents of a GBytes buffer, without copying it
+//
+// The caller keeps its reference to `pBytes`. See `sendChangeNotificationVariant()` for details on batching and rate limiting.
+void GattCharacteristic::sendChangeNotificationBytes(GDBusConnection *pBusConnection, GBytes *pBytes) const
+{
+	if (!isNotifying())
+	{
+		return;
+	}
+
+	sendChangeNotificationVariant(pBusConnection, Utils::gvariantFromBytes(pBytes));
+}
+
+// Sends a change notification right away, bypassing batching and rate limiting
+//
+// Held notifications only ever carry the latest value, which is wrong for a stream in which every value matters (see
+// BulkTransfer.cpp.) Each call to this method sends its own notification, through our acquired notification socket if there
+// is one. Returns false if nobody is subscribed or the notification could not be sent (for example, because the acquired
+// socket is full.)
+//
+// This method must be called from the main loop thread.
+bool GattCharacteristic::sendChangeNotificationNow(GDBusConnection *pBusConnection, const guint8 *pData, size_t length) const
+{
+	if (!isNotifying())
+	{
+		return false;
+	}
+
+	if (notifyFd >= 0)
+	{
+		return sendNotificationData(pData, length);
+	}
+
+	emitChangeNotification(pBusConnection, Utils::gvariantFromByteArray(pData, static_cast<int>(length)));
+	return true;
+}
+
+// Returns the ATT MTU our change notifications must fit
+//
+// If BlueZ has acquired our notifications, this is the MTU it gave us then. Otherwise it is the smallest MTU reported for any
+// connected device (see `HciAdapter::setConnectionMtu()`), or the minimum ATT MTU (23) if we don't know. A notification
+// carries up to MTU - 3 bytes.
+guint16 GattCharacteristic::getNotifyMtu() const
+{
+	guint16 mtu = notifyFd >= 0 ? notifyMtu : HciAdapter::getInstance().getMinimumConnectionMtu();
+	return std::min(std::max(mtu, kMinimumAttMtu), static_cast<guint16>(kMaxAcquiredPacketSize));
+}
+
+// Sets how values sent with `sendFramedNotification()` are split or combined to fit the MTU
+//
+//     ENotifyFramingNone     - Each value is sent as it is, as with `sendChangeNotificationVariant()`. BlueZ truncates
+//                              values that don't fit the MTU.
+//     ENotifyFramingFragment - Each value is split across as many notifications as it takes. Each notification starts with
+//                              a header byte (see kFragmentStart, kFragmentEnd and kFragmentSequenceMask) so the client can
+//                              put the value back together and spot a lost notification.
+//     ENotifyFramingPack     - Values are records, each sent as a length byte followed by the record. Records are packed
+//                              together until the next one won't fit or the current main loop cycle ends, then sent as one
+//                              notification. Records may be up to min(255, MTU - 4) bytes long.
+//
+// This method returns a reference to `this` in order to enable chaining inside the server description.
+GattCharacteristic &GattCharacteristic::setNotifyFraming(NotifyFraming framing)
+{
+	notifyFraming = framing;
+	if (framing == ENotifyFramingPack && nullptr == pPackBuffer)
+	{
+		pPackBuffer.reset(new guint8[kMaxAcquiredPacketSize]);
+	}
+	return *this;
+}
+
+// Sends a value to subscribers, framed as set by `setNotifyFraming()`
+//
+// Fragments and packed records are sent without batching or rate limiting (see `sendChangeNotificationNow()`), since every
+// one of them matters. Returns false if nobody is subscribed, a packed record is too long or a notification could not be sent.
+//
+// This method must be called from the main loop thread.
+bool GattCharacteristic::sendFramedNotification(GDBusConnection *pBusConnection, const guint8 *pData, size_t length) const
+{
+	if (!isNotifying())
+	{
+		return false;
+	}
+
+	size_t capacity = getNotifyMtu() - 3;
+
+	if (notifyFraming == ENotifyFramingNone)
+	{
+		sendChangeNotificationVariant(pBusConnection, Utils::gvariantFromByteArray(pData, static_cast<int>(length)));
+		return true;
+	}
+
+	if (notifyFraming == ENotifyFramingFragment)
+	{
+		// Each fragment carries a header byte, and even an empty value is sent as one (empty) fragment
+		size_t payloadSize = capacity - 1;
+		guint8 frame[kMaxAcquiredPacketSize];
+		size_t offset = 0;
+		do
+		{
+			size_t fragmentLength = std::min(payloadSize, length - offset);
+			guint8 header = fragmentSequence++ & kFragmentSequenceMask;
+			if (offset == 0) { header |= kFragmentStart; }
+			if (offset + fragmentLength == length) { header |= kFragmentEnd; }
+
+			frame[0] = header;
+			if (fragmentLength != 0)
+			{
+				memcpy(frame + 1, pData + offset, fragmentLength);
+			}
+
+			if (!sendChangeNotificationNow(pBusConnection, frame, fragmentLength + 1))
+			{
+				return false;
+			}
+
+			offset += fragmentLength;
+		} while (offset < length);
+
+		return true;
+	}
+
+	// ENotifyFramingPack
+	if (length > 255 || length + 1 > capacity)
+	{
+		Logger::warn(SSTR << "Record of " << length << " bytes is too long to pack into a notification for '" << getPath() << "'");
+		return false;
+	}
+
+	// Make room for this record by sending the ones before it
+	if (packLength + length + 1 > capacity)
+	{
+		bool sent = sendChangeNotificationNow(pPackConnection, pPackBuffer.get(), packLength);
+		packLength = 0;
+		if (!sent)
+		{
+			return false;
+		}
+	}
+
+	pPackBuffer[packLength] = static_cast<guint8>(length);
+	if (length != 0)
+	{
+		memcpy(pPackBuffer.get() + packLength + 1, pData, length);
+	}
+	packLength += length + 1;
+	pPackConnection = pBusConnection;
+
+	if (0 == packFlushSourceId)
+	{
+		packFlushSourceId = MainContext::addIdle
+		(
+			[](gpointer pUserData) -> gboolean
+			{
+				const GattCharacteristic *pCharacteristic = static_cast<const GattCharacteristic *>(pUserData);
+
+				// The source is removed by returning G_SOURCE_REMOVE, so forget its ID before flushing
+				pCharacteristic->packFlushSourceId = 0;
+				pCharacteristic->flushPackedNotification();
+				return G_SOURCE_REMOVE;
+			},
+			const_cast<GattCharacteristic *>(this)
+		);
+	}
+
+	return true;
+}
+
+// Sends the records waiting to be packed into a notification (see ENotifyFramingPack), if there are any
+//
+// This is called automatically at the end of the main loop cycle. It is public only so that records can be flushed explicitly.
+void GattCharacteristic::flushPackedNotification() const
+{
+	if (0 != packFlushSourceId)
+	{
+		MainContext::removeSource(packFlushSourceId);
+		packFlushSourceId = 0;
+	}
+
+	if (packLength == 0)
+	{
+		return;
+	}
+
+	sendChangeNotificationNow(pPackConnection, pPackBuffer.get(), packLength);
+	packLength = 0;
+}
+
+// Sends all change notifications that are being held until the end of the current main loop cycle
+//
+// This is called automatically from the main loop. It is public only so that pending notifications can be flushed explicitly.
+void GattCharacteristic::flushBatchedChangeNotifications()
+{
+	Instance &instance = Instance::current();
+	if (0 != instance.batchFlushSourceId)
+	{
+		MainContext::removeSource(instance.batchFlushSourceId);
+		instance.batchFlushSourceId = 0;
+	}
+
+	// Take the batch, in case any of these notifications cause new ones to be batched
+	std::vector<const GattCharacteristic *> batch;
+	batch.swap(instance.batchedNotifications);
+
+	LOG_DEBUG("Flushing " << batch.size() << " batched change notification(s)");
+
+	for (const GattCharacteristic *pCharacteristic : batch)
+	{
+		pCharacteristic->notifyBatched = false;
+		pCharacteristic->flushChangeNotification();
+	}
+}
+
+// Arranges for our held change notification to be sent, taking batching and rate limiting into account
+void GattCharacteristic::scheduleChangeNotification() const
+{
+	// Already on its way; the held value has been updated, so the latest value will be sent
+	if (notifyBatched || 0 != notifyTimerId)
+	{
+		return;
+	}
+
+	// If we're rate limited, wait until our interval has elapsed
+	if (minimumNotifyIntervalMS > 0 && 0 != lastNotifyTime)
+	{
+		gint64 earliest = lastNotifyTime + static_cast<gint64>(minimumNotifyIntervalMS) * 1000;
+		gint64 now = g_get_monotonic_time();
+		if (now < earliest)
+		{
+			guint delayMS = static_cast<guint>((earliest - now + 999) / 1000);
+			notifyTimerId = MainContext::addTimeout
+			(
+				delayMS,
+				[](gpointer pUserData) -> gboolean
+				{
+					const GattCharacteristic *pCharacteristic = static_cast<const GattCharacteristic *>(pUserData);
+					pCharacteristic->notifyTimerId = 0;
+					pCharacteristic->scheduleChangeNotification();
+					return G_SOURCE_REMOVE;
+				},
+				const_cast<GattCharacteristic *>(this)
+			);
+			return;
+		}
+	}
+
+	// Without batching, the notification goes out immediately
+	if (nullptr == TheServer || !TheServer->getEnableNotificationBatching())
+	{
+		flushChangeNotification();
+		return;
+	}
+
+	// Join the batch for this main loop cycle
+	Instance &instance = Instance::current();
+	notifyBatched = true;
+	instance.batchedNotifications.push_back(this);
+
+	if (0 == instance.batchFlushSourceId)
+	{
+		instance.batchFlushSourceId = MainContext::addIdle
+		(
+			[](gpointer /*pUserData*/) -> gboolean
+			{
+				// The source is removed by returning G_SOURCE_REMOVE, so forget its ID before flushing
+				Instance::current().batchFlushSourceId = 0;
+				flushBatchedChangeNotifications();
+				return G_SOURCE_REMOVE;
+			},
+			nullptr
+		);
+	}
+}
+
+// Sends our held change notification (if any) immediately
+void GattCharacteristic::flushChangeNotification() const
+{
+	if (nullptr == pHeldNotifyValue)
+	{
+		return;
+	}
+
+	GVariant *pValue = pHeldNotifyValue;
+	pHeldNotifyValue = nullptr;
+
+	emitChangeNotification(pHeldNotifyConnection, pValue);
+	lastNotifyTime = g_get_monotonic_time();
+
+	g_variant_unref(pValue);
+}
+
+// Emits the PropertiesChanged signal carrying our new value (or writes it to our acquired notification socket)
+void GattCharacteristic::emitChangeNotification(GDBusConnection *pBusConnection, GVariant *pNewValue) const
+{
+	// BlueZ has acquired our notifications, so skip D-Bus entirely
+	if (notifyFd >= 0)
+	{
+		GVariant *pValue = g_variant_ref_sink(pNewValue);
+		sendNotificationData(g_variant_get_data(pValue), g_variant_get_size(pValue));
+		g_variant_unref(pValue);
+		return;
+	}
+
 	g_auto(GVariantBuilder) builder;
 	g_variant_builder_init(&builder, G_VARIANT_TYPE_ARRAY);
 	g_variant_builder_add(&builder, "{sv}", "Value", pNewValue);
 	GVariant *pSasv = g_variant_new("(sa{sv})", "org.bluez.GattCharacteristic1", &builder);
 	owner.emitSignal(pBusConnection, "org.freedesktop.DBus.Properties", "PropertiesChanged", pSasv);
+	TheStats.notificationsSent.fetch_add(1, std::memory_order_relaxed);
 }
 
 }; // namespace ggk
\ No newline at end of file
@@ -36,11 +36,16 @@
 #include <gio/gio.h>
 #include <string>
 #include <list>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #include "Utils.h"
+#include "AsyncReply.h"
 #include "TickEvent.h"
 #include "GattInterface.h"
 #include "HciAdapter.h"
+#include "DataStore.h"
 
 namespace ggk {
 
@@ -84,6 +89,24 @@ struct DBusObject;
        void *pUserData \
 )
 
+#define CHARACTERISTIC_ASYNC_METHOD_CALLBACK_LAMBDA [] \
+( \
+	const GattCharacteristic &self, \
+	const std::string &methodName, \
+	GVariant *pParameters, \
+	std::shared_ptr<AsyncReply> pReply, \
+	void *pUserData \
+)
+
+#define CHARACTERISTIC_ASSEMBLED_WRITE_CALLBACK_LAMBDA [] \
+( \
+	const GattCharacteristic &self, \
+	GDBusConnection *pConnection, \
+	const guint8 *pData, \
+	size_t length, \
+	void *pUserData \
+)
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 // Representation of a Bluetooth GATT Characteristic
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -96,13 +119,39 @@ struct GattCharacteristic : GattInterface
 	typedef void (*MethodCallback)(const GattCharacteristic &self, GDBusConnection *pConnection, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData);
 	typedef void (*EventCallback)(const GattCharacteristic &self, const TickEvent &event, GDBusConnection *pConnection, void *pUserData);
 	typedef bool (*UpdatedValueCallback)(const GattCharacteristic &self, GDBusConnection *pConnection, void *pUserData);
+	typedef void (*AcquiredWriteCallback)(const GattCharacteristic &self, const guint8 *pData, size_t length, void *pUserData);
+	typedef void (*AsyncMethodCallback)(const GattCharacteristic &self, const std::string &methodName, GVariant *pParameters, std::shared_ptr<AsyncReply> pReply, void *pUserData);
+	typedef void (*AssembledWriteCallback)(const GattCharacteristic &self, GDBusConnection *pConnection, const guint8 *pData, size_t length, void *pUserData);
+
+	// The longest value an attribute may hold, per the Bluetooth Core Specification
+	static const size_t kMaxAttributeValueLength = 512;
+
+	// How change notifications sent with `sendFramedNotification()` are framed (see `setNotifyFraming()`)
+	enum NotifyFraming
+	{
+		ENotifyFramingNone,
+		ENotifyFramingFragment,
+		ENotifyFramingPack
+	};
+
+	// The header byte of each notification sent with ENotifyFramingFragment: start and end flags and a 6-bit sequence number
+	static const guint8 kFragmentStart = 0x80;
+	static const guint8 kFragmentEnd = 0x40;
+	static const guint8 kFragmentSequenceMask = 0x3f;
+
+	// How long (in milliseconds) an assembled write waits for another fragment before it is delivered (see `onAssembledWrite()`)
+	static const int kAssembledWriteSettleMS = 20;
+
+	// The bytes of an ATT Prepare Write Request that aren't value (opcode, handle and offset), so a fragment of a long write
+	// carries at most mtu - 5 bytes of value
+	static const int kAttPrepareWriteHeaderSize = 5;
 
 	// Construct a GattCharacteristic
 	//
 	// Genreally speaking, these objects should not be constructed directly. Rather, use the `gattCharacteristicBegin()` method
 	// in `GattService`.
 	GattCharacteristic(DBusObject &owner, GattService &service, const std::string &name);
-	virtual ~GattCharacteristic() {}
+	virtual ~GattCharacteristic();
 
 	// Returns a string identifying the type of interface
 	virtual const std::string getInterfaceType() const { return GattCharacteristic::kInterfaceType; }
@@ -112,8 +161,11 @@ struct GattCharacteristic : GattInterface
 	// This method compliments `GattService::gattCharacteristicBegin()`
 	GattService &gattCharacteristicEnd();
 
+	// Returns the service this characteristic belongs to
+	const GattService &getService() const { return service; }
+
 	// Locates a D-Bus method within this D-Bus interface and invokes the method
-	virtual bool callMethod(const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
+	virtual bool callMethod(const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
 
 	// Adds an event to the characteristic and returns a refereence to 'this` to enable method chaining in the server description
 	//
@@ -121,10 +173,15 @@ struct GattCharacteristic : GattInterface
 	// TickEvent::Callback type. We also return our own type. This simplifies the server description by allowing call to chain.
 	GattCharacteristic &onEvent(int tickFrequency, void *pUserData, EventCallback callback);
 
-	// Ticks events within this characteristic
+	// Adds an event to the characteristic that fires every `periodMS` milliseconds
+	//
+	// NOTE: Like `onEvent()`, this is overloaded to accept our custom EventCallback type and return our own type.
+	GattCharacteristic &onEventMS(int periodMS, void *pUserData, EventCallback callback);
+
+	// Fires one of this characteristic's events
 	//
 	// Note: we specifically override this method in order to translate the generic TickEvent::Callback into our own EventCallback
-	virtual void tickEvents(GDBusConnection *pConnection, void *pUserData) const;
+	virtual void fireEvent(const TickEvent &event, GDBusConnection *pConnection, void *pUserData) const;
 
 	// Specialized support for Characteristic ReadlValue method
 	//
@@ -147,6 +204,58 @@ struct GattCharacteristic : GattInterface
 	//     Output args: void
 	GattCharacteristic &onWriteValue(MethodCallback callback);
 
+	// Support for a Characteristic ReadValue method whose handler may take a while
+	//
+	// The handler is run on a worker thread (see WorkerPool.cpp) rather than on the main loop, so it may block without stalling
+	// the rest of the server. It answers through `pReply` (see AsyncReply.h), which it may hold on to and complete later from any
+	// thread. If every worker is busy and the queue is full, the read is refused with an error without calling the handler.
+	//
+	// Because it runs on another thread, the handler must not send notifications or touch the server description; anything that
+	// needs the main loop can be handed back with `WorkerPool::invokeOnMainContext()`. Async reads are not cached.
+	GattCharacteristic &onReadValueAsync(AsyncMethodCallback callback);
+
+	// Support for a Characteristic WriteValue method whose handler may take a while
+	//
+	// This is the WriteValue counterpart to `onReadValueAsync()`; see that method for details. The reply to a WriteValue carries
+	// no value, so the handler should complete with `pReply->returnVariant(nullptr)` (or an error.)
+	GattCharacteristic &onWriteValueAsync(AsyncMethodCallback callback);
+
+	// Support for a Characteristic WriteValue method that reassembles long writes before handing them over
+	//
+	// A client writes a value longer than its MTU allows in fragments (prepared writes), and BlueZ passes each fragment to
+	// WriteValue with an "offset" option. Rather than leave every handler to stitch those together, we copy each fragment in place
+	// into a buffer of `capacity` bytes that is allocated here, once, and answer the fragment right away. Once the value is
+	// complete, `callback` is called one time with a view of the whole value. The data pointer is only valid for the duration of
+	// the call.
+	//
+	// BlueZ doesn't mark the last fragment, so a value is considered complete when the next value starts (a fragment at offset
+	// 0) or when no fragment has arrived for `kAssembledWriteSettleMS`. Writes without response are never fragmented and are
+	// delivered immediately, as are writes at offset 0 that are shorter than the largest fragment the MTU allows (mtu - 5), since
+	// a client only splits a value it can't send whole. Fragments that leave a gap or overrun `capacity` are refused and the
+	// partial value is discarded.
+	//
+	// The callback is called from the main loop thread, after the write has been answered, so it has no way to fail the write.
+	//
+	// This method returns a reference to `this` in order to enable chaining inside the server description.
+	GattCharacteristic &onAssembledWrite(AssembledWriteCallback callback, size_t capacity = kMaxAttributeValueLength);
+
+	// Returns the "offset" option from a WriteValue method's parameters, or 0 if there is none
+	//
+	// Handlers set with `onWriteValue()` can use this to place a fragment of a long write. See also `onAssembledWrite()`.
+	static guint16 getWriteOffset(GVariant *pParameters);
+
+	// Caches the result of this characteristic's `onReadValue` handler for `milliseconds`
+	//
+	// While the cached value is fresh, ReadValue methods are answered from the cache without calling the handler. This includes
+	// long reads: BlueZ reads a long value in pieces, each with an "offset" option, and each piece is served from the one cached
+	// value. Because the cache applies the offset, a handler on a cached characteristic should always return the complete value.
+	//
+	// The cache is discarded when an update is posted for this characteristic (see `ggkNofifyUpdatedCharacteristic()`), when a client
+	// writes to it, or explicitly with `invalidateReadCache()`. Handlers that reply asynchronously are not cached.
+	//
+	// This method returns a reference to `this` in order to enable chaining inside the server description.
+	GattCharacteristic &cacheReadValue(int milliseconds);
+
 	// Custom support for handling updates to our characteristic's value
 	//
 	// Defined as: (NOT defined by Bluetooth or BlueZ - this method is internal only)
@@ -176,7 +285,10 @@ struct GattCharacteristic : GattInterface
 	//          // Call the onUpdateValue method that was set in the same Characteristic
 	//          self.callOnUpdatedValue(pConnection, pUserData);
 	//      })
-	bool callOnUpdatedValue(GDBusConnection *pConnection, void *pUserData) const;
+	virtual bool callOnUpdatedValue(GDBusConnection *pConnection, void *pUserData) const;
+
+	// Returns the number of bytes of memory used by this characteristic, including its value and write assembly buffers
+	virtual size_t getMemoryUsage() const;
 
 	// Convenience functions to add a GATT descriptor to the hierarchy
 	//
@@ -198,13 +310,145 @@ struct GattCharacteristic : GattInterface
 	// To end the descriptor, call `gattDescriptorEnd()`
 	GattDescriptor &gattDescriptorBegin(const std::string &pathElement, const GattUuid &uuid, const std::vector<const char *> &flags);
 
+	// Adds the BlueZ methods used by clients to subscribe to change notifications for this characteristic
+	//
+	// Defined as: void StartNotify()
+	//             void StopNotify()
+	//
+	// BlueZ calls StartNotify when the first client subscribes to notifications (or indications) and StopNotify when the last
+	// client unsubscribes or disconnects. We use these to track whether anybody is listening (see `isNotifying()`) so that we
+	// can avoid the work of sending notifications that nobody will receive.
+	//
+	// This is called automatically by `GattService::gattCharacteristicBegin()` for characteristics with the "notify" or
+	// "indicate" flag, so there is generally no need to call it from the server description.
+	GattCharacteristic &addNotifyMethods();
+
+	// Adds BlueZ's AcquireNotify method, which lets BlueZ receive this characteristic's notifications over a socket
+	//
+	// Defined as: fd, uint16 mtu AcquireNotify(dict options)
+	//
+	// Rather than subscribing with StartNotify, BlueZ may call AcquireNotify and take one end of a socket pair. While a socket is
+	// acquired, change notifications are written straight to it instead of being sent as PropertiesChanged signals, and
+	// `sendNotificationData()` can write raw values without building a GVariant at all. BlueZ closes the socket when the last
+	// client unsubscribes.
+	//
+	// This is called automatically by `GattService::gattCharacteristicBegin()` for characteristics with the "acquire-notify" flag.
+	GattCharacteristic &addAcquireNotify();
+
+	// Adds BlueZ's AcquireWrite method, which lets BlueZ deliver writes to this characteristic over a socket
+	//
+	// Defined as: fd, uint16 mtu AcquireWrite(dict options)
+	//
+	// Each packet BlueZ writes to the socket is passed to the callback set with `onAcquiredWrite()`, with no D-Bus message or
+	// options dictionary to unpack. This is typically used with "write-without-response".
+	//
+	// This is called automatically by `GattService::gattCharacteristicBegin()` for characteristics with the "acquire-write" flag.
+	GattCharacteristic &addAcquireWrite();
+
+	// Sets the callback that receives writes made through an acquired write socket (see `addAcquireWrite()`)
+	//
+	// The callback is called from the main loop thread. The data pointer is only valid for the duration of the call. If the
+	// AcquireWrite method has not been added, this adds it.
+	//
+	// This method returns a reference to `this` in order to enable chaining inside the server description.
+	GattCharacteristic &onAcquiredWrite(AcquiredWriteCallback callback, void *pUserData = nullptr);
+
+	// Returns true if BlueZ has acquired this characteristic's notification socket (see `addAcquireNotify()`)
+	bool isNotifyAcquired() const { return notifyFd >= 0; }
+
+	// Returns the MTU BlueZ reported when it acquired our notification socket, or 0 if it is not acquired
+	guint16 getAcquiredNotifyMtu() const { return notifyFd >= 0 ? notifyMtu : 0; }
+
+	// Writes a raw value straight to our acquired notification socket
+	//
+	// This is the fastest way to notify: there is no GVariant, no D-Bus message, and no batching or rate limiting. Returns false
+	// if the notification socket is not acquired (use `sendChangeNotificationValue()` in that case) or the write failed.
+	//
+	// This method must be called from the main loop thread.
+	bool sendNotificationData(const void *pData, size_t length) const;
+
+	// Returns true if a client has subscribed to change notifications for this characteristic
+	//
+	// When this returns false, `sendChangeNotificationValue()` and `sendChangeNotificationVariant()` do nothing, so callers only
+	// need to consult this method if building the new value is itself expensive. This method may be called from any thread.
+	bool isNotifying() const { return notifying.load(std::memory_order_acquire); }
+
+	// Sets the subscription state of this characteristic
+	//
+	// This is called by our framework in response to the StartNotify and StopNotify methods (see `addNotifyMethods()`.)
+	void setNotifying(bool enabled) const;
+
+	// Sets the minimum interval between change notifications sent for this characteristic
+	//
+	// Change notifications sent more frequently than this are held back. When the interval expires, only the most recent value is
+	// sent. This prevents a high-frequency sensor from flooding the bus. A value of 0 (the default) disables rate limiting.
+	//
+	// This method returns a reference to `this` in order to enable chaining inside the server description.
+	GattCharacteristic &setMinimumNotifyInterval(int milliseconds);
+
+	// Returns the minimum interval (in milliseconds) between change notifications sent for this characteristic
+	int getMinimumNotifyInterval() const { return minimumNotifyIntervalMS; }
+
+	// Binds this characteristic to a slot in the data store (see DataStore.cpp)
+	//
+	// The slot is registered with `capacity` bytes if it does not already exist. Once bound, publishing a value to the slot (see
+	// `ggkPublish()`) queues this characteristic's `onUpdatedValue()` callback directly, without resolving its object path, and
+	// the characteristic's callbacks can read the value with `getSlotValue()` or `getDataSlotVariant()`.
+	//
+	// This method returns a reference to `this` in order to enable chaining inside the server description.
+	GattCharacteristic &bindDataSlot(const std::string &name, size_t capacity);
+
+	// Returns the handle of the data slot bound to this characteristic, or `DataStore::kInvalidHandle` if none is bound
+	int getDataSlot() const { return dataSlot; }
+
+	// Reads the value of our bound data slot as a plain type, returning `defaultValue` if the slot doesn't hold a value of that size
+	template<typename T>
+	T getSlotValue(const T defaultValue) const
+	{
+		return TheDataStore.readValue<T>(dataSlot, defaultValue);
+	}
+
+	// Returns the value of our bound data slot as a floating "ay" GVariant, or nullptr if no slot is bound
+	GVariant *getDataSlotVariant() const;
+
+	// Replaces this characteristic's shared value buffer
+	//
+	// The value buffer is an optional, reference-counted copy of the characteristic's current value. It is intended for large
+	// values (firmware chunks, log dumps, etc.) where copying on every read and notification adds up: `methodReturnBytes()` and
+	// `sendChangeNotificationBytes()` hand the buffer to D-Bus without copying it.
+	//
+	// We take our own reference to `pBytes` (pass nullptr to clear the buffer.) This method may be called from any thread.
+	void setValueBuffer(GBytes *pBytes) const;
+
+	// Returns a new reference to this characteristic's shared value buffer, or nullptr if none has been set
+	//
+	// The caller must release the reference with `g_bytes_unref()`. This method may be called from any thread.
+	GBytes *getValueBuffer() const;
+
+	// Responds to a ReadValue method with the contents of our shared value buffer (see `setValueBuffer()`), without copying it
+	//
+	// If no buffer has been set, an empty array is returned.
+	void methodReturnValueBuffer(GDBusMethodInvocation *pInvocation) const;
+
+	// Sends a change notification to subscribers to this characteristic with the contents of a GBytes buffer, without copying it
+	//
+	// The caller keeps its reference to `pBytes`. See `sendChangeNotificationVariant()` for details on batching and rate limiting.
+	void sendChangeNotificationBytes(GDBusConnection *pBusConnection, GBytes *pBytes) const;
+
 	// Sends a change notification to subscribers to this characteristic
 	//
 	// This is a generalized method that accepts a `GVariant *`. A templated version is available that supports common types called
 	// `sendChangeNotificationValue()`.
 	//
-	// The caller may choose to consult HciAdapter::getInstance().getActiveConnectionCount() in order to determine if there are any
-	// active connections before sending a change notification.
+	// If notification batching is enabled (see `Server::getEnableNotificationBatching()`), the notification is held until the end
+	// of the current main loop cycle and sent along with all other notifications from that cycle. If the minimum notify interval
+	// has not elapsed since the last notification (see `setMinimumNotifyInterval()`), the notification is held until it has. In
+	// either case, if the value changes again while the notification is held, only the latest value is sent.
+	//
+	// If no client is subscribed to this characteristic (see `isNotifying()`), this method does nothing other than release the
+	// value.
+	//
+	// This method must be called from the main loop thread, which is where all of our callbacks are made.
 	void sendChangeNotificationVariant(GDBusConnection *pBusConnection, GVariant *pNewValue) const;
 
 	// Sends a change notification to subscribers to this characteristic
@@ -212,19 +456,175 @@ struct GattCharacteristic : GattInterface
 	// This is a helper method that accepts common types. For custom types, there is a form that accepts a `GVariant *`, called
 	// `sendChangeNotificationVariant()`.
 	//
-	// The caller may choose to consult HciAdapter::getInstance().getActiveConnectionCount() in order to determine if there are any
-	// active connections before sending a change notification.
+	// If no client is subscribed to this characteristic (see `isNotifying()`), this method does nothing.
 	template<typename T>
 	void sendChangeNotificationValue(GDBusConnection *pBusConnection, T value) const
 	{
+		if (!isNotifying())
+		{
+			return;
+		}
+
 		GVariant *pVariant = Utils::gvariantFromByteArray(value);
 		sendChangeNotificationVariant(pBusConnection, pVariant);
 	}
 
+	// Sends a change notification right away, bypassing batching and rate limiting
+	//
+	// Held notifications only ever carry the latest value, which is wrong for a stream in which every value matters (see
+	// BulkTransfer.cpp.) Each call to this method sends its own notification, through our acquired notification socket if there
+	// is one. Returns false if nobody is subscribed or the notification could not be sent (for example, because the acquired
+	// socket is full.)
+	//
+	// This method must be called from the main loop thread.
+	bool sendChangeNotificationNow(GDBusConnection *pBusConnection, const guint8 *pData, size_t length) const;
+
+	// Returns the ATT MTU our change notifications must fit
+	//
+	// If BlueZ has acquired our notifications, this is the MTU it gave us then. Otherwise it is the smallest MTU reported for any
+	// connected device (see `HciAdapter::setConnectionMtu()`), or the minimum ATT MTU (23) if we don't know. A notification
+	// carries up to MTU - 3 bytes.
+	guint16 getNotifyMtu() const;
+
+	// Sets how values sent with `sendFramedNotification()` are split or combined to fit the MTU
+	//
+	//     ENotifyFramingNone     - Each value is sent as it is, as with `sendChangeNotificationVariant()`. BlueZ truncates
+	//                              values that don't fit the MTU.
+	//     ENotifyFramingFragment - Each value is split across as many notifications as it takes. Each notification starts with
+	//                              a header byte (see kFragmentStart, kFragmentEnd and kFragmentSequenceMask) so the client can
+	//                              put the value back together and spot a lost notification.
+	//     ENotifyFramingPack     - Values are records, each sent as a length byte followed by the record. Records are packed
+	//                              together until the next one won't fit or the current main loop cycle ends, then sent as one
+	//                              notification. Records may be up to min(255, MTU - 4) bytes long.
+	//
+	// This method returns a reference to `this` in order to enable chaining inside the server description.
+	GattCharacteristic &setNotifyFraming(NotifyFraming framing);
+
+	// Returns how values sent with `sendFramedNotification()` are framed
+	NotifyFraming getNotifyFraming() const { return notifyFraming; }
+
+	// Sends a value to subscribers, framed as set by `setNotifyFraming()`
+	//
+	// Fragments and packed records are sent without batching or rate limiting (see `sendChangeNotificationNow()`), since every
+	// one of them matters. Returns false if nobody is subscribed, a packed record is too long or a notification could not be sent.
+	//
+	// This method must be called from the main loop thread.
+	bool sendFramedNotification(GDBusConnection *pBusConnection, const guint8 *pData, size_t length) const;
+
+	// Sends the records waiting to be packed into a notification (see ENotifyFramingPack), if there are any
+	//
+	// This is called automatically at the end of the main loop cycle. It is public only so that records can be flushed explicitly.
+	void flushPackedNotification() const;
+
+	// Sends all change notifications that are being held until the end of the current main loop cycle
+	//
+	// This is called automatically from the main loop. It is public only so that pending notifications can be flushed explicitly.
+	static void flushBatchedChangeNotifications();
+
 protected:
 
+	// Arranges for our held change notification to be sent, taking batching and rate limiting into account
+	void scheduleChangeNotification() const;
+
+	// Sends our held change notification (if any) immediately
+	void flushChangeNotification() const;
+
+	// The DBusMethod callback for methods added with `onReadValueAsync()` and `onWriteValueAsync()`
+	static void asyncMethodTrampoline(const GattCharacteristic &self, GDBusConnection *pConnection, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData);
+
+	// Hands a method call to an async handler on the worker pool
+	void dispatchAsync(AsyncMethodCallback callback, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData) const;
+
+	// The DBusMethod callback for WriteValue methods added with `onAssembledWrite()`
+	static void assembledWriteTrampoline(const GattCharacteristic &self, GDBusConnection *pConnection, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData);
+
+	// Hands our assembled value (if any) to our `onAssembledWrite()` callback and starts over with an empty buffer
+	void deliverAssembledWrite() const;
+
+	// Throws away any partially assembled value without delivering it
+	void discardAssembledWrite() const;
+
+	// Emits the PropertiesChanged signal carrying our new value (or writes it to our acquired notification socket)
+	void emitChangeNotification(GDBusConnection *pBusConnection, GVariant *pNewValue) const;
+
+	// Main loop handlers for our acquired sockets
+	static gboolean onAcquiredNotifySocket(gint fd, GIOCondition condition, gpointer pUserData);
+	static gboolean onAcquiredWriteSocket(gint fd, GIOCondition condition, gpointer pUserData);
+
+	// Closes our acquired sockets (and removes their main loop watches)
+	void releaseAcquiredNotify() const;
+	void releaseAcquiredWrite() const;
+
 	GattService &service;
 	UpdatedValueCallback pOnUpdatedValueFunc;
+
+	// Our async ReadValue and WriteValue handlers (see `onReadValueAsync()` and `onWriteValueAsync()`)
+	AsyncMethodCallback pOnReadValueAsyncFunc;
+	AsyncMethodCallback pOnWriteValueAsyncFunc;
+
+	// Set while a client is subscribed to change notifications (between StartNotify and StopNotify)
+	mutable std::atomic<bool> notifying;
+
+	// Change notification rate limiting (0 = no limit)
+	int minimumNotifyIntervalMS;
+
+	// Our bound slot in the data store (see `bindDataSlot()`)
+	int dataSlot;
+
+	// Our shared value buffer (see `setValueBuffer()`) and the mutex that guards swapping it
+	mutable GBytes *pValueBuffer;
+	mutable std::mutex valueBufferMutex;
+
+	// The most recent value (and its connection) waiting to be sent as a change notification
+	mutable GVariant *pHeldNotifyValue;
+	mutable GDBusConnection *pHeldNotifyConnection;
+
+	// Monotonic time (in microseconds) of our last change notification
+	mutable gint64 lastNotifyTime;
+
+	// Timer used to send a rate-limited notification once our minimum interval has elapsed
+	mutable guint notifyTimerId;
+
+	// Set while we are waiting in the batch of notifications to be sent at the end of the main loop cycle
+	mutable bool notifyBatched;
+
+	// Our end of the acquired notification socket (-1 if not acquired), its MTU and its main loop watch
+	mutable int notifyFd;
+	mutable guint16 notifyMtu;
+	mutable guint notifyFdSourceId;
+
+	// Our end of the acquired write socket (-1 if not acquired), its MTU and its main loop watch
+	mutable int writeFd;
+	mutable guint16 writeMtu;
+	mutable guint writeFdSourceId;
+
+	// Receives writes made through the acquired write socket
+	AcquiredWriteCallback pOnAcquiredWriteFunc;
+	void *pAcquiredWriteUserData;
+
+	// Long write reassembly (see `onAssembledWrite()`): our callback and its preallocated buffer
+	AssembledWriteCallback pOnAssembledWriteFunc;
+	std::unique_ptr<guint8[]> pAssemblyBuffer;
+	size_t assemblyCapacity;
+
+	// The value being assembled: its length so far, whether there is one at all, and where it came from
+	mutable size_t assemblyLength;
+	mutable bool assemblyPending;
+	mutable GDBusConnection *pAssemblyConnection;
+	mutable void *pAssemblyUserData;
+
+	// Timer that delivers the assembled value once fragments stop arriving
+	mutable guint assemblyTimerId;
+
+	// Notification framing (see `setNotifyFraming()`) and the sequence number of our next fragment
+	NotifyFraming notifyFraming;
+	mutable guint8 fragmentSequence;
+
+	// Records waiting to be sent in one notification (ENotifyFramingPack), where they go and the idle source that flushes them
+	std::unique_ptr<guint8[]> pPackBuffer;
+	mutable size_t packLength;
+	mutable GDBusConnection *pPackConnection;
+	mutable guint packFlushSourceId;
 };
 
 }; // namespace ggk
\ No newline at end of file
@@ -66,18 +66,36 @@ GattCharacteristic &GattDescriptor::gattDescriptorEnd()
 //
 
 // Locates a D-Bus method within this D-Bus interface
-bool GattDescriptor::callMethod(const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
+bool GattDescriptor::callMethod(const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
 {
-	for (const DBusMethod &method : methods)
+	const DBusMethod *pMethod = findMethod(methodName);
+	if (nullptr == pMethod)
 	{
-		if (methodName == method.getName())
+		return false;
+	}
+
+	// A write changes our value, so whatever we have cached is stale
+	if (methodName == "WriteValue")
+	{
+		invalidateReadCache();
+	}
+
+	// Serve reads from the cache if we can, otherwise capture what the handler returns
+	if (isReadCacheEnabled() && methodName == "ReadValue")
+	{
+		if (replyFromReadCache(pParameters, pInvocation))
 		{
-			method.call<GattDescriptor>(pConnection, getPath(), getName(), methodName, pParameters, pInvocation, pUserData);
 			return true;
 		}
+
+		beginReadCapture(pParameters, pInvocation);
+		pMethod->call<GattDescriptor>(pConnection, getPath(), getName(), pMethod->getName(), pParameters, pInvocation, pUserData);
+		endReadCapture();
+		return true;
 	}
 
-	return false;
+	pMethod->call<GattDescriptor>(pConnection, getPath(), getName(), pMethod->getName(), pParameters, pInvocation, pUserData);
+	return true;
 }
 
 // Adds an event to the descriptor and returns a refereence to 'this` to enable method chaining in the server description
@@ -86,19 +104,25 @@ bool GattDescriptor::callMethod(const std::string &methodName, GDBusConnection *
 // TickEvent::Callback type. We also return our own type. This simplifies the server description by allowing call to chain.
 GattDescriptor &GattDescriptor::onEvent(int tickFrequency, void *pUserData, EventCallback callback)
 {
-	events.push_back(TickEvent(this, tickFrequency, reinterpret_cast<TickEvent::Callback>(callback), pUserData));
+	events.push_back(TickEvent(this, tickFrequency * TickEvent::kTickPeriodMS, reinterpret_cast<TickEvent::Callback>(callback), pUserData));
+	return *this;
+}
+
+// Adds an event to the descriptor that fires every `periodMS` milliseconds
+//
+// NOTE: Like `onEvent()`, this is overloaded to accept our custom EventCallback type and return our own type.
+GattDescriptor &GattDescriptor::onEventMS(int periodMS, void *pUserData, EventCallback callback)
+{
+	events.push_back(TickEvent(this, periodMS, reinterpret_cast<TickEvent::Callback>(callback), pUserData));
 	return *this;
 }
 
-// Ticks events within this descriptor
+// Fires one of this descriptor's events
 //
 // Note: we specifically override this method in order to translate the generic TickEvent::Callback into our own EventCallback
-void GattDescriptor::tickEvents(GDBusConnection *pConnection, void *pUserData) const
+void GattDescriptor::fireEvent(const TickEvent &event, GDBusConnection *pConnection, void *pUserData) const
 {
-	for (const TickEvent &event : events)
-	{
-		event.tick<GattDescriptor>(getPath(), pConnection, pUserData);
-	}
+	event.fire<GattDescriptor>(getPath(), pConnection, pUserData);
 }
 
 // Specialized support for ReadlValue method
@@ -133,6 +157,22 @@ GattDescriptor &GattDescriptor::onWriteValue(MethodCallback callback)
 	return *this;
 }
 
+// Caches the result of this descriptor's `onReadValue` handler for `milliseconds`
+//
+// While the cached value is fresh, ReadValue methods are answered from the cache without calling the handler. This includes
+// long reads: BlueZ reads a long value in pieces, each with an "offset" option, and each piece is served from the one cached
+// value. Because the cache applies the offset, a handler on a cached descriptor should always return the complete value.
+//
+// The cache is discarded when an update is posted for this descriptor (see `ggkNofifyUpdatedDescriptor()`), when a client
+// writes to it, or explicitly with `invalidateReadCache()`. Handlers that reply asynchronously are not cached.
+//
+// This method returns a reference to `this` in order to enable chaining inside the server description.
+GattDescriptor &GattDescriptor::cacheReadValue(int milliseconds)
+{
+	setReadCacheTTL(milliseconds);
+	return *this;
+}
+
 // Custom support for handling updates to our descriptor's value
 //
 // Defined as: (NOT defined by Bluetooth or BlueZ - this method is internal only)
@@ -173,7 +213,7 @@ bool GattDescriptor::callOnUpdatedValue(GDBusConnection *pConnection, void *pUse
 		return false;
 	}
 
-	Logger::debug(SSTR << "Calling OnUpdatedValue function for interface at path '" << getPath() << "'");
+	LOG_DEBUG("Calling OnUpdatedValue function for interface at path '" << getPath() << "'");
 	return pOnUpdatedValueFunc(*this, pConnection, pUserData);
 }
 
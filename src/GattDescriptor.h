@@ -113,7 +113,7 @@ struct GattDescriptor : GattInterface
 	GattCharacteristic &gattDescriptorEnd();
 
 	// Locates a D-Bus method within this D-Bus interface and invokes the method
-	virtual bool callMethod(const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
+	virtual bool callMethod(const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
 
 	// Adds an event to the descriptor and returns a refereence to 'this` to enable method chaining in the server description
 	//
@@ -121,10 +121,15 @@ struct GattDescriptor : GattInterface
 	// TickEvent::Callback type. We also return our own type. This simplifies the server description by allowing call to chain.
 	GattDescriptor &onEvent(int tickFrequency, void *pUserData, EventCallback callback);
 
-	// Ticks events within this descriptor
+	// Adds an event to the descriptor that fires every `periodMS` milliseconds
+	//
+	// NOTE: Like `onEvent()`, this is overloaded to accept our custom EventCallback type and return our own type.
+	GattDescriptor &onEventMS(int periodMS, void *pUserData, EventCallback callback);
+
+	// Fires one of this descriptor's events
 	//
 	// Note: we specifically override this method in order to translate the generic TickEvent::Callback into our own EventCallback
-	virtual void tickEvents(GDBusConnection *pConnection, void *pUserData) const;
+	virtual void fireEvent(const TickEvent &event, GDBusConnection *pConnection, void *pUserData) const;
 
 	// Specialized support for Descriptor ReadlValue method
 	//
@@ -147,6 +152,18 @@ struct GattDescriptor : GattInterface
 	//     Output args: void
 	GattDescriptor &onWriteValue(MethodCallback callback);
 
+	// Caches the result of this descriptor's `onReadValue` handler for `milliseconds`
+	//
+	// While the cached value is fresh, ReadValue methods are answered from the cache without calling the handler. This includes
+	// long reads: BlueZ reads a long value in pieces, each with an "offset" option, and each piece is served from the one cached
+	// value. Because the cache applies the offset, a handler on a cached descriptor should always return the complete value.
+	//
+	// The cache is discarded when an update is posted for this descriptor (see `ggkNofifyUpdatedDescriptor()`), when a client
+	// writes to it, or explicitly with `invalidateReadCache()`. Handlers that reply asynchronously are not cached.
+	//
+	// This method returns a reference to `this` in order to enable chaining inside the server description.
+	GattDescriptor &cacheReadValue(int milliseconds);
+
 	// Custom support for handling updates to our descriptor's value
 	//
 	// Defined as: (NOT defined by Bluetooth or BlueZ - this method is internal only)
@@ -176,7 +193,7 @@ struct GattDescriptor : GattInterface
 	//          // Call the onUpdateValue method that was set in the same Descriptor
 	//          self.callOnUpdatedValue(pConnection, pUserData);
 	//      })
-	bool callOnUpdatedValue(GDBusConnection *pConnection, void *pUserData) const;
+	virtual bool callOnUpdatedValue(GDBusConnection *pConnection, void *pUserData) const;
 
 protected:
 
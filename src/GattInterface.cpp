@@ -42,12 +42,18 @@ namespace ggk {
 // Standard constructor
 //
 GattInterface::GattInterface(DBusObject &owner, const std::string &name)
-: DBusInterface(owner, name)
+: DBusInterface(owner, name), readCacheTTLMS(0), pReadCacheValue(nullptr), readCacheExpiry(0), readCacheGeneration(0),
+  readCacheInvalidations(0), pReadCaptureInvocation(nullptr), readCaptureOffset(0)
 {
 }
 
 GattInterface::~GattInterface()
 {
+	if (nullptr != pReadCacheValue)
+	{
+		g_variant_unref(pReadCacheValue);
+		pReadCacheValue = nullptr;
+	}
 }
 
 //
@@ -55,11 +61,58 @@ GattInterface::~GattInterface()
 //
 
 // Returns the list of GATT properties
-const std::list<GattProperty> &GattInterface::getProperties() const
+const std::vector<GattProperty> &GattInterface::getProperties() const
 {
 	return properties;
 }
 
+// Rebuilds `propertyIndex` from `properties` (the keys and values point into `properties`, so this is required when it
+// reallocates)
+//
+// If more than one property shares a name, the first one added is the one that will be found.
+void GattInterface::rebuildPropertyIndex()
+{
+	propertyIndex.clear();
+	propertyIndex.reserve(properties.size());
+	for (const GattProperty &property : properties)
+	{
+		propertyIndex.emplace(StringKey(property.getName()), &property);
+	}
+}
+
+// Releases any spare capacity held by this interface's methods, events and properties once the server description is complete
+//
+// If `releaseIndexes` is set, the property lookup table is released along with the method lookup table.
+void GattInterface::compact(bool releaseIndexes)
+{
+	DBusInterface::compact(releaseIndexes);
+	properties.shrink_to_fit();
+
+	if (releaseIndexes)
+	{
+		decltype(propertyIndex)().swap(propertyIndex);
+	}
+	else
+	{
+		rebuildPropertyIndex();
+	}
+}
+
+// Returns the number of bytes of memory used by this interface, including its properties and their values (and any cached
+// ReadValue result)
+size_t GattInterface::getMemoryUsage() const
+{
+	size_t bytes = DBusInterface::getMemoryUsage() + sizeof(GattInterface) - sizeof(DBusInterface) +
+		properties.capacity() * sizeof(GattProperty) + Utils::hashTableMemoryUsage(propertyIndex) + Utils::memoryUsage(pReadCacheValue);
+
+	for (const GattProperty &property : properties)
+	{
+		bytes += property.getMemoryUsage();
+	}
+
+	return bytes;
+}
+
 // When responding to a method, we need to return a GVariant value wrapped in a tuple. This method will simplify this slightly by
 // wrapping a GVariant of the type "ay" and wrapping it in a tuple before sending it off as the method response.
 //
@@ -67,6 +120,39 @@ const std::list<GattProperty> &GattInterface::getProperties() const
 // common types.
 void GattInterface::methodReturnVariant(GDBusMethodInvocation *pInvocation, GVariant *pVariant, bool wrapInTuple) const
 {
+	// Is this the result of a ReadValue we're caching?
+	if (nullptr != pReadCaptureInvocation && pInvocation == pReadCaptureInvocation)
+	{
+		GVariant *pValue = g_variant_ref_sink(pVariant);
+		if (!wrapInTuple && g_variant_is_of_type(pValue, G_VARIANT_TYPE("(ay)")))
+		{
+			GVariant *pChild = g_variant_get_child_value(pValue, 0);
+			g_variant_unref(pValue);
+			pValue = pChild;
+		}
+
+		if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_BYTESTRING))
+		{
+			if (nullptr != pReadCacheValue)
+			{
+				g_variant_unref(pReadCacheValue);
+			}
+			pReadCacheValue = g_variant_ref(pValue);
+			readCacheExpiry = g_get_monotonic_time() + static_cast<gint64>(readCacheTTLMS) * 1000;
+
+			pReadCaptureInvocation = nullptr;
+			replyWithOffset(pInvocation, pValue, readCaptureOffset);
+			g_variant_unref(pValue);
+			return;
+		}
+
+		// Not something we know how to cache, so just send it along
+		pReadCaptureInvocation = nullptr;
+		g_dbus_method_invocation_return_value(pInvocation, wrapInTuple ? g_variant_new_tuple(&pValue, 1) : pValue);
+		g_variant_unref(pValue);
+		return;
+	}
+
 	if (wrapInTuple)
 	{
 		pVariant = g_variant_new_tuple(&pVariant, 1);
@@ -74,54 +160,154 @@ void GattInterface::methodReturnVariant(GDBusMethodInvocation *pInvocation, GVar
 	g_dbus_method_invocation_return_value(pInvocation, pVariant);
 }
 
+// Responds to a method with the contents of a GBytes buffer as an array of bytes ("ay"), without copying the buffer
+//
+// The caller keeps its reference to `pBytes`. This is the preferred way to return large values.
+void GattInterface::methodReturnBytes(GDBusMethodInvocation *pInvocation, GBytes *pBytes, bool wrapInTuple) const
+{
+	methodReturnVariant(pInvocation, Utils::gvariantFromBytes(pBytes), wrapInTuple);
+}
+
+// Enables caching of ReadValue results for `milliseconds` (0 disables caching)
+void GattInterface::setReadCacheTTL(int milliseconds)
+{
+	readCacheTTLMS = milliseconds > 0 ? milliseconds : 0;
+	invalidateReadCache();
+}
+
+// Answers a ReadValue method from the cache, honoring the "offset" option
+//
+// Returns false (and does nothing) if there is no fresh cached value, in which case the caller should call the `onReadValue`
+// handler between `beginReadCapture()` and `endReadCapture()`.
+bool GattInterface::replyFromReadCache(GVariant *pParameters, GDBusMethodInvocation *pInvocation) const
+{
+	if (nullptr == pReadCacheValue)
+	{
+		return false;
+	}
+
+	if (readCacheGeneration != readCacheInvalidations.load(std::memory_order_acquire) || g_get_monotonic_time() >= readCacheExpiry)
+	{
+		g_variant_unref(pReadCacheValue);
+		pReadCacheValue = nullptr;
+		return false;
+	}
+
+	replyWithOffset(pInvocation, pReadCacheValue, getReadOffset(pParameters));
+	return true;
+}
+
+// Arranges for the value the `onReadValue` handler returns for `pInvocation` to be cached (see `methodReturnVariant()`)
+void GattInterface::beginReadCapture(GVariant *pParameters, GDBusMethodInvocation *pInvocation) const
+{
+	// Note the invalidation count before calling the handler, so an update that races with the handler isn't lost
+	readCacheGeneration = readCacheInvalidations.load(std::memory_order_acquire);
+	readCaptureOffset = getReadOffset(pParameters);
+	pReadCaptureInvocation = pInvocation;
+}
+
+// Stops capturing (a handler that replies asynchronously simply isn't cached)
+void GattInterface::endReadCapture() const
+{
+	pReadCaptureInvocation = nullptr;
+}
+
+// Replies to a ReadValue method with the portion of an "ay" value starting at `offset`
+//
+// The portion references the value's own storage rather than being copied.
+void GattInterface::replyWithOffset(GDBusMethodInvocation *pInvocation, GVariant *pValue, guint16 offset)
+{
+	if (0 == offset)
+	{
+		GVariant *pResult = g_variant_ref(pValue);
+		g_dbus_method_invocation_return_value(pInvocation, g_variant_new_tuple(&pResult, 1));
+		g_variant_unref(pResult);
+		return;
+	}
+
+	GBytes *pBytes = g_variant_get_data_as_bytes(pValue);
+	gsize size = g_bytes_get_size(pBytes);
+	if (offset > size)
+	{
+		g_bytes_unref(pBytes);
+		g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.InvalidOffset", "Read offset is beyond the end of the value");
+		return;
+	}
+
+	GBytes *pTail = g_bytes_new_from_bytes(pBytes, offset, size - offset);
+	GVariant *pResult = Utils::gvariantFromBytes(pTail);
+	g_dbus_method_invocation_return_value(pInvocation, g_variant_new_tuple(&pResult, 1));
+	g_bytes_unref(pTail);
+	g_bytes_unref(pBytes);
+}
+
+// Returns the "offset" option from a ReadValue method's parameters, or 0 if there is none
+guint16 GattInterface::getReadOffset(GVariant *pParameters)
+{
+	guint16 offset = 0;
+	if (nullptr == pParameters || !g_variant_is_of_type(pParameters, G_VARIANT_TYPE("(a{sv})")))
+	{
+		return offset;
+	}
+
+	GVariant *pOptions = g_variant_get_child_value(pParameters, 0);
+	g_variant_lookup(pOptions, "offset", "q", &offset);
+	g_variant_unref(pOptions);
+	return offset;
+}
+
 // Locates a `GattProperty` within the interface
 //
 // This method returns a pointer to the property or nullptr if not found
-const GattProperty *GattInterface::findProperty(const std::string &name) const
+const GattProperty *GattInterface::findProperty(const StringKey &name) const
 {
-	for (const GattProperty &property : properties)
+	// Without an index (see `compact()`), we search
+	if (propertyIndex.empty())
 	{
-		if (property.getName() == name)
+		for (const GattProperty &property : properties)
 		{
-			return &property;
+			if (StringKey(property.getName()) == name)
+			{
+				return &property;
+			}
 		}
+
+		return nullptr;
 	}
 
-	return nullptr;
+	auto iter = propertyIndex.find(name);
+	return iter == propertyIndex.end() ? nullptr : iter->second;
 }
 
 // Internal method used to generate introspection XML used to describe our services on D-Bus
-std::string GattInterface::generateIntrospectionXML(int depth) const
+//
+// The XML is appended to `xml`, indented for the given `depth`.
+void GattInterface::generateIntrospectionXML(std::string &xml, int depth) const
 {
-	std::string prefix;
-	prefix.insert(0, depth * 2, ' ');
-
-	std::string xml = std::string();
+	size_t indent = depth * 2;
 
 	if (methods.size() && getProperties().empty())
 	{
-		xml += prefix + "<interface name='" + getName() + "' />\n";
+		xml.append(indent, ' ').append("<interface name='").append(getName()).append("' />\n");
 	}
 	else
 	{
-		xml += prefix + "<interface name='" + getName() + "'>\n";
+		xml.append(indent, ' ').append("<interface name='").append(getName()).append("'>\n");
 
 		// Describe our methods
 		for (const DBusMethod &method : methods)
 		{
-			xml += method.generateIntrospectionXML(depth + 1);
+			method.generateIntrospectionXML(xml, depth + 1);
 		}
 
 		// Describe our properties
 		for (const GattProperty &property : getProperties())
 		{
-			xml += property.generateIntrospectionXML(depth + 1);
+			property.generateIntrospectionXML(xml, depth + 1);
 		}
 
-		xml += prefix + "</interface>\n";
+		xml.append(indent, ' ').append("</interface>\n");
 	}
-
-	return xml;
 }
 
 }; // namespace ggk
\ No newline at end of file
@@ -34,7 +34,9 @@
 
 #include <gio/gio.h>
 #include <string>
-#include <list>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
 
 #include "TickEvent.h"
 #include "DBusInterface.h"
@@ -70,7 +72,7 @@ struct GattInterface : DBusInterface
 	//
 
 	// Returns the list of GATT properties
-	const std::list<GattProperty> &getProperties() const;
+	const std::vector<GattProperty> &getProperties() const;
 
 	// Add a `GattProperty` to the interface
 	//
@@ -80,6 +82,9 @@ struct GattInterface : DBusInterface
 	T &addProperty(const GattProperty &property)
 	{
 		properties.push_back(property);
+
+		// Adding a property may have moved the others, so the index is rebuilt rather than extended
+		rebuildPropertyIndex();
 		return *static_cast<T *>(this);
 	}
 
@@ -100,6 +105,20 @@ struct GattInterface : DBusInterface
 		return addProperty<T>(GattProperty(name, Utils::gvariantFromString(uuid.toString128().c_str()), getter, setter));
 	}
 
+	// Sets the UUID for this interface and adds it as the "UUID" property
+	//
+	// The UUID is kept in binary form for lookups (see `getUuid()`.) It is formatted as a string only once, here, and the
+	// resulting GVariant is reused for every property request.
+	template<typename T>
+	T &setUuid(const GattUuid &uuid)
+	{
+		this->uuid = uuid;
+		return addProperty<T>("UUID", uuid);
+	}
+
+	// Returns the UUID set by `setUuid()`, or an invalid UUID if none was set
+	const GattUuid &getUuid() const { return uuid; }
+
 	// Helper method for adding a named property with a `DBusObjectPath`
 	template<typename T>
 	T &addProperty(const std::string &name, const DBusObjectPath &path, GDBusInterfaceGetPropertyFunc getter = nullptr, GDBusInterfaceSetPropertyFunc setter = nullptr)
@@ -152,7 +171,8 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	T getDataValue(const char *pName, const T defaultValue) const
 	{
-		const void *pData = TheServer->getDataGetter()(pName);
+		GGKServerDataGetter getter = TheServer->getDataGetter();
+		const void *pData = nullptr == getter ? nullptr : getter(pName);
 		return nullptr == pData ? defaultValue : *static_cast<const T *>(pData);
 	}
 
@@ -166,7 +186,8 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	T getDataPointer(const char *pName, const T defaultValue) const
 	{
-		const void *pData = TheServer->getDataGetter()(pName);
+		GGKServerDataGetter getter = TheServer->getDataGetter();
+		const void *pData = nullptr == getter ? nullptr : getter(pName);
 		return nullptr == pData ? defaultValue : static_cast<const T>(pData);
 	}
 
@@ -181,7 +202,8 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	bool setDataValue(const char *pName, const T value) const
 	{
-		return TheServer->getDataSetter()(pName, static_cast<const void *>(&value)) != 0;
+		GGKServerDataSetter setter = TheServer->getDataSetter();
+		return nullptr != setter && setter(pName, static_cast<const void *>(&value)) != 0;
 	}
 
 	// Sends a data pointer from the server back to the application through the server's registered data setter
@@ -195,7 +217,8 @@ struct GattInterface : DBusInterface
 	template<typename T>
 	bool setDataPointer(const char *pName, const T pointer) const
 	{
-		return TheServer->getDataSetter()(pName, static_cast<const void *>(pointer)) != 0;
+		GGKServerDataSetter setter = TheServer->getDataSetter();
+		return nullptr != setter && setter(pName, static_cast<const void *>(pointer)) != 0;
 	}
 
 	// When responding to a ReadValue method, we need to return a GVariant value in the form "(ay)" (a tuple containing an array of
@@ -219,17 +242,93 @@ struct GattInterface : DBusInterface
 		methodReturnVariant(pInvocation, pVariant, wrapInTuple);
 	}
 
+	// Responds to a method with the contents of a GBytes buffer as an array of bytes ("ay"), without copying the buffer
+	//
+	// The caller keeps its reference to `pBytes`. This is the preferred way to return large values.
+	void methodReturnBytes(GDBusMethodInvocation *pInvocation, GBytes *pBytes, bool wrapInTuple = false) const;
+
 	// Locates a `GattProperty` within the interface
 	//
 	// This method returns a pointer to the property or nullptr if not found
-	const GattProperty *findProperty(const std::string &name) const;
+	const GattProperty *findProperty(const StringKey &name) const;
+
+	//
+	// Read value caching
+	//
+
+	// Returns true if ReadValue results are cached for this interface (see `GattCharacteristic::cacheReadValue()`)
+	bool isReadCacheEnabled() const { return readCacheTTLMS > 0; }
+
+	// Discards the cached ReadValue result (if any) so that the next read calls the `onReadValue` handler again
+	//
+	// This is called automatically whenever an update is posted for this interface (see `ggkNofifyUpdatedCharacteristic()`.) This
+	// method may be called from any thread.
+	void invalidateReadCache() const { readCacheInvalidations.fetch_add(1, std::memory_order_release); }
 
 	// Internal method used to generate introspection XML used to describe our services on D-Bus
-	virtual std::string generateIntrospectionXML(int depth) const;
+	//
+	// The XML is appended to `xml`, indented for the given `depth`.
+	virtual void generateIntrospectionXML(std::string &xml, int depth) const;
+
+	// Releases any spare capacity held by this interface's methods, events and properties once the server description is complete
+	//
+	// If `releaseIndexes` is set, the property lookup table is released along with the method lookup table.
+	virtual void compact(bool releaseIndexes);
+
+	// Returns the number of bytes of memory used by this interface, including its properties and their values (and any cached
+	// ReadValue result)
+	virtual size_t getMemoryUsage() const;
 
 protected:
 
-	std::list<GattProperty> properties;
+	// Rebuilds `propertyIndex` from `properties` (the keys and values point into `properties`, so this is required when it
+	// reallocates)
+	void rebuildPropertyIndex();
+
+	// Enables caching of ReadValue results for `milliseconds` (0 disables caching)
+	void setReadCacheTTL(int milliseconds);
+
+	// Answers a ReadValue method from the cache, honoring the "offset" option
+	//
+	// Returns false (and does nothing) if there is no fresh cached value, in which case the caller should call the `onReadValue`
+	// handler between `beginReadCapture()` and `endReadCapture()`.
+	bool replyFromReadCache(GVariant *pParameters, GDBusMethodInvocation *pInvocation) const;
+
+	// Arranges for the value the `onReadValue` handler returns for `pInvocation` to be cached (see `methodReturnVariant()`)
+	void beginReadCapture(GVariant *pParameters, GDBusMethodInvocation *pInvocation) const;
+
+	// Stops capturing (a handler that replies asynchronously simply isn't cached)
+	void endReadCapture() const;
+
+	// Replies to a ReadValue method with the portion of an "ay" value starting at `offset`
+	static void replyWithOffset(GDBusMethodInvocation *pInvocation, GVariant *pValue, guint16 offset);
+
+	// Returns the "offset" option from a ReadValue method's parameters, or 0 if there is none
+	static guint16 getReadOffset(GVariant *pParameters);
+
+	// How long (in milliseconds) a ReadValue result is served from the cache (0 = caching disabled)
+	int readCacheTTLMS;
+
+	// The cached value ("ay"), the monotonic time (in microseconds) that it expires and the invalidation count it was cached under
+	mutable GVariant *pReadCacheValue;
+	mutable gint64 readCacheExpiry;
+	mutable unsigned int readCacheGeneration;
+
+	// Bumped by `invalidateReadCache()`, which may be called from any thread
+	mutable std::atomic<unsigned int> readCacheInvalidations;
+
+	// The ReadValue invocation whose result we are capturing (and the offset it asked for)
+	mutable GDBusMethodInvocation *pReadCaptureInvocation;
+	mutable guint16 readCaptureOffset;
+
+	std::vector<GattProperty> properties;
+
+	// Property lookup table keyed by property name (the keys reference the names of the properties stored in `properties`, see
+	// `rebuildPropertyIndex()`)
+	std::unordered_map<StringKey, const GattProperty *, StringKey::Hash> propertyIndex;
+
+	// Our UUID, in binary form (see `setUuid()`)
+	GattUuid uuid;
 };
 
 }; // namespace ggk
\ No newline at end of file
@@ -29,10 +29,16 @@
 //
 // This class is intended to be used within the server description. For an explanation of how this class is used, see the detailed
 // description in Server.cpp.
+//
+// Most properties (a service's UUID and Primary flag, a characteristic's UUID, Service and Flags, and so on) never change once the
+// server description is built. These are immutable: they have no getter, and their value is marshalled into a GVariant once, when
+// the property is added. The property holds a (sunk) reference to that GVariant, so both a property get and the `GetManagedObjects`
+// reply simply take another reference to it. Properties with a getter are dynamic and call it for every get.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <gio/gio.h>
 #include <string>
+#include <utility>
 
 #include "Utils.h"
 #include "GattProperty.h"
@@ -43,11 +49,59 @@ namespace ggk {
 //
 // In general, properties should not be constructed directly as properties are typically instanticated by adding them to to an
 // interface using one of the the interface's `addProperty` methods.
+//
+// The property keeps a reference to `pValue`, sinking it if it is floating (so a newly built value is simply handed over.)
 GattProperty::GattProperty(const std::string &name, GVariant *pValue, GDBusInterfaceGetPropertyFunc getter, GDBusInterfaceSetPropertyFunc setter)
-: name(name), pValue(pValue), getterFunc(getter), setterFunc(setter)
+: name(name), pValue(nullptr == pValue ? nullptr : g_variant_ref_sink(pValue)), getterFunc(getter), setterFunc(setter)
+{
+}
+
+// Properties share their value, so copies only add a reference to it
+GattProperty::GattProperty(const GattProperty &other)
+: name(other.name), pValue(nullptr == other.pValue ? nullptr : g_variant_ref(other.pValue)), getterFunc(other.getterFunc), setterFunc(other.setterFunc)
 {
 }
 
+GattProperty::GattProperty(GattProperty &&other)
+: name(std::move(other.name)), pValue(other.pValue), getterFunc(other.getterFunc), setterFunc(other.setterFunc)
+{
+	other.pValue = nullptr;
+}
+
+GattProperty &GattProperty::operator =(const GattProperty &other)
+{
+	if (this != &other)
+	{
+		name = other.name;
+		setValue(other.pValue);
+		getterFunc = other.getterFunc;
+		setterFunc = other.setterFunc;
+	}
+	return *this;
+}
+
+GattProperty &GattProperty::operator =(GattProperty &&other)
+{
+	if (this != &other)
+	{
+		name = std::move(other.name);
+		setValue(nullptr);
+		pValue = other.pValue;
+		other.pValue = nullptr;
+		getterFunc = other.getterFunc;
+		setterFunc = other.setterFunc;
+	}
+	return *this;
+}
+
+GattProperty::~GattProperty()
+{
+	if (nullptr != pValue)
+	{
+		g_variant_unref(pValue);
+	}
+}
+
 //
 // Name
 //
@@ -78,13 +132,30 @@ const GVariant *GattProperty::getValue() const
 	return pValue;
 }
 
+// Returns a new reference to the property's value
+//
+// This is what we hand to GDBus for a property get (it takes ownership of the result), so reading an immutable property costs
+// a reference count bump rather than building a new GVariant.
+GVariant *GattProperty::getValueReference() const
+{
+	return nullptr == pValue ? nullptr : g_variant_ref(pValue);
+}
+
 // Sets the property's value
 //
+// The property keeps a reference to `pValue` (as with the constructor) and releases its previous value.
+//
 // In general, this method should not be called directly as properties are typically added to an interface using one of the the
 // interface's `addProperty` methods.
 GattProperty &GattProperty::setValue(GVariant *pValue)
 {
-	this->pValue = pValue;
+	// Sink the new value before releasing the old one, in case they are the same
+	GVariant *pNewValue = nullptr == pValue ? nullptr : g_variant_ref_sink(pValue);
+	if (nullptr != this->pValue)
+	{
+		g_variant_unref(this->pValue);
+	}
+	this->pValue = pNewValue;
 	return *this;
 }
 
@@ -125,65 +196,70 @@ GattProperty &GattProperty::setSetterFunc(GDBusInterfaceSetPropertyFunc func)
 }
 
 // Internal method used to generate introspection XML used to describe our services on D-Bus
-std::string GattProperty::generateIntrospectionXML(int depth) const
+//
+// The XML is appended to `xml`, indented for the given `depth`.
+void GattProperty::generateIntrospectionXML(std::string &xml, int depth) const
 {
-	std::string prefix;
-	prefix.insert(0, depth * 2, ' ');
-
-	std::string xml = std::string();
+	size_t indent = depth * 2;
 
 	GVariant *pValue = const_cast<GVariant *>(getValue());
 	const gchar *pType = g_variant_get_type_string(pValue);
-	xml += prefix + "<property name='" + getName() + "' type='" + pType + "' access='read'>\n";
+	xml.append(indent, ' ').append("<property name='").append(getName()).append("' type='").append(pType).append("' access='read'>\n");
 
 	if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_BOOLEAN))
 	{
-		xml += prefix + "  <annotation name='name' value='" + (g_variant_get_boolean(pValue) != 0 ? "true":"false") + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(g_variant_get_boolean(pValue) != 0 ? "true":"false").append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_INT16))
 	{
-		xml += prefix + "  <annotation name='name' value='" + std::to_string(g_variant_get_int16(pValue)) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(std::to_string(g_variant_get_int16(pValue))).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_UINT16))
 	{
-		xml += prefix + "  <annotation name='name' value='" + std::to_string(g_variant_get_uint16(pValue)) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(std::to_string(g_variant_get_uint16(pValue))).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_INT32))
 	{
-		xml += prefix + "  <annotation name='name' value='" + std::to_string(g_variant_get_int32(pValue)) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(std::to_string(g_variant_get_int32(pValue))).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_UINT32))
 	{
-		xml += prefix + "  <annotation name='name' value='" + std::to_string(g_variant_get_uint32(pValue)) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(std::to_string(g_variant_get_uint32(pValue))).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_INT64))
 	{
-		xml += prefix + "  <annotation name='name' value='" + std::to_string(g_variant_get_int64(pValue)) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(std::to_string(g_variant_get_int64(pValue))).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_UINT64))
 	{
-		xml += prefix + "  <annotation name='name' value='" + std::to_string(g_variant_get_uint64(pValue)) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(std::to_string(g_variant_get_uint64(pValue))).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_DOUBLE))
 	{
-		xml += prefix + "  <annotation value='" + std::to_string(g_variant_get_double(pValue)) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation value='").append(std::to_string(g_variant_get_double(pValue))).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_STRING))
 	{
-		xml += prefix + "  <annotation name='name' value='" + g_variant_get_string(pValue, nullptr) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(g_variant_get_string(pValue, nullptr)).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_OBJECT_PATH))
 	{
-		xml += prefix + "  <annotation name='name' value='" + g_variant_get_string(pValue, nullptr) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(g_variant_get_string(pValue, nullptr)).append("' />\n");
 	}
 	else if (g_variant_is_of_type(pValue, G_VARIANT_TYPE_BYTESTRING))
 	{
-		xml += prefix + "  <annotation name='name' value='" + g_variant_get_bytestring(pValue) + "' />\n";
+		xml.append(indent, ' ').append("  <annotation name='name' value='").append(g_variant_get_bytestring(pValue)).append("' />\n");
 	}
 
-	xml += prefix + "</property>\n";
+	xml.append(indent, ' ').append("</property>\n");
+}
 
-	return xml;
+// Returns the number of bytes this property has allocated for its name and value (see `ggkGetMemoryStats()`)
+//
+// The property itself is stored (and counted) by its interface.
+size_t GattProperty::getMemoryUsage() const
+{
+	return Utils::memoryUsage(name) + Utils::memoryUsage(pValue);
 }
 
 }; // namespace ggk
\ No newline at end of file
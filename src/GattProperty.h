@@ -46,8 +46,17 @@ struct GattProperty
 	//
 	// In general, properties should not be constructed directly as properties are typically instanticated by adding them to to an
 	// interface using one of the the interface's `addProperty` methods.
+	//
+	// The property keeps a reference to `pValue`, sinking it if it is floating (so a newly built value is simply handed over.)
 	GattProperty(const std::string &name, GVariant *pValue, GDBusInterfaceGetPropertyFunc getter = nullptr, GDBusInterfaceSetPropertyFunc setter = nullptr);
 
+	// Properties share their value, so copies only add a reference to it
+	GattProperty(const GattProperty &other);
+	GattProperty(GattProperty &&other);
+	GattProperty &operator =(const GattProperty &other);
+	GattProperty &operator =(GattProperty &&other);
+	~GattProperty();
+
 	//
 	// Name
 	//
@@ -68,12 +77,24 @@ struct GattProperty
 	// Returns the property's value
 	const GVariant *getValue() const;
 
+	// Returns a new reference to the property's value
+	//
+	// This is what we hand to GDBus for a property get (it takes ownership of the result), so reading an immutable property costs
+	// a reference count bump rather than building a new GVariant.
+	GVariant *getValueReference() const;
+
 	// Sets the property's value
 	//
+	// The property keeps a reference to `pValue` (as with the constructor) and releases its previous value.
+	//
 	// In general, this method should not be called directly as properties are typically added to an interface using one of the the
 	// interface's `addProperty` methods.
 	GattProperty &setValue(GVariant *pValue);
 
+	// Returns true if the property is immutable: it has no getter, so its value (built once, when the property was added) is the
+	// answer to every request
+	bool isImmutable() const { return nullptr == getterFunc; }
+
 	//
 	// Callbacks to get/set this property
 	//
@@ -97,7 +118,14 @@ struct GattProperty
 	GattProperty &setSetterFunc(GDBusInterfaceSetPropertyFunc func);
 
 	// Internal method used to generate introspection XML used to describe our services on D-Bus
-	std::string generateIntrospectionXML(int depth) const;
+	//
+	// The XML is appended to `xml`, indented for the given `depth`.
+	void generateIntrospectionXML(std::string &xml, int depth) const;
+
+	// Returns the number of bytes this property has allocated for its name and value (see `ggkGetMemoryStats()`)
+	//
+	// The property itself is stored (and counted) by its interface.
+	size_t getMemoryUsage() const;
 
 private:
 
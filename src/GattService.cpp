@@ -34,8 +34,10 @@
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <gio/gio.h>
+#include <string.h>
 #include <string>
 #include <list>
+#include <vector>
 
 #include "GattService.h"
 #include "GattInterface.h"
@@ -84,13 +86,58 @@ DBusObject &GattService::gattServiceEnd()
 //     "secure-read" (Server only)
 //     "secure-write" (Server only)
 //
+// In addition, we accept two flags of our own, which are not passed along to BlueZ:
+//
+//     "acquire-notify" - Let BlueZ take notifications over a socket (see `GattCharacteristic::addAcquireNotify()`)
+//     "acquire-write"  - Let BlueZ deliver writes over a socket (see `GattCharacteristic::addAcquireWrite()`)
+//
 GattCharacteristic &GattService::gattCharacteristicBegin(const std::string &pathElement, const GattUuid &uuid, const std::vector<const char *> &flags)
 {
 	DBusObject &child = owner.addChild(DBusObjectPath(pathElement));
 	GattCharacteristic &characteristic = *child.addInterface(std::make_shared<GattCharacteristic>(child, *this, "org.bluez.GattCharacteristic1"));
-	characteristic.addProperty<GattCharacteristic>("UUID", uuid);
+	characteristic.setUuid<GattCharacteristic>(uuid);
 	characteristic.addProperty<GattCharacteristic>("Service", owner.getPath());
-	characteristic.addProperty<GattCharacteristic>("Flags", flags);
+
+	// Separate our own flags from BlueZ's
+	std::vector<const char *> bluezFlags;
+	bool notifies = false;
+	bool acquireNotify = false;
+	bool acquireWrite = false;
+	for (const char *pFlag : flags)
+	{
+		if (0 == strcmp(pFlag, "acquire-notify"))
+		{
+			acquireNotify = true;
+			continue;
+		}
+		if (0 == strcmp(pFlag, "acquire-write"))
+		{
+			acquireWrite = true;
+			continue;
+		}
+		if (0 == strcmp(pFlag, "notify") || 0 == strcmp(pFlag, "indicate"))
+		{
+			notifies = true;
+		}
+		bluezFlags.push_back(pFlag);
+	}
+
+	characteristic.addProperty<GattCharacteristic>("Flags", bluezFlags);
+
+	// Characteristics that can notify need to know when clients subscribe
+	if (notifies)
+	{
+		characteristic.addNotifyMethods();
+	}
+	if (acquireNotify)
+	{
+		characteristic.addAcquireNotify();
+	}
+	if (acquireWrite)
+	{
+		characteristic.addAcquireWrite();
+	}
+
 	return characteristic;
 }
 
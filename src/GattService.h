@@ -94,6 +94,11 @@ struct GattService : GattInterface
 	//     "secure-read" (Server only)
 	//     "secure-write" (Server only)
 	//
+	// In addition, we accept two flags of our own, which are not passed along to BlueZ:
+	//
+	//     "acquire-notify" - Let BlueZ take notifications over a socket (see `GattCharacteristic::addAcquireNotify()`)
+	//     "acquire-write"  - Let BlueZ deliver writes over a socket (see `GattCharacteristic::addAcquireWrite()`)
+	//
 	GattCharacteristic &gattCharacteristicBegin(const std::string &pathElement, const GattUuid &uuid, const std::vector<const char *> &flags);
 
 	// Returns a string identifying the type of interface
@@ -0,0 +1,74 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A static, table-driven alternative to the chained server description
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of GattTable.h
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "GattTable.h"
+
+namespace ggk {
+
+// The flag strings, in the same order as the bits in `GattTable::Flags`
+static const char *kFlagNames[] =
+{
+	"broadcast",
+	"read",
+	"write-without-response",
+	"write",
+	"notify",
+	"indicate",
+	"authenticated-signed-writes",
+	"reliable-write",
+	"writable-auxiliaries",
+	"encrypt-read",
+	"encrypt-write",
+	"encrypt-authenticated-read",
+	"encrypt-authenticated-write",
+	"secure-read",
+	"secure-write",
+	"acquire-notify",
+	"acquire-write"
+};
+
+// Returns the flag strings for a combination of `Flags`
+std::vector<const char *> GattTable::flagNames(uint32_t flags)
+{
+	std::vector<const char *> names;
+	for (size_t bit = 0; bit < sizeof(kFlagNames) / sizeof(kFlagNames[0]); ++bit)
+	{
+		if ((flags & (1u << bit)) != 0)
+		{
+			names.push_back(kFlagNames[bit]);
+		}
+	}
+	return names;
+}
+
+}; // namespace ggk
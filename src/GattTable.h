@@ -0,0 +1,197 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A static, table-driven alternative to the chained server description
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// The server description in Server.cpp is built at startup by chaining calls like `gattServiceBegin()` and
+// `gattCharacteristicBegin()`. Each of those converts string UUIDs (cleaning and re-formatting them) and copies flag lists as
+// it goes. A `GattTable` describes the same thing as constant data:
+//
+//     static constexpr GattTableEntry kDeviceTable[] =
+//     {
+//         GattTable::service("device", "180A"),
+//             GattTable::characteristic("mfgr_name", "2A29", GattTable::ERead, readManufacturerName),
+//             GattTable::end(),
+//         GattTable::end(),
+//     };
+//
+//     static_assert(GattTable::isWellFormed(kDeviceTable), "kDeviceTable is not well formed");
+//
+// Because the table is `constexpr`, the compiler does the work up front:
+//
+//     * UUIDs are parsed into their binary form (see `ConstUuid`). A malformed UUID will not compile.
+//
+//     * Flags are a bit mask, so a misspelled flag will not compile either.
+//
+//     * `isWellFormed()` checks at compile time that every service, characteristic and descriptor is properly nested and ended.
+//
+//     * The table itself lives in read-only data, so no code runs to build it.
+//
+// At startup, `DBusObject::gattTable()` walks the table once to create the objects, just as the chained calls would. Callbacks
+// are plain functions rather than lambdas, because C++11 doesn't allow lambdas in constant expressions. Since a table produces
+// the same objects as the chained calls, the two styles can be mixed freely, and the rest of the server (caching of our
+// introspection and managed objects, for example) works the same for both.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "GattUuid.h"
+#include "GattCharacteristic.h"
+#include "GattDescriptor.h"
+
+namespace ggk {
+
+// A single row in a GATT table (see the discussion at the top of this file)
+//
+// Rows are generally created with the helpers in `GattTable` rather than directly.
+struct GattTableEntry
+{
+	enum Kind
+	{
+		EService,
+		ECharacteristic,
+		EDescriptor,
+		EEnd
+	};
+
+	Kind kind;
+	const char *pPathElement;
+	ConstUuid uuid;
+
+	// A combination of `GattTable::Flags`
+	uint32_t flags;
+
+	// Callbacks for characteristics (ignored for other kinds of rows)
+	GattCharacteristic::MethodCallback onCharacteristicRead;
+	GattCharacteristic::MethodCallback onCharacteristicWrite;
+	GattCharacteristic::UpdatedValueCallback onCharacteristicUpdated;
+
+	// Callbacks for descriptors (ignored for other kinds of rows)
+	GattDescriptor::MethodCallback onDescriptorRead;
+	GattDescriptor::MethodCallback onDescriptorWrite;
+	GattDescriptor::UpdatedValueCallback onDescriptorUpdated;
+
+	// How long to cache read values, in milliseconds (see `GattCharacteristic::cacheReadValue()`.) 0 disables caching.
+	int readCacheTTLMS;
+};
+
+struct GattTable
+{
+	// Characteristic and descriptor flags
+	//
+	// These correspond to the flag strings accepted by `GattService::gattCharacteristicBegin()`, including our own
+	// "acquire-notify" and "acquire-write" flags.
+	enum Flags : uint32_t
+	{
+		EBroadcast                 = 1 << 0,
+		ERead                      = 1 << 1,
+		EWriteWithoutResponse      = 1 << 2,
+		EWrite                     = 1 << 3,
+		ENotify                    = 1 << 4,
+		EIndicate                  = 1 << 5,
+		EAuthenticatedSignedWrites = 1 << 6,
+		EReliableWrite             = 1 << 7,
+		EWritableAuxiliaries       = 1 << 8,
+		EEncryptRead               = 1 << 9,
+		EEncryptWrite              = 1 << 10,
+		EEncryptAuthenticatedRead  = 1 << 11,
+		EEncryptAuthenticatedWrite = 1 << 12,
+		ESecureRead                = 1 << 13,
+		ESecureWrite               = 1 << 14,
+		EAcquireNotify             = 1 << 15,
+		EAcquireWrite              = 1 << 16
+	};
+
+	// Returns the flag strings for a combination of `Flags`
+	static std::vector<const char *> flagNames(uint32_t flags);
+
+	// Begins a service (end it with `end()`)
+	static constexpr GattTableEntry service(const char *pPathElement, const ConstUuid &uuid)
+	{
+		return GattTableEntry { GattTableEntry::EService, pPathElement, uuid, 0, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 0 };
+	}
+
+	// Begins a characteristic within a service (end it with `end()`)
+	static constexpr GattTableEntry characteristic(const char *pPathElement, const ConstUuid &uuid, uint32_t flags,
+		GattCharacteristic::MethodCallback onRead = nullptr, GattCharacteristic::MethodCallback onWrite = nullptr,
+		GattCharacteristic::UpdatedValueCallback onUpdated = nullptr, int readCacheTTLMS = 0)
+	{
+		return GattTableEntry { GattTableEntry::ECharacteristic, pPathElement, uuid, flags, onRead, onWrite, onUpdated, nullptr, nullptr, nullptr, readCacheTTLMS };
+	}
+
+	// Begins a descriptor within a characteristic (end it with `end()`)
+	static constexpr GattTableEntry descriptor(const char *pPathElement, const ConstUuid &uuid, uint32_t flags,
+		GattDescriptor::MethodCallback onRead = nullptr, GattDescriptor::MethodCallback onWrite = nullptr,
+		GattDescriptor::UpdatedValueCallback onUpdated = nullptr, int readCacheTTLMS = 0)
+	{
+		return GattTableEntry { GattTableEntry::EDescriptor, pPathElement, uuid, flags, nullptr, nullptr, nullptr, onRead, onWrite, onUpdated, readCacheTTLMS };
+	}
+
+	// Ends the most recent service, characteristic or descriptor
+	static constexpr GattTableEntry end()
+	{
+		return GattTableEntry { GattTableEntry::EEnd, nullptr, ConstUuid("0000"), 0, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 0 };
+	}
+
+	// Returns true if every service, characteristic and descriptor in the table is properly nested and ended
+	//
+	// This is intended for use in a `static_assert` alongside the table.
+	template<size_t N>
+	static constexpr bool isWellFormed(const GattTableEntry (&entries)[N])
+	{
+		return isWellFormed(entries, N);
+	}
+
+	// Returns true if every service, characteristic and descriptor in the `count` entries at `pEntries` is properly nested and
+	// ended
+	static constexpr bool isWellFormed(const GattTableEntry *pEntries, size_t count)
+	{
+		return isWellFormed(pEntries, count, 0);
+	}
+
+private:
+
+	// Services sit at depth 0, their characteristics at depth 1 and their descriptors at depth 2
+	static constexpr int depthOf(GattTableEntry::Kind kind)
+	{
+		return kind == GattTableEntry::EService ? 0 : kind == GattTableEntry::ECharacteristic ? 1 : 2;
+	}
+
+	static constexpr bool isWellFormed(const GattTableEntry *pEntries, size_t count, int depth)
+	{
+		return count == 0 ? depth == 0 :
+			pEntries->kind == GattTableEntry::EEnd ? depth > 0 && isWellFormed(pEntries + 1, count - 1, depth - 1) :
+			depthOf(pEntries->kind) == depth && isWellFormed(pEntries + 1, count - 1, depth + 1);
+	}
+};
+
+}; // namespace ggk
@@ -57,13 +57,25 @@
 //
 // By represetng a UUID in a custom class like this, we are able to give a UUID its own type, and use type safety to ensure that we
 // don't confuse regular strings with GATT UUIDs throughout the codebase.
+//
+// For UUIDs that are known at compile time (such as those in a static server table, see GattTable.h) there is also `ConstUuid`.
+// A `ConstUuid` is parsed from a string literal by the compiler: the string may only contain hex digits and dashes, and must hold
+// 4, 8 or 32 hex digits. Anything else is a compile error when the `ConstUuid` is used in a constant expression. Converting a
+// `ConstUuid` to a `GattUuid` is a simple copy, without any of the cleaning a string UUID needs.
+//
+// A `GattUuid` is stored as its 128-bit value along with the bit count it was created with (which decides its short form.)
+// Comparing, ordering and hashing UUIDs are integer operations, so a UUID makes a cheap key for lookups (see
+// `Server::findCharacteristic()`.) The string form is only built when it's asked for, which normally happens once, when the UUID
+// property is added to an interface; from then on the property's GVariant is reused for every D-Bus request.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #pragma once
 
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
 #include <algorithm>
-#include <stdint.h>
 #include <ctype.h>
 
 #include <iostream>
@@ -71,12 +83,83 @@
 
 namespace ggk {
 
+// A 128-bit UUID parsed and validated at compile time (see the discussion at the top of this file)
+struct ConstUuid
+{
+	// The upper and lower 64 bits of the full 128-bit UUID
+	uint64_t high;
+	uint64_t low;
+
+	// The number of bits in the UUID as it was written (16, 32 or 128)
+	int bitCount;
+
+	// Parses a UUID from a string of 4, 8 or 32 hex digits (dashes are allowed anywhere and are ignored)
+	//
+	// 16- and 32-bit UUIDs are expanded with the Bluetooth Base UUID ("00000000-0000-1000-8000-00805f9b34fb".)
+	constexpr ConstUuid(const char *pUuid)
+	: high(countDigits(pUuid) == 32 ? digits(pUuid, 0, 16, 0, 0) : (digits(pUuid, 0, 8, 0, 0) << 32) | kBaseHigh),
+	  low(countDigits(pUuid) == 32 ? digits(pUuid, 16, 16, 0, 0) : kBaseLow),
+	  bitCount(validBitCount(countDigits(pUuid) * 4))
+	{
+	}
+
+private:
+
+	// The parts of the Bluetooth Base UUID that a 16- or 32-bit UUID doesn't specify
+	static constexpr uint64_t kBaseHigh = 0x00001000ULL;
+	static constexpr uint64_t kBaseLow = 0x800000805f9b34fbULL;
+
+	static constexpr bool isHexDigit(char c)
+	{
+		return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+	}
+
+	static constexpr uint64_t hexValue(char c)
+	{
+		return c <= '9' ? c - '0' : (c <= 'F' ? c - 'A' + 10 : c - 'a' + 10);
+	}
+
+	// Counts the hex digits in the string (any character other than a hex digit or a dash is an error)
+	static constexpr int countDigits(const char *p)
+	{
+		return *p == 0 ? 0 :
+			isHexDigit(*p) ? 1 + countDigits(p + 1) :
+			*p == '-' ? countDigits(p + 1) :
+			throw "Invalid character in UUID";
+	}
+
+	static constexpr int validBitCount(int bits)
+	{
+		return bits == 16 || bits == 32 || bits == 128 ? bits : throw "A UUID must have 4, 8 or 32 hex digits";
+	}
+
+	// Accumulates `count` hex digits starting with the digit at index `first`
+	//
+	// A 16-bit UUID is the low half of a 32-bit one, which works out naturally: its four digits accumulate into the low bits.
+	static constexpr uint64_t digits(const char *p, int first, int count, int index, uint64_t value)
+	{
+		return *p == 0 || index >= first + count ? value :
+			!isHexDigit(*p) ? digits(p + 1, first, count, index, value) :
+			index < first ? digits(p + 1, first, count, index + 1, value) :
+			digits(p + 1, first, count, index + 1, (value << 4) | hexValue(*p));
+	}
+};
+
 // "0000180A-0000-1000-8000-00805f9b34fb"
+//
+// Internally, a GattUuid is simply the 128-bit value plus the bit count it was created with. Strings are only produced when asked
+// for (typically once, when the UUID property is added to an interface), and comparisons and hashing are integer operations.
 struct GattUuid
 {
 	static constexpr const char *kGattStandardUuidPart1Prefix = "0000";
 	static constexpr const char *kGattStandardUuidSuffix = "-0000-1000-8000-00805f9b34fb";
 
+	// Constructs an invalid (empty) GattUuid with a bit count of 0
+	GattUuid()
+	: high(0), low(0), bitCount(0)
+	{
+	}
+
 	// Construct a GattUuid from a partial or complete string UUID
 	//
 	// This constructor will do the best it can with the data it is given. It will first clean the input by removing all non-hex
@@ -88,8 +171,6 @@ struct GattUuid
 	//
 	// If the input string is not one of the above lengths, the  UUID will be left uninitialized as an empty string with a bit
 	// count of 0.
-	//
-	// Finally, dashes are inserted into the string at the appropriate locations (see `dashify`).
 	GattUuid(const char *strUuid)
 	{
 		*this = GattUuid(std::string(strUuid));
@@ -106,31 +187,34 @@ struct GattUuid
 	//
 	// If the input string is not one of the above lengths, the  UUID will be left uninitialized as an empty string with a bit
 	// count of 0.
-	//
-	// Finally, dashes are inserted into the string at the appropriate locations (see `dashify`).
 	GattUuid(std::string strUuid)
+	: high(0), low(0), bitCount(0)
 	{
 		// Clean the string
 		strUuid = clean(strUuid);
 
 		// It's hex, so each character represents 4 bits
-		bitCount = strUuid.length() * 4;
+		size_t bits = strUuid.length() * 4;
 
-		if (bitCount == 16)
+		if (bits == 16 || bits == 32)
 		{
-			strUuid = kGattStandardUuidPart1Prefix + strUuid + kGattStandardUuidSuffix;
+			*this = GattUuid(static_cast<uint32_t>(parseHex(strUuid, 0, strUuid.length())));
+			bitCount = static_cast<uint8_t>(bits);
 		}
-		else if (bitCount == 32)
+		else if (bits == 128)
 		{
-			strUuid += kGattStandardUuidSuffix;
-		}
-		else if (bitCount != 128)
-		{
-			bitCount = 0;
-			strUuid = "";
+			high = parseHex(strUuid, 0, 16);
+			low = parseHex(strUuid, 16, 16);
+			bitCount = 128;
 		}
+	}
 
-		uuid = dashify(strUuid);
+	// Constructs a GattUuid from a UUID that was parsed at compile time
+	//
+	// The UUID is already validated and in binary form, so this is a simple copy.
+	GattUuid(const ConstUuid &constUuid)
+	: high(constUuid.high), low(constUuid.low), bitCount(static_cast<uint8_t>(constUuid.bitCount))
+	{
 	}
 
 	// Constructs a GattUuid from a 16-bit Uuid value
@@ -141,11 +225,8 @@ struct GattUuid
 	//
 	// ...where "????" is replaced by the 4-digit hex value of `part`
 	GattUuid(const uint16_t part)
+	: high((static_cast<uint64_t>(part) << 32) | kBaseHigh), low(kBaseLow), bitCount(16)
 	{
-		bitCount = 16;
-		char partStr[5];
-		snprintf(partStr, sizeof(partStr), "%04x", part);
-		uuid = std::string(kGattStandardUuidPart1Prefix) + partStr + kGattStandardUuidSuffix;
 	}
 
 	// Constructs a GattUuid from a 32-bit Uuid value
@@ -156,11 +237,8 @@ struct GattUuid
 	//
 	// ...where "????????" is replaced by the 8-digit hex value of `part`
 	GattUuid(const uint32_t part)
+	: high((static_cast<uint64_t>(part) << 32) | kBaseHigh), low(kBaseLow), bitCount(32)
 	{
-		bitCount = 32;
-		char partStr[9];
-		snprintf(partStr, sizeof(partStr), "%08x", part);
-		uuid = std::string(partStr) + kGattStandardUuidSuffix;
 	}
 
 	// Constructs a GattUuid from a 5-part set of input values
@@ -174,13 +252,10 @@ struct GattUuid
 	// Note that `part5` is a 48-bit value and will be masked such that only the lower 48-bits of `part5` are used with all other
 	// bits ignored.
 	GattUuid(const uint32_t part1, const uint16_t part2, const uint16_t part3, const uint16_t part4, const uint64_t part5)
+	: high((static_cast<uint64_t>(part1) << 32) | (static_cast<uint64_t>(part2) << 16) | part3),
+	  low((static_cast<uint64_t>(part4) << 48) | (part5 & 0xffffffffffffULL)),
+	  bitCount(128)
 	{
-		bitCount = 128;
-		char partsStr[37];
-		uint32_t part5a = (part5 >> 4) & 0xffffffff;
-		uint32_t part5b = part5 & 0xffff;
-		snprintf(partsStr, sizeof(partsStr), "%08x-%04x-%04x-%04x-%08x%04x", part1, part2, part3, part4, part5a, part5b);
-		uuid = std::string(partsStr);
 	}
 
 	// Returns the bit count of the input when the GattUuid was constructed. Valid values are 16, 32, 128.
@@ -191,14 +266,34 @@ struct GattUuid
 		return bitCount;
 	}
 
+	// Returns true if the GattUuid was constructed properly
+	bool isValid() const
+	{
+		return bitCount != 0;
+	}
+
+	// Returns the upper 64 bits of the full 128-bit UUID
+	uint64_t getHigh() const
+	{
+		return high;
+	}
+
+	// Returns the lower 64 bits of the full 128-bit UUID
+	uint64_t getLow() const
+	{
+		return low;
+	}
+
 	// Returns the 16-bit portion of the GATT UUID or an empty string if the GattUuid was not created correctly
 	//
 	// Note that a 16-bit GATT UUID is only valid for standarg GATT UUIDs (prefixed with "0000" and ending with
 	// "0000-1000-8000-00805f9b34fb").
 	std::string toString16() const
 	{
-		if (uuid.empty()) { return uuid; }
-		return uuid.substr(4, 4);
+		if (!isValid()) { return std::string(); }
+		char str[5];
+		snprintf(str, sizeof(str), "%04x", static_cast<unsigned int>((high >> 32) & 0xffff));
+		return std::string(str);
 	}
 
 	// Returns the 32-bit portion of the GATT UUID or an empty string if the GattUuid was not created correctly
@@ -206,14 +301,24 @@ struct GattUuid
 	// Note that a 32-bit GATT UUID is only valid for standarg GATT UUIDs (ending with "0000-1000-8000-00805f9b34fb").
 	std::string toString32() const
 	{
-		if (uuid.empty()) { return uuid; }
-		return uuid.substr(0, 8);
+		if (!isValid()) { return std::string(); }
+		char str[9];
+		snprintf(str, sizeof(str), "%08x", static_cast<unsigned int>(high >> 32));
+		return std::string(str);
 	}
 
 	// Returns the full 128-bit GATT UUID or an empty string if the GattUuid was not created correctly
 	std::string toString128() const
 	{
-		return uuid;
+		if (!isValid()) { return std::string(); }
+		char str[37];
+		snprintf(str, sizeof(str), "%08x-%04x-%04x-%04x-%012llx",
+			static_cast<unsigned int>(high >> 32),
+			static_cast<unsigned int>((high >> 16) & 0xffff),
+			static_cast<unsigned int>(high & 0xffff),
+			static_cast<unsigned int>(low >> 48),
+			static_cast<unsigned long long>(low & 0xffffffffffffULL));
+		return std::string(str);
 	}
 
 	// Returns a string form of the UUID, based on the bit count used when the UUID was created. A 16-bit UUID will return a
@@ -226,6 +331,39 @@ struct GattUuid
 		return toString128();
 	}
 
+	//
+	// Comparison and hashing
+	//
+	// UUIDs compare by their full 128-bit value, so "180A" and "0000180a-0000-1000-8000-00805f9b34fb" are equal. All invalid
+	// UUIDs are equal to each other and to nothing else.
+	//
+
+	bool operator ==(const GattUuid &rhs) const
+	{
+		return high == rhs.high && low == rhs.low && isValid() == rhs.isValid();
+	}
+
+	bool operator !=(const GattUuid &rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+	bool operator <(const GattUuid &rhs) const
+	{
+		return high != rhs.high ? high < rhs.high : low != rhs.low ? low < rhs.low : isValid() < rhs.isValid();
+	}
+
+	// Hash functor, for use with unordered containers
+	struct Hash
+	{
+		size_t operator ()(const GattUuid &uuid) const
+		{
+			// Standard UUIDs differ only in the upper 32 bits, so those must feed the hash
+			uint64_t mixed = (uuid.high ^ (uuid.high >> 32)) * 0x9e3779b97f4a7c15ULL ^ uuid.low;
+			return static_cast<size_t>(mixed ^ (mixed >> 29));
+		}
+	};
+
 	// Returns a new string containing the lower case contents of `strUuid` with all non-hex characters (0-9, A-F) removed
 	static std::string clean(const std::string &strUuid)
 	{
@@ -279,8 +417,28 @@ struct GattUuid
 
 private:
 
-	std::string uuid;
-	int bitCount;
+	// The parts of the Bluetooth Base UUID that a 16- or 32-bit UUID doesn't specify
+	static constexpr uint64_t kBaseHigh = 0x00001000ULL;
+	static constexpr uint64_t kBaseLow = 0x800000805f9b34fbULL;
+
+	// Returns the value of `count` hex digits starting at `first` in a clean string (see `clean`)
+	static uint64_t parseHex(const std::string &str, size_t first, size_t count)
+	{
+		uint64_t value = 0;
+		for (size_t i = first; i < first + count; ++i)
+		{
+			char c = str[i];
+			value = (value << 4) | static_cast<uint64_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+		}
+		return value;
+	}
+
+	// The full 128-bit UUID
+	uint64_t high;
+	uint64_t low;
+
+	// The bit count the UUID was created with (16, 32 or 128), which determines its short form. 0 means the UUID is invalid.
+	uint8_t bitCount;
 };
 
 }; // namespace ggk
\ No newline at end of file
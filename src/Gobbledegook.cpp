@@ -39,58 +39,288 @@
 // The interface below has the following categories:
 //
 //     Log registration - used to register methods that accept all Gobbledegook logs
+//     Connections - used to find out which devices are connected, and to be told when they connect or disconnect
 //     Update queue management - used for notifying the server that data has been updated
 //     Server state - used to track the server's current running state and health
 //     Server control - running and stopping the server
+//     Link tuning - requesting better connection parameters, PHYs and data lengths
+//     Instances - running several independent servers in one process (see Instance.cpp)
+//     Memory - choosing a memory profile and reporting what the server is using
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <string.h>
 #include <string>
 #include <thread>
 #include <memory>
-#include <deque>
+#include <atomic>
 #include <mutex>
+#include <vector>
+#include <stdio.h>
 
+#include "Advertising.h"
+#include "BondStore.h"
 #include "Init.h"
+#include "HciAdapter.h"
 #include "Logger.h"
 #include "Server.h"
+#include "DBusInterface.h"
+#include "GattCharacteristic.h"
+#include "GattDescriptor.h"
+#include "UpdateQueue.h"
+#include "DataStore.h"
+#include "DBusMethod.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+#include "MainContext.h"
+#include "Instance.h"
 
 namespace ggk
 {
 	// During initialization, we'll check for complation at this interval
 	static const int kMaxAsyncInitCheckIntervalMS = 10;
 
-	// Our server thread
-	static std::thread serverThread;
-
-	// The current server state
-	volatile static GGKServerRunState serverRunState = EUninitialized;
-
-	// The current server health
-	volatile static GGKServerHealth serverHealth = EOk;
-
 	// We store the old GLib print handler and error print handler so we can restore if
+	//
+	// GLib only has one set of handlers, so they are shared by every instance that is running (see `captureGLibOutput()`)
 	static GPrintFunc printHandlerGLib;
 	static GPrintFunc printerrHandlerGLib;
 	static GLogFunc logHandlerGLib;
-
-	// Our update queue
-	typedef std::tuple<std::string, std::string> QueueEntry;
-	std::deque<QueueEntry> updateQueue;
-	std::mutex updateQueueMutex;
+	static int glibOutputCaptureCount = 0;
+	static std::mutex glibOutputMutex;
 
 	// Internal method to set the run state of the server
 	void setServerRunState(GGKServerRunState newState)
 	{
-		Logger::status(SSTR << "** SERVER RUN STATE CHANGED: " << ggkGetServerRunStateString(serverRunState) << " -> " << ggkGetServerRunStateString(newState));
-		serverRunState = newState;
+		Instance &instance = Instance::current();
+		Logger::status(SSTR << "** SERVER RUN STATE CHANGED: " << ggkGetServerRunStateString(instance.serverRunState) << " -> " << ggkGetServerRunStateString(newState));
+		instance.serverRunState = newState;
 	}
 
 	// Internal method to set the health of the server
 	void setServerHealth(GGKServerHealth newHealth)
 	{
-		Logger::status(SSTR << "** SERVER HEALTH CHANGED: " << ggkGetServerHealthString(serverHealth) << " -> " << ggkGetServerHealthString(newHealth));
-		serverHealth = newHealth;
+		Instance &instance = Instance::current();
+		Logger::status(SSTR << "** SERVER HEALTH CHANGED: " << ggkGetServerHealthString(instance.serverHealth) << " -> " << ggkGetServerHealthString(newHealth));
+		instance.serverHealth = newHealth;
+	}
+
+	// Internal method to redirect GLib's output to our logger for the current instance
+	//
+	// The first instance to start installs our handlers and the last one to stop restores GLib's (see `releaseGLibOutput()`.)
+	static void captureGLibOutput()
+	{
+		Instance &instance = Instance::current();
+		std::lock_guard<std::mutex> lock(glibOutputMutex);
+		if (instance.bCapturingGLibOutput)
+		{
+			return;
+		}
+
+		instance.bCapturingGLibOutput = true;
+		if (glibOutputCaptureCount++ != 0)
+		{
+			return;
+		}
+
+		// Redirect GLib output to this log method
+		printHandlerGLib = g_set_print_handler([](const gchar *string)
+		{
+			Logger::info(string);
+		});
+		printerrHandlerGLib = g_set_printerr_handler([](const gchar *string)
+		{
+			Logger::error(string);
+		});
+		logHandlerGLib = g_log_set_default_handler([](const gchar *log_domain, GLogLevelFlags log_levels, const gchar *message, gpointer /*user_data*/)
+		{
+			std::string str = std::string(log_domain) + ": " + message;
+			if ((log_levels & (G_LOG_FLAG_RECURSION|G_LOG_FLAG_FATAL)) != 0)
+			{
+				Logger::fatal(str);
+			}
+			else if ((log_levels & (G_LOG_LEVEL_CRITICAL|G_LOG_LEVEL_ERROR)) != 0)
+			{
+				Logger::error(str);
+			}
+			else if ((log_levels & G_LOG_LEVEL_WARNING) != 0)
+			{
+				Logger::warn(str);
+			}
+			else if ((log_levels & G_LOG_LEVEL_DEBUG) != 0)
+			{
+				LOG_DEBUG(str);
+			}
+			else
+			{
+				Logger::info(str);
+			}
+		}, nullptr);
+	}
+
+	// Internal method to stop redirecting GLib's output for the current instance (see `captureGLibOutput()`)
+	static void releaseGLibOutput()
+	{
+		Instance &instance = Instance::current();
+		std::lock_guard<std::mutex> lock(glibOutputMutex);
+		if (!instance.bCapturingGLibOutput)
+		{
+			return;
+		}
+
+		instance.bCapturingGLibOutput = false;
+		if (--glibOutputCaptureCount != 0)
+		{
+			return;
+		}
+
+		// Restore the GLib output functions
+		g_set_print_handler(printHandlerGLib);
+		g_set_printerr_handler(printerrHandlerGLib);
+		g_log_set_default_handler(logHandlerGLib, nullptr);
+	}
+
+	// Internal method to resolve an update to its interface and add it to the update queue
+	//
+	// If `skipUnsubscribed` is set and the interface is a characteristic that no client has subscribed to, the update is
+	// discarded (successfully) without being queued, since there is nobody to notify.
+	//
+	// Returns non-zero value on success or 0 on failure.
+	static int pushUpdate(const char *pObjectPath, const char *pInterfaceName, bool skipUnsubscribed)
+	{
+		if (nullptr == TheServer)
+		{
+			Logger::warn(SSTR << "Unable to queue update before the server is started: path[" << pObjectPath << "], name[" << pInterfaceName << "]");
+			return 0;
+		}
+
+		// We may be on any thread, so the lookup is made under the description lock (see `Server::addService()`)
+		std::shared_ptr<const DBusInterface> pInterface;
+		{
+			std::unique_lock<std::mutex> lock = TheServer->lockDescription();
+			pInterface = TheServer->findInterface(pObjectPath, pInterfaceName);
+		}
+
+		if (nullptr == pInterface)
+		{
+			Logger::warn(SSTR << "Unable to find interface for update: path[" << pObjectPath << "], name[" << pInterfaceName << "]");
+			return 0;
+		}
+
+		// The value has changed, so any cached read of the old value is stale (whether or not anybody is notified)
+		std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic);
+		std::shared_ptr<const GattDescriptor> pDescriptor = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattDescriptor);
+		if (nullptr != pCharacteristic)
+		{
+			pCharacteristic->invalidateReadCache();
+		}
+		else if (nullptr != pDescriptor)
+		{
+			pDescriptor->invalidateReadCache();
+		}
+
+		if (skipUnsubscribed && nullptr != pCharacteristic && !pCharacteristic->isNotifying())
+		{
+			return 1;
+		}
+
+		if (!TheUpdateQueue.push(pInterface.get()))
+		{
+			Logger::warn(SSTR << "Update queue is full; dropping update: path[" << pObjectPath << "], name[" << pInterfaceName << "]");
+			return 0;
+		}
+
+		return 1;
+	}
+
+	// Internal method to add updates for a batch of characteristics to the update queue in one go
+	//
+	// As with `ggkNofifyUpdatedCharacteristic()`, characteristics that nobody is subscribed to are not queued.
+	//
+	// Returns non-zero value on success or 0 on failure.
+	static int pushCharacteristicBatch(const std::vector<const GattCharacteristic *> &characteristics)
+	{
+		static thread_local std::vector<const DBusInterface *> batch;
+		batch.clear();
+
+		for (const GattCharacteristic *pCharacteristic : characteristics)
+		{
+			// The value has changed, so any cached read of the old value is stale (whether or not anybody is notified)
+			pCharacteristic->invalidateReadCache();
+			if (pCharacteristic->isNotifying())
+			{
+				batch.push_back(pCharacteristic);
+			}
+		}
+
+		if (!TheUpdateQueue.pushBatch(batch.data(), batch.size()))
+		{
+			Logger::warn(SSTR << "Update queue is full; dropping a batch of " << batch.size() << " updates");
+			return 0;
+		}
+
+		return 1;
+	}
+
+	// Converts a connection from the adapter into its public form
+	static GGKConnection toGGKConnection(const HciAdapter::Connection &connection)
+	{
+		GGKConnection result;
+		result.controllerIndex = connection.controllerIndex;
+
+		// Addresses arrive from the adapter in little-endian order
+		snprintf(result.address, sizeof(result.address), "%02X:%02X:%02X:%02X:%02X:%02X",
+			connection.address[5], connection.address[4], connection.address[3],
+			connection.address[2], connection.address[1], connection.address[0]);
+
+		result.addressType = connection.addressType;
+		result.minConnectionInterval = connection.minConnectionInterval;
+		result.maxConnectionInterval = connection.maxConnectionInterval;
+		result.connectionLatency = connection.connectionLatency;
+		result.supervisionTimeout = connection.supervisionTimeout;
+		return result;
+	}
+
+	// A connection or disconnection, on its way to the server's thread
+	struct ConnectionChange
+	{
+		GGKConnection connection;
+		bool connected;
+		int reason;
+	};
+
+	// Our connection handler (see `HciAdapter::setConnectionHandler()`)
+	//
+	// This is called from the HciAdapter's event thread, so rather than calling the delegates here, we hand the change over to the
+	// server's thread (via an idle source on the main loop) and return immediately.
+	static void onConnectionChanged(const HciAdapter::Connection &connection, bool connected, uint8_t reason)
+	{
+		Instance &instance = Instance::current();
+		if (nullptr == instance.connectDelegate.load() && nullptr == instance.disconnectDelegate.load())
+		{
+			return;
+		}
+
+		ConnectionChange *pChange = new ConnectionChange;
+		pChange->connection = toGGKConnection(connection);
+		pChange->connected = connected;
+		pChange->reason = reason;
+
+		MainContext::addIdle([](gpointer pUserData) -> gboolean
+		{
+			std::unique_ptr<ConnectionChange> pChange(static_cast<ConnectionChange *>(pUserData));
+			if (pChange->connected)
+			{
+				GGKConnectDelegate delegate = Instance::current().connectDelegate;
+				if (nullptr != delegate) { delegate(&pChange->connection); }
+			}
+			else
+			{
+				GGKDisconnectDelegate delegate = Instance::current().disconnectDelegate;
+				if (nullptr != delegate) { delegate(&pChange->connection, pChange->reason); }
+			}
+			return G_SOURCE_REMOVE;
+		}, pChange);
 	}
 }; // namespace ggk
 
@@ -115,6 +345,126 @@ void ggkLogRegisterFatal(GGKLogReceiver receiver) { Logger::registerFatalReceive
 void ggkLogRegisterTrace(GGKLogReceiver receiver) { Logger::registerTraceReceiver(receiver); }
 void ggkLogRegisterAlways(GGKLogReceiver receiver) { Logger::registerAlwaysReceiver(receiver); }
 
+// Enables (non-zero) or disables (zero) asynchronous log delivery (see `Logger::setAsync()`)
+void ggkLogSetAsync(int enabled) { Logger::setAsync(enabled != 0); }
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//   ____                            _   _
+//  / ___|___  _ __  _ __   ___  ___| |_(_) ___  _ __  ___
+// | |   / _ \| '_ \| '_ \ / _ \/ __| __| |/ _ \| '_ \/ __|
+// | |__| (_) | | | | | | |  __/ (__| |_| | (_) | | | \__  |
+//  \____\___/|_| |_|_| |_|\___|\___|\__|_|\___/|_| |_|___/
+//
+// Find out who is connected. The connection table itself lives in the HciAdapter, which is fed by events from the kernel.
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Each of these methods registers a connection delegate. To unregister a delegate, simply register with `nullptr`.
+void ggkRegisterConnectDelegate(GGKConnectDelegate delegate)
+{
+	Instance::current().connectDelegate = delegate;
+	HciAdapter::getInstance().setConnectionHandler(onConnectionChanged);
+}
+
+void ggkRegisterDisconnectDelegate(GGKDisconnectDelegate delegate)
+{
+	Instance::current().disconnectDelegate = delegate;
+	HciAdapter::getInstance().setConnectionHandler(onConnectionChanged);
+}
+
+// Returns the number of devices currently connected to any of our adapters
+int ggkGetConnectionCount()
+{
+	return HciAdapter::getInstance().getActiveConnectionCount();
+}
+
+// Copies up to `maxConnections` of the currently connected devices into `pConnections`
+//
+// Returns the number of connections copied
+int ggkGetConnections(struct GGKConnection *pConnections, int maxConnections)
+{
+	if (nullptr == pConnections || maxConnections <= 0)
+	{
+		return 0;
+	}
+
+	int count = 0;
+	for (const HciAdapter::Connection &connection : HciAdapter::getInstance().getConnections())
+	{
+		if (count == maxConnections) { break; }
+		pConnections[count++] = toGGKConnection(connection);
+	}
+
+	return count;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____        _              _
+// |  _ \  __ _| |_ __ _   ___| |_ ___  _ __ ___
+// | | | |/ _` | __/ _` | / __| __/ _ \| '__/ _ |
+// | |_| | (_| | || (_| | \__ \ || (_) | | |  __/
+// |____/ \__,_|\__\__,_| |___/\__\___/|_|  \___|
+//
+// Named, lock-free slots for data shared between the application and the server (see DataStore.cpp)
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Registers a named slot in the server's data store that can hold values of up to `maxSize` bytes
+//
+// If a slot with this name already exists (for example, because the server description bound a characteristic to it), the
+// existing slot's handle is returned. Slots may be registered before the server is started.
+//
+// Returns the slot's handle, or -1 on failure.
+int ggkRegisterDataSlot(const char *pName, int maxSize)
+{
+	if (nullptr == pName || maxSize <= 0)
+	{
+		return -1;
+	}
+
+	return TheDataStore.registerSlot(pName, static_cast<size_t>(maxSize));
+}
+
+// Returns the handle of the slot with the given name, or -1 if there is no such slot
+int ggkFindDataSlot(const char *pName)
+{
+	if (nullptr == pName)
+	{
+		return -1;
+	}
+
+	return TheDataStore.findSlot(pName);
+}
+
+// Stores a new value in a data slot
+//
+// The value is copied, so the caller's buffer may be reused immediately. If the slot is bound to a characteristic and a client
+// is subscribed to that characteristic, the characteristic is queued for an update (as with `ggkNofifyUpdatedCharacteristic`.)
+//
+// This may be called from any thread and never blocks readers of the slot.
+//
+// Returns non-zero value on success or 0 on failure (an invalid handle or a value larger than the slot.)
+int ggkPublish(int handle, const void *pData, int dataLength)
+{
+	if (dataLength < 0)
+	{
+		return 0;
+	}
+
+	return TheDataStore.publish(handle, pData, static_cast<size_t>(dataLength)) ? 1 : 0;
+}
+
+// Copies the current value of a data slot into `pBuffer`
+//
+// Returns the length of the value, or -1 on failure (an invalid handle or a buffer too small to hold the value.)
+int ggkReadDataSlot(int handle, void *pBuffer, int bufferLength)
+{
+	if (nullptr == pBuffer || bufferLength < 0)
+	{
+		return -1;
+	}
+
+	return TheDataStore.read(handle, pBuffer, static_cast<size_t>(bufferLength));
+}
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 //  _   _           _       _                                                                                                     _
 // | | | |_ __   __| | __ _| |_ ___     __ _ _   _  ___ _   _  ___    _ __ ___   __ _ _ __   __ _  __ _  ___ _ __ ___   ___ _ __ | |_
@@ -124,15 +474,18 @@ void ggkLogRegisterAlways(GGKLogReceiver receiver) { Logger::registerAlwaysRecei
 //       |_|                              |_|                                                     |___/
 //
 // Push/pop update notifications onto a queue. As these methods are where threads collide (i.e., this is how they communicate),
-// these methods are thread-safe.
+// these methods are thread-safe. The queue itself is lock-free (see UpdateQueue.cpp.)
 // ---------------------------------------------------------------------------------------------------------------------------------
 
 // Adds an update to the front of the queue for a characteristic at the given object path
 //
+// If no client is currently subscribed to the characteristic's notifications, there is nobody to notify, so the update is
+// not queued (this still counts as success.)
+//
 // Returns non-zero value on success or 0 on failure.
 int ggkNofifyUpdatedCharacteristic(const char *pObjectPath)
 {
-	return ggkPushUpdateQueue(pObjectPath, "org.bluez.GattCharacteristic1") != 0;
+	return pushUpdate(pObjectPath, "org.bluez.GattCharacteristic1", true);
 }
 
 // Adds an update to the front of the queue for a descriptor at the given object path
@@ -140,62 +493,186 @@ int ggkNofifyUpdatedCharacteristic(const char *pObjectPath)
 // Returns non-zero value on success or 0 on failure.
 int ggkNofifyUpdatedDescriptor(const char *pObjectPath)
 {
-	return ggkPushUpdateQueue(pObjectPath, "org.bluez.GattDescriptor1") != 0;
+	return pushUpdate(pObjectPath, "org.bluez.GattDescriptor1", false);
+}
+
+// Adds updates for `count` characteristics, given by their object paths, to the queue all at once
+//
+// This works like calling `ggkNofifyUpdatedCharacteristic()` for each path, except that the whole batch is queued together
+// (with a single wakeup of the server) and is processed by the server in a single pass. If any of the paths is not a
+// characteristic, or the queue doesn't have room for the batch, nothing is queued.
+//
+// Returns non-zero value on success or 0 on failure.
+int ggkNotifyUpdatedCharacteristics(const char **ppObjectPaths, int count)
+{
+	if (nullptr == TheServer || (nullptr == ppObjectPaths && count != 0) || count < 0)
+	{
+		return 0;
+	}
+
+	static thread_local std::vector<const GattCharacteristic *> characteristics;
+	characteristics.clear();
+
+	// Resolve the whole batch under a single hold of the description lock (see `Server::addService()`)
+	{
+		std::unique_lock<std::mutex> lock = TheServer->lockDescription();
+		for (int i = 0; i < count; ++i)
+		{
+			std::shared_ptr<const DBusInterface> pInterface = TheServer->findInterface(ppObjectPaths[i], "org.bluez.GattCharacteristic1");
+			std::shared_ptr<const GattCharacteristic> pCharacteristic = nullptr == pInterface ? nullptr : TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic);
+			if (nullptr == pCharacteristic)
+			{
+				Logger::warn(SSTR << "Unable to find characteristic for update: path[" << ppObjectPaths[i] << "]");
+				return 0;
+			}
+
+			characteristics.push_back(pCharacteristic.get());
+		}
+	}
+
+	return pushCharacteristicBatch(characteristics);
+}
+
+// Resolves the characteristic at the given object path to a handle, for use with `ggkNotifyUpdatedCharacteristicHandles()`
+//
+// Resolving the same characteristic again returns the same handle. The server must be started first. If the characteristic's
+// service is removed (and added again), resolve it again.
+//
+// Returns the handle, or -1 if there is no such characteristic (or no more handles are available)
+int ggkResolveCharacteristic(const char *pObjectPath)
+{
+	if (nullptr == TheServer || nullptr == pObjectPath)
+	{
+		return -1;
+	}
+
+	std::shared_ptr<const DBusInterface> pInterface;
+	{
+		std::unique_lock<std::mutex> lock = TheServer->lockDescription();
+		pInterface = TheServer->findInterface(pObjectPath, "org.bluez.GattCharacteristic1");
+	}
+
+	std::shared_ptr<const GattCharacteristic> pCharacteristic = nullptr == pInterface ? nullptr : TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic);
+	if (nullptr == pCharacteristic)
+	{
+		Logger::warn(SSTR << "Unable to resolve characteristic: path[" << pObjectPath << "]");
+		return -1;
+	}
+
+	Instance &instance = Instance::current();
+	std::lock_guard<std::mutex> lock(instance.characteristicHandleMutex);
+
+	int handleCount = instance.characteristicHandleCount.load(std::memory_order_relaxed);
+	for (int handle = 0; handle < handleCount; ++handle)
+	{
+		if (instance.characteristicHandles[handle].load(std::memory_order_relaxed) == pCharacteristic.get())
+		{
+			return handle;
+		}
+	}
+
+	if (handleCount == Instance::kMaxCharacteristicHandles)
+	{
+		Logger::warn(SSTR << "Unable to resolve characteristic '" << pObjectPath << "': all " << Instance::kMaxCharacteristicHandles << " handles are in use");
+		return -1;
+	}
+
+	// Publish the handle only once it's ready
+	instance.characteristicHandles[handleCount].store(pCharacteristic.get(), std::memory_order_relaxed);
+	instance.characteristicHandleCount.store(handleCount + 1, std::memory_order_release);
+	return handleCount;
+}
+
+// Adds updates for `count` characteristics, given by handles from `ggkResolveCharacteristic()`, to the queue all at once
+//
+// This is the fastest way to notify of many updates: nothing is looked up and nothing is locked. Otherwise, it works like
+// `ggkNotifyUpdatedCharacteristics()`. If any of the handles is invalid, nothing is queued.
+//
+// Returns non-zero value on success or 0 on failure.
+int ggkNotifyUpdatedCharacteristicHandles(const int *pHandles, int count)
+{
+	if ((nullptr == pHandles && count != 0) || count < 0)
+	{
+		return 0;
+	}
+
+	static thread_local std::vector<const GattCharacteristic *> characteristics;
+	characteristics.clear();
+
+	Instance &instance = Instance::current();
+	int handleCount = instance.characteristicHandleCount.load(std::memory_order_acquire);
+	for (int i = 0; i < count; ++i)
+	{
+		if (pHandles[i] < 0 || pHandles[i] >= handleCount)
+		{
+			Logger::warn(SSTR << "Invalid characteristic handle for update: " << pHandles[i]);
+			return 0;
+		}
+
+		characteristics.push_back(instance.characteristicHandles[pHandles[i]].load(std::memory_order_relaxed));
+	}
+
+	return pushCharacteristicBatch(characteristics);
 }
 
-// Adds a named update to the front of the queue. Generally, this routine should not be used directly. Instead, use the
+// Adds a named update to the queue. Generally, this routine should not be used directly. Instead, use the
 // `ggkNofifyUpdatedCharacteristic()` instead.
 //
+// The object path and interface name are resolved to an interface when the update is pushed, so the server must be started
+// before updates can be posted. If the interface already has an update pending, this update is coalesced with it.
+//
+// Unlike `ggkNofifyUpdatedCharacteristic()`, updates are queued whether or not a client is subscribed.
+//
 // Returns non-zero value on success or 0 on failure.
 int ggkPushUpdateQueue(const char *pObjectPath, const char *pInterfaceName)
 {
-	QueueEntry t(pObjectPath, pInterfaceName);
-
-	std::lock_guard<std::mutex> guard(updateQueueMutex);
-	updateQueue.push_front(t);
-	return 1;
+	return pushUpdate(pObjectPath, pInterfaceName, false);
 }
 
-// Get the next update from the back of the queue and returns the element in `element` as a string in the format:
+// Get the next update from the front of the queue and returns the element in `element` as a string in the format:
 //
 //     "com/object/path|com.interface.name"
 //
 // If the queue is empty, this method returns `0` and does nothing.
 //
 // `elementLen` is the size of the `element` buffer in bytes. If the resulting string (including the null terminator) will not
-// fit within `elementLen` bytes, the method returns `-1` and does nothing.
+// fit within `elementLen` bytes, the method returns `-1` and the entry stays queued (if it was being removed, it goes to the
+// back of the queue.)
+//
+// If `keep` is set to non-zero, the entry is not removed. Since other threads (including the server itself) may take it at any
+// time, the result is only a snapshot of the front of the queue: the next call may well return a different entry. Otherwise,
+// the element is removed and returned in a single step.
 //
-// If `keep` is set to non-zero, the entry is not removed and will be retrieved again on the next call. Otherwise, the element
-// is removed.
+// Note that the server processes its own queue internally, without going through this method. This method is retained for
+// applications that wish to inspect or drain the queue themselves.
 //
 // Returns 1 on success, 0 if the queue is empty, -1 on error (such as the length too small to store the element)
 int ggkPopUpdateQueue(char *pElementBuffer, int elementLen, int keep)
 {
-	std::string result;
-
-	{
-		std::lock_guard<std::mutex> guard(updateQueueMutex);
-
-		// Check for an empty queue
-		if (updateQueue.empty()) { return 0; }
+	// Take the entry in one step when removing it, since the front of the queue may change under us between a peek and a pop
+	const DBusInterface *pInterface = keep == 0 ? TheUpdateQueue.pop() : TheUpdateQueue.peek();
+	if (nullptr == pInterface) { return 0; }
 
-		// Get the last element
-		QueueEntry t = updateQueue.back();
+	// The result string is "<path>|<name>", copied straight from the interface
+	const std::string &path = pInterface->getPath().toString();
+	const std::string &name = pInterface->getName();
+	size_t length = path.length() + 1 + name.length();
 
-		// Get the result string
-		result = std::get<0>(t) + "|" + std::get<1>(t);
-
-		// Ensure there's enough room for it
-		if (result.length() + 1 > static_cast<size_t>(elementLen)) { return -1; }
-
-		if (keep == 0)
+	// Ensure there's enough room for it, returning a removed entry to the queue if not
+	if (elementLen < 0 || length + 1 > static_cast<size_t>(elementLen))
+	{
+		if (keep == 0 && !TheUpdateQueue.push(pInterface))
 		{
-			updateQueue.pop_back();
+			Logger::warn(SSTR << "Update queue is full; dropping update for '" << path << "|" << name << "'");
 		}
+
+		return -1;
 	}
 
 	// Copy the element string
-	memcpy(pElementBuffer, result.c_str(), result.length() + 1);
+	memcpy(pElementBuffer, path.c_str(), path.length());
+	pElementBuffer[path.length()] = '|';
+	memcpy(pElementBuffer + path.length() + 1, name.c_str(), name.length() + 1);
 
 	return 1;
 }
@@ -203,90 +680,334 @@ int ggkPopUpdateQueue(char *pElementBuffer, int elementLen, int keep)
 // Returns 1 if the queue is empty, otherwise 0
 int ggkUpdateQueueIsEmpty()
 {
-	std::lock_guard<std::mutex> guard(updateQueueMutex);
-	return updateQueue.empty() ? 1 : 0;
+	return TheUpdateQueue.empty() ? 1 : 0;
 }
 
 // Returns the number of entries waiting in the queue
 int ggkUpdateQueueSize()
 {
-	std::lock_guard<std::mutex> guard(updateQueueMutex);
-	return updateQueue.size();
+	return static_cast<int>(TheUpdateQueue.size());
 }
 
 // Removes all entries from the queue
 void ggkUpdateQueueClear()
 {
-	std::lock_guard<std::mutex> guard(updateQueueMutex);
-	updateQueue.clear();
+	TheUpdateQueue.clear();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____                     _        _
+// |  _ \ _   _ _ __     ___| |_ __ _| |_ ___
+// | |_) | | | | '_ \   / __| __/ _` | __/ _ )
+// |  _ <| |_| | | | |  \__ \ || (_| | ||  __/
+// |_| \_\\__,_|_| |_|  |___/\__\__,_|\__\___|
+//
+// Methods for maintaining and reporting the state of the server
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Retrieve the current running state of the server
+//
+// See `GGKServerRunState` (enumeration) for more information.
+GGKServerRunState ggkGetServerRunState()
+{
+	return Instance::current().serverRunState;
+}
+
+// Convert a `GGKServerRunState` into a human-readable string
+const char *ggkGetServerRunStateString(GGKServerRunState state)
+{
+	switch(state)
+	{
+		case EUninitialized: return "Uninitialized";
+		case EInitializing: return "Initializing";
+		case ERunning: return "Running";
+		case EStopping: return "Stopping";
+		case EStopped: return "Stopped";
+		default: return "Unknown";
+	}
+}
+
+// Convenience method to check ServerRunState for a running server
+int ggkIsServerRunning()
+{
+	return Instance::current().serverRunState <= ERunning ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____                              _                _ _   _
+// / ___|  ___ _ ____   _____ _ __   | |__   ___  __ _| | |_| |___
+// \___ \ / _ \ '__\ \ / / _ \ '__|  | '_ \ / _ \/ _` | | __| '_  |
+//  ___) |  __/ |   \ V /  __/ |     | | | |  __/ (_| | | |_| | | |
+// |____/ \___|_|    \_/ \___|_|     |_| |_|\___|\__,_|_|\__|_| |_|
+//
+// Methods for maintaining and reporting the health of the server
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Retrieve the current health of the server
+//
+// See `GGKServerHealth` (enumeration) for more information.
+GGKServerHealth ggkGetServerHealth()
+{
+	return Instance::current().serverHealth;
+}
+
+// Convert a `GGKServerHealth` into a human-readable string
+const char *ggkGetServerHealthString(GGKServerHealth state)
+{
+	switch(state)
+	{
+		case EOk: return "Ok";
+		case EFailedInit: return "Failed initialization";
+		case EFailedRun: return "Failed run";
+		default: return "Unknown";
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ___           _
+// |_ _|_ __  ___| |_ __ _ _ __   ___ ___  ___
+//  | || '_ \/ __| __/ _` | '_ \ / __/ _ \/ __|
+//  | || | | \__ \ || (_| | | | | (_|  __/\__ )
+// |___|_| |_|___/\__\__,_|_| |_|\___\___||___/
+//
+// Independent servers, each with its own thread (see Instance.cpp)
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the instance a public handle refers to (nullptr refers to the default instance)
+static Instance &toInstance(GGKInstance *pInstance)
+{
+	return nullptr == pInstance ? Instance::getDefault() : *reinterpret_cast<Instance *>(pInstance);
+}
+
+// Returns the public handle for an instance
+static GGKInstance *toGGKInstance(Instance &instance)
+{
+	return reinterpret_cast<GGKInstance *>(&instance);
+}
+
+// Creates a new instance, ready to be configured and started
+//
+// Returns the new instance, or nullptr on failure.
+GGKInstance *ggkCreate()
+{
+	try
+	{
+		return toGGKInstance(*new Instance);
+	}
+	catch(...)
+	{
+		Logger::error("Unable to create a server instance");
+		return nullptr;
+	}
+}
+
+// Destroys an instance created with `ggkCreate()`
+//
+// The instance must have been stopped (or never started) and must not be selected on any thread.
+//
+// Returns non-zero on success, or 0 if the instance is still running.
+int ggkDestroy(GGKInstance *pInstance)
+{
+	if (nullptr == pInstance)
+	{
+		return 1;
+	}
+
+	GGKServerRunState runState = ggkGetInstanceRunState(pInstance);
+	if (runState != EUninitialized && runState != EStopped)
+	{
+		Logger::warn("Unable to destroy a server instance that is still running");
+		return 0;
+	}
+
+	delete &toInstance(pInstance);
+	return 1;
+}
+
+// Makes `pInstance` the current instance of the calling thread, so that every other method called from this thread works with
+// it (pass nullptr to return to the default instance)
+//
+// This is how an instance is configured before it is started: select it, then call `ggkAddAdapter()`,
+// `ggkAddAdvertisingInstance()` and the rest as you would for the default instance.
+void ggkSelectInstance(GGKInstance *pInstance)
+{
+	Instance::select(nullptr == pInstance ? nullptr : &toInstance(pInstance));
+}
+
+// Returns the current instance of the calling thread, or nullptr for the default instance
+GGKInstance *ggkGetSelectedInstance()
+{
+	Instance &instance = Instance::current();
+	return &instance == &Instance::getDefault() ? nullptr : toGGKInstance(instance);
+}
+
+// Each of these works like its counterpart that doesn't take an instance, on the given instance
+int ggkStartInstance(GGKInstance *pInstance, const char *pServiceName, const char *pAdvertisingName, const char *pAdvertisingShortName,
+	GGKServerDataGetter getter, GGKServerDataSetter setter, int maxAsyncInitTimeoutMS)
+{
+	InstanceScope scope(toInstance(pInstance));
+	return ggkStart(pServiceName, pAdvertisingName, pAdvertisingShortName, getter, setter, maxAsyncInitTimeoutMS);
+}
+
+void ggkTriggerShutdownInstance(GGKInstance *pInstance)
+{
+	InstanceScope scope(toInstance(pInstance));
+	ggkTriggerShutdown();
+}
+
+int ggkWaitInstance(GGKInstance *pInstance)
+{
+	InstanceScope scope(toInstance(pInstance));
+	return ggkWait();
+}
+
+int ggkShutdownAndWaitInstance(GGKInstance *pInstance)
+{
+	InstanceScope scope(toInstance(pInstance));
+	return ggkShutdownAndWait();
+}
+
+GGKServerRunState ggkGetInstanceRunState(GGKInstance *pInstance)
+{
+	InstanceScope scope(toInstance(pInstance));
+	return ggkGetServerRunState();
+}
+
+GGKServerHealth ggkGetInstanceHealth(GGKInstance *pInstance)
+{
+	InstanceScope scope(toInstance(pInstance));
+	return ggkGetServerHealth();
+}
+
+int ggkNotifyUpdatedCharacteristicInstance(GGKInstance *pInstance, const char *pObjectPath)
+{
+	InstanceScope scope(toInstance(pInstance));
+	return ggkNofifyUpdatedCharacteristic(pObjectPath);
+}
+
+int ggkPublishInstance(GGKInstance *pInstance, int handle, const void *pData, int dataLength)
+{
+	InstanceScope scope(toInstance(pInstance));
+	return ggkPublish(handle, pData, dataLength);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
-//  ____                     _        _
-// |  _ \ _   _ _ __     ___| |_ __ _| |_ ___
-// | |_) | | | | '_ \   / __| __/ _` | __/ _ )
-// |  _ <| |_| | | | |  \__ \ || (_| | ||  __/
-// |_| \_\\__,_|_| |_|  |___/\__\__,_|\__\___|
+//  ____  _        _   _     _   _
+// / ___|| |_ __ _| |_(_)___| |_(_) ___ ___
+// \___ \| __/ _` | __| / __| __| |/ __/ __|
+//  ___) | || (_| | |_| \__ \ |_| | (__\__ |
+// |____/ \__\__,_|\__|_|___/\__|_|\___|___/
 //
-// Methods for maintaining and reporting the state of the server
+// Performance counters and latency histograms (see Stats.cpp)
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Retrieve the current running state of the server
+// Calls `visitor` for every D-Bus method in the object hierarchy rooted at `object`
+template<typename Visitor>
+static void visitMethods(const DBusObject &object, Visitor visitor)
+{
+	for (const std::shared_ptr<DBusInterface> &pInterface : object.getInterfaces())
+	{
+		for (const DBusMethod &method : pInterface->getMethods())
+		{
+			visitor(*pInterface, method);
+		}
+	}
+
+	for (const DBusObject &child : object.getChildren())
+	{
+		visitMethods(child, visitor);
+	}
+}
+
+// Copies the current performance counters into `pStats`
 //
-// See `GGKServerRunState` (enumeration) for more information.
-GGKServerRunState ggkGetServerRunState()
+// This may be called from any thread at any time. Returns 1 on success, or 0 if `pStats` is null.
+int ggkGetStats(GGKStats *pStats)
 {
-	return serverRunState;
+	if (nullptr == pStats)
+	{
+		return 0;
+	}
+
+	TheStats.snapshot(pStats);
+	return 1;
 }
 
-// Convert a `GGKServerRunState` into a human-readable string
-const char *ggkGetServerRunStateString(GGKServerRunState state)
+// Resets all performance counters, including the per-method histograms
+void ggkResetStats()
 {
-	switch(state)
+	TheStats.reset();
+
+	if (nullptr != TheServer)
 	{
-		case EUninitialized: return "Uninitialized";
-		case EInitializing: return "Initializing";
-		case ERunning: return "Running";
-		case EStopping: return "Stopping";
-		case EStopped: return "Stopped";
-		default: return "Unknown";
+		std::unique_lock<std::mutex> lock = TheServer->lockDescription();
+		for (const DBusObject &object : TheServer->getObjects())
+		{
+			visitMethods(object, [](const DBusInterface &, const DBusMethod &method) { method.resetLatency(); });
+		}
 	}
 }
 
-// Convenience method to check ServerRunState for a running server
-int ggkIsServerRunning()
+// Calls `receiver` with the latency histogram of every D-Bus method in the server description that has been called at least
+// once. The strings are only valid for the duration of each call.
+//
+// Returns the number of methods reported, or -1 if the server has not been started.
+int ggkEnumerateMethodStats(GGKMethodStatsReceiver receiver, void *pUserData)
 {
-	return serverRunState <= ERunning ? 1 : 0;
+	if (nullptr == TheServer || nullptr == receiver)
+	{
+		return -1;
+	}
+
+	int reported = 0;
+	std::unique_lock<std::mutex> lock = TheServer->lockDescription();
+	for (const DBusObject &object : TheServer->getObjects())
+	{
+		visitMethods(object, [&](const DBusInterface &interface, const DBusMethod &method)
+		{
+			GGKHistogram latency;
+			method.getLatency().snapshot(&latency);
+			if (0 == latency.count)
+			{
+				return;
+			}
+
+			receiver(interface.getPath().c_str(), interface.getName().c_str(), method.getName().c_str(), &latency, pUserData);
+			++reported;
+		});
+	}
+
+	return reported;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
-//  ____                              _                _ _   _
-// / ___|  ___ _ ____   _____ _ __   | |__   ___  __ _| | |_| |___
-// \___ \ / _ \ '__\ \ / / _ \ '__|  | '_ \ / _ \/ _` | | __| '_  |
-//  ___) |  __/ |   \ V /  __/ |     | | | |  __/ (_| | | |_| | | |
-// |____/ \___|_|    \_/ \___|_|     |_| |_|\___|\__,_|_|\__|_| |_|
+//  _____               _
+// |_   _| __ __ _  ___(_)_ __   __ _
+//   | || '__/ _` |/ __| | '_ \ / _` |
+//   | || | | (_| | (__| | | | | (_| |
+//   |_||_|  \__,_|\___|_|_| |_|\__, |
+//                              |___/
 //
-// Methods for maintaining and reporting the health of the server
+// Recording of HCI events and D-Bus requests for offline replay (see Trace.cpp)
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Retrieve the current health of the server
+// Starts recording a trace to the file at `pTraceFile`, replacing anything already there (and finishing any trace in progress)
 //
-// See `GGKServerHealth` (enumeration) for more information.
-GGKServerHealth ggkGetServerHealth()
+// This may be called at any time, from any thread. Returns 1 on success, or 0 if the file could not be written.
+int ggkStartTrace(const char *pTraceFile)
 {
-	return serverHealth;
+	if (nullptr == pTraceFile || *pTraceFile == '\0')
+	{
+		return 0;
+	}
+
+	return TheTraceRecorder.start(pTraceFile) ? 1 : 0;
 }
 
-// Convert a `GGKServerHealth` into a human-readable string
-const char *ggkGetServerHealthString(GGKServerHealth state)
+// Finishes the trace in progress, if any
+void ggkStopTrace()
 {
-	switch(state)
-	{
-		case EOk: return "Ok";
-		case EFailedInit: return "Failed initialization";
-		case EFailedRun: return "Failed run";
-		default: return "Unknown";
-	}
+	TheTraceRecorder.stop();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -353,6 +1074,7 @@ int ggkWait()
 			Logger::info("Waiting for GGK server to stop");
 		}
 
+		std::thread &serverThread = Instance::current().serverThread;
 		if (serverThread.joinable())
 		{
 			serverThread.join();
@@ -380,10 +1102,8 @@ int ggkWait()
 		}
 	}
 
-	// Restore the GLib output functions
-	g_set_print_handler(printHandlerGLib);
-	g_set_printerr_handler(printerrHandlerGLib);
-	g_log_set_default_handler(logHandlerGLib, nullptr);
+	// Restore the GLib output functions (unless another instance is still running)
+	releaseGLibOutput();
 
 	return result;
 }
@@ -453,43 +1173,19 @@ int ggkStart(const char *pServiceName, const char *pAdvertisingName, const char
 {
 	try
 	{
+		// An instance only runs one server at a time
+		if (Instance::current().serverThread.joinable())
+		{
+			Logger::error("Unable to start a server on an instance that is already started (see ggkWait)");
+			return 0;
+		}
+
 		//
 		// Start by capturing the GLib output
 		//
 
-		// Redirect GLib output to this log method
-		printHandlerGLib = g_set_print_handler([](const gchar *string)
-		{
-			Logger::info(string);
-		});
-		printerrHandlerGLib = g_set_printerr_handler([](const gchar *string)
-		{
-			Logger::error(string);
-		});
-		logHandlerGLib = g_log_set_default_handler([](const gchar *log_domain, GLogLevelFlags log_levels, const gchar *message, gpointer /*user_data*/)
-		{
-			std::string str = std::string(log_domain) + ": " + message;
-			if ((log_levels & (G_LOG_FLAG_RECURSION|G_LOG_FLAG_FATAL)) != 0)
-			{
-				Logger::fatal(str);
-			}
-			else if ((log_levels & (G_LOG_LEVEL_CRITICAL|G_LOG_LEVEL_ERROR)) != 0)
-			{
-				Logger::error(str);
-			}
-			else if ((log_levels & G_LOG_LEVEL_WARNING) != 0)
-			{
-				Logger::warn(str);
-			}
-			else if ((log_levels & G_LOG_LEVEL_DEBUG) != 0)
-			{
-				Logger::debug(str);
-			}
-			else
-			{
-				Logger::info(str);
-			}
-		}, nullptr);
+		// Redirect GLib output to this log method (see `captureGLibOutput()`)
+		captureGLibOutput();
 
 		Logger::info(SSTR << "Starting GGK server '" << pAdvertisingName << "'");
 
@@ -499,7 +1195,13 @@ int ggkStart(const char *pServiceName, const char *pAdvertisingName, const char
 		// Start our server thread
 		try
 		{
-			serverThread = std::thread(runServerThread);
+			// The server thread works with the instance it was started for, whichever thread started it
+			Instance &instance = Instance::current();
+			instance.serverThread = std::thread([&instance]()
+			{
+				InstanceScope scope(instance);
+				runServerThread();
+			});
 		}
 		catch(std::system_error &ex)
 		{
@@ -539,7 +1241,7 @@ int ggkStart(const char *pServiceName, const char *pAdvertisingName, const char
 		}
 
 		// Everything looks good
-		Logger::trace("GGK server has started");
+		LOG_TRACE("GGK server has started");
 		return 1;
 	}
 	catch(...)
@@ -548,3 +1250,309 @@ int ggkStart(const char *pServiceName, const char *pAdvertisingName, const char
 		return 0;
 	}
 }
+
+// Adds a Bluetooth adapter (ex: "hci0") to serve the GATT application on
+//
+// By default, the server uses the first adapter provided by BlueZ. Call this method once for each adapter you want to use
+// before calling `ggkStart()`. All adapters share the same services and every notification is sent on each of them, but each
+// adapter is configured separately, with its own connections.
+//
+// pAdvertisingName/pAdvertisingShortName: The names this adapter advertises over LE. Pass empty strings (or nullptr) to use
+//     the names given to `ggkStart()`.
+//
+// Returns non-zero on success, or 0 if the server has already been started.
+int ggkAddAdapter(const char *pAdapterName, const char *pAdvertisingName, const char *pAdvertisingShortName)
+{
+	if (nullptr == pAdapterName || ggkGetServerRunState() != EUninitialized)
+	{
+		return 0;
+	}
+
+	addAdapter(pAdapterName, nullptr == pAdvertisingName ? "" : pAdvertisingName, nullptr == pAdvertisingShortName ? "" : pAdvertisingShortName);
+	return 1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  _     _       _      _                     _
+// | |   (_)_ __ | | __ | |_ _   _ _ __   (_)_ __   __ _
+// | |   | | '_ \| |/ / | __| | | | '_ \  | | '_ \ / _` |
+// | |___| | | | |   <  | |_| |_| | | | | | | | | | (_| |
+// |_____|_|_| |_|_|\_\  \__|\__,_|_| |_| |_|_| |_|\__, |
+//                                                  |___/
+//
+// Requests for better connection parameters, PHYs and data lengths. These are applied when each adapter is configured.
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns true if the given connection parameters are within the ranges allowed by the spec
+static bool validConnectionParameters(int minInterval, int maxInterval, int latency, int supervisionTimeout)
+{
+	return minInterval >= 6 && maxInterval <= 3200 && minInterval <= maxInterval && latency >= 0 && latency <= 499 &&
+		supervisionTimeout >= 10 && supervisionTimeout <= 3200;
+}
+
+// Sets the preferred connection parameters for all devices
+//
+// Intervals are in units of 1.25ms [6, 3200], latency is a number of connection events [0, 499] and the supervision timeout
+// is in units of 10ms [10, 3200]. This requires Linux 5.9 or later.
+int ggkSetConnectionParameters(int minInterval, int maxInterval, int latency, int supervisionTimeout)
+{
+	if (ggkGetServerRunState() != EUninitialized || !validConnectionParameters(minInterval, maxInterval, latency, supervisionTimeout))
+	{
+		return 0;
+	}
+
+	LinkOptions &options = getLinkOptions();
+	options.minConnectionInterval = static_cast<uint16_t>(minInterval);
+	options.maxConnectionInterval = static_cast<uint16_t>(maxInterval);
+	options.connectionLatency = static_cast<uint16_t>(latency);
+	options.supervisionTimeout = static_cast<uint16_t>(supervisionTimeout);
+	return 1;
+}
+
+// Sets the preferred connection parameters for a specific device (ex: "01:23:45:67:89:AB"), overriding those set with
+// `ggkSetConnectionParameters()`
+//
+// The address type is 1 for an LE public address or 2 for an LE random address. Parameters are as described for
+// `ggkSetConnectionParameters()`. This may be called once for each device.
+int ggkSetDeviceConnectionParameters(const char *pAddress, int addressType, int minInterval, int maxInterval, int latency, int supervisionTimeout)
+{
+	if (ggkGetServerRunState() != EUninitialized || nullptr == pAddress || (addressType != 1 && addressType != 2) ||
+		!validConnectionParameters(minInterval, maxInterval, latency, supervisionTimeout))
+	{
+		return 0;
+	}
+
+	unsigned int bytes[6];
+	char extra = 0;
+	if (sscanf(pAddress, "%2x:%2x:%2x:%2x:%2x:%2x%c", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5], &extra) != 6)
+	{
+		return 0;
+	}
+
+	Mgmt::ConnectionParameters parameters;
+
+	// The adapter wants addresses in little-endian order
+	for (int i = 0; i < 6; ++i)
+	{
+		parameters.address[i] = static_cast<uint8_t>(bytes[5 - i]);
+	}
+
+	parameters.addressType = static_cast<uint8_t>(addressType);
+	parameters.minConnectionInterval = static_cast<uint16_t>(minInterval);
+	parameters.maxConnectionInterval = static_cast<uint16_t>(maxInterval);
+	parameters.connectionLatency = static_cast<uint16_t>(latency);
+	parameters.supervisionTimeout = static_cast<uint16_t>(supervisionTimeout);
+	getLinkOptions().deviceConnectionParameters.push_back(parameters);
+	return 1;
+}
+
+// Enables (non-zero) or disables (0) the LE 2M PHY, which roughly doubles the raw data rate on supporting devices
+int ggkSetLE2MPhy(int enable)
+{
+	if (ggkGetServerRunState() != EUninitialized)
+	{
+		return 0;
+	}
+
+	getLinkOptions().lePhys = Mgmt::ELE1MTx | Mgmt::ELE1MRx | (enable ? (Mgmt::ELE2MTx | Mgmt::ELE2MRx) : 0);
+	return 1;
+}
+
+// Sets the suggested LL data length for new connections, in octets [27, 251] and microseconds [328, 17040]
+//
+// For the best throughput, use 251 octets and 2120us.
+int ggkSetDataLength(int txOctets, int txTimeUS)
+{
+	if (ggkGetServerRunState() != EUninitialized || txOctets < 27 || txOctets > 251 || txTimeUS < 328 || txTimeUS > 17040)
+	{
+		return 0;
+	}
+
+	LinkOptions &options = getLinkOptions();
+	options.dataLengthOctets = static_cast<uint16_t>(txOctets);
+	options.dataLengthTimeUS = static_cast<uint16_t>(txTimeUS);
+	return 1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____                  _ _
+// | __ )  ___  _ __   __| (_)_ __   __ _
+// |  _ \ / _ \| '_ \ / _` | | '_ \ / _` |
+// | |_) | (_) | | | | (_| | | | | | (_| |
+// |____/ \___/|_| |_|\__,_|_|_| |_|\__, |
+//                                  |___/
+//
+// An optional store of the keys exchanged when devices bond with us, restored when each adapter is set up (see BondStore.cpp.)
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Keeps bonds in the file at `pPath` (which is created when the first device bonds), restoring any that are already there
+//
+// The file holds secret keys, so it is only readable by its owner. Restoring replaces the kernel's keys for the adapter,
+// including any bluetoothd loaded for it, so the bond store should be the one place bonds are kept for the adapters the
+// server uses. This must be called before `ggkStart()`.
+//
+// Returns non-zero on success, or 0 if the file exists but is not a bond store or the server has already been started.
+int ggkSetBondStore(const char *pPath)
+{
+	if (ggkGetServerRunState() != EUninitialized || nullptr == pPath || *pPath == '\0')
+	{
+		return 0;
+	}
+
+	return TheBondStore.open(pPath) ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//     _       _                _   _     _
+//    / \   __| |_   _____ _ __| |_(_)___(_)_ __   __ _
+//   / _ \ / _` \ \ / / _ \ '__| __| / __| | '_ \ / _` |
+//  / ___ \ (_| |\ V /  __/ |  | |_| \__ \ | | | | (_| |
+// /_/   \_\__,_| \_/ \___|_|   \__|_|___/_|_| |_|\__, |
+//                                                  |___/
+//
+// Advertising instances and intervals. Like the link tuning, these are applied when each adapter is configured.
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Adds an advertising instance, numbered from 1
+//
+// Adapters support a handful of instances (often 5) and rotate between them. The data are sequences of AD structures (length,
+// type, value), up to 31 bytes each for the advertisement and the scan response (pass nullptr and 0 for none.) `flags` is a
+// combination of `GGKAdvertisingFlags`. The instance is advertised for `durationSeconds` at a time when rotating (0 for the
+// kernel's default) and stops being advertised after `timeoutSeconds` (0 to advertise it for as long as the server runs.)
+//
+// Once an instance is added, the adapter's plain advertising (see `ggkStart()`) is disabled in favor of the instances.
+int ggkAddAdvertisingInstance(int instance, int flags, const void *pAdvertisingData, int advertisingDataLength,
+	const void *pScanResponseData, int scanResponseLength, int durationSeconds, int timeoutSeconds)
+{
+	if (ggkGetServerRunState() != EUninitialized || instance < 1 || instance > 254 || (flags & ~0x7f) != 0 ||
+		advertisingDataLength < 0 || advertisingDataLength > Mgmt::kMaxAdvertisingDataLength ||
+		scanResponseLength < 0 || scanResponseLength > Mgmt::kMaxAdvertisingDataLength ||
+		(nullptr == pAdvertisingData && advertisingDataLength != 0) || (nullptr == pScanResponseData && scanResponseLength != 0) ||
+		durationSeconds < 0 || durationSeconds > 0xffff || timeoutSeconds < 0 || timeoutSeconds > 0xffff)
+	{
+		return 0;
+	}
+
+	// Our flags have the same values as the management API's (see `Mgmt::AdvertisingFlags`)
+	AdvertisingInstance entry;
+	entry.instance = static_cast<uint8_t>(instance);
+	entry.flags = static_cast<uint32_t>(flags);
+	entry.duration = static_cast<uint16_t>(durationSeconds);
+	entry.timeout = static_cast<uint16_t>(timeoutSeconds);
+
+	const uint8_t *pAdBytes = static_cast<const uint8_t *>(pAdvertisingData);
+	const uint8_t *pScanBytes = static_cast<const uint8_t *>(pScanResponseData);
+	entry.advertisingData.assign(pAdBytes, pAdBytes + advertisingDataLength);
+	entry.scanResponseData.assign(pScanBytes, pScanBytes + scanResponseLength);
+
+	// Adding an instance a second time replaces it
+	std::vector<AdvertisingInstance> &instances = getAdvertisingOptions().instances;
+	for (AdvertisingInstance &existing : instances)
+	{
+		if (existing.instance == entry.instance)
+		{
+			existing = entry;
+			return 1;
+		}
+	}
+
+	instances.push_back(entry);
+	return 1;
+}
+
+// Sets the advertising intervals, in units of 0.625ms [32, 16384]
+//
+// Each adapter advertises with the fast intervals for `fastPeriodSeconds` after it is configured, then with the slow intervals.
+// Pass 0 for `fastPeriodSeconds` to keep advertising with the fast intervals (the slow intervals are then ignored.) This
+// requires Linux 5.9 or later.
+int ggkSetAdvertisingIntervals(int fastMinInterval, int fastMaxInterval, int fastPeriodSeconds, int slowMinInterval, int slowMaxInterval)
+{
+	if (ggkGetServerRunState() != EUninitialized || fastMinInterval < 32 || fastMaxInterval > 16384 || fastMinInterval > fastMaxInterval ||
+		fastPeriodSeconds < 0 || fastPeriodSeconds > 0xffff)
+	{
+		return 0;
+	}
+
+	if (fastPeriodSeconds != 0 && (slowMinInterval < 32 || slowMaxInterval > 16384 || slowMinInterval > slowMaxInterval))
+	{
+		return 0;
+	}
+
+	AdvertisingOptions &options = getAdvertisingOptions();
+	options.fastMinInterval = static_cast<uint16_t>(fastMinInterval);
+	options.fastMaxInterval = static_cast<uint16_t>(fastMaxInterval);
+	options.fastPeriodSeconds = static_cast<uint16_t>(fastPeriodSeconds);
+	options.slowMinInterval = fastPeriodSeconds != 0 ? static_cast<uint16_t>(slowMinInterval) : 0;
+	options.slowMaxInterval = fastPeriodSeconds != 0 ? static_cast<uint16_t>(slowMaxInterval) : 0;
+	return 1;
+}
+
+// Sets the number of worker threads [1, 64] and the number of requests that may wait for one (at least 1)
+//
+// The defaults are 2 threads and 64 waiting requests. This must be called before `ggkStart()`. Returns non-zero on success, or 0
+// if a parameter is out of range or the server has already been started.
+int ggkSetWorkerThreads(int threadCount, int maxPendingJobs)
+{
+	if (ggkGetServerRunState() != EUninitialized)
+	{
+		return 0;
+	}
+
+	return TheWorkerPool.configure(threadCount, maxPendingJobs) ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  __  __
+// |  \/  | ___ _ __ ___   ___  _ __ _   _
+// | |\/| |/ _ \ '_ ` _ \ / _ \| '__| | | |
+// | |  | |  __/ | | | | | (_) | |  | |_| |
+// |_|  |_|\___|_| |_| |_|\___/|_|   \__, |
+//                                   |___/
+//
+// The memory profile of the current instance and a report of what it is using.
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Enables (non-zero) or disables (0) the low-memory profile
+//
+// This replaces the update queue, so any call to `ggkSetUpdateQueue()` should come after it. Returns non-zero on success, or 0
+// if the server has already been started.
+int ggkSetLowMemoryMode(int enable)
+{
+	if (ggkGetServerRunState() != EUninitialized)
+	{
+		return 0;
+	}
+
+	Instance::current().setLowMemory(enable != 0);
+	return 1;
+}
+
+// Sets the number of updates the update queue can hold [2, 65536] (rounded up to a power of two) and, as a
+// `GGKUpdateDropPolicy`, what happens to an update that arrives when it is full
+//
+// Returns non-zero on success, or 0 if a parameter is out of range or the server has already been started.
+int ggkSetUpdateQueue(int capacity, int dropPolicy)
+{
+	if (ggkGetServerRunState() != EUninitialized || capacity < 2 || static_cast<size_t>(capacity) > UpdateQueue::kMaxCapacity ||
+		(dropPolicy != EUpdateDropNewest && dropPolicy != EUpdateDropOldest))
+	{
+		return 0;
+	}
+
+	Instance::current().pUpdateQueue.reset(new UpdateQueue(static_cast<size_t>(capacity), static_cast<GGKUpdateDropPolicy>(dropPolicy)));
+	return 1;
+}
+
+// Copies the current instance's memory usage into `pStats`
+//
+// This may be called from any thread at any time. Returns 1 on success, or 0 if `pStats` is null.
+int ggkGetMemoryStats(struct GGKMemoryStats *pStats)
+{
+	if (nullptr == pStats)
+	{
+		return 0;
+	}
+
+	Instance::current().getMemoryStats(*pStats);
+	return 1;
+}
@@ -50,23 +50,41 @@
 // However, for initialization, it seems to be generally safe to treat them as "nearly 1:1". The solution below is to consume all
 // events and look for the event that we're waiting on. This seems to work in my environment (Raspberry Pi) fairly well, but please
 // do use this with caution.
+//
+// Commands may be pipelined. Each command sent via `sendCommandAsync()` is recorded in a table of outstanding commands, keyed by
+// command code and controller index, and the event thread completes the oldest matching entry when a Command Complete (or
+// Command Status) event arrives. The caller receives a future for each command, so any number of commands can be in flight at once
+// and no threads are created to wait for them. `sendCommand()` is simply `sendCommandAsync()` followed by a wait.
+//
+// A single HCI socket receives events for every controller, so the adapter information (settings, name, connection counts) is
+// tracked separately for each controller index.
+//
+// Each server instance (see Instance.cpp) has an adapter of its own, with its own socket and event thread. The kernel sends every
+// event to every management socket, and the reply to a command only to the socket that sent it, so instances don't see each
+// other's replies.
+//
+// Connected devices are kept in a connection table, along with their connection parameters (from the New Connection Parameter
+// event) and their ATT MTU (which only BlueZ knows, and reports to our GATT methods; see `setConnectionMtu()`.) Anybody who
+// wants to know about connections and disconnections as they happen can set a connection handler, which is called from the
+// event thread and therefore must not block.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+#include <stdio.h>
 #include <string.h>
 #include <chrono>
 #include <future>
 
+#include "BondStore.h"
+#include "Trace.h"
 #include "HciAdapter.h"
 #include "HciSocket.h"
 #include "Utils.h"
 #include "Mgmt.h"
 #include "Logger.h"
+#include "Stats.h"
 
 namespace ggk {
 
-// Our event thread listens for events coming from the adapter and deals with them appropriately
-std::thread HciAdapter::eventThread;
-
 const char * const HciAdapter::kCommandCodeNames[kMaxCommandCode + 1] =
 {
 	"Invalid Command",                                   // 0x0000
@@ -140,7 +158,16 @@ const char * const HciAdapter::kCommandCodeNames[kMaxCommandCode + 1] =
 	// code for "Set Appearance Command" is 0x0042. It also says this about the previous command in the list ("Read Extended
 	// Controller Information Command".) This is likely an error, so I'm following the order of the commands as they appear in the
 	// documentation. This makes "Set Appearance Code" have a command code of 0x0043.
-	"Set Appearance Command"                             // 0x0043
+	"Set Appearance Command",                            // 0x0043
+	"Get PHY Configuration Command",                     // 0x0044
+	"Set PHY Configuration Command",                     // 0x0045
+	"Load Blocked Keys Command",                         // 0x0046
+	"Set Wideband Speech Command",                       // 0x0047
+	"Read Security Information Command",                 // 0x0048
+	"Read Experimental Features Information Command",    // 0x0049
+	"Set Experimental Feature Command",                  // 0x004a
+	"Read Default System Configuration Command",         // 0x004b
+	"Set Default System Configuration Command"           // 0x004c
 };
 
 const char * const HciAdapter::kEventTypeNames[kMaxEventType + 1] =
@@ -210,12 +237,6 @@ const char * const HciAdapter::kStatusCodes[kMaxStatusCode + 1] =
 	"Permission Denied",                                 // 0x14
 };
 
-// Our thread interface, which simply launches our the thread processor on our HciAdapter instance
-void runEventThread()
-{
-	HciAdapter::getInstance().runEventThread();
-}
-
 // Event processor, responsible for receiving events from the HCI socket
 //
 // This mehtod should not be called directly. Rather, it runs continuously on a thread until the server shuts down
@@ -223,166 +244,457 @@ void runEventThread()
 // It isn't necessary to disconnect manually; the HCI socket will get disocnnected automatically at before this method returns
 void HciAdapter::runEventThread()
 {
-	Logger::trace("Entering the HciAdapter event thread");
+	LOG_TRACE("Entering the HciAdapter event thread");
 
 	while (ggkGetServerRunState() <= ERunning && hciSocket.isConnected())
 	{
 		// Read the next event, waiting until one arrives
-		std::vector<uint8_t> responsePacket = std::vector<uint8_t>();
-		if (!hciSocket.read(responsePacket))
+		//
+		// The packet lives in the socket's receive buffer, so we parse it in place
+		const uint8_t *pResponsePacket = nullptr;
+		size_t responsePacketLength = 0;
+		if (!hciSocket.read(pResponsePacket, responsePacketLength))
 		{
 			break;
 		}
 
-		// Do we have enough to check the event code?
-		if (responsePacket.size() < 2)
+		if (TheTraceRecorder.isRecording())
 		{
-			Logger::error(SSTR << "Invalid command response: too short");
-			continue;
+			TheTraceRecorder.recordHciEvent(pResponsePacket, responsePacketLength);
 		}
 
-		// Our response, as a usable object type
-		uint16_t eventCode = Utils::endianToHost(*reinterpret_cast<uint16_t *>(responsePacket.data()));
-
-		// Ensure our event code is valid
-		if (eventCode < HciAdapter::kMinEventType || eventCode > HciAdapter::kMaxEventType)
+		if (!processEvent(pResponsePacket, responsePacketLength))
 		{
-			Logger::error(SSTR << "Invalid command response: event code (" << eventCode << ") out of range");
-			continue;
+			break;
 		}
+	}
+
+	// Make sure we're disconnected before we leave
+	hciSocket.disconnect();
 
-		switch(eventCode)
+	LOG_TRACE("Leaving the HciAdapter event thread");
+}
+
+// Processes a single management event packet, as read from the HCI socket
+//
+// This is normally called from the event thread, but a trace replay (see replay.cpp) calls it directly to feed recorded events
+// through the same code.
+//
+// Returns false if the event was malformed badly enough that the event thread should stop, otherwise true
+bool HciAdapter::processEvent(const uint8_t *pResponsePacket, size_t responsePacketLength)
+{
+	// Do we have enough to check the event code?
+	if (responsePacketLength < 2)
+	{
+		Logger::error(SSTR << "Invalid command response: too short");
+		return true;
+	}
+
+	// Our response, as a usable object type
+	uint16_t eventCode = Utils::endianToHost(*reinterpret_cast<const uint16_t *>(pResponsePacket));
+
+	// Ensure our event code is valid
+	if (eventCode < HciAdapter::kMinEventType || eventCode > HciAdapter::kMaxEventType)
+	{
+		Logger::error(SSTR << "Invalid command response: event code (" << eventCode << ") out of range");
+		return true;
+	}
+
+	switch(eventCode)
+	{
+		// Command complete event
+		case Mgmt::ECommandCompleteEvent:
 		{
-			// Command complete event
-			case Mgmt::ECommandCompleteEvent:
-			{
-				// Extract our event
-				CommandCompleteEvent event(responsePacket);
+			// Extract our event
+			CommandCompleteEvent event(pResponsePacket);
 
-				// Point to the data following the event
-				uint8_t *data = responsePacket.data() + sizeof(CommandCompleteEvent);
-				size_t dataLen = responsePacket.size() - sizeof(CommandCompleteEvent);
+			// Point to the data following the event
+			const uint8_t *data = pResponsePacket + sizeof(CommandCompleteEvent);
+			size_t dataLen = responsePacketLength - sizeof(CommandCompleteEvent);
 
-				switch(event.commandCode)
+			switch(event.commandCode)
+			{
+				// We just log the version/revision info
+				case Mgmt::EReadVersionInformationCommand:
 				{
-					// We just log the version/revision info
-					case Mgmt::EReadVersionInformationCommand:
+					// Verify the size is what we expect
+					if (dataLen != sizeof(VersionInformation))
 					{
-						// Verify the size is what we expect
-						if (dataLen != sizeof(VersionInformation))
-						{
-							Logger::error("Invalid data length");
-							return;
-						}
-
-						versionInformation = *reinterpret_cast<VersionInformation *>(data);
-						versionInformation.toHost();
-						Logger::debug(versionInformation.debugText());
-						break;
+						Logger::error("Invalid data length");
+						return false;
 					}
-					case Mgmt::EReadControllerInformationCommand:
+
+					VersionInformation info = *reinterpret_cast<const VersionInformation *>(data);
+					info.toHost();
+					LOG_DEBUG(info.debugText());
+
+					std::lock_guard<std::mutex> lock(controllerStateMutex);
+					versionInformation = info;
+					break;
+				}
+				case Mgmt::EReadControllerInformationCommand:
+				{
+					if (dataLen != sizeof(ControllerInformation))
 					{
-						if (dataLen != sizeof(ControllerInformation))
-						{
-							Logger::error("Invalid data length");
-							return;
-						}
-
-						controllerInformation = *reinterpret_cast<ControllerInformation *>(data);
-						controllerInformation.toHost();
-						Logger::debug(controllerInformation.debugText());
-						break;
+						Logger::error("Invalid data length");
+						return false;
 					}
-					case Mgmt::ESetLocalNameCommand:
+
+					ControllerInformation info = *reinterpret_cast<const ControllerInformation *>(data);
+					info.toHost();
+					LOG_DEBUG(info.debugText());
+
+					std::lock_guard<std::mutex> lock(controllerStateMutex);
+					controllerStates[event.header.controllerId].controllerInformation = info;
+					break;
+				}
+				case Mgmt::ESetLocalNameCommand:
+				{
+					if (dataLen != sizeof(LocalName))
 					{
-						if (dataLen != sizeof(LocalName))
-						{
-							Logger::error("Invalid data length");
-							return;
-						}
-
-						localName = *reinterpret_cast<LocalName *>(data);
-						Logger::info(localName.debugText());
-						break;
+						Logger::error("Invalid data length");
+						return false;
 					}
-					case Mgmt::ESetPoweredCommand:
-					case Mgmt::ESetBREDRCommand:
-					case Mgmt::ESetSecureConnectionsCommand:
-					case Mgmt::ESetBondableCommand:
-					case Mgmt::ESetConnectableCommand:
-					case Mgmt::ESetLowEnergyCommand:
-					case Mgmt::ESetAdvertisingCommand:
+
+					LocalName name = *reinterpret_cast<const LocalName *>(data);
+					LOG_INFO(name.debugText());
+
+					std::lock_guard<std::mutex> lock(controllerStateMutex);
+					controllerStates[event.header.controllerId].localName = name;
+					break;
+				}
+				case Mgmt::EGetPHYConfigurationCommand:
+				{
+					if (dataLen != sizeof(PhyConfiguration))
 					{
-						if (dataLen != sizeof(AdapterSettings))
-						{
-							Logger::error("Invalid data length");
-							return;
-						}
+						Logger::error("Invalid data length");
+						return false;
+					}
 
-						adapterSettings = *reinterpret_cast<AdapterSettings *>(data);
-						adapterSettings.toHost();
+					PhyConfiguration configuration = *reinterpret_cast<const PhyConfiguration *>(data);
+					configuration.toHost();
+					LOG_DEBUG(configuration.debugText());
 
-						Logger::debug(adapterSettings.debugText());
-						break;
+					std::lock_guard<std::mutex> lock(controllerStateMutex);
+					controllerStates[event.header.controllerId].phyConfiguration = configuration;
+					break;
+				}
+				case Mgmt::EReadAdvertisingFeaturesCommand:
+				{
+					// The fixed part is followed by the list of instances in use
+					if (dataLen < sizeof(AdvertisingFeatures))
+					{
+						Logger::error("Invalid data length");
+						return false;
 					}
+
+					AdvertisingFeatures features = *reinterpret_cast<const AdvertisingFeatures *>(data);
+					features.toHost();
+					LOG_DEBUG(features.debugText());
+
+					std::lock_guard<std::mutex> lock(controllerStateMutex);
+					controllerStates[event.header.controllerId].advertisingFeatures = features;
+					break;
 				}
+				case Mgmt::ESetPoweredCommand:
+				case Mgmt::ESetBREDRCommand:
+				case Mgmt::ESetSecureConnectionsCommand:
+				case Mgmt::ESetBondableCommand:
+				case Mgmt::ESetConnectableCommand:
+				case Mgmt::ESetLowEnergyCommand:
+				case Mgmt::ESetAdvertisingCommand:
+				{
+					if (dataLen != sizeof(AdapterSettings))
+					{
+						Logger::error("Invalid data length");
+						return false;
+					}
+
+					AdapterSettings settings = *reinterpret_cast<const AdapterSettings *>(data);
+					settings.toHost();
 
-				// Notify anybody waiting that we received a response to their command code
-				setCommandResponse(event.commandCode);
+					LOG_DEBUG(settings.debugText());
 
-				break;
+					std::lock_guard<std::mutex> lock(controllerStateMutex);
+					controllerStates[event.header.controllerId].adapterSettings = settings;
+					break;
+				}
 			}
-			// Command status event
-			case Mgmt::ECommandStatusEvent:
+
+			// Notify anybody waiting that we received a response to their command code
+			completeCommand(event.commandCode, event.header.controllerId, event.status);
+
+			break;
+		}
+		// Command status event
+		case Mgmt::ECommandStatusEvent:
+		{
+			CommandStatusEvent event(pResponsePacket);
+
+			// Notify anybody waiting that we received a response to their command code
+			completeCommand(event.commandCode, event.header.controllerId, event.status);
+			break;
+		}
+		// Device connected event
+		case Mgmt::EDeviceConnectedEvent:
+		{
+			DeviceConnectedEvent event(pResponsePacket);
+
+			Connection connection = Connection();
+			connection.controllerIndex = event.header.controllerId;
+			memcpy(connection.address, event.address, sizeof(connection.address));
+			connection.addressType = event.addressType;
+
 			{
-				CommandStatusEvent event(responsePacket);
+				std::lock_guard<std::mutex> lock(controllerStateMutex);
 
-				// Notify anybody waiting that we received a response to their command code
-				setCommandResponse(event.commandCode);
-				break;
+				// Replace any stale entry for this device (in case we missed its disconnection)
+				removeConnection(connection.controllerIndex, connection.address, connection.addressType);
+				connections.push_back(connection);
+				LOG_DEBUG("  > Connection count incremented to " << connections.size());
 			}
-			// Command status event
-			case Mgmt::EDeviceConnectedEvent:
+
+			ConnectionHandler handler = connectionHandler;
+			if (nullptr != handler)
 			{
-				DeviceConnectedEvent event(responsePacket);
-				activeConnections += 1;
-				Logger::debug(SSTR << "  > Connection count incremented to " << activeConnections);
-				break;
+				handler(connection, true, 0);
 			}
-			// Command status event
-			case Mgmt::EDeviceDisconnectedEvent:
+			break;
+		}
+		// Device disconnected event
+		case Mgmt::EDeviceDisconnectedEvent:
+		{
+			DeviceDisconnectedEvent event(pResponsePacket);
+
+			Connection connection;
+			bool found = false;
 			{
-				DeviceDisconnectedEvent event(responsePacket);
-				if (activeConnections > 0)
+				std::lock_guard<std::mutex> lock(controllerStateMutex);
+				found = removeConnection(event.header.controllerId, event.address, event.addressType, &connection);
+				if (found)
 				{
-					activeConnections -= 1;
-					Logger::debug(SSTR << "  > Connection count decremented to " << activeConnections);
+					LOG_DEBUG("  > Connection count decremented to " << connections.size());
 				}
 				else
 				{
-					Logger::debug(SSTR << "  > Connection count already at zero, ignoring non-connected disconnect event");
+					LOG_DEBUG("  > Device was not connected, ignoring non-connected disconnect event");
 				}
-				break;
 			}
-			// Unsupported
-			default:
+
+			ConnectionHandler handler = connectionHandler;
+			if (found && nullptr != handler)
 			{
-				if (eventCode >= kMinEventType && eventCode <= kMaxEventType)
-				{
-					Logger::error("Unsupported response event type: " + Utils::hex(eventCode) + " (" + kEventTypeNames[eventCode] + ")");
-				}
-				else
+				handler(connection, false, event.reason);
+			}
+			break;
+		}
+		// New connection parameter event
+		case Mgmt::ENewConnectionParameterEvent:
+		{
+			NewConnectionParameterEvent event(pResponsePacket);
+
+			std::lock_guard<std::mutex> lock(controllerStateMutex);
+			for (Connection &connection : connections)
+			{
+				if (connection.matches(event.header.controllerId, event.address, event.addressType))
 				{
-					Logger::error("Invalid event type response: " + Utils::hex(eventCode));					
+					connection.minConnectionInterval = event.minConnectionInterval;
+					connection.maxConnectionInterval = event.maxConnectionInterval;
+					connection.connectionLatency = event.connectionLatency;
+					connection.supervisionTimeout = event.supervisionTimeout;
 				}
 			}
+			break;
+		}
+		// Keys from pairing, which we keep in our bond store (if there is one) so they can be restored later
+		case Mgmt::ENewLongTermKeyEvent:
+		{
+			NewLongTermKeyEvent event(pResponsePacket);
+			if (event.storeHint != 0)
+			{
+				TheBondStore.addLongTermKey(event.header.controllerId, event.key);
+			}
+			break;
+		}
+		case Mgmt::ENewIdentityResolvingKeyEvent:
+		{
+			NewIdentityResolvingKeyEvent event(pResponsePacket);
+			if (event.storeHint != 0)
+			{
+				TheBondStore.addIdentityResolvingKey(event.header.controllerId, event.key);
+			}
+			break;
+		}
+		case Mgmt::EDeviceUnpairedEvent:
+		{
+			DeviceUnpairedEvent event(pResponsePacket);
+			TheBondStore.removeDevice(event.header.controllerId, event.address, event.addressType);
+			break;
+		}
+		// Advertising instance events (we only log these; the kernel schedules the instances)
+		case Mgmt::EAdvertisingAddedEvent:
+		case Mgmt::EAdvertisingRemovedEvent:
+		{
+			AdvertisingInstanceEvent event(pResponsePacket);
+			break;
+		}
+		// Unsupported
+		default:
+		{
+			if (eventCode >= kMinEventType && eventCode <= kMaxEventType)
+			{
+				Logger::error("Unsupported response event type: " + Utils::hex(eventCode) + " (" + kEventTypeNames[eventCode] + ")");
+			}
+			else
+			{
+				Logger::error("Invalid event type response: " + Utils::hex(eventCode));					
+			}
 		}
 	}
 
-	// Make sure we're disconnected before we leave
-	hciSocket.disconnect();
+	return true;
+}
+
+// Returns the latest adapter settings received from the given controller
+HciAdapter::AdapterSettings HciAdapter::getAdapterSettings(uint16_t controllerIndex)
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return controllerStates[controllerIndex].adapterSettings;
+}
+
+// Returns the latest controller information received from the given controller
+HciAdapter::ControllerInformation HciAdapter::getControllerInformation(uint16_t controllerIndex)
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return controllerStates[controllerIndex].controllerInformation;
+}
 
-	Logger::trace("Leaving the HciAdapter event thread");
+// Returns the latest local name received from the given controller
+HciAdapter::LocalName HciAdapter::getLocalName(uint16_t controllerIndex)
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return controllerStates[controllerIndex].localName;
+}
+
+// Returns the latest PHY configuration received from the given controller
+HciAdapter::PhyConfiguration HciAdapter::getPhyConfiguration(uint16_t controllerIndex)
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return controllerStates[controllerIndex].phyConfiguration;
+}
+
+// Returns the latest advertising features received from the given controller
+HciAdapter::AdvertisingFeatures HciAdapter::getAdvertisingFeatures(uint16_t controllerIndex)
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return controllerStates[controllerIndex].advertisingFeatures;
+}
+
+// Returns the number of active connections on the given controller
+int HciAdapter::getActiveConnectionCount(uint16_t controllerIndex)
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	int count = 0;
+	for (const Connection &connection : connections)
+	{
+		if (connection.controllerIndex == controllerIndex) { count += 1; }
+	}
+	return count;
+}
+
+// Returns a snapshot of the devices currently connected to any of our controllers
+std::vector<HciAdapter::Connection> HciAdapter::getConnections()
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return connections;
+}
+
+// Records the ATT MTU BlueZ reported for a connected device, given the device's BlueZ object path
+//
+// BlueZ includes the MTU and the device (as a path such as "/org/bluez/hci0/dev_AA_BB_CC_DD_EE_FF") in the options it passes
+// to ReadValue, WriteValue, AcquireNotify and AcquireWrite. The MTU is forgotten when the device disconnects.
+//
+// Returns false if the path isn't a device path or the device isn't in our connection table.
+bool HciAdapter::setConnectionMtu(const std::string &devicePath, uint16_t mtu)
+{
+	unsigned int controllerIndex = 0;
+	unsigned int bytes[6];
+	if (sscanf(devicePath.c_str(), "/org/bluez/hci%u/dev_%02X_%02X_%02X_%02X_%02X_%02X", &controllerIndex,
+		&bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 7)
+	{
+		return false;
+	}
+
+	// Device paths show the address most significant byte first; the management API stores it the other way around
+	uint8_t address[6];
+	for (int i = 0; i < 6; ++i)
+	{
+		address[i] = static_cast<uint8_t>(bytes[5 - i]);
+	}
+
+	// The path doesn't tell us the address type, but an address is only connected once
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	for (Connection &connection : connections)
+	{
+		if (connection.controllerIndex == controllerIndex && memcmp(connection.address, address, sizeof(address)) == 0)
+		{
+			connection.mtu = mtu;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Returns the smallest ATT MTU reported for any connected device, or 0 if none has been reported
+//
+// Notifications go to every subscribed device, so this is the largest notification that every one of them can receive.
+uint16_t HciAdapter::getMinimumConnectionMtu()
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	uint16_t minimum = 0;
+	for (const Connection &connection : connections)
+	{
+		if (connection.mtu != 0 && (minimum == 0 || connection.mtu < minimum))
+		{
+			minimum = connection.mtu;
+		}
+	}
+	return minimum;
+}
+
+// Removes a device from our connection table, optionally returning a copy of its entry in `pRemoved`
+//
+// The caller must hold `controllerStateMutex`.
+//
+// Returns true if the device was in the table, otherwise false
+bool HciAdapter::removeConnection(uint16_t controllerIndex, const uint8_t *pAddress, uint8_t addressType, Connection *pRemoved)
+{
+	for (auto iter = connections.begin(); iter != connections.end(); ++iter)
+	{
+		if (iter->matches(controllerIndex, pAddress, addressType))
+		{
+			if (nullptr != pRemoved) { *pRemoved = *iter; }
+			connections.erase(iter);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Returns the version information, which is not specific to any controller
+HciAdapter::VersionInformation HciAdapter::getVersionInformation()
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return versionInformation;
+}
+
+// Returns the number of active connections across all controllers
+int HciAdapter::getActiveConnectionCount()
+{
+	std::lock_guard<std::mutex> lock(controllerStateMutex);
+	return static_cast<int>(connections.size());
 }
 
 // Reads current values from the controller
@@ -391,25 +703,30 @@ void HciAdapter::runEventThread()
 // milliseconds. Therefore, it is not recommended attempt to retrieve the results from their accessors immediately.
 void HciAdapter::sync(uint16_t controllerIndex)
 {
-	Logger::debug("Synchronizing version information");
+	LOG_DEBUG("Synchronizing version information");
 
 	HciAdapter::HciHeader request;
 	request.code = Mgmt::EReadVersionInformationCommand;
 	request.controllerId = HciAdapter::kNonController;
 	request.dataSize = 0;
 
-	if (!HciAdapter::getInstance().sendCommand(request))
-	{
-		Logger::error("Failed to get version information");
-	}
+	CommandFuture versionCommand = sendCommandAsync(request);
 
-	Logger::debug("Synchronizing controller information");
+	LOG_DEBUG("Synchronizing controller information");
 
 	request.code = Mgmt::EReadControllerInformationCommand;
 	request.controllerId = controllerIndex;
 	request.dataSize = 0;
 
-	if (!HciAdapter::getInstance().sendCommand(request))
+	CommandFuture controllerCommand = sendCommandAsync(request);
+
+	// Both requests are in flight; now wait for them
+	if (!waitForCommand(versionCommand))
+	{
+		Logger::error("Failed to get version information");
+	}
+
+	if (!waitForCommand(controllerCommand))
 	{
 		Logger::error("Failed to get current settings");
 	}
@@ -443,7 +760,11 @@ bool HciAdapter::start()
 	// Create a thread to read the data from the socket
 	try
 	{
-		eventThread = std::thread(ggk::runEventThread);
+		eventThread = std::thread([this]()
+		{
+			InstanceScope scope(owner);
+			runEventThread();
+		});
 	}
 	catch(std::system_error &ex)
 	{
@@ -459,7 +780,10 @@ bool HciAdapter::start()
 // This method will block until the thread joins
 void HciAdapter::stop()
 {
-	Logger::trace("HciAdapter waiting for thread termination");
+	LOG_TRACE("HciAdapter waiting for thread termination");
+
+	// Wake the event thread so that it notices we're stopping
+	hciSocket.requestStop();
 
 	try
 	{
@@ -467,11 +791,11 @@ void HciAdapter::stop()
 		{
 			eventThread.join();
 
-			Logger::trace("Event thread has stopped");
+			LOG_TRACE("Event thread has stopped");
 		}
 		else
 		{
-			Logger::trace(" > Event thread is not joinable");
+			LOG_TRACE(" > Event thread is not joinable");
 		}
 	}
 	catch(std::system_error &ex)
@@ -495,75 +819,153 @@ void HciAdapter::stop()
 	}
 }
 
+// Replaces the HCI socket's receive buffer with one of `size` bytes (see `Instance::setLowMemory()`)
+//
+// Returns false (and does nothing) if the event thread is running.
+bool HciAdapter::setReceiveBufferSize(size_t size)
+{
+	if (eventThread.joinable())
+	{
+		return false;
+	}
+
+	hciSocket.setReceiveBufferSize(size);
+	return true;
+}
+
 // Sends a command over the HCI socket
 //
 // If the HCI socket is not connected, it will auto-connect prior to sending the command. In the case of a failed auto-connect,
 // a failure is returned.
 //
-// Returns true on success, otherwise false
-bool HciAdapter::sendCommand(HciHeader &request)
+// This waits (up to `kMaxEventWaitTimeMS`) for the response. To send a command without waiting, see `sendCommandAsync()`.
+//
+// If `pStatus` is provided, it receives the status code from the response.
+//
+// Returns true if a response was received (whatever its status), otherwise false
+bool HciAdapter::sendCommand(HciHeader &request, uint8_t *pStatus)
 {
+	CommandFuture command = sendCommandAsync(request);
+	return waitForCommand(command, kMaxEventWaitTimeMS, pStatus);
+}
+
+// Sends a command over the HCI socket without waiting for its response
+//
+// The returned future completes (from the event thread) with the command's status code when the controller responds. Any number of
+// commands may be outstanding at once; responses are matched to commands by command code and controller index, in the order
+// they were sent.
+//
+// If the command could not be sent, the returned future is not valid.
+HciAdapter::CommandFuture HciAdapter::sendCommandAsync(HciHeader &request)
+{
+	CommandFuture command;
+	command.id = 0;
+	command.commandCode = request.code;
+	command.controllerId = request.controllerId;
+
 	// Auto-connect
 	if (!eventThread.joinable() && !start())
 	{
 		Logger::error("HciAdapter failed to start");
-		return false;
+		return command;
 	}
 
-	conditionalValue = -1;
-	std::future<bool> fut = std::async(std::launch::async,
-	[&]() mutable
+	// Record the command before it is sent, so the event thread can't see the response before we're ready for it
 	{
-		return waitForCommandResponse(request.code, kMaxEventWaitTimeMS);
-	});
+		std::lock_guard<std::mutex> lock(pendingCommandsMutex);
+
+		PendingCommand pending;
+		pending.id = ++nextCommandId;
+		pending.sentTime = g_get_monotonic_time();
+		command.id = pending.id;
+		command.status = pending.status.get_future();
+		pendingCommands[getCommandKey(command.commandCode, command.controllerId)].push_back(std::move(pending));
+	}
 
 	// Prepare the request to be sent (endianness correction)
+	size_t requestSize = sizeof(request) + request.dataSize;
 	request.toNetwork();
-	uint8_t *pRequest = reinterpret_cast<uint8_t *>(&request);
 
-	std::vector<uint8_t> requestPacket = std::vector<uint8_t>(pRequest, pRequest + sizeof(request) + request.dataSize);
-	if (!hciSocket.write(requestPacket))
+	if (!hciSocket.write(reinterpret_cast<uint8_t *>(&request), requestSize))
 	{
-		return false;
+		cancelCommand(command);
+		command.status = std::future<uint8_t>();
 	}
 
-	return fut.get();
+	return command;
 }
 
-// Uses a std::condition_variable to wait for a response event for the given `commandCode` or `timeoutMS` milliseconds.
+// Waits up to `timeoutMS` milliseconds for the response to a command sent with `sendCommandAsync()`
 //
-// Returns true if the response event was received for `commandCode` or false if the timeout expired.
+// If the wait times out, the command is abandoned (see `cancelCommand()`.) If `pStatus` is provided, it receives the status
+// code from the response.
 //
-// Command responses are set via `setCommandResponse()`
-bool HciAdapter::waitForCommandResponse(uint16_t commandCode, int timeoutMS)
+// Returns true if the response was received, otherwise false
+bool HciAdapter::waitForCommand(CommandFuture &command, int timeoutMS, uint8_t *pStatus)
 {
-	Logger::debug(SSTR << "  + Waiting on command code " << commandCode << " for up to " << timeoutMS << "ms");
+	if (!command.status.valid())
+	{
+		return false;
+	}
 
-	bool success = cvCommandResponse.wait_for(commandResponseLock, std::chrono::milliseconds(timeoutMS),
-		[&]
-		{
-			return conditionalValue == commandCode;
-		}
-	);
+	LOG_DEBUG("  + Waiting on command code " << command.commandCode << " for up to " << timeoutMS << "ms");
 
-	if (!success)
+	if (command.status.wait_for(std::chrono::milliseconds(timeoutMS)) != std::future_status::ready)
 	{
-		Logger::warn(SSTR << "  + Timed out waiting on command code " << Utils::hex(commandCode) << " (" << kCommandCodeNames[commandCode] << ")");
+		Logger::warn(SSTR << "  + Timed out waiting on command code " << Utils::hex(command.commandCode) << " (" << kCommandCodeNames[command.commandCode] << ")");
+		cancelCommand(command);
+		TheStats.hciCommandTimeouts.fetch_add(1, std::memory_order_relaxed);
+		return false;
 	}
-	else
+
+	uint8_t status = command.status.get();
+	LOG_DEBUG("  + Recieved the command code we were waiting for: " << Utils::hex(command.commandCode) << " (" << kCommandCodeNames[command.commandCode] << "), status: " << Utils::hex(status));
+	if (nullptr != pStatus)
 	{
-		Logger::debug(SSTR << "  + Recieved the command code we were waiting for: " << Utils::hex(commandCode) << " (" << kCommandCodeNames[commandCode] << ")");
+		*pStatus = status;
 	}
+	return true;
+}
+
+// Abandons a command sent with `sendCommandAsync()`, so that its response (if it ever arrives) is ignored
+void HciAdapter::cancelCommand(CommandFuture &command)
+{
+	std::lock_guard<std::mutex> lock(pendingCommandsMutex);
 
-	return success;
+	auto iter = pendingCommands.find(getCommandKey(command.commandCode, command.controllerId));
+	if (iter == pendingCommands.end())
+	{
+		return;
+	}
+
+	std::list<PendingCommand> &commands = iter->second;
+	for (auto pending = commands.begin(); pending != commands.end(); ++pending)
+	{
+		if (pending->id == command.id)
+		{
+			commands.erase(pending);
+			break;
+		}
+	}
 }
 
-// Sets the command response and notifies the waiting std::condition_variable (see `waitForCommandResponse`)
-void HciAdapter::setCommandResponse(uint16_t commandCode)
+// Completes the oldest outstanding command with the given command code and controller index
+//
+// This is called from the event thread when a Command Complete or Command Status event arrives.
+void HciAdapter::completeCommand(uint16_t commandCode, uint16_t controllerId, uint8_t status)
 {
-	std::lock_guard<std::mutex> lk(commandResponseMutex);
-	conditionalValue = commandCode;
-	cvCommandResponse.notify_one();
+	std::lock_guard<std::mutex> lock(pendingCommandsMutex);
+
+	auto iter = pendingCommands.find(getCommandKey(commandCode, controllerId));
+	if (iter == pendingCommands.end() || iter->second.empty())
+	{
+		LOG_DEBUG("  + Ignoring response to command code " << Utils::hex(commandCode) << " (nobody is waiting for it)");
+		return;
+	}
+
+	TheStats.hciCommandLatency.record(g_get_monotonic_time() - iter->second.front().sentTime);
+	iter->second.front().status.set_value(status);
+	iter->second.pop_front();
 }
 
 }; // namespace ggk
\ No newline at end of file
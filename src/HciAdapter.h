@@ -36,10 +36,15 @@
 
 #include <stdint.h>
 #include <vector>
+#include <list>
+#include <unordered_map>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <string.h>
 
+#include "Instance.h"
 #include "HciSocket.h"
 #include "Utils.h"
 #include "Logger.h"
@@ -62,7 +67,7 @@ public:
 
 	// Command code names
 	static const int kMinCommandCode = 0x0001;
-	static const int kMaxCommandCode = 0x0043;
+	static const int kMaxCommandCode = 0x004c;
 	static const char * const kCommandCodeNames[kMaxCommandCode + 1];
 
 	// Event type names
@@ -136,13 +141,13 @@ public:
 		uint16_t commandCode;
 		uint8_t status;
 
-		CommandCompleteEvent(const std::vector<uint8_t> &data)
+		CommandCompleteEvent(const uint8_t *pData)
 		{
-			*this = *reinterpret_cast<const CommandCompleteEvent *>(data.data());
+			*this = *reinterpret_cast<const CommandCompleteEvent *>(pData);
 			toHost();
 
 			// Log it
-			Logger::debug(debugText());
+			LOG_DEBUG(debugText());
 		}
 
 		void toNetwork()
@@ -176,13 +181,13 @@ public:
 		uint16_t commandCode;
 		uint8_t status;
 
-		CommandStatusEvent(const std::vector<uint8_t> &data)
+		CommandStatusEvent(const uint8_t *pData)
 		{
-			*this = *reinterpret_cast<const CommandStatusEvent *>(data.data());
+			*this = *reinterpret_cast<const CommandStatusEvent *>(pData);
 			toHost();
 
 			// Log it
-			Logger::debug(debugText());
+			LOG_DEBUG(debugText());
 		}
 
 		void toNetwork()
@@ -218,13 +223,13 @@ public:
 		uint32_t flags;
 		uint16_t eirDataLength;
 
-		DeviceConnectedEvent(const std::vector<uint8_t> &data)
+		DeviceConnectedEvent(const uint8_t *pData)
 		{
-			*this = *reinterpret_cast<const DeviceConnectedEvent *>(data.data());
+			*this = *reinterpret_cast<const DeviceConnectedEvent *>(pData);
 			toHost();
 
 			// Log it
-			Logger::debug(debugText());
+			LOG_DEBUG(debugText());
 		}
 
 		void toNetwork()
@@ -268,13 +273,13 @@ public:
 		uint8_t addressType;
 		uint8_t reason;
 
-		DeviceDisconnectedEvent(const std::vector<uint8_t> &data)
+		DeviceDisconnectedEvent(const uint8_t *pData)
 		{
-			*this = *reinterpret_cast<const DeviceDisconnectedEvent *>(data.data());
+			*this = *reinterpret_cast<const DeviceDisconnectedEvent *>(pData);
 			toHost();
 
 			// Log it
-			Logger::debug(debugText());
+			LOG_DEBUG(debugText());
 		}
 
 		void toNetwork()
@@ -301,6 +306,257 @@ public:
 		}
 	} __attribute__((packed));
 
+	struct NewConnectionParameterEvent
+	{
+		HciHeader header;
+		uint8_t address[6];
+		uint8_t addressType;
+		uint8_t storeHint;
+		uint16_t minConnectionInterval;
+		uint16_t maxConnectionInterval;
+		uint16_t connectionLatency;
+		uint16_t supervisionTimeout;
+
+		NewConnectionParameterEvent(const uint8_t *pData)
+		{
+			*this = *reinterpret_cast<const NewConnectionParameterEvent *>(pData);
+			toHost();
+
+			// Log it
+			LOG_DEBUG(debugText());
+		}
+
+		void toNetwork()
+		{
+			header.toNetwork();
+			minConnectionInterval = Utils::endianToHci(minConnectionInterval);
+			maxConnectionInterval = Utils::endianToHci(maxConnectionInterval);
+			connectionLatency = Utils::endianToHci(connectionLatency);
+			supervisionTimeout = Utils::endianToHci(supervisionTimeout);
+		}
+
+		void toHost()
+		{
+			header.toHost();
+			minConnectionInterval = Utils::endianToHost(minConnectionInterval);
+			maxConnectionInterval = Utils::endianToHost(maxConnectionInterval);
+			connectionLatency = Utils::endianToHost(connectionLatency);
+			supervisionTimeout = Utils::endianToHost(supervisionTimeout);
+		}
+
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> NewConnectionParameter event\n";
+			text += "  + Event code         : " + Utils::hex(header.code) + " (" + HciAdapter::kEventTypeNames[header.code] + ")\n";
+			text += "  + Controller Id      : " + Utils::hex(header.controllerId) + "\n";
+			text += "  + Data size          : " + std::to_string(header.dataSize) + " bytes\n";
+			text += "  + Address            : " + Utils::bluetoothAddressString(address) + "\n";
+			text += "  + Address type       : " + Utils::hex(addressType) + "\n";
+			text += "  + Store hint         : " + Utils::hex(storeHint) + "\n";
+			text += "  + Min interval       : " + std::to_string(minConnectionInterval) + "\n";
+			text += "  + Max interval       : " + std::to_string(maxConnectionInterval) + "\n";
+			text += "  + Latency            : " + std::to_string(connectionLatency) + "\n";
+			text += "  + Supervision timeout: " + std::to_string(supervisionTimeout);
+			return text;
+		}
+	} __attribute__((packed));
+
+	// A long term key, as carried by the New Long Term Key event and the Load Long Term Keys command
+	//
+	// Everything is kept in the adapter's (little-endian) byte order, since keys only ever pass from the adapter back to it. The
+	// address type is 1 for an LE public address or 2 for an LE random address. `central` is set if the key is used when the
+	// device is the central (legacy pairing distributes a key for each role.)
+	struct LongTermKey
+	{
+		uint8_t address[6];
+		uint8_t addressType;
+		uint8_t keyType;
+		uint8_t central;
+		uint8_t encryptionSize;
+		uint16_t ediv;
+		uint64_t rand;
+		uint8_t value[16];
+	} __attribute__((packed));
+
+	// An identity resolving key, as carried by the New Identity Resolving Key event and the Load Identity Resolving Keys command
+	//
+	// The address is the device's identity address, to which the kernel resolves the device's private addresses.
+	struct IdentityResolvingKey
+	{
+		uint8_t address[6];
+		uint8_t addressType;
+		uint8_t value[16];
+	} __attribute__((packed));
+
+	struct NewLongTermKeyEvent
+	{
+		HciHeader header;
+		uint8_t storeHint;
+		LongTermKey key;
+
+		NewLongTermKeyEvent(const uint8_t *pData)
+		{
+			*this = *reinterpret_cast<const NewLongTermKeyEvent *>(pData);
+			toHost();
+
+			// Log it
+			LOG_DEBUG(debugText());
+		}
+
+		void toHost()
+		{
+			header.toHost();
+		}
+
+		// The key itself is never logged
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> NewLongTermKey event\n";
+			text += "  + Event code         : " + Utils::hex(header.code) + " (" + HciAdapter::kEventTypeNames[header.code] + ")\n";
+			text += "  + Controller Id      : " + Utils::hex(header.controllerId) + "\n";
+			text += "  + Data size          : " + std::to_string(header.dataSize) + " bytes\n";
+			text += "  + Store hint         : " + Utils::hex(storeHint) + "\n";
+			text += "  + Address            : " + Utils::bluetoothAddressString(key.address) + "\n";
+			text += "  + Address type       : " + Utils::hex(key.addressType) + "\n";
+			text += "  + Key type           : " + Utils::hex(key.keyType) + "\n";
+			text += "  + Central            : " + Utils::hex(key.central);
+			return text;
+		}
+	} __attribute__((packed));
+
+	struct NewIdentityResolvingKeyEvent
+	{
+		HciHeader header;
+		uint8_t storeHint;
+		uint8_t randomAddress[6];
+		IdentityResolvingKey key;
+
+		NewIdentityResolvingKeyEvent(const uint8_t *pData)
+		{
+			*this = *reinterpret_cast<const NewIdentityResolvingKeyEvent *>(pData);
+			toHost();
+
+			// Log it
+			LOG_DEBUG(debugText());
+		}
+
+		void toHost()
+		{
+			header.toHost();
+		}
+
+		// The key itself is never logged
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> NewIdentityResolvingKey event\n";
+			text += "  + Event code         : " + Utils::hex(header.code) + " (" + HciAdapter::kEventTypeNames[header.code] + ")\n";
+			text += "  + Controller Id      : " + Utils::hex(header.controllerId) + "\n";
+			text += "  + Data size          : " + std::to_string(header.dataSize) + " bytes\n";
+			text += "  + Store hint         : " + Utils::hex(storeHint) + "\n";
+			text += "  + Random address     : " + Utils::bluetoothAddressString(randomAddress) + "\n";
+			text += "  + Identity address   : " + Utils::bluetoothAddressString(key.address) + "\n";
+			text += "  + Address type       : " + Utils::hex(key.addressType);
+			return text;
+		}
+	} __attribute__((packed));
+
+	struct DeviceUnpairedEvent
+	{
+		HciHeader header;
+		uint8_t address[6];
+		uint8_t addressType;
+
+		DeviceUnpairedEvent(const uint8_t *pData)
+		{
+			*this = *reinterpret_cast<const DeviceUnpairedEvent *>(pData);
+			toHost();
+
+			// Log it
+			LOG_DEBUG(debugText());
+		}
+
+		void toHost()
+		{
+			header.toHost();
+		}
+
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> DeviceUnpaired event\n";
+			text += "  + Event code         : " + Utils::hex(header.code) + " (" + HciAdapter::kEventTypeNames[header.code] + ")\n";
+			text += "  + Controller Id      : " + Utils::hex(header.controllerId) + "\n";
+			text += "  + Data size          : " + std::to_string(header.dataSize) + " bytes\n";
+			text += "  + Address            : " + Utils::bluetoothAddressString(address) + "\n";
+			text += "  + Address type       : " + Utils::hex(addressType);
+			return text;
+		}
+	} __attribute__((packed));
+
+	// Sent when an advertising instance is added or removed (including when the kernel removes one whose timeout has expired)
+	struct AdvertisingInstanceEvent
+	{
+		HciHeader header;
+		uint8_t instance;
+
+		AdvertisingInstanceEvent(const uint8_t *pData)
+		{
+			*this = *reinterpret_cast<const AdvertisingInstanceEvent *>(pData);
+			toHost();
+
+			// Log it
+			LOG_DEBUG(debugText());
+		}
+
+		void toHost()
+		{
+			header.toHost();
+		}
+
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> AdvertisingInstance event\n";
+			text += "  + Event code         : " + Utils::hex(header.code) + " (" + HciAdapter::kEventTypeNames[header.code] + ")\n";
+			text += "  + Controller Id      : " + Utils::hex(header.controllerId) + "\n";
+			text += "  + Data size          : " + std::to_string(header.dataSize) + " bytes\n";
+			text += "  + Instance           : " + std::to_string(instance);
+			return text;
+		}
+	} __attribute__((packed));
+
+	// A device (central) that is connected to one of our controllers
+	struct Connection
+	{
+		uint16_t controllerIndex;
+		uint8_t address[6];
+		uint8_t addressType;
+
+		// The latest connection parameters from a New Connection Parameter event (intervals are in units of 1.25ms and the
+		// supervision timeout is in units of 10ms.) These are all zero until such an event is received.
+		uint16_t minConnectionInterval;
+		uint16_t maxConnectionInterval;
+		uint16_t connectionLatency;
+		uint16_t supervisionTimeout;
+
+		// The ATT MTU BlueZ last reported for this device (see `setConnectionMtu()`), or 0 if it hasn't reported one
+		uint16_t mtu;
+
+		// Returns true if this connection is to the given device on the given controller
+		bool matches(uint16_t otherControllerIndex, const uint8_t *pOtherAddress, uint8_t otherAddressType) const
+		{
+			return controllerIndex == otherControllerIndex && addressType == otherAddressType && memcmp(address, pOtherAddress, sizeof(address)) == 0;
+		}
+	};
+
+	// Type definition for a handler that is told when a device connects or disconnects
+	//
+	// The handler is called from the event thread, so it must not block. A `reason` is only provided for disconnections.
+	typedef void (*ConnectionHandler)(const Connection &connection, bool connected, uint8_t reason);
+
 	struct AdapterSettings
 	{
 		uint32_t masks;
@@ -411,6 +667,60 @@ public:
 		}
 	} __attribute__((packed));
 
+	// The PHY configuration, returned by the Get PHY Configuration command
+	struct PhyConfiguration
+	{
+		uint32_t supportedPhys;
+		uint32_t configurablePhys;
+		uint32_t selectedPhys;
+
+		void toHost()
+		{
+			supportedPhys = Utils::endianToHost(supportedPhys);
+			configurablePhys = Utils::endianToHost(configurablePhys);
+			selectedPhys = Utils::endianToHost(selectedPhys);
+		}
+
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> PHY configuration\n";
+			text += "  + Supported PHYs     : " + Utils::hex(supportedPhys) + "\n";
+			text += "  + Configurable PHYs  : " + Utils::hex(configurablePhys) + "\n";
+			text += "  + Selected PHYs      : " + Utils::hex(selectedPhys);
+			return text;
+		}
+	} __attribute__((packed));
+
+	// The advertising features, returned by the Read Advertising Features command
+	//
+	// The response continues with the number of each instance that is currently in use, which we don't keep.
+	struct AdvertisingFeatures
+	{
+		uint32_t supportedFlags;
+		uint8_t maxAdvertisingDataLength;
+		uint8_t maxScanResponseLength;
+		uint8_t maxInstances;
+		uint8_t instanceCount;
+
+		void toHost()
+		{
+			supportedFlags = Utils::endianToHost(supportedFlags);
+		}
+
+		std::string debugText()
+		{
+			std::string text = "";
+			text += "> Advertising features\n";
+			text += "  + Supported flags    : " + Utils::hex(supportedFlags) + "\n";
+			text += "  + Max data length    : " + std::to_string(maxAdvertisingDataLength) + "\n";
+			text += "  + Max scan response  : " + std::to_string(maxScanResponseLength) + "\n";
+			text += "  + Max instances      : " + std::to_string(maxInstances) + "\n";
+			text += "  + Instances in use   : " + std::to_string(instanceCount);
+			return text;
+		}
+	} __attribute__((packed));
+
 	struct LocalName
 	{
 		char name[249];
@@ -430,21 +740,47 @@ public:
 	// Accessors
 	//
 
-	// Returns the instance to this singleton class
+	// Returns the adapter of the current instance (see Instance.cpp)
 	static HciAdapter &getInstance()
 	{
-		static HciAdapter instance;
-		return instance;
+		return *Instance::current().pHciAdapter;
 	}
 
-	AdapterSettings getAdapterSettings() { return adapterSettings; }
-	ControllerInformation getControllerInformation() { return controllerInformation; }
-	VersionInformation getVersionInformation() { return versionInformation; }
-	LocalName getLocalName() { return localName; }
-	int getActiveConnectionCount() { return activeConnections; }
+	// Each of these returns the latest information received from the given controller (see `sync()`)
+	AdapterSettings getAdapterSettings(uint16_t controllerIndex);
+	ControllerInformation getControllerInformation(uint16_t controllerIndex);
+	LocalName getLocalName(uint16_t controllerIndex);
+	PhyConfiguration getPhyConfiguration(uint16_t controllerIndex);
+	AdvertisingFeatures getAdvertisingFeatures(uint16_t controllerIndex);
+	int getActiveConnectionCount(uint16_t controllerIndex);
+
+	// Returns a snapshot of the devices currently connected to any of our controllers
+	std::vector<Connection> getConnections();
+
+	// Records the ATT MTU BlueZ reported for a connected device, given the device's BlueZ object path
+	//
+	// BlueZ includes the MTU and the device (as a path such as "/org/bluez/hci0/dev_AA_BB_CC_DD_EE_FF") in the options it passes
+	// to ReadValue, WriteValue, AcquireNotify and AcquireWrite. The MTU is forgotten when the device disconnects.
+	//
+	// Returns false if the path isn't a device path or the device isn't in our connection table.
+	bool setConnectionMtu(const std::string &devicePath, uint16_t mtu);
+
+	// Returns the smallest ATT MTU reported for any connected device, or 0 if none has been reported
+	//
+	// Notifications go to every subscribed device, so this is the largest notification that every one of them can receive.
+	uint16_t getMinimumConnectionMtu();
+
+	// Sets the handler that is told when a device connects or disconnects (or nullptr to stop being told)
+	void setConnectionHandler(ConnectionHandler handler) { connectionHandler = handler; }
+
+	// Returns the version information, which is not specific to any controller
+	VersionInformation getVersionInformation();
+
+	// Returns the number of active connections across all controllers
+	int getActiveConnectionCount();
 
 	//
-	// Disallow copies of our singleton (c++11)
+	// Disallow copies (c++11)
 	//
 
 	HciAdapter(HciAdapter const&) = delete;
@@ -470,52 +806,136 @@ public:
 	// This method will block until the thread joins
 	void stop();
 
+	// Replaces the HCI socket's receive buffer with one of `size` bytes (see `Instance::setLowMemory()`)
+	//
+	// Returns false (and does nothing) if the event thread is running.
+	bool setReceiveBufferSize(size_t size);
+
+	// Returns the size of the HCI socket's receive buffer, in bytes
+	size_t getReceiveBufferSize() const { return hciSocket.getReceiveBufferSize(); }
+
+	// A handle to a command sent with `sendCommandAsync()`, used to wait for the command's response
+	struct CommandFuture
+	{
+		uint64_t id;
+		uint16_t commandCode;
+		uint16_t controllerId;
+
+		// Completes with the command's status code when the response arrives
+		std::future<uint8_t> status;
+	};
+
 	// Sends a command over the HCI socket
 	//
 	// If the HCI socket is not connected, it will auto-connect prior to sending the command. In the case of a failed auto-connect,
 	// a failure is returned.
 	//
-	// Returns true on success, otherwise false
-	bool sendCommand(HciHeader &request);
+	// This waits (up to `kMaxEventWaitTimeMS`) for the response. To send a command without waiting, see `sendCommandAsync()`.
+	//
+	// If `pStatus` is provided, it receives the status code from the response.
+	//
+	// Returns true if a response was received (whatever its status), otherwise false
+	bool sendCommand(HciHeader &request, uint8_t *pStatus = nullptr);
+
+	// Sends a command over the HCI socket without waiting for its response
+	//
+	// The returned future completes (from the event thread) with the command's status code when the controller responds. Any
+	// number of commands may be outstanding at once; responses are matched to commands by command code and controller index, in
+	// the order they were sent.
+	//
+	// If the command could not be sent, the returned future is not valid.
+	CommandFuture sendCommandAsync(HciHeader &request);
+
+	// Waits up to `timeoutMS` milliseconds for the response to a command sent with `sendCommandAsync()`
+	//
+	// If the wait times out, the command is abandoned (see `cancelCommand()`.) If `pStatus` is provided, it receives the status
+	// code from the response.
+	//
+	// Returns true if the response was received, otherwise false
+	bool waitForCommand(CommandFuture &command, int timeoutMS = kMaxEventWaitTimeMS, uint8_t *pStatus = nullptr);
+
+	// Abandons a command sent with `sendCommandAsync()`, so that its response (if it ever arrives) is ignored
+	void cancelCommand(CommandFuture &command);
 
 	// Event processor, responsible for receiving events from the HCI socket
 	//
 	// This mehtod should not be called directly. Rather, it runs continuously on a thread until the server shuts down
 	void runEventThread();
 
+	// Processes a single management event packet, as read from the HCI socket
+	//
+	// This is normally called from the event thread, but a trace replay (see replay.cpp) calls it directly to feed recorded events
+	// through the same code.
+	//
+	// Returns false if the event was malformed badly enough that the event thread should stop, otherwise true
+	bool processEvent(const uint8_t *pResponsePacket, size_t responsePacketLength);
+
 private:
-	// Private constructor for our Singleton
-	HciAdapter() : commandResponseLock(commandResponseMutex), activeConnections(0) {}
+	// Only an instance creates its adapter (see `getInstance()`)
+	friend struct Instance;
+	explicit HciAdapter(Instance &owner) : owner(owner), versionInformation(), nextCommandId(0), connectionHandler(nullptr) {}
 
-	// Uses a std::condition_variable to wait for a response event for the given `commandCode` or `timeoutMS` milliseconds.
-	//
-	// Returns true if the response event was received for `commandCode` or false if the timeout expired.
+	// The instance we belong to, which our event thread works with
+	Instance &owner;
+
+	// The information we track for each controller
+	struct ControllerState
+	{
+		ControllerState() : adapterSettings(), controllerInformation(), localName(), phyConfiguration(), advertisingFeatures() {}
+
+		AdapterSettings adapterSettings;
+		ControllerInformation controllerInformation;
+		LocalName localName;
+		PhyConfiguration phyConfiguration;
+		AdvertisingFeatures advertisingFeatures;
+	};
+
+	// An outstanding command, waiting for its response
+	struct PendingCommand
+	{
+		uint64_t id;
+		std::promise<uint8_t> status;
+
+		// When the command was sent (see `Stats::hciCommandLatency`)
+		int64_t sentTime;
+	};
+
+	// Returns the key used to match a response to its outstanding commands
+	static uint32_t getCommandKey(uint16_t commandCode, uint16_t controllerId) { return (static_cast<uint32_t>(commandCode) << 16) | controllerId; }
+
+	// Completes the oldest outstanding command with the given command code and controller index
 	//
-	// Command responses are set via `setCommandResponse()`
-	bool waitForCommandResponse(uint16_t commandCode, int timeoutMS);
+	// This is called from the event thread when a Command Complete or Command Status event arrives.
+	void completeCommand(uint16_t commandCode, uint16_t controllerId, uint8_t status);
 
-	// Sets the command response and notifies the waiting std::condition_variable (see `waitForCommandResponse`)
-	void setCommandResponse(uint16_t commandCode);
+	// Removes a device from our connection table, optionally returning a copy of its entry in `pRemoved`
+	//
+	// The caller must hold `controllerStateMutex`.
+	//
+	// Returns true if the device was in the table, otherwise false
+	bool removeConnection(uint16_t controllerIndex, const uint8_t *pAddress, uint8_t addressType, Connection *pRemoved = nullptr);
 
 	// Our HCI Socket, which allows us to talk directly to the kernel
 	HciSocket hciSocket;
 
 	// Our event thread listens for events coming from the adapter and deals with them appropriately
-	static std::thread eventThread;
+	std::thread eventThread;
 
-	// Our adapter information
-	AdapterSettings adapterSettings;
-	ControllerInformation controllerInformation;
+	// Our adapter information, for each controller index that we've heard from
+	std::mutex controllerStateMutex;
+	std::unordered_map<uint16_t, ControllerState> controllerStates;
 	VersionInformation versionInformation;
-	LocalName localName;
 
-	std::condition_variable cvCommandResponse;
-	std::mutex commandResponseMutex;
-	std::unique_lock<std::mutex> commandResponseLock;
-	int conditionalValue;
+	// The devices connected to our controllers (guarded by `controllerStateMutex`)
+	std::vector<Connection> connections;
+
+	// Our outstanding commands (in the order they were sent) for each command code and controller index
+	std::mutex pendingCommandsMutex;
+	std::unordered_map<uint32_t, std::list<PendingCommand> > pendingCommands;
+	uint64_t nextCommandId;
 
-	// Our active connection count
-	int activeConnections;
+	// Told about connections and disconnections (see `setConnectionHandler()`)
+	std::atomic<ConnectionHandler> connectionHandler;
 };
 
 }; // namespace ggk
\ No newline at end of file
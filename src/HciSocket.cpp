@@ -44,6 +44,8 @@
 #include <bluetooth/hci.h>
 #include <thread>
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "HciSocket.h"
 #include "Logger.h"
@@ -53,8 +55,31 @@ namespace ggk {
 
 // Initializes an unconnected socket
 HciSocket::HciSocket()
-: fdSocket(-1)
+: fdSocket(-1), fdEpoll(-1), fdStop(-1), receiveBuffer(kResponseMaxSize)
 {
+	fdEpoll = epoll_create1(EPOLL_CLOEXEC);
+	if (fdEpoll < 0)
+	{
+		logErrno("HciSocket(epoll_create1)");
+	}
+
+	fdStop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fdStop < 0)
+	{
+		logErrno("HciSocket(eventfd)");
+	}
+
+	if (fdEpoll >= 0 && fdStop >= 0)
+	{
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = fdStop;
+		if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdStop, &event) < 0)
+		{
+			logErrno("HciSocket(epoll_ctl)");
+		}
+	}
 }
 
 // Socket destructor
@@ -63,6 +88,16 @@ HciSocket::HciSocket()
 HciSocket::~HciSocket()
 {
 	disconnect();
+
+	if (fdStop >= 0)
+	{
+		close(fdStop);
+	}
+
+	if (fdEpoll >= 0)
+	{
+		close(fdEpoll);
+	}
 }
 
 // Connects to an HCI socket using the Bluetooth Management API protocol
@@ -92,7 +127,25 @@ bool HciSocket::connect()
 		return false;
 	}
 
-	Logger::debug(SSTR << "Connected to HCI control socket (fd = " << fdSocket << ")");
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = fdSocket;
+	if (fdEpoll < 0 || epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdSocket, &event) < 0)
+	{
+		logErrno("Connect(epoll_ctl)");
+		disconnect();
+		return false;
+	}
+
+	// Clear any stop request left over from a previous connection
+	uint64_t count = 0;
+	if (fdStop >= 0 && ::read(fdStop, &count, sizeof(count)) < 0 && errno != EAGAIN)
+	{
+		logErrno("Connect(read)");
+	}
+
+	LOG_DEBUG("Connected to HCI control socket (fd = " << fdSocket << ")");
 
 	return true;
 }
@@ -108,7 +161,7 @@ void HciSocket::disconnect()
 {
 	if (isConnected())
 	{
-		Logger::debug("HciSocket disconnecting");
+		LOG_DEBUG("HciSocket disconnecting");
 
 		if (close(fdSocket) != 0)
 		{
@@ -116,66 +169,102 @@ void HciSocket::disconnect()
 		}
 
 		fdSocket = -1;
-		Logger::trace("HciSocket closed");
+		LOG_TRACE("HciSocket closed");
+	}
+}
+
+// Wakes any thread blocked in `read()` and causes it (and any future reads) to return false until the socket is reconnected
+//
+// This method is thread-safe and is used to stop the HciAdapter's event thread.
+void HciSocket::requestStop() const
+{
+	uint64_t one = 1;
+	if (fdStop < 0 || ::write(fdStop, &one, sizeof(one)) != sizeof(one))
+	{
+		logErrno("requestStop(write)");
 	}
 }
 
 // Reads data from the HCI socket
 //
-// Raw data is read and returned in `response`.
+// If no data is available, this method sleeps until data arrives or a stop is requested (see `requestStop()`). Data that is
+// already waiting is returned immediately, so a caller that reads in a loop drains every pending event per wakeup.
+//
+// Raw data is read into the socket's own receive buffer, which is allocated once and reused for every read. On success,
+// `pData` points to the data within that buffer and `dataLength` is the number of bytes read. The data is only valid until the
+// next call to `read()`, so it should be parsed in place rather than stored. A packet too large for the buffer is dropped.
 //
 // Returns true if data was read successfully, otherwise false is returned. A false return code does not necessarily depict
 // an error, as this can arise from expected conditions (such as an interrupt.)
-bool HciSocket::read(std::vector<uint8_t> &response) const
+bool HciSocket::read(const uint8_t *&pData, size_t &dataLength) const
 {
-	// Fill our response with empty data
-	response.resize(kResponseMaxSize, 0);
+	pData = nullptr;
+	dataLength = 0;
 
-	// Wait for data or a cancellation
-	if (!waitForDataOrShutdown())
+	// Each recv returns a single management packet. Take whatever is already waiting and only sleep once we've run dry.
+	ssize_t bytesRead = -1;
+	for (;;)
 	{
-		return false;
-	}
+		// With MSG_TRUNC, we're told the full length of a packet that didn't fit
+		bytesRead = ::recv(fdSocket, receiveBuffer.data(), receiveBuffer.size(), MSG_DONTWAIT | MSG_TRUNC);
+		if (bytesRead > static_cast<ssize_t>(receiveBuffer.size()))
+		{
+			Logger::warn(SSTR << "Dropping a " << bytesRead << " byte HCI packet that doesn't fit our " << receiveBuffer.size() << " byte receive buffer");
+			continue;
+		}
+
+		if (bytesRead >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			break;
+		}
 
-	// Block until we receive data, a disconnect, or a signal
-	ssize_t bytesRead = ::recv(fdSocket, &response[0], kResponseMaxSize, MSG_WAITALL);
+		// Wait for data or a stop request
+		if (!waitForDataOrShutdown())
+		{
+			return false;
+		}
+	}
 
-	// If there was an error, wipe the data and return an error condition
+	// If there was an error, return an error condition
 	if (bytesRead < 0)
 	{
 		if (errno == EINTR)
 		{
-			Logger::debug("HciSocket receive interrupted");
+			LOG_DEBUG("HciSocket receive interrupted");
 		}
 		else
 		{
 			logErrno("recv");
 		}
-		response.resize(0);
 		return false;
 	}
 	else if (bytesRead == 0)
 	{
 		Logger::error("Peer closed the socket");
-		response.resize(0);
 		return false;
 	}
 
 	// We have data
-	response.resize(bytesRead);
+	pData = receiveBuffer.data();
+	dataLength = bytesRead;
 
-	std::string dump = "";
-	dump += "  > Read " + std::to_string(response.size()) + " bytes\n";
-	dump += Utils::hex(response.data(), response.size());
-	Logger::debug(dump);
+	LOG_DEBUG("  > Read " << dataLength << " bytes\n" << Utils::hex(pData, dataLength));
 
 	return true;
 }
 
+// Replaces the receive buffer with one of `size` bytes
+//
+// This must not be called while another thread may be reading.
+void HciSocket::setReceiveBufferSize(size_t size)
+{
+	std::vector<uint8_t>(size).swap(receiveBuffer);
+}
+
 // Writes the array of bytes of a given count
 //
 // This method returns true if the bytes were written successfully, otherwise false
-bool HciSocket::write(std::vector<uint8_t> buffer) const
+bool HciSocket::write(const std::vector<uint8_t> &buffer) const
 {
 	return write(buffer.data(), buffer.size());
 }
@@ -185,10 +274,7 @@ bool HciSocket::write(std::vector<uint8_t> buffer) const
 // This method returns true if the bytes were written successfully, otherwise false
 bool HciSocket::write(const uint8_t *pBuffer, size_t count) const
 {
-	std::string dump = "";
-	dump += "  > Writing " + std::to_string(count) + " bytes\n";
-	dump += Utils::hex(pBuffer, count);
-	Logger::debug(dump);
+	LOG_DEBUG("  > Writing " << count << " bytes\n" << Utils::hex(pBuffer, count));
 
 	size_t len = ::write(fdSocket, pBuffer, count);
 
@@ -201,34 +287,46 @@ bool HciSocket::write(const uint8_t *pBuffer, size_t count) const
 	return true;
 }
 
-// Wait for data to arrive, or for a shutdown event
+// Wait for data to arrive, or for a stop request
 //
-// Returns true if data is available, false if we are shutting down
+// Returns true if data is available, false if we are stopping (or on error)
 bool HciSocket::waitForDataOrShutdown() const
 {
-	while(ggkIsServerRunning())
+	for (;;)
 	{
-		fd_set rfds;
-		FD_ZERO(&rfds);
-		FD_SET(fdSocket, &rfds);
-
-		struct timeval tv;
-		tv.tv_sec = 0;
-		tv.tv_usec = kDataWaitTimeMS * 1000;
-
-		int retval = select(fdSocket+1, &rfds, NULL, NULL, &tv);
+		struct epoll_event events[2];
+		int count = epoll_wait(fdEpoll, events, 2, -1);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
 
-		// Do we have data?
-		if (retval > 0) { return true; }
+			logErrno("epoll_wait");
+			return false;
+		}
 
-		// We have an error
-		if (retval < 0) { return false; }
+		bool dataAvailable = false;
+		for (int i = 0; i < count; ++i)
+		{
+			// A stop request wins over any pending data
+			if (events[i].data.fd == fdStop)
+			{
+				return false;
+			}
+
+			if (events[i].data.fd == fdSocket)
+			{
+				dataAvailable = true;
+			}
+		}
 
-		// No data; keep waiting
-		continue;
+		if (dataAvailable)
+		{
+			return true;
+		}
 	}
-
-	return false;
 }
 
 // Utilitarian function for logging errors for the given operation
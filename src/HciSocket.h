@@ -41,6 +41,13 @@ namespace ggk {
 class HciSocket
 {
 public:
+	// The default size of our receive buffer, and the size used by the low-memory profile (see `Instance::setLowMemory()`)
+	//
+	// Management packets are a header and a few hundred bytes at most, so the smaller buffer is still roomy. A packet that doesn't
+	// fit is dropped (see `read()`.)
+	static const size_t kResponseMaxSize = 64 * 1024;
+	static const size_t kLowMemoryResponseMaxSize = 4 * 1024;
+
 	// Initializes an unconnected socket
 	HciSocket();
 
@@ -60,18 +67,36 @@ public:
 	// Disconnects from the HCI socket
 	void disconnect();
 
+	// Wakes any thread blocked in `read()` and causes it (and any future reads) to return false until the socket is reconnected
+	//
+	// This method is thread-safe and is used to stop the HciAdapter's event thread.
+	void requestStop() const;
+
 	// Reads data from the HCI socket
 	//
-	// Raw data is read until no more data is available. If no data is available when this method initially starts to read, it will
-	// retry for a maximum timeout defined by `kMaxRetryTimeMS`.
+	// If no data is available, this method sleeps until data arrives or a stop is requested (see `requestStop()`). Data that is
+	// already waiting is returned immediately, so a caller that reads in a loop drains every pending event per wakeup.
+	//
+	// Raw data is read into the socket's own receive buffer, which is allocated once and reused for every read. On success,
+	// `pData` points to the data within that buffer and `dataLength` is the number of bytes read. The data is only valid until the
+	// next call to `read()`, so it should be parsed in place rather than stored. A packet too large for the buffer is dropped.
 	//
-	// Returns true if any data was read successfully, otherwise false is returned in the case of an error or a timeout.
-	bool read(std::vector<uint8_t> &response) const;
+	// Returns true if data was read successfully, otherwise false is returned. A false return code does not necessarily depict
+	// an error, as this can arise from expected conditions (such as an interrupt.)
+	bool read(const uint8_t *&pData, size_t &dataLength) const;
+
+	// Replaces the receive buffer with one of `size` bytes
+	//
+	// This must not be called while another thread may be reading.
+	void setReceiveBufferSize(size_t size);
+
+	// Returns the size of the receive buffer, in bytes
+	size_t getReceiveBufferSize() const { return receiveBuffer.capacity(); }
 
 	// Writes the array of bytes of a given count
 	//
 	// This method returns true if the bytes were written successfully, otherwise false
-	bool write(std::vector<uint8_t> buffer) const;
+	bool write(const std::vector<uint8_t> &buffer) const;
 
 	// Writes the array of bytes of a given count
 	//
@@ -80,9 +105,9 @@ public:
 
 private:
 
-	// Wait for data to arrive, or for a shutdown event
+	// Wait for data to arrive, or for a stop request
 	//
-	// Returns true if data is available, false if we are shutting down
+	// Returns true if data is available, false if we are stopping (or on error)
 	bool waitForDataOrShutdown() const;
 
 	// Utilitarian function for logging errors for the given operation
@@ -90,8 +115,13 @@ private:
 
 	int	fdSocket;
 
-	const size_t kResponseMaxSize = 64 * 1024;
-	const int kDataWaitTimeMS = 10;
+	// Our epoll instance (watching both `fdSocket` and `fdStop`) and the eventfd used to signal a stop request. These live for
+	// the lifetime of the object so that `requestStop()` can never race with a disconnect.
+	int fdEpoll;
+	int fdStop;
+
+	// Our receive buffer (see `read()`)
+	mutable std::vector<uint8_t> receiveBuffer;
 };
 
 }; // namespace ggk
\ No newline at end of file
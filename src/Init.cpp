@@ -30,7 +30,7 @@
 // This file contains the highest-level framework for our server:
 //
 //    Initialization
-//    Adapter configuration (mode, settings, name, etc.)
+//    Adapter configuration (mode, settings, name, etc.) for each of the adapters we serve on
 //    GATT server registration with BlueZ
 //    Signal handling (such as CTRL-C)
 //    Event management
@@ -39,16 +39,32 @@
 // Want to poke around and see how things work? Here's a tip: Start at the bottom of the file and work upwards. It'll make a lot
 // more sense, I promise.
 //
+// Initialization is driven by `initializationStateProcessor()`. Once we have a bus connection, the steps that don't depend on
+// one another are started together: acquiring our owned name, fetching BlueZ's ObjectManager, registering our objects with D-Bus
+// and (for adapters requested with `addAdapter()`, whose controller indices we already know) configuring the adapters over the
+// management API. Each step calls back into the state processor when it completes, and the application is registered with BlueZ
+// as soon as everything it depends on is in place.
+//
+// A step that fails schedules a retry on its own timer, with a delay that doubles after each consecutive failure (see
+// `setRetry()`.) We also watch BlueZ's name on the bus. If bluetoothd goes away, we forget about its adapters and wait; the moment
+// it returns, we cancel any pending retry and re-register straight away.
+//
+// Everything we keep track of along the way belongs to the current server instance (see `InitState` and Instance.cpp), so a
+// process may run several servers at once, each initializing on its own thread.
+//
 // Want to become your own boss while working from home? (Just kidding.)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <gio/gio.h>
+#include <glib-unix.h>
+#include <stdlib.h>
 #include <string>
 #include <vector>
 #include <atomic>
-#include <chrono>
-#include <thread>
+#include <algorithm>
 
+#include "Advertising.h"
+#include "BondStore.h"
 #include "Server.h"
 #include "Globals.h"
 #include "Mgmt.h"
@@ -58,6 +74,13 @@
 #include "GattCharacteristic.h"
 #include "GattProperty.h"
 #include "Logger.h"
+#include "UpdateQueue.h"
+#include "EventScheduler.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+#include "MainContext.h"
+#include "Instance.h"
 #include "Init.h"
 
 namespace ggk {
@@ -66,36 +89,129 @@ namespace ggk {
 // Constants
 //
 
-static const int kPeriodicTimerFrequencySeconds = 1;
-static const int kRetryDelaySeconds = 2;
-static const int kIdleFrequencyMS = 10;
+static const guint kRetryInitialDelayMS = 250;
+static const guint kRetryMaxDelayMS = 8000;
+static const int kMaxUpdatesPerWakeup = 64;
+static const int kStallProbeIntervalMS = 100;
 
-//
-// Retries
-//
+// An interface that we've registered with D-Bus, along with the path we registered it at
+struct RegisteredObject
+{
+	std::string path;
+	guint id;
+};
 
-static time_t retryTimeStart = 0;
+// An adapter that was requested with `addAdapter()`
+struct AdapterConfiguration
+{
+	std::string name;
+	std::string advertisingName;
+	std::string advertisingShortName;
+};
 
+// A BlueZ adapter that we serve our GATT application on
 //
-// Adapter configuration
+// Every adapter shares the same server description (and therefore the same D-Bus objects), but each is configured and registered
+// with BlueZ separately.
+struct BluezAdapter
+{
+	BluezAdapter()
+	: controllerIndex(0), pObject(nullptr), pGattManagerProxy(nullptr), pAdapterInterfaceProxy(nullptr),
+	  pAdapterPropertiesInterfaceProxy(nullptr), bConfigured(false), bBondsRestored(false), bRegistrationPending(false),
+	  bApplicationRegistered(false)
+	{
+	}
+
+	// The adapter's name (ex: "hci0") and the controller index used to manage it
+	std::string name;
+	uint16_t controllerIndex;
+
+	// The advertising names for this adapter (empty to use the server's names)
+	std::string advertisingName;
+	std::string advertisingShortName;
+
+	GDBusObject *pObject;
+	GDBusProxy *pGattManagerProxy;
+	GDBusProxy *pAdapterInterfaceProxy;
+	GDBusProxy *pAdapterPropertiesInterfaceProxy;
+
+	bool bConfigured;
+	bool bBondsRestored;
+	bool bRegistrationPending;
+	bool bApplicationRegistered;
+};
+
+// Everything we keep track of while initializing and running a server instance
 //
+// Each instance has its own (see Instance.cpp), which we get at through `state()`.
+struct InitState
+{
+	InitState()
+	: retryTimerId(0), retryDelayMS(kRetryInitialDelayMS), scheduledRetryDelayMS(0), pBusConnection(nullptr), ownedNameId(0),
+	  bluezWatchId(0), updateQueueSourceId(0), stallProbeSourceId(0), stallProbeDueTime(0), pMainLoop(nullptr),
+	  pBluezObjectManager(nullptr), bBusAcquirePending(false), bOwnedNameAcquired(false), bOwnedNamePending(false),
+	  bOwnedNameWasAcquired(false), bObjectManagerPending(false), bAdaptersPreconfigured(false), bApplicationRegistered(false),
+	  bBluezPresent(false), adapterGeneration(0)
+	{
+	}
 
-GDBusConnection *pBusConnection = nullptr;
-static guint ownedNameId = 0;
-static guint periodicTimeoutId = 0;
-static std::vector<guint> registeredObjectIds;
-static std::atomic<GMainLoop *> pMainLoop(nullptr);
-static GDBusObjectManager *pBluezObjectManager = nullptr;
-static GDBusObject *pBluezAdapterObject = nullptr;
-static GDBusObject *pBluezDeviceObject = nullptr;
-static GDBusProxy *pBluezGattManagerProxy = nullptr;
-static GDBusProxy *pBluezAdapterInterfaceProxy = nullptr;
-static GDBusProxy *pBluezDeviceInterfaceProxy = nullptr;
-static GDBusProxy *pBluezAdapterPropertiesInterfaceProxy = nullptr;
-static bool bOwnedNameAcquired = false;
-static bool bAdapterConfigured = false;
-static bool bApplicationRegistered = false;
-static std::string bluezGattManagerInterfaceName = "";
+	//
+	// Retries
+	//
+
+	guint retryTimerId;
+	guint retryDelayMS;
+	guint scheduledRetryDelayMS;
+
+	//
+	// Adapter configuration
+	//
+
+	GDBusConnection *pBusConnection;
+	guint ownedNameId;
+	guint bluezWatchId;
+	guint updateQueueSourceId;
+	guint stallProbeSourceId;
+	gint64 stallProbeDueTime;
+
+	std::vector<RegisteredObject> registeredObjects;
+	std::atomic<GMainLoop *> pMainLoop;
+	GDBusObjectManager *pBluezObjectManager;
+	bool bBusAcquirePending;
+	bool bOwnedNameAcquired;
+	bool bOwnedNamePending;
+	bool bOwnedNameWasAcquired;
+	bool bObjectManagerPending;
+	bool bAdaptersPreconfigured;
+	bool bApplicationRegistered;
+	bool bBluezPresent;
+
+	//
+	// Adapters
+	//
+
+	std::vector<AdapterConfiguration> adapterConfigurations;
+	std::vector<BluezAdapter> bluezAdapters;
+
+	// The controller indices of the adapters configured so far (an adapter may be configured before BlueZ tells us about it)
+	std::vector<uint16_t> configuredControllers;
+
+	// Bumped each time our adapters are released, so that replies to calls made on behalf of an old set of adapters are ignored
+	size_t adapterGeneration;
+	LinkOptions linkOptions;
+};
+
+// Returns the state of the current instance
+static InitState &state()
+{
+	return *Instance::current().pInitState;
+}
+
+// Creates the state for a new server instance (see Instance.cpp)
+std::shared_ptr<InitState> createInitState()
+{
+	return std::make_shared<InitState>();
+}
 
 //
 // Externs
@@ -109,6 +225,7 @@ extern void setServerHealth(enum GGKServerHealth newHealth);
 //
 
 static void initializationStateProcessor();
+void unregisterObjects(const std::string &path);
 
 // ---------------------------------------------------------------------------------------------------------------------------------
 //  ___    _ _           __      _       _                                             _
@@ -118,27 +235,25 @@ static void initializationStateProcessor();
 // |___\__,_|_|\___| /_/     \__,_|\__,_|\__\__,_|  | .__/|_|  \___/ \___\___||___/___/_|_| |_|\__, |
 //                                                  |_|                                        |___/
 //
-// Our idle funciton is what processes data updates. We handle this in a simple way. We update the data directly in our global
+// Our update processor is what processes data updates. We handle this in a simple way. We update the data directly in our global
 // `TheServer` object, then call `ggkPushUpdateQueue` to trigger that data to be updated (in whatever way the service responsible
 // for that data() sees fit.
 //
-// This is done using the `ggkPushUpdateQueue` / `ggkPopUpdateQueue` methods to manage the queue of pending update messages. Each
-// entry represents an interface that needs to be updated. The idleFunc calls the interface's `onUpdatedValue` method for each
-// update.
+// This is done using the `ggkPushUpdateQueue` method to post entries onto our update queue (see UpdateQueue.cpp.) Each entry
+// represents an interface that needs to be updated. The processor calls the interface's `onUpdatedValue` method for each update.
 //
-// The idle processor will perform one update per idle tick, however, it will notify that there is more data so the idle ticks
-// do not lag behind.
+// Rather than polling the queue, the main loop watches the queue's eventfd, which is signaled whenever an update is pushed. Each
+// wakeup drains up to `kMaxUpdatesPerWakeup` updates. If more remain, we signal ourselves again and return, which lets the main
+// loop dispatch other pending work (such as D-Bus messages) before we continue.
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Our idle function
+// Processes a single update from the update queue
 //
 // This method is used to process data on the same thread as our main loop. This allows us to communicate with our service from
 // the outside.
 //
-// IMPORTANT: This method must return 'true' if any work was performed, otherwise it must return 'false'. Returning 'true' will
-// cause the idle loop to continue to call this method to process data at the maximum rate (which can peg the CPU at 100%.) By
-// returning false when there is no work to do, we are nicer to the system.
-bool idleFunc(void *pUserData)
+// Returns true if an update was processed, or false if there was nothing to do.
+bool processUpdate(void *pUserData)
 {
 
 	// Don't do anything unless we're running
@@ -148,42 +263,55 @@ bool idleFunc(void *pUserData)
 	}
 
 	// Try to get an update
-	const int kQueueEntryLen = 1024;
-	char queueEntry[kQueueEntryLen];
-	if (ggkPopUpdateQueue(queueEntry, kQueueEntryLen, 0) != 1)
+	//
+	// Entries in the queue are interfaces that were resolved when the update was pushed, so there's nothing to look up here
+	const DBusInterface *pInterface = TheUpdateQueue.pop();
+	if (nullptr == pInterface)
 	{
 		return false;
 	}
 
-	std::string entryString = queueEntry;
-	auto token = entryString.find('|');
-	if (token == std::string::npos)
+	// Updates may still be queued for a service that has since been removed (see `Server::removeService()`)
+	if (pInterface->getOwner().isRetired())
 	{
-		Logger::error("Queue entry was not formatted properly - could not find separating token");
-		return false;
+		return true;
 	}
 
-	DBusObjectPath objectPath = DBusObjectPath(entryString.substr(0, token));
-	std::string interfaceName = entryString.substr(token+1);
-
 	// We have an update - call the onUpdatedValue method on the interface
-	std::shared_ptr<const DBusInterface> pInterface = TheServer->findInterface(objectPath, interfaceName);
-	if (nullptr == pInterface)
+	LOG_DEBUG("Processing updated value for interface '" << pInterface->getName() << "' at path '" << pInterface->getPath() << "'");
+	pInterface->callOnUpdatedValue(state().pBusConnection, pUserData);
+	return true;
+}
+
+// Called by the main loop when the update queue's eventfd is signaled
+//
+// Drains a batch of updates from the queue. This method never blocks.
+gboolean onUpdateQueueWakeup(gint /*fd*/, GIOCondition /*condition*/, gpointer pUserData)
+{
+	// Acknowledge first, so that anything pushed while we drain will wake us again
+	TheUpdateQueue.acknowledgeWakeup();
+
+	int processed = 0;
+	while (processed < kMaxUpdatesPerWakeup && processUpdate(pUserData))
 	{
-		Logger::warn(SSTR << "Unable to find interface for update: path[" << objectPath << "], name[" << interfaceName << "]");
+		++processed;
 	}
-	else
+
+	// Send the notifications these updates produced together, now, rather than waiting for the idle flush (see
+	// `Server::getEnableNotificationBatching()`)
+	if (processed != 0 && TheServer->getEnableNotificationBatching())
 	{
-		// Is it a characteristic?
-		if (std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic))
-		{
-			Logger::debug(SSTR << "Processing updated value for interface '" << interfaceName << "' at path '" << objectPath << "'");
-			pCharacteristic->callOnUpdatedValue(pBusConnection, pUserData);
-			return true;
-		}
+		GattCharacteristic::flushBatchedChangeNotifications();
 	}
 
-	return false;
+	// If we hit our batch limit, come back for the rest after the main loop has had a chance to do other work
+	if (processed == kMaxUpdatesPerWakeup && !TheUpdateQueue.empty())
+	{
+		TheUpdateQueue.wakeup();
+	}
+
+	// Always continue so our wakeup source remains in tact
+	return G_SOURCE_CONTINUE;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -196,84 +324,82 @@ bool idleFunc(void *pUserData)
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
+// Releases the BlueZ objects and proxies for each of our adapters and forgets about them
+void releaseAdapters()
+{
+	for (BluezAdapter &adapter : state().bluezAdapters)
+	{
+		if (nullptr != adapter.pObject) { g_object_unref(adapter.pObject); }
+		if (nullptr != adapter.pGattManagerProxy) { g_object_unref(adapter.pGattManagerProxy); }
+		if (nullptr != adapter.pAdapterInterfaceProxy) { g_object_unref(adapter.pAdapterInterfaceProxy); }
+		if (nullptr != adapter.pAdapterPropertiesInterfaceProxy) { g_object_unref(adapter.pAdapterPropertiesInterfaceProxy); }
+	}
+
+	state().bluezAdapters.clear();
+	++state().adapterGeneration;
+}
+
 // Perform final cleanup of various resources that were allocated while the server was initialized and/or running
 void uninit()
 {
   	// We've left our main loop - nullify its pointer so we know we're no longer running
-  	pMainLoop = nullptr;
+  	state().pMainLoop = nullptr;
 
-	if (nullptr != pBluezAdapterObject)
-	{
-		g_object_unref(pBluezAdapterObject);
-		pBluezAdapterObject = nullptr;
-	}
+	releaseAdapters();
 
-	if (nullptr != pBluezDeviceObject)
+	if (nullptr != state().pBluezObjectManager)
 	{
-		g_object_unref(pBluezDeviceObject);
-		pBluezDeviceObject = nullptr;
+		g_object_unref(state().pBluezObjectManager);
+		state().pBluezObjectManager = nullptr;
 	}
 
-	if (nullptr != pBluezAdapterInterfaceProxy)
-	{
-		g_object_unref(pBluezAdapterInterfaceProxy);
-		pBluezAdapterInterfaceProxy = nullptr;
-	}
+	unregisterObjects(std::string());
+	stopAdvertising();
 
-	if (nullptr != pBluezDeviceInterfaceProxy)
+	if (0 != state().retryTimerId)
 	{
-		g_object_unref(pBluezDeviceInterfaceProxy);
-		pBluezDeviceInterfaceProxy = nullptr;
+		MainContext::removeSource(state().retryTimerId);
+		state().retryTimerId = 0;
 	}
 
-	if (nullptr != pBluezAdapterPropertiesInterfaceProxy)
+	if (0 != state().bluezWatchId)
 	{
-		g_object_unref(pBluezAdapterPropertiesInterfaceProxy);
-		pBluezAdapterPropertiesInterfaceProxy = nullptr;
+		g_bus_unwatch_name(state().bluezWatchId);
+		state().bluezWatchId = 0;
 	}
 
-	if (nullptr != pBluezGattManagerProxy)
-	{
-		g_object_unref(pBluezGattManagerProxy);
-		pBluezGattManagerProxy = nullptr;
-	}
+	TheEventScheduler.stop();
 
-	if (nullptr != pBluezObjectManager)
-	{
-		g_object_unref(pBluezObjectManager);
-		pBluezObjectManager = nullptr;
-	}
+	// Let any async handlers that are still running finish before the server description goes away
+	TheWorkerPool.stop();
 
-	if (!registeredObjectIds.empty())
+	if (0 != state().updateQueueSourceId)
 	{
-		for (guint id : registeredObjectIds)
-		{
-			g_dbus_connection_unregister_object(pBusConnection, id);
-		}
-		registeredObjectIds.clear();
+		MainContext::removeSource(state().updateQueueSourceId);
+		state().updateQueueSourceId = 0;
 	}
 
-	if (0 != periodicTimeoutId)
+	if (0 != state().stallProbeSourceId)
 	{
-		g_source_remove(periodicTimeoutId);
-		periodicTimeoutId = 0;
+		MainContext::removeSource(state().stallProbeSourceId);
+		state().stallProbeSourceId = 0;
 	}
 
-  	if (ownedNameId > 0)
+  	if (state().ownedNameId > 0)
   	{
-		g_bus_unown_name(ownedNameId);
+		g_bus_unown_name(state().ownedNameId);
 	}
 
-	if (nullptr != pBusConnection)
+	if (nullptr != state().pBusConnection)
 	{
-		g_object_unref(pBusConnection);
-		pBusConnection = nullptr;
+		g_object_unref(state().pBusConnection);
+		state().pBusConnection = nullptr;
 	}
 
-	if (nullptr != pMainLoop)
+	if (nullptr != state().pMainLoop)
 	{
-		g_main_loop_unref(pMainLoop);
-		pMainLoop = nullptr;
+		g_main_loop_unref(state().pMainLoop);
+		state().pMainLoop = nullptr;
 	}
 }
 
@@ -305,9 +431,9 @@ void shutdown()
 	HciAdapter::getInstance().stop();
 
 	// If we still have a main loop, ask it to quit
-	if (nullptr != pMainLoop)
+	if (nullptr != state().pMainLoop)
 	{
-		g_main_loop_quit(pMainLoop);
+		g_main_loop_quit(state().pMainLoop);
 	}
 }
 
@@ -320,49 +446,35 @@ void shutdown()
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Periodic timer handler
+// Retry timer handler
 //
-// A periodic timer is a timer fires every so often (see kPeriodicTimerFrequencySeconds.) This is used for our initialization
-// failure retries, but custom code can also be added to a server description (see `onEvent()`)
-gboolean onPeriodicTimer(gpointer pUserData)
+// This one-shot timer is scheduled by `setRetry()` when an initialization step fails. Events that are added to a server
+// description (see `onEvent()`) are driven separately, by the EventScheduler.
+gboolean onRetryTimer(gpointer /*pUserData*/)
 {
-	// If we're shutting down, don't do anything and stop the periodic timer
-	if (ggkGetServerRunState() > ERunning)
-	{
-		return FALSE;
-	}
+	state().retryTimerId = 0;
 
-	// Deal with retry timers
-	if (0 != retryTimeStart)
+	// If we're shutting down, don't do anything
+	if (ggkGetServerRunState() > ERunning)
 	{
-		Logger::debug(SSTR << "Ticking retry timer");
-
-		// Has the retry time expired?
-		int secondsRemaining = time(nullptr) - retryTimeStart - kRetryDelaySeconds;
-		if (secondsRemaining >= 0)
-		{
-			retryTimeStart = 0;
-			initializationStateProcessor();
-		}
+		return G_SOURCE_REMOVE;
 	}
 
-	// If we're registered, then go ahead and emit signals
-	if (bApplicationRegistered)
-	{
-		// Tick the object hierarchy
-		//
-		// The real goal here is to have the objects tick their interfaces (see `onEvent()` method when adding interfaces inside
-		// 'Server::Server()'
-		for (const DBusObject &object : TheServer->getObjects())
-		{
-			if (object.isPublished())
-			{
-				object.tickEvents(pBusConnection, pUserData);
-			}
-		}
-	}
+	LOG_DEBUG("Retrying initialization");
+	initializationStateProcessor();
+	return G_SOURCE_REMOVE;
+}
 
-	return TRUE;
+// Main loop stall probe
+//
+// This runs every kStallProbeIntervalMS and records how late it ran (see `Stats::mainLoopStall`.) Anything that blocks the main
+// loop delays the probe, so the lateness is a direct measure of how long the main loop was unable to dispatch.
+gboolean onStallProbe(gpointer /*pUserData*/)
+{
+	gint64 now = g_get_monotonic_time();
+	TheStats.mainLoopStall.record(now - state().stallProbeDueTime);
+	state().stallProbeDueTime = now + kStallProbeIntervalMS * 1000;
+	return G_SOURCE_CONTINUE;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -389,12 +501,15 @@ void onMethodCall
 	gpointer pUserData
 )
 {
-	// Convert our input path into our custom type for path management
-	DBusObjectPath objectPath(pObjectPath);
+	if (TheTraceRecorder.isRecording())
+	{
+		TheTraceRecorder.recordMethodCall(pSender, pObjectPath, pInterfaceName, pMethodName, pParameters);
+	}
 
-	if (!TheServer->callMethod(objectPath, pInterfaceName, pMethodName, pConnection, pParameters, pInvocation, pUserData))
+	LatencyTimer timer(TheStats.methodCallLatency);
+	if (!TheServer->callMethod(pObjectPath, pInterfaceName, pMethodName, pConnection, pParameters, pInvocation, pUserData))
 	{
-		Logger::error(SSTR << " + Method not found: [" << pSender << "]:[" << objectPath << "]:[" << pInterfaceName << "]:[" << pMethodName << "]");
+		Logger::error(SSTR << " + Method not found: [" << pSender << "]:[" << pObjectPath << "]:[" << pInterfaceName << "]:[" << pMethodName << "]");
 		g_dbus_method_invocation_return_dbus_error(pInvocation, kErrorNotImplemented.c_str(), "This method is not implemented");
 		return;
 	}
@@ -402,6 +517,14 @@ void onMethodCall
 	return;
 }
 
+// Returns a description of a property request for our log ("[sender]:[path]:[interface]:[property]")
+//
+// This is only built when something is logged, so that a successful request doesn't allocate.
+static std::string describeProperty(const gchar *pSender, const gchar *pObjectPath, const gchar *pInterfaceName, const gchar *pPropertyName)
+{
+	return std::string("[") + pSender + "]:[" + pObjectPath + "]:[" + pInterfaceName + "]:[" + pPropertyName + "]";
+}
+
 // Handle D-Bus requests to get a property
 GVariant *onGetProperty
 (
@@ -414,32 +537,42 @@ GVariant *onGetProperty
 	gpointer         pUserData
 )
 {
-	// Convert our input path into our custom type for path management
-	DBusObjectPath objectPath(pObjectPath);
+	if (TheTraceRecorder.isRecording())
+	{
+		TheTraceRecorder.recordGetProperty(pSender, pObjectPath, pInterfaceName, pPropertyName);
+	}
 
-	const GattProperty *pProperty = TheServer->findProperty(objectPath, pInterfaceName, pPropertyName);
+	LatencyTimer timer(TheStats.propertyGetLatency);
+	const GattProperty *pProperty = TheServer->findProperty(pObjectPath, pInterfaceName, pPropertyName);
 
-	std::string propertyPath = std::string("[") + pSender + "]:[" + objectPath.toString() + "]:[" + pInterfaceName + "]:[" + pPropertyName + "]";
 	if (!pProperty)
 	{
+		std::string propertyPath = describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName);
 		Logger::error(SSTR << "Property(get) not found: " << propertyPath);
 	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(get) not found: " + propertyPath).c_str(), pSender);
 		return nullptr;
 	}
 
+	// Immutable properties were marshalled when they were added, so all we hand back is another reference to that value
+	if (pProperty->isImmutable() && nullptr != pProperty->getValue())
+	{
+		return pProperty->getValueReference();
+	}
+
 	if (!pProperty->getGetterFunc())
 	{
+		std::string propertyPath = describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName);
 		Logger::error(SSTR << "Property(get) func not found: " << propertyPath);
 	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(get) func not found: " + propertyPath).c_str(), pSender);
 		return nullptr;
 	}
 
-	Logger::info(SSTR << "Calling property getter: " << propertyPath);
-	GVariant *pResult = pProperty->getGetterFunc()(pConnection, pSender, objectPath.c_str(), pInterfaceName, pPropertyName, ppError, pUserData);
+	LOG_INFO("Calling property getter: " << describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName));
+	GVariant *pResult = pProperty->getGetterFunc()(pConnection, pSender, pObjectPath, pInterfaceName, pPropertyName, ppError, pUserData);
 
 	if (nullptr == pResult)
 	{
-	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(get) failed: " + propertyPath).c_str(), pSender);
+	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(get) failed: " + describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName)).c_str(), pSender);
 	    return nullptr;
 	}
 
@@ -459,14 +592,16 @@ gboolean onSetProperty
 	gpointer         pUserData
 )
 {
-	// Convert our input path into our custom type for path management
-	DBusObjectPath objectPath(pObjectPath);
+	if (TheTraceRecorder.isRecording())
+	{
+		TheTraceRecorder.recordSetProperty(pSender, pObjectPath, pInterfaceName, pPropertyName, pValue);
+	}
 
-	const GattProperty *pProperty = TheServer->findProperty(objectPath, pInterfaceName, pPropertyName);
+	const GattProperty *pProperty = TheServer->findProperty(pObjectPath, pInterfaceName, pPropertyName);
 
-	std::string propertyPath = std::string("[") + pSender + "]:[" + objectPath.toString() + "]:[" + pInterfaceName + "]:[" + pPropertyName + "]";
 	if (!pProperty)
 	{
+		std::string propertyPath = describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName);
 		Logger::error(SSTR << "Property(set) not found: " << propertyPath);
 	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(set) not found: " + propertyPath).c_str(), pSender);
 		return false;
@@ -474,15 +609,16 @@ gboolean onSetProperty
 
 	if (!pProperty->getSetterFunc())
 	{
+		std::string propertyPath = describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName);
 		Logger::error(SSTR << "Property(set) func not found: " << propertyPath);
 	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(set) func not found: " + propertyPath).c_str(), pSender);
 		return false;
 	}
 
-	Logger::info(SSTR << "Calling property getter: " << propertyPath);
-	if (!pProperty->getSetterFunc()(pConnection, pSender, objectPath.c_str(), pInterfaceName, pPropertyName, pValue, ppError, pUserData))
+	LOG_INFO("Calling property getter: " << describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName));
+	if (!pProperty->getSetterFunc()(pConnection, pSender, pObjectPath, pInterfaceName, pPropertyName, pValue, ppError, pUserData))
 	{
-	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(set) failed: " + propertyPath).c_str(), pSender);
+	    g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, ("Property(set) failed: " + describeProperty(pSender, pObjectPath, pInterfaceName, pPropertyName)).c_str(), pSender);
 	    return false;
 	}
 
@@ -500,17 +636,43 @@ gboolean onSetProperty
 // ---------------------------------------------------------------------------------------------------------------------------------
 
 // Convenience method for setting a retry timer so that operations can be continuously retried until we eventually succeed
-void setRetry()
+//
+// Each consecutive retry waits twice as long as the one before it (starting at kRetryInitialDelayMS, up to kRetryMaxDelayMS.)
+// The delay is reset once we're running (see `resetRetry()`.) If a retry is already scheduled, it is left alone.
+//
+// Returns the delay (in milliseconds) until the scheduled retry.
+guint setRetry()
 {
-	retryTimeStart = time(nullptr);
+	InitState &initState = state();
+	if (0 != initState.retryTimerId)
+	{
+		return initState.scheduledRetryDelayMS;
+	}
+
+	initState.scheduledRetryDelayMS = initState.retryDelayMS;
+	initState.retryTimerId = MainContext::addTimeout(initState.scheduledRetryDelayMS, onRetryTimer, nullptr);
+	initState.retryDelayMS = std::min(initState.retryDelayMS * 2, kRetryMaxDelayMS);
+	return initState.scheduledRetryDelayMS;
 }
 
 // Convenience method for setting a retry timer so that failures (related to initialization) can be continuously retried until we
 // eventually succeed.
 void setRetryFailure()
 {
-	setRetry();
-	Logger::warn(SSTR << "  + Will retry the failed operation in about " << kRetryDelaySeconds << " seconds");
+	guint delayMS = setRetry();
+	Logger::warn(SSTR << "  + Will retry the failed operation in about " << delayMS << "ms");
+}
+
+// Cancels any scheduled retry and resets the retry delay back to kRetryInitialDelayMS
+void resetRetry()
+{
+	if (0 != state().retryTimerId)
+	{
+		MainContext::removeSource(state().retryTimerId);
+		state().retryTimerId = 0;
+	}
+
+	state().retryDelayMS = kRetryInitialDelayMS;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -523,45 +685,88 @@ void setRetryFailure()
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Use the BlueZ GATT Manager proxy to register our GATT application with BlueZ
+// Use the BlueZ GATT Manager proxy of each adapter to register our GATT application with BlueZ
+//
+// The same application (our D-Bus objects) is registered with every adapter, so BlueZ delivers our notifications on all of them.
 void doRegisterApplication()
 {
-	g_auto(GVariantBuilder) builder;
-	g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
-	GVariant *pParams = g_variant_new("(oa{sv})", "/", &builder);
+	for (size_t index = 0; index < state().bluezAdapters.size(); ++index)
+	{
+		BluezAdapter &adapter = state().bluezAdapters[index];
+		if (adapter.bApplicationRegistered || adapter.bRegistrationPending)
+		{
+			continue;
+		}
 
-	g_dbus_proxy_call
-	(
-		pBluezGattManagerProxy,         // GDBusProxy *proxy
-		"RegisterApplication",          // const gchar *method_name   (ex: "GetManagedObjects")
-		pParams,                        // GVariant *parameters
-		G_DBUS_CALL_FLAGS_NONE,         // GDBusCallFlags flags
-		-1,                             // gint timeout_msec
-		nullptr,                        // GCancellable *cancellable
+		g_auto(GVariantBuilder) builder;
+		g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+		GVariant *pParams = g_variant_new("(oa{sv})", "/", &builder);
 
-		// GAsyncReadyCallback callback
-		[] (GObject * /*pSourceObject*/, GAsyncResult *pAsyncResult, gpointer /*pUserData*/)
-		{
-			GError *pError = nullptr;
-			GVariant *pVariant = g_dbus_proxy_call_finish(pBluezGattManagerProxy, pAsyncResult, &pError);
-			if (nullptr == pVariant)
-			{
-				Logger::error(SSTR << "Failed to register application: " << (nullptr == pError ? "Unknown" : pError->message));
-				setRetryFailure();
-			}
-			else
-			{
-				g_variant_unref(pVariant);
-				Logger::debug(SSTR << "GATT application registered with BlueZ");
-				bApplicationRegistered = true;
-			}
+		adapter.bRegistrationPending = true;
 
-			// Keep going...
-			initializationStateProcessor();
-		},
+		// The reply identifies its adapter by index, tagged with the current adapter generation (see `releaseAdapters()`)
+		size_t token = (state().adapterGeneration << 16) | index;
 
-		nullptr                         // gpointer user_data
-	);
+		g_dbus_proxy_call
+		(
+			adapter.pGattManagerProxy,      // GDBusProxy *proxy
+			"RegisterApplication",          // const gchar *method_name   (ex: "GetManagedObjects")
+			pParams,                        // GVariant *parameters
+			G_DBUS_CALL_FLAGS_NONE,         // GDBusCallFlags flags
+			-1,                             // gint timeout_msec
+			nullptr,                        // GCancellable *cancellable
+
+			// GAsyncReadyCallback callback
+			[] (GObject *pSourceObject, GAsyncResult *pAsyncResult, gpointer pUserData)
+			{
+				GError *pError = nullptr;
+				GVariant *pVariant = g_dbus_proxy_call_finish(reinterpret_cast<GDBusProxy *>(pSourceObject), pAsyncResult, &pError);
+
+				// Our adapters may have been released (and perhaps found again) while the call was in flight
+				size_t token = GPOINTER_TO_SIZE(pUserData);
+				size_t index = token & 0xffff;
+				if (token != ((state().adapterGeneration << 16) | index) || index >= state().bluezAdapters.size())
+				{
+					if (nullptr != pVariant) { g_variant_unref(pVariant); }
+					return;
+				}
+
+				BluezAdapter &adapter = state().bluezAdapters[index];
+				adapter.bRegistrationPending = false;
+
+				if (nullptr == pVariant)
+				{
+					Logger::error(SSTR << "Failed to register application on " << adapter.name << ": " << (nullptr == pError ? "Unknown" : pError->message));
+					setRetryFailure();
+				}
+				else
+				{
+					g_variant_unref(pVariant);
+					LOG_DEBUG("GATT application registered with BlueZ on " << adapter.name);
+					adapter.bApplicationRegistered = true;
+
+					bool allRegistered = true;
+					for (const BluezAdapter &other : state().bluezAdapters)
+					{
+						allRegistered = allRegistered && other.bApplicationRegistered;
+					}
+
+					// Once we're registered everywhere, start firing the events in our server description (see `onEvent()`
+					// method when adding interfaces inside 'Server::Server()')
+					if (allRegistered)
+					{
+						state().bApplicationRegistered = true;
+						TheEventScheduler.start(state().pBusConnection, state().pBusConnection);
+					}
+				}
+
+				// Keep going...
+				initializationStateProcessor();
+			},
+
+			GSIZE_TO_POINTER(token)         // gpointer user_data
+		);
+	}
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -576,30 +781,35 @@ void doRegisterApplication()
 // use an XML description of our D-Bus objects.
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-void registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath = DBusObjectPath(), int depth = 1)
+// Returns the vtable that dispatches D-Bus requests on our objects to the server (see the event handlers above)
+const GDBusInterfaceVTable *getInterfaceVtable()
+{
+	static GDBusInterfaceVTable interfaceVtable = { onMethodCall, onGetProperty, onSetProperty, { nullptr } };
+	return &interfaceVtable;
+}
+
+// Registers the interfaces of a parsed node and all of its children with D-Bus, with the node itself at `basePath`
+//
+// Returns false if anything failed to register (anything that did register is left for the caller to clean up.)
+bool registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath = DBusObjectPath(), int depth = 1)
 {
 	std::string prefix;
 	prefix.insert(0, depth * 2, ' ');
 
-	static GDBusInterfaceVTable interfaceVtable;
-	interfaceVtable.method_call = onMethodCall;
-	interfaceVtable.get_property = onGetProperty;
-	interfaceVtable.set_property = onSetProperty;
-
 	GDBusInterfaceInfo **ppInterface = pNode->interfaces;
 
-	Logger::debug(SSTR << prefix << "+ " << pNode->path);
+	LOG_DEBUG(prefix << "+ " << pNode->path);
 
 	while(nullptr != *ppInterface)
 	{
 		GError *pError = nullptr;
-		Logger::debug(SSTR << prefix << "    (iface: " << (*ppInterface)->name << ")");
+		LOG_DEBUG(prefix << "    (iface: " << (*ppInterface)->name << ")");
 		guint registeredObjectId = g_dbus_connection_register_object
 		(
-			pBusConnection,             // GDBusConnection *connection
+			state().pBusConnection,             // GDBusConnection *connection
 			basePath.c_str(),           // const gchar *object_path
 			*ppInterface,               // GDBusInterfaceInfo *interface_info
-			&interfaceVtable,           // const GDBusInterfaceVTable *vtable
+			getInterfaceVtable(),       // const GDBusInterfaceVTable *vtable
 			nullptr,                    // gpointer user_data
 			nullptr,                    // GDestroyNotify user_data_free_func
 			&pError                     // GError **error
@@ -608,18 +818,14 @@ void registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath
 		if (0 == registeredObjectId)
 		{
 			Logger::error(SSTR << "Failed to register object: " << (nullptr == pError ? "Unknown" : pError->message));
-
-			// Cleanup and pretend like we were never here
-			g_dbus_node_info_unref(pNode);
-			registeredObjectIds.clear();
-
-			// Try again later
-			setRetryFailure();
-			return;
+			return false;
 		}
 
 		// Save the registered object Id so we can clean it up later
-		registeredObjectIds.push_back(registeredObjectId);
+		RegisteredObject registered;
+		registered.path = basePath.toString();
+		registered.id = registeredObjectId;
+		state().registeredObjects.push_back(registered);
 
 		++ppInterface;
 	}
@@ -627,38 +833,120 @@ void registerNodeHierarchy(GDBusNodeInfo *pNode, const DBusObjectPath &basePath
 	GDBusNodeInfo **ppChild = pNode->nodes;
 	while(nullptr != *ppChild)
 	{
-		registerNodeHierarchy(*ppChild, basePath + (*ppChild)->path, depth + 1);
+		if (!registerNodeHierarchy(*ppChild, basePath + (*ppChild)->path, depth + 1))
+		{
+			return false;
+		}
 
 		++ppChild;
 	}
+
+	return true;
 }
 
-void registerObjects()
+// Unregisters everything we've registered with D-Bus at `path` or beneath it (an empty path unregisters everything)
+void unregisterObjects(const std::string &path)
 {
-	// Parse each object into an XML interface tree
+	auto iter = state().registeredObjects.begin();
+	while (iter != state().registeredObjects.end())
+	{
+		// "/com/foo" contains "/com/foo/bar" but not "/com/foobar"
+		bool within = path.empty() || iter->path == path ||
+			(iter->path.compare(0, path.length(), path) == 0 && iter->path.length() > path.length() && iter->path[path.length()] == '/');
+
+		if (within)
+		{
+			g_dbus_connection_unregister_object(state().pBusConnection, iter->id);
+			iter = state().registeredObjects.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+// Returns our connection to the system bus, or nullptr if we don't have one yet
+GDBusConnection *getBusConnection()
+{
+	return state().pBusConnection;
+}
+
+// Returns true once our objects are registered with D-Bus
+bool objectsRegistered()
+{
+	return !state().registeredObjects.empty();
+}
+
+// Registers an object (and its children) that was added to the server description at runtime (see `Server::addService()`)
+//
+// If we haven't registered with D-Bus yet, there is nothing to do: the object will be registered along with everything else.
+//
+// Returns false if the object could not be registered, in which case nothing of it is left registered.
+bool registerObjectSubtree(const DBusObject &object)
+{
+	if (!objectsRegistered())
+	{
+		return true;
+	}
+
+	GDBusNodeInfo *pNode = object.getIntrospectionNodeInfo();
+	if (nullptr == pNode)
+	{
+		return false;
+	}
+
+	LOG_DEBUG("Registering object subtree '" << object.getPath() << "' with D-Bus");
+	if (!registerNodeHierarchy(pNode, object.getPath()))
+	{
+		unregisterObjects(object.getPath().toString());
+		return false;
+	}
+
+	TheServer->trimCaches();
+	return true;
+}
+
+// Unregisters an object (and its children) that is being removed from the server description (see `Server::removeService()`)
+void unregisterObjectSubtree(const DBusObject &object)
+{
+	LOG_DEBUG("Unregistering object subtree '" << object.getPath() << "' from D-Bus");
+	unregisterObjects(object.getPath().toString());
+}
+
+// Registers our object hierarchy with D-Bus
+//
+// Returns true on success, otherwise false (in which case a retry has been scheduled)
+bool registerObjects()
+{
+	// Register each object's interface tree. The parsed introspection is cached by each object, so this is only expensive the
+	// first time through (subsequent re-registrations simply reuse it, unless the low-memory profile released it, see
+	// `Server::trimCaches()`.) D-Bus keeps its own reference to each interface's info, so releasing it is safe.
 	for (const DBusObject &object : TheServer->getObjects())
 	{
-		GError *pError = nullptr;
-		std::string xmlString = object.generateIntrospectionXML();
-		GDBusNodeInfo *pNode = g_dbus_node_info_new_for_xml(xmlString.c_str(), &pError);
+		GDBusNodeInfo *pNode = object.getIntrospectionNodeInfo();
 		if (nullptr == pNode)
 		{
-			Logger::error(SSTR << "Failed to introspect XML: " << (nullptr == pError ? "Unknown" : pError->message));
 			setRetryFailure();
-			return;
+			return false;
 		}
 
-		Logger::debug(SSTR << "Registering object hierarchy with D-Bus hierarchy");
+		LOG_DEBUG("Registering object hierarchy with D-Bus hierarchy");
 
 		// Register the node hierarchy
-		registerNodeHierarchy(pNode, DBusObjectPath(pNode->path));
+		if (!registerNodeHierarchy(pNode, DBusObjectPath(pNode->path)))
+		{
+			// Cleanup and pretend like we were never here (the node itself is cached by its DBusObject, so we leave it alone)
+			unregisterObjects(std::string());
 
-		// Cleanup the node
-		g_dbus_node_info_unref(pNode);
+			// Try again later
+			setRetryFailure();
+			return false;
+		}
 	}
 
-	// Keep going
-	initializationStateProcessor();
+	TheServer->trimCaches();
+	return true;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -674,45 +962,57 @@ void registerObjects()
 // Configure an adapter to ensure it is setup the way we need. We turn things on that we need and turn everything else off
 // (to maximize security.)
 //
-// Note that this only works for the first adapter (index 0). Search for kControllerIndex for information.
+// Each adapter is managed through its own controller index, with its own advertising names (or the server's, if it has none.)
 //
 // See also: https://git.kernel.org/pub/scm/bluetooth/bluez.git/tree/doc/mgmt-api.txt
-void configureAdapter()
+//
+// Returns true if the adapter is configured, otherwise false
+bool configureAdapter(BluezAdapter &adapter)
 {
-	Mgmt mgmt;
+	Mgmt mgmt(adapter.controllerIndex);
 
 	// Get our properly truncated advertising names
-	std::string advertisingName = Mgmt::truncateName(TheServer->getAdvertisingName());
-	std::string advertisingShortName = Mgmt::truncateShortName(TheServer->getAdvertisingShortName());
+	std::string advertisingName = Mgmt::truncateName(adapter.advertisingName.empty() ? TheServer->getAdvertisingName() : adapter.advertisingName);
+	std::string advertisingShortName = Mgmt::truncateShortName(adapter.advertisingShortName.empty() ? TheServer->getAdvertisingShortName() : adapter.advertisingShortName);
+
+	// Our own advertising instances are only advertised while the adapter's advertising setting is disabled
+	bool enableAdvertising = TheServer->getEnableAdvertising() && !usesAdvertisingInstances();
+
+	// Devices can only bond with us if we're bondable, which is the point of having a bond store
+	bool enableBondable = TheServer->getEnableBondable() || TheBondStore.isEnabled();
 
 	// Find out what our current settings are
-	HciAdapter::ControllerInformation info = HciAdapter::getInstance().getControllerInformation();
+	HciAdapter::ControllerInformation info = HciAdapter::getInstance().getControllerInformation(adapter.controllerIndex);
 
 	// Are all of our settings the way we want them?
 	bool pwFlag = info.currentSettings.isSet(HciAdapter::EHciPowered) == true;
 	bool leFlag = info.currentSettings.isSet(HciAdapter::EHciLowEnergy) == true;
 	bool brFlag = info.currentSettings.isSet(HciAdapter::EHciBasicRate_EnhancedDataRate) == TheServer->getEnableBREDR();
 	bool scFlag = info.currentSettings.isSet(HciAdapter::EHciSecureConnections) == TheServer->getEnableSecureConnection();
-	bool bnFlag = info.currentSettings.isSet(HciAdapter::EHciBondable) == TheServer->getEnableBondable();
+	bool bnFlag = info.currentSettings.isSet(HciAdapter::EHciBondable) == enableBondable;
 	bool cnFlag = info.currentSettings.isSet(HciAdapter::EHciConnectable) == TheServer->getEnableConnectable();
-	bool adFlag = info.currentSettings.isSet(HciAdapter::EHciAdvertising) == TheServer->getEnableAdvertising();
+	bool adFlag = info.currentSettings.isSet(HciAdapter::EHciAdvertising) == enableAdvertising;
 	bool anFlag = (advertisingName.length() == 0 || advertisingName == info.name) && (advertisingShortName.length() == 0 || advertisingShortName == info.shortName);
 
 	// If everything is setup already, we're done
 	if (!pwFlag || !leFlag || !brFlag || !scFlag || !bnFlag || !cnFlag || !adFlag || !anFlag)
 	{
-		// We need it off to start with
+		// We need it off to start with. Powering off completes in the background, so we wait for it before changing settings that
+		// depend on the power state
 		if (pwFlag)
 		{
-			Logger::debug("Powering off");
-			if (!mgmt.setPowered(false)) { setRetry(); return; }
+			LOG_DEBUG("Powering off");
+			if (!mgmt.setPowered(false)) { return false; }
 		}
 
+		// The settings in between don't depend on each other, so send them all at once and wait for the responses at the end
+		mgmt.beginPipeline();
+
 		// Enable the LE state (we always set this state if it's not set)
 		if (!leFlag)
 		{
-			Logger::debug("Enabling LE");
-			if (!mgmt.setLE(true)) { setRetry(); return; }
+			LOG_DEBUG("Enabling LE");
+			if (!mgmt.setLE(true)) { return false; }
 		}
 
 		// Change the Br/Edr state?
@@ -720,55 +1020,181 @@ void configureAdapter()
 		// Note that enabling this requries LE to already be enabled or this command will receive a 'rejected' result
 		if (!brFlag)
 		{
-			Logger::debug(SSTR << (TheServer->getEnableBREDR() ? "Enabling":"Disabling") << " BR/EDR");
-			if (!mgmt.setBredr(TheServer->getEnableBREDR())) { setRetry(); return; }
+			LOG_DEBUG((TheServer->getEnableBREDR() ? "Enabling":"Disabling") << " BR/EDR");
+			if (!mgmt.setBredr(TheServer->getEnableBREDR())) { return false; }
 		}
 
 		// Change the Secure Connectinos state?
 		if (!scFlag)
 		{
-			Logger::debug(SSTR << (TheServer->getEnableSecureConnection() ? "Enabling":"Disabling") << " Secure Connections");
-			if (!mgmt.setSecureConnections(TheServer->getEnableSecureConnection() ? 1 : 0)) { setRetry(); return; }
+			LOG_DEBUG((TheServer->getEnableSecureConnection() ? "Enabling":"Disabling") << " Secure Connections");
+			if (!mgmt.setSecureConnections(TheServer->getEnableSecureConnection() ? 1 : 0)) { return false; }
 		}
 
 		// Change the Bondable state?
 		if (!bnFlag)
 		{
-			Logger::debug(SSTR << (TheServer->getEnableBondable() ? "Enabling":"Disabling") << " Bondable");
-			if (!mgmt.setBondable(TheServer->getEnableBondable())) { setRetry(); return; }
+			LOG_DEBUG((enableBondable ? "Enabling":"Disabling") << " Bondable");
+			if (!mgmt.setBondable(enableBondable)) { return false; }
 		}
 
 		// Change the Connectable state?
 		if (!cnFlag)
 		{
-			Logger::debug(SSTR << (TheServer->getEnableConnectable() ? "Enabling":"Disabling") << " Connectable");
-			if (!mgmt.setConnectable(TheServer->getEnableConnectable())) { setRetry(); return; }
+			LOG_DEBUG((TheServer->getEnableConnectable() ? "Enabling":"Disabling") << " Connectable");
+			if (!mgmt.setConnectable(TheServer->getEnableConnectable())) { return false; }
 		}
 
 		// Change the Advertising state?
 		if (!adFlag)
 		{
-			Logger::debug(SSTR << (TheServer->getEnableAdvertising() ? "Enabling":"Disabling") << " Advertising");
-			if (!mgmt.setAdvertising(TheServer->getEnableAdvertising() ? 1 : 0)) { setRetry(); return; }
+			LOG_DEBUG((enableAdvertising ? "Enabling":"Disabling") << " Advertising");
+			if (!mgmt.setAdvertising(enableAdvertising ? 1 : 0)) { return false; }
 		}
 
 		// Set the name?
 		if (!anFlag)
 		{
 			Logger::info(SSTR << "Setting advertising name to '" << advertisingName << "' (with short name: '" << advertisingShortName << "')");
-			if (!mgmt.setName(advertisingName.c_str(), advertisingShortName.c_str())) { setRetry(); return; }
+			if (!mgmt.setName(advertisingName.c_str(), advertisingShortName.c_str())) { return false; }
 		}
 
-		// Turn it back on
-		Logger::debug("Powering on");
-		if (!mgmt.setPowered(true)) { setRetry(); return; }
+		// Any setting that didn't take means trying again later
+		if (!mgmt.endPipeline()) { return false; }
+
+		// Turn it back on, now that everything it will come up with is in place
+		LOG_DEBUG("Powering on");
+		if (!mgmt.setPowered(true)) { return false; }
+	}
+
+	// Apply any link tuning we were asked for
+	//
+	// These are optimizations rather than requirements, so a failure (such as a kernel or controller that doesn't support one of
+	// them) is logged but doesn't stop us from serving on this adapter
+	if (state().linkOptions.maxConnectionInterval != 0)
+	{
+		LOG_DEBUG("Setting default connection parameters");
+		mgmt.setDefaultConnectionParameters(state().linkOptions.minConnectionInterval, state().linkOptions.maxConnectionInterval, state().linkOptions.connectionLatency, state().linkOptions.supervisionTimeout);
+	}
+
+	if (!state().linkOptions.deviceConnectionParameters.empty())
+	{
+		LOG_DEBUG("Loading connection parameters for " << state().linkOptions.deviceConnectionParameters.size() << " device(s)");
+		mgmt.loadConnectionParameters(state().linkOptions.deviceConnectionParameters);
 	}
 
-	Logger::info("The Bluetooth adapter is fully configured");
+	if (state().linkOptions.lePhys != 0)
+	{
+		LOG_DEBUG("Selecting LE PHYs " << Utils::hex(state().linkOptions.lePhys));
+		mgmt.setLEPhys(state().linkOptions.lePhys);
+	}
+
+	if (state().linkOptions.dataLengthOctets != 0)
+	{
+		LOG_DEBUG("Setting default data length to " << state().linkOptions.dataLengthOctets << " octets");
+		mgmt.setDefaultDataLength(state().linkOptions.dataLengthOctets, state().linkOptions.dataLengthTimeUS);
+	}
+
+	// Likewise, our advertising instances and intervals (see Advertising.cpp)
+	startAdvertising(adapter.controllerIndex, enableAdvertising);
+
+	Logger::info(SSTR << "The Bluetooth adapter '" << adapter.name << "' is fully configured");
 
 	// We're all set, nothing to do!
-	bAdapterConfigured = true;
-	initializationStateProcessor();
+	adapter.bConfigured = true;
+	state().configuredControllers.push_back(adapter.controllerIndex);
+	return true;
+}
+
+// Loads the keys in our bond store (if we have one) into the kernel for an adapter, so that returning centrals can resume
+// encryption without pairing again (see BondStore.cpp)
+//
+// This waits until BlueZ has found the adapter, since bluetoothd loads its own keys (replacing ours) when it sets an adapter up.
+// If we have no keys for the adapter, bluetoothd's are left alone.
+void restoreBonds(BluezAdapter &adapter)
+{
+	adapter.bBondsRestored = true;
+	if (!TheBondStore.isEnabled())
+	{
+		return;
+	}
+
+	std::vector<HciAdapter::IdentityResolvingKey> identityResolvingKeys = TheBondStore.getIdentityResolvingKeys(adapter.controllerIndex);
+	std::vector<HciAdapter::LongTermKey> longTermKeys = TheBondStore.getLongTermKeys(adapter.controllerIndex);
+	if (identityResolvingKeys.empty() && longTermKeys.empty())
+	{
+		return;
+	}
+
+	// These are optimizations rather than requirements, like the link tuning
+	LOG_DEBUG("Restoring " << longTermKeys.size() << " long term key(s) and " << identityResolvingKeys.size() << " identity resolving key(s)");
+	Mgmt mgmt(adapter.controllerIndex);
+	mgmt.loadIdentityResolvingKeys(identityResolvingKeys);
+	mgmt.loadLongTermKeys(longTermKeys);
+}
+
+// Configure each of our adapters (see `configureAdapter()`)
+//
+// Returns true if all of our adapters are configured, otherwise false (in which case a retry has been scheduled)
+bool configureAdapters()
+{
+	for (BluezAdapter &adapter : state().bluezAdapters)
+	{
+		if (!adapter.bConfigured && !configureAdapter(adapter))
+		{
+			Logger::warn(SSTR << "Unable to configure the Bluetooth adapter '" << adapter.name << "'");
+			setRetryFailure();
+			return false;
+		}
+
+		if (!adapter.bBondsRestored)
+		{
+			restoreBonds(adapter);
+		}
+	}
+
+	return true;
+}
+
+// Configures the adapters requested with `addAdapter()` before BlueZ has told us about them
+//
+// Their names give us their controller indices, so the management API can set them up while we're still waiting on BlueZ's
+// ObjectManager. Any that fail (or don't exist) are simply configured later, once they're found (see `configureAdapters()`.)
+void preconfigureAdapters()
+{
+	for (const AdapterConfiguration &configuration : state().adapterConfigurations)
+	{
+		const std::string &name = configuration.name;
+		if (name.compare(0, 3, "hci") != 0 || name.length() == 3 || name.find_first_not_of("0123456789", 3) != std::string::npos)
+		{
+			continue;
+		}
+
+		BluezAdapter adapter;
+		adapter.name = name;
+		adapter.controllerIndex = static_cast<uint16_t>(strtoul(name.c_str() + 3, nullptr, 10));
+		adapter.advertisingName = configuration.advertisingName;
+		adapter.advertisingShortName = configuration.advertisingShortName;
+
+		if (std::find(state().configuredControllers.begin(), state().configuredControllers.end(), adapter.controllerIndex) == state().configuredControllers.end())
+		{
+			LOG_DEBUG("Configuring adapter '" << name << "' ahead of BlueZ");
+			configureAdapter(adapter);
+		}
+	}
+
+	state().bAdaptersPreconfigured = true;
+}
+
+// Returns true if all of our adapters are configured (and have had their bonds restored)
+bool adaptersConfigured()
+{
+	for (const BluezAdapter &adapter : state().bluezAdapters)
+	{
+		if (!adapter.bConfigured || !adapter.bBondsRestored) { return false; }
+	}
+
+	return true;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -781,84 +1207,139 @@ void configureAdapter()
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Find the BlueZ's GATT Manager interface for the *first* Bluetooth adapter provided by BlueZ. We'll need this to register our
-// GATT server with BlueZ.
-void findAdapterInterface()
+// Find the BlueZ's GATT Manager interface for each of our Bluetooth adapters. We'll need these to register our GATT server with
+// BlueZ.
+//
+// If no adapters were requested (see `addAdapter()`), we use the *first* Bluetooth adapter provided by BlueZ.
+//
+// Returns true if we found an adapter, otherwise false (in which case a retry has been scheduled)
+bool findAdapterInterfaces()
 {
 	// Get a list of the BlueZ's D-Bus objects
-	GList *pObjects = g_dbus_object_manager_get_objects(pBluezObjectManager);
+	GList *pObjects = g_dbus_object_manager_get_objects(state().pBluezObjectManager);
 	if (nullptr == pObjects)
 	{
 		Logger::error(SSTR << "Unable to get ObjectManager objects");
 		setRetryFailure();
-		return;
+		return false;
 	}
 
-	// Scan the list of objects we find one with a GATT manager interface
-	//
-	// Note that if there are multiple interfaces, we will only find the first
-	for (guint i = 0; i < g_list_length(pObjects) && bluezGattManagerInterfaceName.empty(); ++i)
+	// Scan the list for the adapters we want, each with a GATT manager interface
+	for (GList *pEntry = pObjects; nullptr != pEntry; pEntry = pEntry->next)
 	{
+		// If we're using the default adapter, we only want the first
+		if (state().adapterConfigurations.empty() && !state().bluezAdapters.empty()) { break; }
+
 		// Current object in question
-		pBluezAdapterObject = static_cast<GDBusObject *>(g_list_nth_data(pObjects, i));
-		if (nullptr == pBluezAdapterObject) { continue; }
+		GDBusObject *pObject = static_cast<GDBusObject *>(pEntry->data);
+		if (nullptr == pObject) { continue; }
+
+		// Adapter paths end with a name of the form 'hciN', where N is the controller index
+		std::string path = g_dbus_object_get_object_path(pObject);
+		std::string name = path.substr(path.rfind('/') + 1);
+		if (name.compare(0, 3, "hci") != 0 || name.length() == 3 || name.find_first_not_of("0123456789", 3) != std::string::npos)
+		{
+			continue;
+		}
+
+		// Is this one of the adapters that we were asked to use?
+		const AdapterConfiguration *pConfiguration = nullptr;
+		for (const AdapterConfiguration &configuration : state().adapterConfigurations)
+		{
+			if (configuration.name == name) { pConfiguration = &configuration; }
+		}
+
+		if (!state().adapterConfigurations.empty() && nullptr == pConfiguration) { continue; }
+
+		BluezAdapter adapter;
+		adapter.name = name;
+		adapter.controllerIndex = static_cast<uint16_t>(strtoul(name.c_str() + 3, nullptr, 10));
+		if (nullptr != pConfiguration)
+		{
+			adapter.advertisingName = pConfiguration->advertisingName;
+			adapter.advertisingShortName = pConfiguration->advertisingShortName;
+		}
 
 		// See if it has a GATT manager interface
-		pBluezGattManagerProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pBluezAdapterObject, "org.bluez.GattManager1"));
-		if (nullptr == pBluezGattManagerProxy) { continue; }
+		adapter.pGattManagerProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pObject, "org.bluez.GattManager1"));
+		if (nullptr == adapter.pGattManagerProxy) { continue; }
 
 		// Get the interface proxy for this adapter - this will come in handy later
-		pBluezAdapterInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pBluezAdapterObject, "org.bluez.Adapter1"));
-		if (nullptr == pBluezAdapterInterfaceProxy)
+		adapter.pAdapterInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pObject, "org.bluez.Adapter1"));
+		if (nullptr == adapter.pAdapterInterfaceProxy)
 		{
 			Logger::warn(SSTR << "Failed to get adapter proxy for interface 'org.bluez.Adapter1'");
+			g_object_unref(adapter.pGattManagerProxy);
 			continue;
 		}
 
 		// Get the interface proxy for this adapter's properties - this will come in handy later
-		pBluezAdapterPropertiesInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pBluezAdapterObject, "org.freedesktop.DBus.Properties"));
-		if (nullptr == pBluezAdapterPropertiesInterfaceProxy)
+		adapter.pAdapterPropertiesInterfaceProxy = reinterpret_cast<GDBusProxy *>(g_dbus_object_get_interface(pObject, "org.freedesktop.DBus.Properties"));
+		if (nullptr == adapter.pAdapterPropertiesInterfaceProxy)
 		{
 			Logger::warn(SSTR << "Failed to get adapter properties proxy for interface 'org.freedesktop.DBus.Properties'");
+			g_object_unref(adapter.pGattManagerProxy);
+			g_object_unref(adapter.pAdapterInterfaceProxy);
 			continue;
 		}
 
-		// Finally, save off the interface name, we're done!
-		bluezGattManagerInterfaceName = g_dbus_proxy_get_object_path(pBluezGattManagerProxy);
-		break;
-	}
-
-	// Get a fresh copy of our objects so we can release the entire list
-	pBluezAdapterObject = g_dbus_object_manager_get_object(pBluezObjectManager, g_dbus_object_get_object_path(pBluezAdapterObject));
+		// Keep our own reference to the object, since we're about to release the entire list
+		adapter.pObject = static_cast<GDBusObject *>(g_object_ref(pObject));
 
-	// We'll need access to the device object so we can set properties on it
-	pBluezDeviceObject = g_dbus_object_manager_get_object(pBluezObjectManager, g_dbus_object_get_object_path(pBluezAdapterObject));
+		// We may have configured it already (see `preconfigureAdapters()`)
+		adapter.bConfigured = std::find(state().configuredControllers.begin(), state().configuredControllers.end(), adapter.controllerIndex) != state().configuredControllers.end();
 
-	// Cleanup the list
-	for (guint i = 0; i < g_list_length(pObjects) && bluezGattManagerInterfaceName.empty(); ++i)
-	{
-		g_object_unref(g_list_nth_data(pObjects, i));
+		LOG_DEBUG("Found adapter '" << adapter.name << "' (controller index " << adapter.controllerIndex << ")");
+		state().bluezAdapters.push_back(adapter);
 	}
 
-	g_list_free(pObjects);
+	// Cleanup the list
+	g_list_free_full(pObjects, g_object_unref);
 
-	// If we didn't find the adapter object, reset things and we'll try again later
-	if (nullptr == pBluezAdapterObject || nullptr == pBluezDeviceObject)
+	// Let them know about any adapters that we were asked to use but couldn't find (we'll carry on with the others)
+	for (const AdapterConfiguration &configuration : state().adapterConfigurations)
 	{
-		Logger::warn(SSTR << "Unable to find BlueZ objects outside of object list");
-		bluezGattManagerInterfaceName.clear();
+		bool found = false;
+		for (const BluezAdapter &adapter : state().bluezAdapters)
+		{
+			found = found || adapter.name == configuration.name;
+		}
+
+		if (!found)
+		{
+			Logger::warn(SSTR << "Unable to find the requested adapter '" << configuration.name << "'");
+		}
 	}
 
-	// If we never ended up with an interface name, bail now
-	if (bluezGattManagerInterfaceName.empty())
+	// If we never ended up with an adapter, bail now
+	if (state().bluezAdapters.empty())
 	{
 		Logger::error(SSTR << "Unable to find the adapter");
 		setRetryFailure();
-		return;
+		return false;
 	}
 
-	// Keep going
-	initializationStateProcessor();
+	return true;
+}
+
+// Returns the link tuning options, which may only be changed before the server is started
+LinkOptions &getLinkOptions()
+{
+	return state().linkOptions;
+}
+
+// Adds a BlueZ adapter (ex: "hci0") to serve our GATT application on, along with the advertising names to use on that adapter
+//
+// Empty names use the server's advertising names. If no adapters are added, the first adapter provided by BlueZ is used.
+//
+// This must be called before the server is started.
+void addAdapter(const std::string &name, const std::string &advertisingName, const std::string &advertisingShortName)
+{
+	AdapterConfiguration configuration;
+	configuration.name = name;
+	configuration.advertisingName = advertisingName;
+	configuration.advertisingShortName = advertisingShortName;
+	state().adapterConfigurations.push_back(configuration);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -877,9 +1358,11 @@ void findAdapterInterface()
 // use this to interrogate BlueZ's objects to find an adapter we can use, among other things.
 void getBluezObjectManager()
 {
+	state().bObjectManagerPending = true;
+
 	g_dbus_object_manager_client_new
 	(
-		pBusConnection,                             // GDBusConnection
+		state().pBusConnection,                             // GDBusConnection
 		G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,    // GDBusObjectManagerClientFlags
 		"org.bluez",                                // Owner name (or well-known name)
 		"/",                                        // Object path
@@ -893,9 +1376,10 @@ void getBluezObjectManager()
 		{
 			// Store BlueZ's ObjectManager
 			GError *pError = nullptr;
-			pBluezObjectManager = g_dbus_object_manager_client_new_finish(pAsyncResult, &pError);
+			state().pBluezObjectManager = g_dbus_object_manager_client_new_finish(pAsyncResult, &pError);
+			state().bObjectManagerPending = false;
 
-			if (nullptr == pBluezObjectManager)
+			if (nullptr == state().pBluezObjectManager)
 			{
 				Logger::error(SSTR << "Failed to get an ObjectManager client: " << (nullptr == pError ? "Unknown" : pError->message));
 				setRetryFailure();
@@ -927,28 +1411,29 @@ void getBluezObjectManager()
 void doOwnedNameAcquire()
 {
 	// Our name is not presently lost
-	bOwnedNameAcquired = false;
+	state().bOwnedNameAcquired = false;
+	state().bOwnedNamePending = true;
+
+	// If we're trying again after losing the name, let go of our previous attempt first
+	if (state().ownedNameId > 0)
+	{
+		g_bus_unown_name(state().ownedNameId);
+		state().ownedNameId = 0;
+	}
 
-	ownedNameId = g_bus_own_name_on_connection
+	state().ownedNameId = g_bus_own_name_on_connection
 	(
-		pBusConnection,                    // GDBusConnection *connection
+		state().pBusConnection,                    // GDBusConnection *connection
 		TheServer->getOwnedName().c_str(), // const gchar *name
 		G_BUS_NAME_OWNER_FLAGS_NONE,       // GBusNameOwnerFlags flags
 
 		// GBusNameAcquiredCallback name_acquired_handler
 		[](GDBusConnection *, const gchar *, gpointer)
 		{
-			// Handy way to get periodic activity
-			periodicTimeoutId = g_timeout_add_seconds(kPeriodicTimerFrequencySeconds, onPeriodicTimer, pBusConnection);
-			if (periodicTimeoutId <= 0)
-			{
-				Logger::fatal(SSTR << "Failed to add a periodic timer");
-				setServerHealth(EFailedInit);
-				shutdown();
-			}
-
 			// Bus name acquired
-			bOwnedNameAcquired = true;
+			state().bOwnedNameAcquired = true;
+			state().bOwnedNamePending = false;
+			state().bOwnedNameWasAcquired = true;
 
 			// Keep going...
 			initializationStateProcessor();
@@ -958,10 +1443,11 @@ void doOwnedNameAcquire()
 		[](GDBusConnection *, const gchar *, gpointer)
 		{
 			// Bus name lost
-			bOwnedNameAcquired = false;
+			state().bOwnedNameAcquired = false;
+			state().bOwnedNamePending = false;
 
-			// If we don't have a periodicTimeout (which we use for error recovery) then we're sunk
-			if (0 == periodicTimeoutId)
+			// If we never had the name to begin with, then we're sunk
+			if (!state().bOwnedNameWasAcquired)
 			{
 				Logger::fatal(SSTR << "Unable to acquire an owned name ('" << TheServer->getOwnedName() << "') on the bus");
 				setServerHealth(EFailedInit);
@@ -992,35 +1478,146 @@ void doOwnedNameAcquire()
 //
 // ---------------------------------------------------------------------------------------------------------------------------------
 
+// Called with our new connection to the SYSTEM bus (or nullptr and the reason we don't have one)
+void onBusAcquired(GDBusConnection *pConnection, GError *pError)
+{
+	state().pBusConnection = pConnection;
+	state().bBusAcquirePending = false;
+
+	if (nullptr == pConnection)
+	{
+		Logger::fatal(SSTR << "Failed to get bus connection: " << (nullptr == pError ? "Unknown" : pError->message));
+		setServerHealth(EFailedInit);
+		shutdown();
+	}
+
+	// Continue
+	initializationStateProcessor();
+}
+
 // Acquire a connection to the SYSTEM bus so we can communicate with BlueZ.
 //
 // Note about error management: We don't yet hwave a timeout callback running for retries; errors are considered fatal
 void doBusAcquire()
 {
-	// Acquire a connection to the SYSTEM bus
-	g_bus_get
+	state().bBusAcquirePending = true;
+
+	// The default instance shares the process's connection to the SYSTEM bus, as it always has
+	if (&Instance::current() == &Instance::getDefault())
+	{
+		g_bus_get
+		(
+			G_BUS_TYPE_SYSTEM,      // GBusType bus_type
+			nullptr,                // GCancellable *cancellable
+
+			// GAsyncReadyCallback callback
+			[] (GObject */*pSourceObject*/, GAsyncResult *pAsyncResult, gpointer /*pUserData*/)
+			{
+				GError *pError = nullptr;
+				GDBusConnection *pConnection = g_bus_get_finish(pAsyncResult, &pError);
+				onBusAcquired(pConnection, pError);
+			},
+
+			nullptr                 // gpointer user_data
+		);
+		return;
+	}
+
+	// Any other instance needs a connection of its own. Objects are registered per connection (so two instances on one connection
+	// would collide at the root path), and the shared connection dispatches to the main context of whoever asked for it first.
+	GError *pError = nullptr;
+	gchar *pAddress = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SYSTEM, nullptr, &pError);
+	if (nullptr == pAddress)
+	{
+		onBusAcquired(nullptr, pError);
+		return;
+	}
+
+	g_dbus_connection_new_for_address
 	(
-		G_BUS_TYPE_SYSTEM,      // GBusType bus_type
-		nullptr,                // GCancellable *cancellable
+		pAddress,                                                // const gchar *address
+		static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+		nullptr,                                                 // GDBusAuthObserver *observer
+		nullptr,                                                 // GCancellable *cancellable
 
 		// GAsyncReadyCallback callback
 		[] (GObject */*pSourceObject*/, GAsyncResult *pAsyncResult, gpointer /*pUserData*/)
 		{
 			GError *pError = nullptr;
-			pBusConnection = g_bus_get_finish(pAsyncResult, &pError);
+			GDBusConnection *pConnection = g_dbus_connection_new_for_address_finish(pAsyncResult, &pError);
+			onBusAcquired(pConnection, pError);
+		},
 
-			if (nullptr == pBusConnection)
-			{
-				Logger::fatal(SSTR << "Failed to get bus connection: " << (nullptr == pError ? "Unknown" : pError->message));
-				setServerHealth(EFailedInit);
-				shutdown();
-			}
+		nullptr                                                  // gpointer user_data
+	);
 
-			// Continue
-			initializationStateProcessor();
-		},
+	g_free(pAddress);
+}
 
-		nullptr                 // gpointer user_data
+// ---------------------------------------------------------------------------------------------------------------------------------
+//  ____  _            _____   _ __   __ _ _ __ ___   ___
+// | __ )| |_   _  ___|__  /  | '_ \ / _` | '_ ` _ \ / _ )
+// |  _ \| | | | |/ _ \ / /   | | | | (_| | | | | | |  __/
+// | |_) | | |_| |  __// /_   |_| |_|\__,_|_| |_| |_|\___|
+// |____/|_|\__,_|\___/____|
+//
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Called when BlueZ ('org.bluez') appears on the bus, including when bluetoothd is restarted
+//
+// Anything we were waiting on is retried immediately, rather than waiting out the retry delay.
+void onBluezAppeared(GDBusConnection * /*pConnection*/, const gchar * /*pName*/, const gchar *pNameOwner, gpointer /*pUserData*/)
+{
+	Logger::info(SSTR << "BlueZ is on the bus (" << pNameOwner << ")");
+	state().bBluezPresent = true;
+
+	resetRetry();
+	initializationStateProcessor();
+}
+
+// Called when BlueZ ('org.bluez') leaves the bus (or isn't there when we start watching for it)
+//
+// Our registration with BlueZ and everything we learned about its adapters went with it, so we forget about them and wait for it
+// to return (see `onBluezAppeared()`.) Our objects stay registered with D-Bus, so there is nothing to redo on our side.
+void onBluezVanished(GDBusConnection * /*pConnection*/, const gchar * /*pName*/, gpointer /*pUserData*/)
+{
+	if (!state().bBluezPresent && nullptr == state().pBluezObjectManager && state().bluezAdapters.empty())
+	{
+		Logger::warn("BlueZ is not on the bus; waiting for it to appear");
+		return;
+	}
+
+	Logger::warn("BlueZ has left the bus; waiting for it to return");
+	state().bBluezPresent = false;
+
+	TheEventScheduler.stop();
+	stopAdvertising();
+	state().bApplicationRegistered = false;
+	releaseAdapters();
+
+	// bluetoothd may reset the adapters on its way back up, so we configure them again
+	state().configuredControllers.clear();
+	state().bAdaptersPreconfigured = false;
+
+	if (nullptr != state().pBluezObjectManager)
+	{
+		g_object_unref(state().pBluezObjectManager);
+		state().pBluezObjectManager = nullptr;
+	}
+}
+
+// Starts watching for BlueZ to appear on (and leave) the bus
+void watchBluez()
+{
+	state().bluezWatchId = g_bus_watch_name_on_connection
+	(
+		state().pBusConnection,                    // GDBusConnection *connection
+		"org.bluez",                       // const gchar *name
+		G_BUS_NAME_WATCHER_FLAGS_NONE,     // GBusNameWatcherFlags flags
+		onBluezAppeared,                   // GBusNameAppearedCallback name_appeared_handler
+		onBluezVanished,                   // GBusNameVanishedCallback name_vanished_handler
+		nullptr,                           // gpointer user_data
+		nullptr                            // GDestroyNotify user_data_free_func
 	);
 }
 
@@ -1037,78 +1634,102 @@ void doBusAcquire()
 // Poor-man's state machine, which effectively ensures everything is initialized in order by verifying actual initialization state
 // rather than stepping through a set of numeric states. This way, if something fails in an out-of-order sort of way, we can still
 // handle it and recover nicely.
+//
+// Steps that don't depend on each other are started together (see the discussion at the top of this file.) Each asynchronous step
+// calls back into here when it completes, so this method is called many times over and simply starts whatever is ready to go.
 void initializationStateProcessor()
 {
 	// If we're in our end-of-life or waiting for a retry, don't process states
-	if (ggkGetServerRunState() > ERunning || 0 != retryTimeStart)
+	if (ggkGetServerRunState() > ERunning || 0 != state().retryTimerId)
 	{
 		return;
 	}
 
 	//
-	// Get a bus connection
+	// Get a bus connection (everything else needs one)
 	//
-	if (nullptr == pBusConnection)
+	if (nullptr == state().pBusConnection)
 	{
-		Logger::debug(SSTR << "Acquiring bus connection");
-		doBusAcquire();
+		if (!state().bBusAcquirePending)
+		{
+			LOG_DEBUG("Acquiring bus connection");
+			doBusAcquire();
+		}
 		return;
 	}
 
+	//
+	// Watch for BlueZ coming and going
+	//
+	if (0 == state().bluezWatchId)
+	{
+		LOG_DEBUG("Watching for BlueZ on the bus");
+		watchBluez();
+	}
+
 	//
 	// Acquire an owned name on the bus
 	//
-	if (!bOwnedNameAcquired)
+	if (!state().bOwnedNameAcquired && !state().bOwnedNamePending)
 	{
-		Logger::debug(SSTR << "Acquiring owned name: '" << TheServer->getOwnedName() << "'");
+		LOG_DEBUG("Acquiring owned name: '" << TheServer->getOwnedName() << "'");
 		doOwnedNameAcquire();
-		return;
 	}
 
 	//
 	// Get BlueZ's ObjectManager
 	//
-	if (nullptr == pBluezObjectManager)
+	if (nullptr == state().pBluezObjectManager && !state().bObjectManagerPending)
 	{
-		Logger::debug(SSTR << "Getting BlueZ ObjectManager");
+		LOG_DEBUG("Getting BlueZ ObjectManager");
 		getBluezObjectManager();
-		return;
 	}
 
 	//
-	// Find the adapter interface
+	// Register our object with D-bus (while we wait on the name and the ObjectManager)
 	//
-	if (bluezGattManagerInterfaceName.empty())
+	if (!objectsRegistered())
 	{
-		Logger::debug(SSTR << "Finding BlueZ GattManager1 interface");
-		findAdapterInterface();
-		return;
+		LOG_DEBUG("Registering with D-Bus");
+		if (!registerObjects()) { return; }
 	}
 
 	//
-	// Find the adapter interface
+	// Configure the adapters we were asked for by name (also while we wait)
 	//
-	if (!bAdapterConfigured)
+	if (!state().bAdaptersPreconfigured)
+	{
+		preconfigureAdapters();
+	}
+
+	// The rest needs the owned name and BlueZ's ObjectManager, both of which call back into here when they arrive
+	if (!state().bOwnedNameAcquired || nullptr == state().pBluezObjectManager)
 	{
-		Logger::debug(SSTR << "Configuring BlueZ adapter '" << bluezGattManagerInterfaceName << "'");
-		configureAdapter();
 		return;
 	}
 
 	//
-	// Register our object with D-bus
+	// Find the adapter interfaces
 	//
-	if (registeredObjectIds.empty())
+	if (state().bluezAdapters.empty())
 	{
-		Logger::debug(SSTR << "Registering with D-Bus");
-		registerObjects();
-		return;
+		LOG_DEBUG("Finding BlueZ GattManager1 interfaces");
+		if (!findAdapterInterfaces()) { return; }
+	}
+
+	//
+	// Configure the adapters
+	//
+	if (!adaptersConfigured())
+	{
+		LOG_DEBUG("Configuring " << state().bluezAdapters.size() << " BlueZ adapter(s)");
+		if (!configureAdapters()) { return; }
 	}
 
 	// Register our appliation with the BlueZ GATT manager
-	if (!bApplicationRegistered)
+	if (!state().bApplicationRegistered)
 	{
-		Logger::debug(SSTR << "Registering application with BlueZ GATT manager");
+		LOG_DEBUG("Registering application with BlueZ GATT manager");
 
 		doRegisterApplication();
 		return;
@@ -1123,8 +1744,17 @@ void initializationStateProcessor()
 		return;
 	}
 
-	// Successful initialization - switch to running state
-	setServerRunState(ERunning);
+	// We made it, so the next failure starts over with a short retry delay
+	resetRetry();
+
+	// Successful initialization - switch to running state (we may already be running if we've just re-registered with BlueZ)
+	if (ggkGetServerRunState() != ERunning)
+	{
+		setServerRunState(ERunning);
+	}
+
+	// Updates are not processed until we're running, so make sure any that arrived during initialization get handled
+	TheUpdateQueue.wakeup();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -1145,6 +1775,12 @@ void runServerThread()
 	// Set the initialization state
 	setServerRunState(EInitializing);
 
+	// Run on our own main context rather than the global default, so we don't share a dispatch loop with the host application.
+	// Pushing it as the thread-default context binds everything GIO creates from this thread (our bus connection, name
+	// ownership, proxies, registered objects and their async callbacks) to it as well. See MainContext.cpp.
+	GMainContext *pMainContext = MainContext::get();
+	g_main_context_push_thread_default(pMainContext);
+
 	// Start our state processor, which is really just a simplified state machine that steps us through an asynchronous
 	// initialization process.
 	//
@@ -1157,36 +1793,29 @@ void runServerThread()
 	// There are alternatives, but using async methods is the recommended way.
 	initializationStateProcessor();
 
-	Logger::debug(SSTR << "Creating GLib main loop");
-	pMainLoop = g_main_loop_new(NULL, FALSE);
+	LOG_DEBUG("Creating GLib main loop");
+	state().pMainLoop = g_main_loop_new(pMainContext, FALSE);
 
-	// Add the idle function
+	// Watch our update queue
 	//
-	// Note that we actually run the idle function from a lambda. This allows us to manage the inter-idle sleep so we don't
-	// soak up 100% of our CPU.
-	guint res = g_idle_add
-	(
-		[](gpointer pUserData) -> gboolean
-		{
-			// Try to process some data and if no data is processed, sleep for the requested frequency
-			if (!idleFunc(pUserData))
-			{
-				std::this_thread::sleep_for(std::chrono::milliseconds(kIdleFrequencyMS));
-			}
-
-			// Always return TRUE so our idle remains in tact
-			return TRUE;
-		},
-		nullptr
-	);
+	// The queue signals its eventfd whenever an update is pushed, so we only run when there is work to do.
+	int updateQueueFd = TheUpdateQueue.openWakeup();
+	if (updateQueueFd >= 0)
+	{
+		state().updateQueueSourceId = MainContext::addUnixFd(updateQueueFd, G_IO_IN, onUpdateQueueWakeup, nullptr);
+	}
 
-	if (res == 0)
+	if (state().updateQueueSourceId == 0)
 	{
-		Logger::error(SSTR << "Unable to add idle to main loop");
+		Logger::error(SSTR << "Unable to add update queue watch to main loop");
 	}
 
-	Logger::trace(SSTR << "Starting GLib main loop");
-	g_main_loop_run(pMainLoop);
+	// Watch for main loop stalls
+	state().stallProbeDueTime = g_get_monotonic_time() + kStallProbeIntervalMS * 1000;
+	state().stallProbeSourceId = MainContext::addTimeout(kStallProbeIntervalMS, onStallProbe, nullptr);
+
+	LOG_TRACE("Starting GLib main loop");
+	g_main_loop_run(state().pMainLoop);
 
 	// We have stopped
 	setServerRunState(EStopped);
@@ -1194,6 +1823,8 @@ void runServerThread()
 
 	// Cleanup
 	uninit();
+
+	g_main_context_pop_thread_default(pMainContext);
 }
 
 }; // namespace ggk
\ No newline at end of file
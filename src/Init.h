@@ -32,8 +32,81 @@
 
 #pragma once
 
+#include <gio/gio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mgmt.h"
+
 namespace ggk {
 
+struct DBusObject;
+struct InitState;
+
+// Link tuning, applied to each adapter as it is configured
+//
+// Zero values leave the kernel's defaults alone.
+struct LinkOptions
+{
+	LinkOptions()
+	: minConnectionInterval(0), maxConnectionInterval(0), connectionLatency(0), supervisionTimeout(0), lePhys(0),
+	  dataLengthOctets(0), dataLengthTimeUS(0)
+	{
+	}
+
+	// Default connection parameters (intervals are in units of 1.25ms, the supervision timeout in units of 10ms)
+	uint16_t minConnectionInterval;
+	uint16_t maxConnectionInterval;
+	uint16_t connectionLatency;
+	uint16_t supervisionTimeout;
+
+	// Preferred connection parameters for specific devices
+	std::vector<Mgmt::ConnectionParameters> deviceConnectionParameters;
+
+	// The LE PHYs the adapter may use (see `Mgmt::LEPhys`)
+	uint32_t lePhys;
+
+	// The suggested default LL data length
+	uint16_t dataLengthOctets;
+	uint16_t dataLengthTimeUS;
+};
+
+// Creates the state for a new server instance (see Instance.cpp)
+std::shared_ptr<InitState> createInitState();
+
+// Returns the link tuning options, which may only be changed before the server is started
+LinkOptions &getLinkOptions();
+
+// Adds a BlueZ adapter (ex: "hci0") to serve our GATT application on, along with the advertising names to use on that adapter
+//
+// Empty names use the server's advertising names. If no adapters are added, the first adapter provided by BlueZ is used.
+//
+// This must be called before the server is started.
+void addAdapter(const std::string &name, const std::string &advertisingName, const std::string &advertisingShortName);
+
+// Returns the vtable that dispatches D-Bus requests on our objects to the server
+//
+// This is what our objects are registered with. A trace replay (see replay.cpp) registers its objects with it too, so that
+// replayed requests take the same path as live ones.
+const GDBusInterfaceVTable *getInterfaceVtable();
+
+// Returns our connection to the system bus, or nullptr if we don't have one yet
+GDBusConnection *getBusConnection();
+
+// Returns true once our objects are registered with D-Bus
+bool objectsRegistered();
+
+// Registers an object (and its children) that was added to the server description at runtime (see `Server::addService()`)
+//
+// If we haven't registered with D-Bus yet, there is nothing to do: the object will be registered along with everything else.
+//
+// Returns false if the object could not be registered, in which case nothing of it is left registered.
+bool registerObjectSubtree(const DBusObject &object);
+
+// Unregisters an object (and its children) that is being removed from the server description (see `Server::removeService()`)
+void unregisterObjectSubtree(const DBusObject &object);
+
 // Trigger a graceful, asynchronous shutdown of the server
 //
 // This method is non-blocking and as such, will only trigger the shutdown process but not wait for it
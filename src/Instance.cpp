@@ -0,0 +1,167 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Everything that belongs to one running server, so that a process can run several of them side by side.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// A server used to be made of process globals: the server description, its thread, update queue, event scheduler and main
+// context, the bus connection and BlueZ proxies in Init.cpp and the HciAdapter with its event thread. That limited a process to a
+// single GATT application. All of that now lives in an `Instance`, and a process may create as many as it likes (see
+// `ggkCreate()`), each with its own main loop thread, bus connection, management socket and event thread.
+//
+// Rather than pass an instance to every method in the server, each thread has a current instance (see `Instance::current()`),
+// which is what `TheServer`, `TheUpdateQueue`, `MainContext::get()`, `HciAdapter::getInstance()` and the rest resolve to. The
+// threads an instance starts make it current for as long as they run (with an `InstanceScope`): its server thread, its event
+// thread and its worker threads. Every callback from the instance's main loop therefore sees the right instance without knowing
+// that there is more than one.
+//
+// Application threads start out with the default instance, which is the one the original API has always worked with, so
+// applications that only ever run one server are unaffected. `ggkSelectInstance()` changes the instance an application thread
+// works with, and the handle-based methods (such as `ggkStartInstance()`) select their instance for the duration of the call.
+//
+// A few things remain shared by every instance in the process, because there is only one of them to begin with: the logger, the
+// performance counters (see Stats.cpp), the bond store, the trace recorder and GLib's print and log handlers (see `ggkStart()`.)
+//
+// Each instance also chooses its own memory profile (see `setLowMemory()`), so a gateway may run a small server alongside a
+// larger one. The profile decides how big the update queue and HCI receive buffer are and how much of the server description
+// is kept indexed or cached once it has been handed to BlueZ.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "Instance.h"
+#include "Server.h"
+#include "UpdateQueue.h"
+#include "EventScheduler.h"
+#include "DataStore.h"
+#include "WorkerPool.h"
+#include "HciAdapter.h"
+#include "Advertising.h"
+#include "Init.h"
+
+namespace ggk {
+
+// The instance selected on this thread (see `InstanceScope`), or nullptr for the default instance
+static thread_local Instance *pCurrentInstance = nullptr;
+
+Instance::Instance()
+: pUpdateQueue(new UpdateQueue(UpdateQueue::kDefaultCapacity)), pEventScheduler(new EventScheduler), pDataStore(new DataStore),
+  pWorkerPool(new WorkerPool(*this)), pHciAdapter(new HciAdapter(*this)), pMainContext(g_main_context_new()),
+  serverRunState(EUninitialized), serverHealth(EOk), bCapturingGLibOutput(false), connectDelegate(nullptr),
+  disconnectDelegate(nullptr), characteristicHandleCount(0), pInitState(createInitState()),
+  pAdvertisingState(createAdvertisingState()), pCachedManagedObjects(nullptr), batchFlushSourceId(0), bLowMemory(false),
+  serverDescriptionBytes(0), introspectionCacheBytes(0), managedObjectsCacheBytes(0)
+{
+	if (kLowMemoryByDefault)
+	{
+		setLowMemory(true);
+	}
+}
+
+// An instance is only destroyed once its server has stopped (see `ggkDestroy()`), but its event thread and worker threads may
+// still be running, and the destructors of its server description expect to find their own instance
+Instance::~Instance()
+{
+	InstanceScope scope(*this);
+
+	if (serverThread.joinable())
+	{
+		serverThread.join();
+	}
+
+	pHciAdapter->stop();
+	pWorkerPool->stop();
+	server.reset();
+
+	if (nullptr != pCachedManagedObjects)
+	{
+		g_variant_unref(pCachedManagedObjects);
+	}
+
+	g_main_context_unref(pMainContext);
+}
+
+// Returns the instance the calling thread is working with
+//
+// This is the instance selected by the innermost `InstanceScope` on this thread, or the default instance if there is none.
+Instance &Instance::current()
+{
+	return nullptr != pCurrentInstance ? *pCurrentInstance : getDefault();
+}
+
+// Returns the default instance, which is the one the application works with unless it selects another
+//
+// It is created on first use and lives for the life of the process.
+Instance &Instance::getDefault()
+{
+	static Instance *pDefaultInstance = new Instance;
+	return *pDefaultInstance;
+}
+
+// Makes `pInstance` the current instance of the calling thread until another is selected (nullptr selects the default instance)
+//
+// Unlike an `InstanceScope`, the selection isn't undone for us. This is what `ggkSelectInstance()` uses.
+void Instance::select(Instance *pInstance)
+{
+	pCurrentInstance = pInstance;
+}
+
+// Switches this instance to (or from) the low-memory profile (see `ggkSetLowMemoryMode()`)
+//
+// This replaces the update queue and resizes the HCI receive buffer, so it may only be used before the server is started.
+void Instance::setLowMemory(bool lowMemory)
+{
+	bLowMemory = lowMemory;
+	pUpdateQueue.reset(new UpdateQueue(lowMemory ? UpdateQueue::kLowMemoryCapacity : UpdateQueue::kDefaultCapacity, pUpdateQueue->getDropPolicy()));
+	pHciAdapter->setReceiveBufferSize(lowMemory ? HciSocket::kLowMemoryResponseMaxSize : HciSocket::kResponseMaxSize);
+}
+
+// Fills `stats` with the memory this instance is using (see `ggkGetMemoryStats()`)
+//
+// This may be called from any thread. The server description and its caches are as last measured by the server thread.
+void Instance::getMemoryStats(GGKMemoryStats &stats) const
+{
+	stats.serverDescription = serverDescriptionBytes.load(std::memory_order_relaxed);
+	stats.introspectionCache = introspectionCacheBytes.load(std::memory_order_relaxed);
+	stats.managedObjectsCache = managedObjectsCacheBytes.load(std::memory_order_relaxed);
+	stats.updateQueue = pUpdateQueue->getMemoryUsage();
+	stats.dataStore = pDataStore->getMemoryUsage();
+	stats.characteristicHandles = sizeof(characteristicHandles);
+	stats.hciBuffers = pHciAdapter->getReceiveBufferSize();
+	stats.total = stats.serverDescription + stats.introspectionCache + stats.managedObjectsCache + stats.updateQueue +
+		stats.dataStore + stats.characteristicHandles + stats.hciBuffers;
+}
+
+InstanceScope::InstanceScope(Instance &instance)
+: pPreviousInstance(pCurrentInstance)
+{
+	pCurrentInstance = &instance;
+}
+
+InstanceScope::~InstanceScope()
+{
+	pCurrentInstance = pPreviousInstance;
+}
+
+}; // namespace ggk
@@ -0,0 +1,192 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Everything that belongs to one running server, so that a process can run several of them side by side.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Instance.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../include/Gobbledegook.h"
+
+namespace ggk {
+
+struct Server;
+struct UpdateQueue;
+struct EventScheduler;
+struct DataStore;
+struct WorkerPool;
+struct HciAdapter;
+struct GattCharacteristic;
+struct InitState;
+struct AdvertisingState;
+
+struct Instance
+{
+	// The number of characteristics that may be resolved to handles (see `ggkResolveCharacteristic()`)
+	static const int kMaxCharacteristicHandles = 1024;
+
+	// Whether new instances use the low-memory profile (see `setLowMemory()`), which building with GGK_LOW_MEMORY defined turns on
+#if defined(GGK_LOW_MEMORY)
+	static const bool kLowMemoryByDefault = true;
+#else
+	static const bool kLowMemoryByDefault = false;
+#endif
+
+	Instance();
+	~Instance();
+
+	Instance(Instance const&) = delete;
+	void operator=(Instance const&) = delete;
+
+	// Returns the instance the calling thread is working with
+	//
+	// This is the instance selected by the innermost `InstanceScope` on this thread, or the default instance if there is none.
+	static Instance &current();
+
+	// Returns the default instance, which is the one the application works with unless it selects another
+	//
+	// It is created on first use and lives for the life of the process.
+	static Instance &getDefault();
+
+	// Makes `pInstance` the current instance of the calling thread until another is selected (nullptr selects the default instance)
+	//
+	// Unlike an `InstanceScope`, the selection isn't undone for us. This is what `ggkSelectInstance()` uses.
+	static void select(Instance *pInstance);
+
+	//
+	// Memory footprint
+	//
+
+	// Switches this instance to (or from) the low-memory profile (see `ggkSetLowMemoryMode()`)
+	//
+	// This replaces the update queue and resizes the HCI receive buffer, so it may only be used before the server is started.
+	void setLowMemory(bool lowMemory);
+
+	// Fills `stats` with the memory this instance is using (see `ggkGetMemoryStats()`)
+	//
+	// This may be called from any thread. The server description and its caches are as last measured by the server thread.
+	void getMemoryStats(GGKMemoryStats &stats) const;
+
+	//
+	// The server
+	//
+
+	// The server description (see `TheServer`), allocated when the server is started
+	std::shared_ptr<Server> server;
+
+	// See `TheUpdateQueue`, `TheEventScheduler`, `TheDataStore`, `TheWorkerPool` and `HciAdapter::getInstance()`
+	std::unique_ptr<UpdateQueue> pUpdateQueue;
+	std::unique_ptr<EventScheduler> pEventScheduler;
+	std::unique_ptr<DataStore> pDataStore;
+	std::unique_ptr<WorkerPool> pWorkerPool;
+	std::unique_ptr<HciAdapter> pHciAdapter;
+
+	// The main context our server thread runs (see `MainContext::get()`)
+	GMainContext *pMainContext;
+
+	//
+	// Lifecycle (see Gobbledegook.cpp)
+	//
+
+	std::thread serverThread;
+	volatile GGKServerRunState serverRunState;
+	volatile GGKServerHealth serverHealth;
+
+	// Set while this instance has GLib's output redirected to our logger
+	bool bCapturingGLibOutput;
+
+	// Our registered connection delegates
+	std::atomic<GGKConnectDelegate> connectDelegate;
+	std::atomic<GGKDisconnectDelegate> disconnectDelegate;
+
+	// Characteristics resolved with `ggkResolveCharacteristic()`, indexed by handle
+	//
+	// Handles are only ever added, so they are looked up without a lock. Interfaces are never destroyed while the instance lives
+	// (removed services are retired rather than destroyed, see `DBusObject::retire()`), so the pointers stay valid.
+	std::atomic<const GattCharacteristic *> characteristicHandles[kMaxCharacteristicHandles];
+	std::atomic<int> characteristicHandleCount;
+	std::mutex characteristicHandleMutex;
+
+	//
+	// Server thread state
+	//
+	// Each of these is only used by the modules named, which keep their own definitions private.
+	//
+
+	// The bus connection, our BlueZ proxies and adapters and the state of our initialization (see Init.cpp)
+	std::shared_ptr<InitState> pInitState;
+
+	// Our advertising options and the adapters we advertise on (see Advertising.cpp)
+	std::shared_ptr<AdvertisingState> pAdvertisingState;
+
+	// The cached reply to `GetManagedObjects` (see `ServerUtils::getManagedObjects()`)
+	GVariant *pCachedManagedObjects;
+
+	// Characteristics with a change notification waiting for the end of the current main loop cycle, along with the idle source
+	// that will flush them (see `GattCharacteristic::scheduleChangeNotification()`)
+	std::vector<const GattCharacteristic *> batchedNotifications;
+	guint batchFlushSourceId;
+
+	//
+	// Memory footprint
+	//
+
+	// True if this instance uses the low-memory profile (see `setLowMemory()`)
+	bool bLowMemory;
+
+	// The size of the server description and its caches, measured by the server thread (see `Server::trimCaches()`)
+	std::atomic<size_t> serverDescriptionBytes;
+	std::atomic<size_t> introspectionCacheBytes;
+	std::atomic<size_t> managedObjectsCacheBytes;
+};
+
+// Makes an instance the current one (see `Instance::current()`) on the calling thread for as long as the scope lives
+//
+// Scopes nest: when one ends, whichever instance was current before it becomes current again.
+struct InstanceScope
+{
+	explicit InstanceScope(Instance &instance);
+	~InstanceScope();
+
+	InstanceScope(InstanceScope const&) = delete;
+	void operator=(InstanceScope const&) = delete;
+
+private:
+
+	Instance *pPreviousInstance;
+};
+
+}; // namespace ggk
@@ -55,12 +55,184 @@
 // There is an additional macro (SSTR) which can simplify sending dynamic data to the logger via a string stream:
 //
 //    Logger::info(SSTR << "There were " << count << " entries in the list");
+//
+// Note that the stream is built before `Logger::info()` gets a chance to see whether anybody is listening. For logging in busy
+// code, use the LOG_* macros instead. They check for a receiver first and only then build the stream:
+//
+//    LOG_DEBUG("There were " << count << " entries in the list");
+//
+// DEBUG and TRACE logging can be removed from the build entirely by defining GGK_DISABLE_DEBUG_LOGGING.
+//
+// Receivers are normally called on whatever thread logged the entry, which is frequently the GLib main loop. If a receiver can
+// be slow (writing to a remote log, for example), call `Logger::setAsync(true)` (or `ggkLogSetAsync()`) to have entries queued
+// and delivered on a dedicated thread instead. The queue is bounded; if it fills, new entries are dropped and the number dropped
+// is reported once there is room again.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include "Logger.h"
 
 namespace ggk {
 
+//
+// Asynchronous delivery
+//
+
+// Queues log entries and delivers them to their receivers on a dedicated thread (see `Logger::setAsync()`)
+struct AsyncLogSink
+{
+	// The most entries we'll hold before dropping new ones
+	static const size_t kMaxQueuedEntries = 4096;
+
+	AsyncLogSink() : enabled(false), stopping(false), delivering(false), droppedCount(0) {}
+
+	// Make sure the thread is gone before our members are destroyed
+	~AsyncLogSink() { stop(); }
+
+	// Starts the delivery thread (does nothing if it's already running)
+	void start()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (thread.joinable())
+		{
+			return;
+		}
+
+		stopping = false;
+		thread = std::thread(&AsyncLogSink::run, this);
+		enabled.store(true, std::memory_order_release);
+	}
+
+	// Delivers everything still queued and stops the delivery thread
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!thread.joinable())
+			{
+				return;
+			}
+
+			enabled.store(false, std::memory_order_release);
+			stopping = true;
+		}
+
+		condition.notify_one();
+		thread.join();
+	}
+
+	// Waits until everything queued so far has been delivered
+	//
+	// An entry that has been taken from the queue still counts until its receiver returns. A receiver that logs from the delivery
+	// thread can't wait for itself, so there we return straight away.
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (std::this_thread::get_id() == thread.get_id())
+		{
+			return;
+		}
+
+		drained.wait(lock, [this] { return (entries.empty() && !delivering) || !thread.joinable(); });
+	}
+
+	// Queues an entry, or returns false if we aren't running (in which case the caller should deliver it directly)
+	bool push(GGKLogReceiver receiver, const char *pText)
+	{
+		if (!enabled.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stopping)
+			{
+				return false;
+			}
+
+			if (entries.size() >= kMaxQueuedEntries)
+			{
+				++droppedCount;
+				return true;
+			}
+
+			entries.push_back(Entry { receiver, pText });
+		}
+
+		condition.notify_one();
+		return true;
+	}
+
+	bool isEnabled() const { return enabled.load(std::memory_order_acquire); }
+
+private:
+
+	struct Entry
+	{
+		GGKLogReceiver receiver;
+		std::string text;
+	};
+
+	// The delivery thread
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			condition.wait(lock, [this] { return stopping || !entries.empty(); });
+			if (entries.empty())
+			{
+				break;
+			}
+
+			Entry entry = std::move(entries.front());
+			entries.pop_front();
+			size_t dropped = droppedCount;
+			droppedCount = 0;
+
+			// Never call a receiver with our lock held (`flush()` waits for it to return)
+			delivering = true;
+			lock.unlock();
+			if (dropped != 0)
+			{
+				std::string note = std::to_string(dropped) + " log entries were dropped (the asynchronous log queue was full)";
+				entry.receiver(note.c_str());
+			}
+			entry.receiver(entry.text.c_str());
+			lock.lock();
+			delivering = false;
+
+			if (entries.empty())
+			{
+				drained.notify_all();
+			}
+		}
+
+		drained.notify_all();
+	}
+
+	std::atomic<bool> enabled;
+	bool stopping;
+
+	// True while the delivery thread is calling a receiver
+	bool delivering;
+	size_t droppedCount;
+	std::deque<Entry> entries;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::condition_variable drained;
+	std::thread thread;
+};
+
+static AsyncLogSink asyncLogSink;
+
 //
 // Log receiver delegates
 //
@@ -125,21 +297,58 @@ void Logger::registerAlwaysReceiver(GGKLogReceiver receiver) { Logger::logReceiv
 // appropriate logging action. To unregister, call with `nullptr`
 void Logger::registerTraceReceiver(GGKLogReceiver receiver) { Logger::logReceiverTrace = receiver; }
 
+//
+// Asynchronous delivery
+//
+
+// Enables or disables asynchronous delivery of log entries
+//
+// While enabled, log entries are queued and handed to their receivers on a dedicated thread, so that a slow receiver can't
+// stall the caller (which is often the GLib main loop.) Disabling delivers everything still queued before returning.
+//
+// FATAL entries are always delivered synchronously, after anything already queued.
+void Logger::setAsync(bool enabled)
+{
+	if (enabled)
+	{
+		asyncLogSink.start();
+	}
+	else
+	{
+		asyncLogSink.stop();
+	}
+}
+
+// Returns true if log entries are being delivered asynchronously
+bool Logger::isAsync()
+{
+	return asyncLogSink.isEnabled();
+}
+
+// Hands a log entry to `receiver`, either directly or through the asynchronous queue (see `setAsync()`)
+void Logger::deliver(GGKLogReceiver receiver, const char *pText)
+{
+	if (!asyncLogSink.push(receiver, pText))
+	{
+		receiver(pText);
+	}
+}
+
 //
 // Logging actions
 //
 
 // Log a DEBUG entry with a C string
-void Logger::debug(const char *pText) { if (nullptr != Logger::logReceiverDebug) { Logger::logReceiverDebug(pText); } }
+void Logger::debug(const char *pText) { if (isDebugEnabled()) { deliver(Logger::logReceiverDebug, pText); } }
 
 // Log a DEBUG entry with a string
-void Logger::debug(const std::string &text) { if (nullptr != Logger::logReceiverDebug) { debug(text.c_str()); } }
+void Logger::debug(const std::string &text) { if (isDebugEnabled()) { debug(text.c_str()); } }
 
 // Log a DEBUG entry using a stream
-void Logger::debug(const std::ostream &text) { if (nullptr != Logger::logReceiverDebug) { debug(static_cast<const std::ostringstream &>(text).str().c_str()); } }
+void Logger::debug(const std::ostream &text) { if (isDebugEnabled()) { debug(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 // Log a INFO entry with a C string
-void Logger::info(const char *pText) { if (nullptr != Logger::logReceiverInfo) { Logger::logReceiverInfo(pText); } }
+void Logger::info(const char *pText) { if (nullptr != Logger::logReceiverInfo) { deliver(Logger::logReceiverInfo, pText); } }
 
 // Log a INFO entry with a string
 void Logger::info(const std::string &text) { if (nullptr != Logger::logReceiverInfo) { info(text.c_str()); } }
@@ -148,7 +357,7 @@ void Logger::info(const std::string &text) { if (nullptr != Logger::logReceiverI
 void Logger::info(const std::ostream &text) { if (nullptr != Logger::logReceiverInfo) { info(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 // Log a STATUS entry with a C string
-void Logger::status(const char *pText) { if (nullptr != Logger::logReceiverStatus) { Logger::logReceiverStatus(pText); } }
+void Logger::status(const char *pText) { if (nullptr != Logger::logReceiverStatus) { deliver(Logger::logReceiverStatus, pText); } }
 
 // Log a STATUS entry with a string
 void Logger::status(const std::string &text) { if (nullptr != Logger::logReceiverStatus) { status(text.c_str()); } }
@@ -157,7 +366,7 @@ void Logger::status(const std::string &text) { if (nullptr != Logger::logReceive
 void Logger::status(const std::ostream &text) { if (nullptr != Logger::logReceiverStatus) { status(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 // Log a WARN entry with a C string
-void Logger::warn(const char *pText) { if (nullptr != Logger::logReceiverWarn) { Logger::logReceiverWarn(pText); } }
+void Logger::warn(const char *pText) { if (nullptr != Logger::logReceiverWarn) { deliver(Logger::logReceiverWarn, pText); } }
 
 // Log a WARN entry with a string
 void Logger::warn(const std::string &text) { if (nullptr != Logger::logReceiverWarn) { warn(text.c_str()); } }
@@ -166,7 +375,7 @@ void Logger::warn(const std::string &text) { if (nullptr != Logger::logReceiverW
 void Logger::warn(const std::ostream &text) { if (nullptr != Logger::logReceiverWarn) { warn(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 // Log a ERROR entry with a C string
-void Logger::error(const char *pText) { if (nullptr != Logger::logReceiverError) { Logger::logReceiverError(pText); } }
+void Logger::error(const char *pText) { if (nullptr != Logger::logReceiverError) { deliver(Logger::logReceiverError, pText); } }
 
 // Log a ERROR entry with a string
 void Logger::error(const std::string &text) { if (nullptr != Logger::logReceiverError) { error(text.c_str()); } }
@@ -175,7 +384,15 @@ void Logger::error(const std::string &text) { if (nullptr != Logger::logReceiver
 void Logger::error(const std::ostream &text) { if (nullptr != Logger::logReceiverError) { error(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 // Log a FATAL entry with a C string
-void Logger::fatal(const char *pText) { if (nullptr != Logger::logReceiverFatal) { Logger::logReceiverFatal(pText); } }
+void Logger::fatal(const char *pText)
+{
+	if (nullptr != Logger::logReceiverFatal)
+	{
+		// Fatal entries are delivered synchronously, after anything already queued, so they are seen before the process exits
+		asyncLogSink.flush();
+		Logger::logReceiverFatal(pText);
+	}
+}
 
 // Log a FATAL entry with a string
 void Logger::fatal(const std::string &text) { if (nullptr != Logger::logReceiverFatal) { fatal(text.c_str()); } }
@@ -184,7 +401,7 @@ void Logger::fatal(const std::string &text) { if (nullptr != Logger::logReceiver
 void Logger::fatal(const std::ostream &text) { if (nullptr != Logger::logReceiverFatal) { fatal(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 // Log a ALWAYS entry with a C string
-void Logger::always(const char *pText) { if (nullptr != Logger::logReceiverAlways) { Logger::logReceiverAlways(pText); } }
+void Logger::always(const char *pText) { if (nullptr != Logger::logReceiverAlways) { deliver(Logger::logReceiverAlways, pText); } }
 
 // Log a ALWAYS entry with a string
 void Logger::always(const std::string &text) { if (nullptr != Logger::logReceiverAlways) { always(text.c_str()); } }
@@ -193,12 +410,12 @@ void Logger::always(const std::string &text) { if (nullptr != Logger::logReceive
 void Logger::always(const std::ostream &text) { if (nullptr != Logger::logReceiverAlways) { always(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 // Log a TRACE entry with a C string
-void Logger::trace(const char *pText) { if (nullptr != Logger::logReceiverTrace) { Logger::logReceiverTrace(pText); } }
+void Logger::trace(const char *pText) { if (isTraceEnabled()) { deliver(Logger::logReceiverTrace, pText); } }
 
 // Log a TRACE entry with a string
-void Logger::trace(const std::string &text) { if (nullptr != Logger::logReceiverTrace) { trace(text.c_str()); } }
+void Logger::trace(const std::string &text) { if (isTraceEnabled()) { trace(text.c_str()); } }
 
 // Log a TRACE entry using a stream
-void Logger::trace(const std::ostream &text) { if (nullptr != Logger::logReceiverTrace) { trace(static_cast<const std::ostringstream &>(text).str().c_str()); } }
+void Logger::trace(const std::ostream &text) { if (isTraceEnabled()) { trace(static_cast<const std::ostringstream &>(text).str().c_str()); } }
 
 }; // namespace ggk
\ No newline at end of file
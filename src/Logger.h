@@ -42,6 +42,26 @@ namespace ggk {
 // Our handy stringstream macro
 #define SSTR std::ostringstream().flush()
 
+// Level-gated logging macros
+//
+// These check for a registered receiver before the arguments are evaluated, so nothing is formatted for a log level that nobody
+// is listening to. The arguments are streamed, exactly as they would be following `SSTR`:
+//
+//     LOG_DEBUG("Ticking at path '" << path << "'");
+//
+// Building with GGK_DISABLE_DEBUG_LOGGING defined (see `--disable-debug-logging` in configure) removes DEBUG and TRACE logging
+// entirely. The arguments are still compiled (so they can't rot), but the code is dead and is discarded by the compiler.
+#define GGK_LOG_IF(enabled, method, ...) do { if (enabled) { ggk::Logger::method(SSTR << __VA_ARGS__); } } while (0)
+
+#define LOG_DEBUG(...)  GGK_LOG_IF(ggk::Logger::isDebugEnabled(), debug, __VA_ARGS__)
+#define LOG_INFO(...)   GGK_LOG_IF(ggk::Logger::isInfoEnabled(), info, __VA_ARGS__)
+#define LOG_STATUS(...) GGK_LOG_IF(ggk::Logger::isStatusEnabled(), status, __VA_ARGS__)
+#define LOG_WARN(...)   GGK_LOG_IF(ggk::Logger::isWarnEnabled(), warn, __VA_ARGS__)
+#define LOG_ERROR(...)  GGK_LOG_IF(ggk::Logger::isErrorEnabled(), error, __VA_ARGS__)
+#define LOG_FATAL(...)  GGK_LOG_IF(ggk::Logger::isFatalEnabled(), fatal, __VA_ARGS__)
+#define LOG_ALWAYS(...) GGK_LOG_IF(ggk::Logger::isAlwaysEnabled(), always, __VA_ARGS__)
+#define LOG_TRACE(...)  GGK_LOG_IF(ggk::Logger::isTraceEnabled(), trace, __VA_ARGS__)
+
 class Logger
 {
 public:
@@ -159,8 +179,65 @@ public:
 	// Log a TRACE entry using a stream
 	static void trace(const std::ostream &text);
 
+	//
+	// Level checks
+	//
+	// Use these (or the LOG_* macros, which use them) to avoid building log text that would otherwise be thrown away. DEBUG and
+	// TRACE are never enabled in a build with GGK_DISABLE_DEBUG_LOGGING defined.
+	//
+
+#if defined(GGK_DISABLE_DEBUG_LOGGING)
+	// Returns true if a DEBUG receiver is registered
+	static constexpr bool isDebugEnabled() { return false; }
+
+	// Returns true if a TRACE receiver is registered
+	static constexpr bool isTraceEnabled() { return false; }
+#else
+	// Returns true if a DEBUG receiver is registered
+	static bool isDebugEnabled() { return nullptr != logReceiverDebug; }
+
+	// Returns true if a TRACE receiver is registered
+	static bool isTraceEnabled() { return nullptr != logReceiverTrace; }
+#endif
+
+	// Returns true if an INFO receiver is registered
+	static bool isInfoEnabled() { return nullptr != logReceiverInfo; }
+
+	// Returns true if a STATUS receiver is registered
+	static bool isStatusEnabled() { return nullptr != logReceiverStatus; }
+
+	// Returns true if a WARN receiver is registered
+	static bool isWarnEnabled() { return nullptr != logReceiverWarn; }
+
+	// Returns true if an ERROR receiver is registered
+	static bool isErrorEnabled() { return nullptr != logReceiverError; }
+
+	// Returns true if a FATAL receiver is registered
+	static bool isFatalEnabled() { return nullptr != logReceiverFatal; }
+
+	// Returns true if an ALWAYS receiver is registered
+	static bool isAlwaysEnabled() { return nullptr != logReceiverAlways; }
+
+	//
+	// Asynchronous delivery
+	//
+
+	// Enables or disables asynchronous delivery of log entries
+	//
+	// While enabled, log entries are queued and handed to their receivers on a dedicated thread, so that a slow receiver can't
+	// stall the caller (which is often the GLib main loop.) Disabling delivers everything still queued before returning.
+	//
+	// FATAL entries are always delivered synchronously, after anything already queued.
+	static void setAsync(bool enabled);
+
+	// Returns true if log entries are being delivered asynchronously
+	static bool isAsync();
+
 private:
 
+	// Hands a log entry to `receiver`, either directly or through the asynchronous queue (see `setAsync()`)
+	static void deliver(GGKLogReceiver receiver, const char *pText);
+
 	// The registered log receiver for DEBUG logs - a nullptr will cause the logging for that receiver to be ignored
 	static GGKLogReceiver logReceiverDebug;
 
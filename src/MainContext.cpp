@@ -0,0 +1,116 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The GLib main context our server runs on, along with helpers for attaching sources to it
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// The convenience functions GLib offers for timers and idle callbacks (`g_idle_add()`, `g_timeout_add()` and friends) all attach
+// to the global default context. So does a main loop created for a NULL context. If the host application also runs GLib code (a
+// UI toolkit, for example), its sources and ours would share one dispatch loop and compete with each other, and whichever thread
+// iterates the default context would end up running our handlers.
+//
+// Instead, each server instance runs on a context of its own. Its server thread pushes the context as the thread-default context
+// before doing anything else, which is what GIO uses for async callbacks, D-Bus method dispatch, signal subscriptions and
+// proxies. Sources we create ourselves are attached explicitly using the helpers here, since the GLib shorthands can't be pointed
+// at a context.
+//
+// Note that source IDs are per-context. `g_source_remove()` only looks in the default context, so our sources must be removed
+// with `MainContext::removeSource()`.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "MainContext.h"
+#include "Instance.h"
+
+namespace ggk {
+
+// Returns the main context of the current instance (see Instance.cpp)
+//
+// The context lives as long as its instance. It is only ever iterated by that instance's server thread (see
+// `runServerThread()`.)
+GMainContext *MainContext::get()
+{
+	return Instance::current().pMainContext;
+}
+
+// Returns true if called from the thread that is currently running our main context
+bool MainContext::isOwner()
+{
+	return g_main_context_is_owner(get());
+}
+
+// Adds an idle source to our context (the equivalent of `g_idle_add()`), returning its source ID
+guint MainContext::addIdle(GSourceFunc function, gpointer pUserData)
+{
+	return attach(g_idle_source_new(), function, pUserData);
+}
+
+// Adds a timeout source to our context (the equivalent of `g_timeout_add()`), returning its source ID
+guint MainContext::addTimeout(guint intervalMS, GSourceFunc function, gpointer pUserData)
+{
+	return attach(g_timeout_source_new(intervalMS), function, pUserData);
+}
+
+// Adds a timeout source with a granularity of seconds to our context (the equivalent of `g_timeout_add_seconds()`)
+guint MainContext::addTimeoutSeconds(guint intervalSeconds, GSourceFunc function, gpointer pUserData)
+{
+	return attach(g_timeout_source_new_seconds(intervalSeconds), function, pUserData);
+}
+
+// Adds a file descriptor watch to our context (the equivalent of `g_unix_fd_add()`), returning its source ID
+guint MainContext::addUnixFd(gint fd, GIOCondition condition, GUnixFDSourceFunc function, gpointer pUserData)
+{
+	return attach(g_unix_fd_source_new(fd, condition), reinterpret_cast<GSourceFunc>(function), pUserData);
+}
+
+// Removes a source added by one of the methods above (the equivalent of `g_source_remove()`)
+//
+// Source IDs are only unique within a context, so sources on our context must be removed through here. Removing a source that
+// no longer exists does nothing.
+void MainContext::removeSource(guint sourceId)
+{
+	if (0 == sourceId)
+	{
+		return;
+	}
+
+	GSource *pSource = g_main_context_find_source_by_id(get(), sourceId);
+	if (nullptr != pSource)
+	{
+		g_source_destroy(pSource);
+	}
+}
+
+// Attaches a new source to our context and releases our reference to it, returning its source ID
+guint MainContext::attach(GSource *pSource, GSourceFunc function, gpointer pUserData)
+{
+	g_source_set_callback(pSource, function, pUserData, nullptr);
+	guint sourceId = g_source_attach(pSource, get());
+	g_source_unref(pSource);
+	return sourceId;
+}
+
+}; // namespace ggk
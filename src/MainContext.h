@@ -0,0 +1,76 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The GLib main context our server runs on, along with helpers for attaching sources to it
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of MainContext.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <glib-unix.h>
+
+namespace ggk {
+
+struct MainContext
+{
+	// Returns the main context of the current instance (see Instance.cpp)
+	//
+	// The context lives as long as its instance. It is only ever iterated by that instance's server thread (see
+	// `runServerThread()`.)
+	static GMainContext *get();
+
+	// Returns true if called from the thread that is currently running our main context
+	static bool isOwner();
+
+	// Adds an idle source to our context (the equivalent of `g_idle_add()`), returning its source ID
+	static guint addIdle(GSourceFunc function, gpointer pUserData);
+
+	// Adds a timeout source to our context (the equivalent of `g_timeout_add()`), returning its source ID
+	static guint addTimeout(guint intervalMS, GSourceFunc function, gpointer pUserData);
+
+	// Adds a timeout source with a granularity of seconds to our context (the equivalent of `g_timeout_add_seconds()`)
+	static guint addTimeoutSeconds(guint intervalSeconds, GSourceFunc function, gpointer pUserData);
+
+	// Adds a file descriptor watch to our context (the equivalent of `g_unix_fd_add()`), returning its source ID
+	static guint addUnixFd(gint fd, GIOCondition condition, GUnixFDSourceFunc function, gpointer pUserData);
+
+	// Removes a source added by one of the methods above (the equivalent of `g_source_remove()`)
+	//
+	// Source IDs are only unique within a context, so sources on our context must be removed through here. Removing a source that
+	// no longer exists does nothing.
+	static void removeSource(guint sourceId);
+
+private:
+
+	// Attaches a new source to our context and releases our reference to it, returning its source ID
+	static guint attach(GSource *pSource, GSourceFunc function, gpointer pUserData);
+};
+
+}; // namespace ggk
@@ -30,10 +30,19 @@
 // We only cover the basics here. If there are configuration features you need that aren't supported (such as configuring BR/EDR),
 // then this would be a good place for them.
 //
+// The link tuning commands (connection parameters, PHYs and data length) are there for applications that need more throughput
+// than the kernel's defaults allow. The data length is the odd one out, as it can only be set with a raw HCI command.
+//
 // Note that this class relies on the `HciAdapter`, which is a very primitive implementation. Use with caution.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+#include <algorithm>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "Mgmt.h"
 #include "Logger.h"
@@ -46,11 +55,84 @@ namespace ggk {
 // Set `controllerIndex` to the zero-based index of the device as recognized by the OS. If this parameter is omitted, the index
 // of the first device (0) will be used.
 Mgmt::Mgmt(uint16_t controllerIndex)
-: controllerIndex(controllerIndex)
+: controllerIndex(controllerIndex), pipelining(false)
 {
 	HciAdapter::getInstance().sync(controllerIndex);
 }
 
+// Abandons any commands that are still outstanding from an unfinished pipeline (see `beginPipeline()`)
+Mgmt::~Mgmt()
+{
+	for (HciAdapter::CommandFuture &command : pipeline)
+	{
+		HciAdapter::getInstance().cancelCommand(command);
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Pipelining
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Begins pipelining commands
+//
+// While pipelining, the setters below send their commands without waiting for a response, so a whole configuration sequence
+// can be in flight at once. The kernel takes the commands in the order they were sent, but it doesn't wait for one to finish
+// before looking at the next, so only pipeline commands that don't depend on each other. In particular, powering the adapter on
+// or off completes in the background: wait for `setPowered()` before sending anything that depends on the power state (and
+// for those before powering back on.) A setter's return value only reflects whether the command was sent; call `endPipeline()`
+// to wait for the responses.
+void Mgmt::beginPipeline()
+{
+	pipelining = true;
+}
+
+// Waits for the responses to all commands sent since `beginPipeline()` and stops pipelining
+//
+// Returns true if every command received a response with a success status, otherwise false
+bool Mgmt::endPipeline()
+{
+	bool success = true;
+	for (HciAdapter::CommandFuture &command : pipeline)
+	{
+		uint8_t status = 0;
+		if (!HciAdapter::getInstance().waitForCommand(command, HciAdapter::kMaxEventWaitTimeMS, &status))
+		{
+			Logger::warn(SSTR << "  + No response to pipelined command " << HciAdapter::kCommandCodeNames[command.commandCode]);
+			success = false;
+		}
+		else if (status != 0)
+		{
+			const char *pStatusName = status <= HciAdapter::kMaxStatusCode ? HciAdapter::kStatusCodes[status] : "Unknown";
+			Logger::warn(SSTR << "  + Pipelined command " << HciAdapter::kCommandCodeNames[command.commandCode] << " failed: " << pStatusName << " (" << Utils::hex(status) << ")");
+			success = false;
+		}
+	}
+
+	pipeline.clear();
+	pipelining = false;
+	return success;
+}
+
+// Sends a command, either waiting for its response or (if pipelining) adding it to the pipeline
+//
+// Returns true on success, otherwise false
+bool Mgmt::sendCommand(HciAdapter::HciHeader &request)
+{
+	if (!pipelining)
+	{
+		return HciAdapter::getInstance().sendCommand(request);
+	}
+
+	HciAdapter::CommandFuture command = HciAdapter::getInstance().sendCommandAsync(request);
+	if (!command.status.valid())
+	{
+		return false;
+	}
+
+	pipeline.push_back(std::move(command));
+	return true;
+}
+
 // Set the adapter name and short name
 //
 // The inputs `name` and `shortName` may be truncated prior to setting them on the adapter. To ensure that `name` and
@@ -81,7 +163,7 @@ bool Mgmt::setName(std::string name, std::string shortName)
 	memset(request.shortName, 0, sizeof(request.shortName));
 	snprintf(request.shortName, sizeof(request.shortName), "%s", shortName.c_str());
 
-	if (!HciAdapter::getInstance().sendCommand(request))
+	if (!sendCommand(request))
 	{
 		Logger::warn(SSTR << "  + Failed to set name");
 		return false;
@@ -108,7 +190,7 @@ bool Mgmt::setState(uint16_t commandCode, uint16_t controllerId, uint8_t newStat
 	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
 	request.state = newState;
 
-	if (!HciAdapter::getInstance().sendCommand(request))
+	if (!sendCommand(request))
 	{
 		Logger::warn(SSTR << "  + Failed to set " << HciAdapter::kCommandCodeNames[commandCode] << " state to: " << static_cast<int>(newState));
 		return false;
@@ -174,6 +256,432 @@ bool Mgmt::setAdvertising(uint8_t newState)
 	return setState(Mgmt::ESetAdvertisingCommand, controllerIndex, newState);
 }
 
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Link tuning
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Loads the preferred connection parameters for specific devices
+//
+// The kernel uses these whenever one of the devices connects. Loading a new set replaces any that were loaded before.
+//
+// Returns true on success, otherwise false
+bool Mgmt::loadConnectionParameters(const std::vector<ConnectionParameters> &parameters)
+{
+	// The request is variable-length (a count followed by the entries), so we build it in a buffer
+	size_t dataSize = sizeof(uint16_t) + parameters.size() * sizeof(ConnectionParameters);
+	std::vector<uint8_t> buffer(sizeof(HciAdapter::HciHeader) + dataSize);
+
+	HciAdapter::HciHeader *pRequest = reinterpret_cast<HciAdapter::HciHeader *>(buffer.data());
+	pRequest->code = Mgmt::ELoadConnectionParametersCommand;
+	pRequest->controllerId = controllerIndex;
+	pRequest->dataSize = static_cast<uint16_t>(dataSize);
+
+	uint16_t count = Utils::endianToHci(static_cast<uint16_t>(parameters.size()));
+	memcpy(buffer.data() + sizeof(HciAdapter::HciHeader), &count, sizeof(count));
+
+	uint8_t *pEntry = buffer.data() + sizeof(HciAdapter::HciHeader) + sizeof(count);
+	for (ConnectionParameters entry : parameters)
+	{
+		entry.toNetwork();
+		memcpy(pEntry, &entry, sizeof(entry));
+		pEntry += sizeof(entry);
+	}
+
+	return sendCommandAndCheckStatus(*pRequest, "load connection parameters");
+}
+
+// Sets the default LE connection parameters, used for any device without its own (see `loadConnectionParameters()`)
+//
+// Intervals are in units of 1.25ms and the supervision timeout is in units of 10ms. This requires a kernel that supports the
+// Set Default System Configuration command (Linux 5.9 or later.)
+//
+// Returns true on success, otherwise false
+bool Mgmt::setDefaultConnectionParameters(uint16_t minConnectionInterval, uint16_t maxConnectionInterval, uint16_t connectionLatency, uint16_t supervisionTimeout)
+{
+	// Each parameter is sent as a type/length/value entry
+	struct SParameter
+	{
+		uint16_t type;
+		uint8_t length;
+		uint16_t value;
+	} __attribute__((packed));
+
+	struct SRequest : HciAdapter::HciHeader
+	{
+		SParameter parameters[4];
+	} __attribute__((packed));
+
+	const uint16_t types[4] = { 0x0017, 0x0018, 0x0019, 0x001a };
+	const uint16_t values[4] = { minConnectionInterval, maxConnectionInterval, connectionLatency, supervisionTimeout };
+
+	SRequest request;
+	request.code = Mgmt::ESetDefaultSystemConfigurationCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		request.parameters[i].type = Utils::endianToHci(types[i]);
+		request.parameters[i].length = sizeof(uint16_t);
+		request.parameters[i].value = Utils::endianToHci(values[i]);
+	}
+
+	return sendCommandAndCheckStatus(request, "set default connection parameters");
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Bonding
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Loads the long term keys the kernel uses to resume encryption with bonded devices
+//
+// Loading a new set replaces all of the adapter's long term keys (including any that bluetoothd loaded.) The kernel rejects
+// the whole set if any key is invalid.
+//
+// Returns true on success, otherwise false
+bool Mgmt::loadLongTermKeys(const std::vector<HciAdapter::LongTermKey> &keys)
+{
+	// The keys are already in the adapter's byte order
+	return sendCountedList(Mgmt::ELoadLongTermKeysCommand, keys.data(), keys.size(), sizeof(HciAdapter::LongTermKey), "load long term keys");
+}
+
+// Loads the identity resolving keys the kernel uses to recognize bonded devices that use private addresses
+//
+// As with `loadLongTermKeys()`, loading a new set replaces all of the adapter's identity resolving keys.
+//
+// Returns true on success, otherwise false
+bool Mgmt::loadIdentityResolvingKeys(const std::vector<HciAdapter::IdentityResolvingKey> &keys)
+{
+	return sendCountedList(Mgmt::ELoadIdentityResolvingKeysCommand, keys.data(), keys.size(), sizeof(HciAdapter::IdentityResolvingKey), "load identity resolving keys");
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Advertising
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Reads the adapter's advertising features (the flags it supports, the space available for data and the number of instances)
+//
+// Returns true on success (with the features in `features`), otherwise false
+bool Mgmt::readAdvertisingFeatures(HciAdapter::AdvertisingFeatures &features)
+{
+	HciAdapter::HciHeader request;
+	request.code = Mgmt::EReadAdvertisingFeaturesCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = 0;
+
+	if (!sendCommandAndCheckStatus(request, "read advertising features"))
+	{
+		return false;
+	}
+
+	features = HciAdapter::getInstance().getAdvertisingFeatures(controllerIndex);
+	return true;
+}
+
+// Adds (or replaces) an advertising instance
+//
+// Instances are numbered from 1 to the adapter's maximum and the kernel rotates between them. `flags` is a combination of
+// `AdvertisingFlags`. The instance is advertised for `duration` seconds at a time before moving on to the next (0 for the
+// kernel's default) and is removed after `timeout` seconds (0 to keep it until it is removed.) The data are sequences of AD
+// structures (length, type, value.)
+//
+// Returns true on success, otherwise false
+bool Mgmt::addAdvertising(uint8_t instance, uint32_t flags, uint16_t duration, uint16_t timeout, const std::vector<uint8_t> &advertisingData, const std::vector<uint8_t> &scanResponseData)
+{
+	if (advertisingData.size() > kMaxAdvertisingDataLength || scanResponseData.size() > kMaxAdvertisingDataLength)
+	{
+		Logger::warn(SSTR << "  + Advertising instance " << static_cast<int>(instance) << " has too much data to advertise");
+		return false;
+	}
+
+	// The fixed part of the request is followed by the advertising data and then the scan response data
+	struct SParameters
+	{
+		uint8_t instance;
+		uint32_t flags;
+		uint16_t duration;
+		uint16_t timeout;
+		uint8_t advertisingDataLength;
+		uint8_t scanResponseLength;
+	} __attribute__((packed));
+
+	size_t dataSize = sizeof(SParameters) + advertisingData.size() + scanResponseData.size();
+	std::vector<uint8_t> buffer(sizeof(HciAdapter::HciHeader) + dataSize);
+
+	HciAdapter::HciHeader *pRequest = reinterpret_cast<HciAdapter::HciHeader *>(buffer.data());
+	pRequest->code = Mgmt::EAddAdvertisingCommand;
+	pRequest->controllerId = controllerIndex;
+	pRequest->dataSize = static_cast<uint16_t>(dataSize);
+
+	SParameters parameters;
+	parameters.instance = instance;
+	parameters.flags = Utils::endianToHci(flags);
+	parameters.duration = Utils::endianToHci(duration);
+	parameters.timeout = Utils::endianToHci(timeout);
+	parameters.advertisingDataLength = static_cast<uint8_t>(advertisingData.size());
+	parameters.scanResponseLength = static_cast<uint8_t>(scanResponseData.size());
+
+	uint8_t *pData = buffer.data() + sizeof(HciAdapter::HciHeader);
+	memcpy(pData, &parameters, sizeof(parameters));
+	pData += sizeof(parameters);
+	std::copy(advertisingData.begin(), advertisingData.end(), pData);
+	std::copy(scanResponseData.begin(), scanResponseData.end(), pData + advertisingData.size());
+
+	return sendCommandAndCheckStatus(*pRequest, "add advertising instance");
+}
+
+// Removes an advertising instance (or all of them, if `instance` is 0)
+//
+// Returns true on success, otherwise false
+bool Mgmt::removeAdvertising(uint8_t instance)
+{
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint8_t instance;
+	} __attribute__((packed));
+
+	SRequest request;
+	request.code = Mgmt::ERemoveAdvertisingCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+	request.instance = instance;
+
+	return sendCommandAndCheckStatus(request, "remove advertising instance");
+}
+
+// Sets the default advertising interval range, in units of 0.625ms [32, 16384]
+//
+// The kernel uses these whenever it starts advertising, so they don't change advertising that's already running. This requires
+// the Set Default System Configuration command (Linux 5.9 or later.)
+//
+// Returns true on success, otherwise false
+bool Mgmt::setDefaultAdvertisingIntervals(uint16_t minInterval, uint16_t maxInterval)
+{
+	// Each parameter is sent as a type/length/value entry (see `setDefaultConnectionParameters()`)
+	struct SParameter
+	{
+		uint16_t type;
+		uint8_t length;
+		uint16_t value;
+	} __attribute__((packed));
+
+	struct SRequest : HciAdapter::HciHeader
+	{
+		SParameter parameters[2];
+	} __attribute__((packed));
+
+	const uint16_t types[2] = { 0x000a, 0x000b };
+	const uint16_t values[2] = { minInterval, maxInterval };
+
+	SRequest request;
+	request.code = Mgmt::ESetDefaultSystemConfigurationCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		request.parameters[i].type = Utils::endianToHci(types[i]);
+		request.parameters[i].length = sizeof(uint16_t);
+		request.parameters[i].value = Utils::endianToHci(values[i]);
+	}
+
+	return sendCommandAndCheckStatus(request, "set default advertising intervals");
+}
+
+// Selects the LE PHYs (a combination of `LEPhys`) that the adapter may use, leaving the BR/EDR PHYs as they are
+//
+// PHYs that the adapter does not support are dropped. The 1M PHY is mandatory, so it is always included.
+//
+// Returns true on success, otherwise false
+bool Mgmt::setLEPhys(uint32_t lePhys)
+{
+	// We need the current configuration to know what's supported (and what's already selected)
+	HciAdapter::HciHeader getRequest;
+	getRequest.code = Mgmt::EGetPHYConfigurationCommand;
+	getRequest.controllerId = controllerIndex;
+	getRequest.dataSize = 0;
+
+	if (!sendCommandAndCheckStatus(getRequest, "get PHY configuration"))
+	{
+		return false;
+	}
+
+	HciAdapter::PhyConfiguration configuration = HciAdapter::getInstance().getPhyConfiguration(controllerIndex);
+
+	uint32_t wanted = (lePhys | ELE1MTx | ELE1MRx) & ELEPhysMask;
+	if ((wanted & configuration.supportedPhys) != wanted)
+	{
+		Logger::warn(SSTR << "  + Some of the requested LE PHYs (" << Utils::hex(wanted) << ") are not supported (supported: " << Utils::hex(configuration.supportedPhys) << ")");
+		wanted &= configuration.supportedPhys;
+	}
+
+	uint32_t selected = (configuration.selectedPhys & ~static_cast<uint32_t>(ELEPhysMask)) | wanted;
+	if (selected == configuration.selectedPhys)
+	{
+		return true;
+	}
+
+	struct SRequest : HciAdapter::HciHeader
+	{
+		uint32_t selectedPhys;
+	} __attribute__((packed));
+
+	SRequest request;
+	request.code = Mgmt::ESetPHYConfigurationCommand;
+	request.controllerId = controllerIndex;
+	request.dataSize = sizeof(SRequest) - sizeof(HciAdapter::HciHeader);
+	request.selectedPhys = Utils::endianToHci(selected);
+
+	return sendCommandAndCheckStatus(request, "set PHY configuration");
+}
+
+// Sets the suggested default LL data length for new connections
+//
+// The Management API has no command for this, so it is sent as an HCI command (LE Write Suggested Default Data Length)
+// directly to the controller, which requires the controller to be powered. `txOctets` must be in the range [27, 251] and
+// `txTimeUS` in the range [328, 17040].
+//
+// Returns true on success, otherwise false
+bool Mgmt::setDefaultDataLength(uint16_t txOctets, uint16_t txTimeUS)
+{
+	const uint16_t kLEWriteSuggestedDefaultDataLength = 0x0024;
+
+	std::vector<uint8_t> parameters(4);
+	parameters[0] = txOctets & 0xff;
+	parameters[1] = txOctets >> 8;
+	parameters[2] = txTimeUS & 0xff;
+	parameters[3] = txTimeUS >> 8;
+
+	if (!sendHciCommand(cmd_opcode_pack(OGF_LE_CTL, kLEWriteSuggestedDefaultDataLength), parameters))
+	{
+		Logger::warn(SSTR << "  + Failed to set default data length to " << txOctets << " octets (" << txTimeUS << "us)");
+		return false;
+	}
+
+	return true;
+}
+
+// Sends a command and waits for its response, logging a warning (using `description`) if it fails
+//
+// Returns true only if the adapter responded with a success status, otherwise false
+bool Mgmt::sendCommandAndCheckStatus(HciAdapter::HciHeader &request, const char *pDescription)
+{
+	uint8_t status = 0;
+	if (!HciAdapter::getInstance().sendCommand(request, &status))
+	{
+		Logger::warn(SSTR << "  + Failed to " << pDescription << ": no response");
+		return false;
+	}
+
+	if (status != 0)
+	{
+		const char *pStatusName = status <= HciAdapter::kMaxStatusCode ? HciAdapter::kStatusCodes[status] : "Unknown";
+		Logger::warn(SSTR << "  + Failed to " << pDescription << ": " << pStatusName << " (" << Utils::hex(status) << ")");
+		return false;
+	}
+
+	return true;
+}
+
+// Sends a command whose parameters are a count followed by `entryCount` entries of `entrySize` bytes (already in the adapter's
+// byte order), waiting for its response
+//
+// Returns true only if the adapter responded with a success status, otherwise false
+bool Mgmt::sendCountedList(uint16_t commandCode, const void *pEntries, size_t entryCount, size_t entrySize, const char *pDescription)
+{
+	size_t dataSize = sizeof(uint16_t) + entryCount * entrySize;
+	std::vector<uint8_t> buffer(sizeof(HciAdapter::HciHeader) + dataSize);
+
+	HciAdapter::HciHeader *pRequest = reinterpret_cast<HciAdapter::HciHeader *>(buffer.data());
+	pRequest->code = commandCode;
+	pRequest->controllerId = controllerIndex;
+	pRequest->dataSize = static_cast<uint16_t>(dataSize);
+
+	uint16_t count = Utils::endianToHci(static_cast<uint16_t>(entryCount));
+	memcpy(buffer.data() + sizeof(HciAdapter::HciHeader), &count, sizeof(count));
+	if (entryCount != 0)
+	{
+		memcpy(buffer.data() + sizeof(HciAdapter::HciHeader) + sizeof(count), pEntries, entryCount * entrySize);
+	}
+
+	return sendCommandAndCheckStatus(*pRequest, pDescription);
+}
+
+// Sends an HCI command (not a Management API command) directly to the controller and waits for it to complete
+//
+// Returns true only if the controller responded with a success status, otherwise false
+bool Mgmt::sendHciCommand(uint16_t opcode, const std::vector<uint8_t> &parameters)
+{
+	int fd = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+	if (fd < 0)
+	{
+		Logger::warn(SSTR << "  + Unable to open raw HCI socket (errno " << errno << ")");
+		return false;
+	}
+
+	// We only want to hear about the completion of our command
+	struct hci_filter filter;
+	memset(&filter, 0, sizeof(filter));
+	filter.type_mask = 1 << HCI_EVENT_PKT;
+	filter.event_mask[EVT_CMD_COMPLETE >> 5] |= 1 << (EVT_CMD_COMPLETE & 31);
+	filter.event_mask[EVT_CMD_STATUS >> 5] |= 1 << (EVT_CMD_STATUS & 31);
+	filter.opcode = Utils::endianToHci(opcode);
+
+	struct sockaddr_hci addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.hci_family = AF_BLUETOOTH;
+	addr.hci_dev = controllerIndex;
+	addr.hci_channel = HCI_CHANNEL_RAW;
+
+	if (setsockopt(fd, SOL_HCI, HCI_FILTER, &filter, sizeof(filter)) < 0 || bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+	{
+		Logger::warn(SSTR << "  + Unable to bind raw HCI socket to controller " << controllerIndex << " (errno " << errno << ")");
+		close(fd);
+		return false;
+	}
+
+	// Command packet: type, opcode, parameter length, parameters
+	std::vector<uint8_t> packet;
+	packet.push_back(HCI_COMMAND_PKT);
+	packet.push_back(opcode & 0xff);
+	packet.push_back(opcode >> 8);
+	packet.push_back(static_cast<uint8_t>(parameters.size()));
+	packet.insert(packet.end(), parameters.begin(), parameters.end());
+
+	if (write(fd, packet.data(), packet.size()) != static_cast<ssize_t>(packet.size()))
+	{
+		Logger::warn(SSTR << "  + Unable to write HCI command " << Utils::hex(opcode) << " (errno " << errno << ")");
+		close(fd);
+		return false;
+	}
+
+	// Wait for Command Complete (type, event, length, num commands, opcode, status) or Command Status (type, event, length,
+	// status, num commands, opcode)
+	bool success = false;
+	struct pollfd pollFd = { fd, POLLIN, 0 };
+	if (poll(&pollFd, 1, HciAdapter::kMaxEventWaitTimeMS) > 0)
+	{
+		uint8_t response[260];
+		ssize_t length = read(fd, response, sizeof(response));
+		if (length >= 7 && response[0] == HCI_EVENT_PKT)
+		{
+			uint8_t status = response[1] == EVT_CMD_COMPLETE ? response[6] : response[3];
+			success = status == 0;
+			if (!success)
+			{
+				Logger::warn(SSTR << "  + HCI command " << Utils::hex(opcode) << " failed with status " << Utils::hex(status));
+			}
+		}
+	}
+	else
+	{
+		Logger::warn(SSTR << "  + Timed out waiting for HCI command " << Utils::hex(opcode));
+	}
+
+	close(fd);
+	return success;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------------------
 // Utilitarian
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -37,6 +37,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "HciAdapter.h"
 #include "Utils.h"
@@ -172,15 +173,99 @@ struct Mgmt
 		EGetAdvertisingSizeInformationCommand                 = 0x0040,
 		EStartLimitedDiscoveryCommand                         = 0x0041,
 		EReadExtendedControllerInformationCommand             = 0x0042,
-		ESetAppearanceCommand                                 = 0x0043
+		ESetAppearanceCommand                                 = 0x0043,
+		EGetPHYConfigurationCommand                           = 0x0044,
+		ESetPHYConfigurationCommand                           = 0x0045,
+		ELoadBlockedKeysCommand                               = 0x0046,
+		ESetWidebandSpeechCommand                             = 0x0047,
+		EReadSecurityInformationCommand                       = 0x0048,
+		EReadExperimentalFeaturesInformationCommand           = 0x0049,
+		ESetExperimentalFeatureCommand                        = 0x004a,
+		EReadDefaultSystemConfigurationCommand                = 0x004b,
+		ESetDefaultSystemConfigurationCommand                 = 0x004c
 	};
 
+	// The LE PHYs, as used by the PHY configuration commands (the lower bits describe BR/EDR PHYs, which we leave alone)
+	enum LEPhys
+	{
+		ELE1MTx = (1<<9),
+		ELE1MRx = (1<<10),
+		ELE2MTx = (1<<11),
+		ELE2MRx = (1<<12),
+		ELECodedTx = (1<<13),
+		ELECodedRx = (1<<14),
+
+		ELEPhysMask = ELE1MTx | ELE1MRx | ELE2MTx | ELE2MRx | ELECodedTx | ELECodedRx
+	};
+
+	// Flags for an advertising instance (see `addAdvertising()`)
+	//
+	// Unless one of the flags for them is set, the kernel adds nothing to an instance's data: the flags, TX power, appearance and
+	// local name fields are filled in (and kept up to date) by the kernel when asked for, so they shouldn't also be in the data.
+	enum AdvertisingFlags
+	{
+		EAdvertisingConnectable = (1<<0),
+		EAdvertisingDiscoverable = (1<<1),
+		EAdvertisingLimitedDiscoverable = (1<<2),
+		EAdvertisingManagedFlags = (1<<3),
+		EAdvertisingTxPower = (1<<4),
+		EAdvertisingAppearance = (1<<5),
+		EAdvertisingLocalName = (1<<6)
+	};
+
+	// The most advertising (or scan response) data that fits in a legacy advertising PDU
+	static const int kMaxAdvertisingDataLength = 31;
+
+	// Preferred connection parameters for a device, in the form used by the Load Connection Parameters command
+	//
+	// The address is in the adapter's (little-endian) byte order and the address type is 1 for an LE public address or 2 for an
+	// LE random address. Intervals are in units of 1.25ms and the supervision timeout is in units of 10ms.
+	struct ConnectionParameters
+	{
+		uint8_t address[6];
+		uint8_t addressType;
+		uint16_t minConnectionInterval;
+		uint16_t maxConnectionInterval;
+		uint16_t connectionLatency;
+		uint16_t supervisionTimeout;
+
+		void toNetwork()
+		{
+			minConnectionInterval = Utils::endianToHci(minConnectionInterval);
+			maxConnectionInterval = Utils::endianToHci(maxConnectionInterval);
+			connectionLatency = Utils::endianToHci(connectionLatency);
+			supervisionTimeout = Utils::endianToHci(supervisionTimeout);
+		}
+	} __attribute__((packed));
+
 	// Construct the Mgmt device
 	//
 	// Set `controllerIndex` to the zero-based index of the device as recognized by the OS. If this parameter is omitted, the index
 	// of the first device (0) will be used.
 	Mgmt(uint16_t controllerIndex = kDefaultControllerIndex);
 
+	// Abandons any commands that are still outstanding from an unfinished pipeline (see `beginPipeline()`)
+	~Mgmt();
+
+	//
+	// Pipelining
+	//
+
+	// Begins pipelining commands
+	//
+	// While pipelining, the setters below send their commands without waiting for a response, so a whole configuration sequence
+	// can be in flight at once. The kernel takes the commands in the order they were sent, but it doesn't wait for one to finish
+	// before looking at the next, so only pipeline commands that don't depend on each other. In particular, powering the adapter on
+	// or off completes in the background: wait for `setPowered()` before sending anything that depends on the power state (and
+	// for those before powering back on.) A setter's return value only reflects whether the command was sent; call `endPipeline()`
+	// to wait for the responses.
+	void beginPipeline();
+
+	// Waits for the responses to all commands sent since `beginPipeline()` and stops pipelining
+	//
+	// Returns true if every command received a response with a success status, otherwise false
+	bool endPipeline();
+
 	// Set the adapter name and short name
 	//
 	// The inputs `name` and `shortName` may be truncated prior to setting them on the adapter. To ensure that `name` and
@@ -233,6 +318,99 @@ struct Mgmt
 	// Returns true on success, otherwise false
 	bool setAdvertising(uint8_t newState);
 
+	//
+	// Link tuning
+	//
+	// These commands always wait for their responses (they are not pipelined) and succeed only if the adapter accepts them.
+	//
+
+	// Loads the preferred connection parameters for specific devices
+	//
+	// The kernel uses these whenever one of the devices connects. Loading a new set replaces any that were loaded before.
+	//
+	// Returns true on success, otherwise false
+	bool loadConnectionParameters(const std::vector<ConnectionParameters> &parameters);
+
+	// Sets the default LE connection parameters, used for any device without its own (see `loadConnectionParameters()`)
+	//
+	// Intervals are in units of 1.25ms and the supervision timeout is in units of 10ms. This requires a kernel that supports the
+	// Set Default System Configuration command (Linux 5.9 or later.)
+	//
+	// Returns true on success, otherwise false
+	bool setDefaultConnectionParameters(uint16_t minConnectionInterval, uint16_t maxConnectionInterval, uint16_t connectionLatency, uint16_t supervisionTimeout);
+
+	// Selects the LE PHYs (a combination of `LEPhys`) that the adapter may use, leaving the BR/EDR PHYs as they are
+	//
+	// PHYs that the adapter does not support are dropped. The 1M PHY is mandatory, so it is always included.
+	//
+	// Returns true on success, otherwise false
+	bool setLEPhys(uint32_t lePhys);
+
+	// Sets the suggested default LL data length for new connections
+	//
+	// The Management API has no command for this, so it is sent as an HCI command (LE Write Suggested Default Data Length)
+	// directly to the controller, which requires the controller to be powered. `txOctets` must be in the range [27, 251] and
+	// `txTimeUS` in the range [328, 17040].
+	//
+	// Returns true on success, otherwise false
+	bool setDefaultDataLength(uint16_t txOctets, uint16_t txTimeUS);
+
+	//
+	// Bonding
+	//
+	// Like the link tuning commands, these always wait for their responses.
+	//
+
+	// Loads the long term keys the kernel uses to resume encryption with bonded devices
+	//
+	// Loading a new set replaces all of the adapter's long term keys (including any that bluetoothd loaded.) The kernel rejects
+	// the whole set if any key is invalid.
+	//
+	// Returns true on success, otherwise false
+	bool loadLongTermKeys(const std::vector<HciAdapter::LongTermKey> &keys);
+
+	// Loads the identity resolving keys the kernel uses to recognize bonded devices that use private addresses
+	//
+	// As with `loadLongTermKeys()`, loading a new set replaces all of the adapter's identity resolving keys.
+	//
+	// Returns true on success, otherwise false
+	bool loadIdentityResolvingKeys(const std::vector<HciAdapter::IdentityResolvingKey> &keys);
+
+	//
+	// Advertising
+	//
+	// Like the link tuning commands, these always wait for their responses. Advertising instances replace the plain advertising
+	// setting (see `setAdvertising()`): the kernel only advertises them while that setting is disabled.
+	//
+
+	// Reads the adapter's advertising features (the flags it supports, the space available for data and the number of instances)
+	//
+	// Returns true on success (with the features in `features`), otherwise false
+	bool readAdvertisingFeatures(HciAdapter::AdvertisingFeatures &features);
+
+	// Adds (or replaces) an advertising instance
+	//
+	// Instances are numbered from 1 to the adapter's maximum and the kernel rotates between them. `flags` is a combination of
+	// `AdvertisingFlags`. The instance is advertised for `duration` seconds at a time before moving on to the next (0 for the
+	// kernel's default) and is removed after `timeout` seconds (0 to keep it until it is removed.) The data are sequences of AD
+	// structures (length, type, value.)
+	//
+	// Returns true on success, otherwise false
+	bool addAdvertising(uint8_t instance, uint32_t flags, uint16_t duration, uint16_t timeout, const std::vector<uint8_t> &advertisingData, const std::vector<uint8_t> &scanResponseData);
+
+	// Removes an advertising instance (or all of them, if `instance` is 0)
+	//
+	// Returns true on success, otherwise false
+	bool removeAdvertising(uint8_t instance);
+
+	// Sets the default advertising interval range, in units of 0.625ms [32, 16384]
+	//
+	// The kernel uses these whenever it starts advertising, so they don't change advertising that's already running. This requires
+	// the Set Default System Configuration command (Linux 5.9 or later.)
+	//
+	// Returns true on success, otherwise false
+	bool setDefaultAdvertisingIntervals(uint16_t minInterval, uint16_t maxInterval);
+
 	//
 	// Utilitarian
 	//
@@ -251,9 +429,34 @@ private:
 	// Data members
 	//
 
+	// Sends a command, either waiting for its response or (if pipelining) adding it to the pipeline
+	//
+	// Returns true on success, otherwise false
+	bool sendCommand(HciAdapter::HciHeader &request);
+
+	// Sends a command and waits for its response, logging a warning (using `description`) if it fails
+	//
+	// Returns true only if the adapter responded with a success status, otherwise false
+	bool sendCommandAndCheckStatus(HciAdapter::HciHeader &request, const char *pDescription);
+
+	// Sends a command whose parameters are a count followed by `entryCount` entries of `entrySize` bytes (already in the adapter's
+	// byte order), waiting for its response
+	//
+	// Returns true only if the adapter responded with a success status, otherwise false
+	bool sendCountedList(uint16_t commandCode, const void *pEntries, size_t entryCount, size_t entrySize, const char *pDescription);
+
+	// Sends an HCI command (not a Management API command) directly to the controller and waits for it to complete
+	//
+	// Returns true only if the controller responded with a success status, otherwise false
+	bool sendHciCommand(uint16_t opcode, const std::vector<uint8_t> &parameters);
+
 	// The default controller index (the first device)
 	uint16_t controllerIndex;
 
+	// Our pipeline state (see `beginPipeline()`)
+	bool pipelining;
+	std::vector<HciAdapter::CommandFuture> pipeline;
+
 	// Default controller index
 	static const uint16_t kDefaultControllerIndex = 0;
 };
@@ -0,0 +1,361 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A stand-in for the parts of BlueZ that our server talks to over D-Bus, used by the benchmarks
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Measuring the D-Bus side of the server against a real BlueZ means running as root on a machine with a Bluetooth controller,
+// and the numbers end up including whatever else bluetoothd is doing at the time. The mock lets the benchmarks run against any
+// bus we can own "org.bluez" on (in practice, a private session bus started with `dbus-run-session`.)
+//
+// We only implement what the server needs:
+//
+//     * `org.freedesktop.DBus.ObjectManager` on "/", reporting a single adapter at /org/bluez/hci0
+//
+//     * `org.bluez.Adapter1` on the adapter, with a handful of read-only properties
+//
+//     * `org.bluez.GattManager1` on the adapter. `RegisterApplication` calls `GetManagedObjects` on the application before
+//       replying, just as BlueZ does, so timing it gives a realistic registration round trip.
+//
+// We also listen for PropertiesChanged signals from characteristics, which is how BlueZ receives notifications when a socket
+// hasn't been acquired. That lets the benchmarks measure delivered notifications, not just emitted ones.
+//
+// None of this is built into libggk; it is only linked into the `benchmarks` program.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "MockBluez.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// The path of our one and only adapter
+const char * const MockBluez::kAdapterPath = "/org/bluez/hci0";
+
+static const char *kRootXml =
+	"<node>"
+	"  <interface name='org.freedesktop.DBus.ObjectManager'>"
+	"    <method name='GetManagedObjects'>"
+	"      <arg type='a{oa{sa{sv}}}' name='objects' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+static const char *kAdapterXml =
+	"<node>"
+	"  <interface name='org.bluez.Adapter1'>"
+	"    <property type='s' name='Address' access='read'/>"
+	"    <property type='s' name='Name' access='read'/>"
+	"    <property type='s' name='Alias' access='read'/>"
+	"    <property type='b' name='Powered' access='read'/>"
+	"    <property type='b' name='Discoverable' access='read'/>"
+	"    <property type='b' name='Pairable' access='read'/>"
+	"  </interface>"
+	"  <interface name='org.bluez.GattManager1'>"
+	"    <method name='RegisterApplication'>"
+	"      <arg type='o' name='application' direction='in'/>"
+	"      <arg type='a{sv}' name='options' direction='in'/>"
+	"    </method>"
+	"    <method name='UnregisterApplication'>"
+	"      <arg type='o' name='application' direction='in'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+MockBluez::MockBluez()
+: pConnection(nullptr), pRootNodeInfo(nullptr), pAdapterNodeInfo(nullptr), signalSubscriptionId(0), applicationsRegistered(0),
+  managedObjectCount(0), notificationsReceived(0)
+{
+}
+
+MockBluez::~MockBluez()
+{
+	stop();
+}
+
+// Claims the name "org.bluez" on `pConnection` and exports our adapter
+//
+// The connection should be a private connection to a bus we're free to squat on (typically the session bus.) All of our
+// callbacks are made from the thread-default main context of the calling thread.
+//
+// Returns true on success; on failure, the reason is logged and there is nothing to clean up.
+bool MockBluez::start(GDBusConnection *pNewConnection)
+{
+	GError *pError = nullptr;
+
+	// Claim the name synchronously, so the server can find us as soon as we return
+	GVariant *pResult = g_dbus_connection_call_sync
+	(
+		pNewConnection, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "RequestName",
+		g_variant_new("(su)", "org.bluez", 0x4 /* DBUS_NAME_FLAG_DO_NOT_QUEUE */), G_VARIANT_TYPE("(u)"),
+		G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &pError
+	);
+
+	if (nullptr == pResult)
+	{
+		Logger::error(SSTR << "Mock BlueZ failed to request its name: " << (nullptr == pError ? "Unknown" : pError->message));
+		g_clear_error(&pError);
+		return false;
+	}
+
+	guint32 reply = 0;
+	g_variant_get(pResult, "(u)", &reply);
+	g_variant_unref(pResult);
+
+	// 1 == DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER
+	if (reply != 1)
+	{
+		Logger::error(SSTR << "Mock BlueZ could not own 'org.bluez' (is BlueZ running on this bus?)");
+		return false;
+	}
+
+	pConnection = G_DBUS_CONNECTION(g_object_ref(pNewConnection));
+	pRootNodeInfo = g_dbus_node_info_new_for_xml(kRootXml, nullptr);
+	pAdapterNodeInfo = g_dbus_node_info_new_for_xml(kAdapterXml, nullptr);
+
+	static GDBusInterfaceVTable interfaceVtable;
+	interfaceVtable.method_call = onMethodCall;
+	interfaceVtable.get_property = onGetProperty;
+	interfaceVtable.set_property = nullptr;
+
+	struct { const char *pPath; GDBusNodeInfo *pNode; } exports[] =
+	{
+		{ "/", pRootNodeInfo },
+		{ kAdapterPath, pAdapterNodeInfo },
+	};
+
+	for (const auto &entry : exports)
+	{
+		for (GDBusInterfaceInfo **ppInterface = entry.pNode->interfaces; nullptr != *ppInterface; ++ppInterface)
+		{
+			guint id = g_dbus_connection_register_object(pConnection, entry.pPath, *ppInterface, &interfaceVtable, this, nullptr, &pError);
+			if (0 == id)
+			{
+				Logger::error(SSTR << "Mock BlueZ failed to export " << entry.pPath << ": " << (nullptr == pError ? "Unknown" : pError->message));
+				g_clear_error(&pError);
+				stop();
+				return false;
+			}
+
+			registeredObjectIds.push_back(id);
+		}
+	}
+
+	// Listen for notifications from anybody's characteristics
+	signalSubscriptionId = g_dbus_connection_signal_subscribe
+	(
+		pConnection,                            // GDBusConnection *connection
+		nullptr,                                // const gchar *sender
+		"org.freedesktop.DBus.Properties",      // const gchar *interface_name
+		"PropertiesChanged",                    // const gchar *member
+		nullptr,                                // const gchar *object_path
+		"org.bluez.GattCharacteristic1",        // const gchar *arg0
+		G_DBUS_SIGNAL_FLAGS_NONE,               // GDBusSignalFlags flags
+		onPropertiesChanged,                    // GDBusSignalCallback callback
+		this,                                   // gpointer user_data
+		nullptr                                 // GDestroyNotify user_data_free_func
+	);
+
+	return true;
+}
+
+// Releases the name and unexports our objects
+void MockBluez::stop()
+{
+	if (nullptr == pConnection)
+	{
+		return;
+	}
+
+	if (0 != signalSubscriptionId)
+	{
+		g_dbus_connection_signal_unsubscribe(pConnection, signalSubscriptionId);
+		signalSubscriptionId = 0;
+	}
+
+	for (guint id : registeredObjectIds)
+	{
+		g_dbus_connection_unregister_object(pConnection, id);
+	}
+	registeredObjectIds.clear();
+
+	GVariant *pResult = g_dbus_connection_call_sync
+	(
+		pConnection, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "ReleaseName",
+		g_variant_new("(s)", "org.bluez"), nullptr, G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr
+	);
+	if (nullptr != pResult)
+	{
+		g_variant_unref(pResult);
+	}
+
+	if (nullptr != pRootNodeInfo)
+	{
+		g_dbus_node_info_unref(pRootNodeInfo);
+		pRootNodeInfo = nullptr;
+	}
+
+	if (nullptr != pAdapterNodeInfo)
+	{
+		g_dbus_node_info_unref(pAdapterNodeInfo);
+		pAdapterNodeInfo = nullptr;
+	}
+
+	g_object_unref(pConnection);
+	pConnection = nullptr;
+}
+
+void MockBluez::onMethodCall(GDBusConnection */*pConnection*/, const gchar *pSender, const gchar */*pObjectPath*/,
+	const gchar *pInterfaceName, const gchar *pMethodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation,
+	gpointer pUserData)
+{
+	MockBluez *pSelf = static_cast<MockBluez *>(pUserData);
+	std::string interfaceName = pInterfaceName;
+	std::string methodName = pMethodName;
+
+	if (interfaceName == "org.freedesktop.DBus.ObjectManager" && methodName == "GetManagedObjects")
+	{
+		g_dbus_method_invocation_return_value(pInvocation, pSelf->buildManagedObjects());
+	}
+	else if (interfaceName == "org.bluez.GattManager1" && methodName == "RegisterApplication")
+	{
+		pSelf->registerApplication(pSender, pParameters, pInvocation);
+	}
+	else if (interfaceName == "org.bluez.GattManager1" && methodName == "UnregisterApplication")
+	{
+		g_dbus_method_invocation_return_value(pInvocation, nullptr);
+	}
+	else
+	{
+		g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.NotSupported", "Not supported by the mock");
+	}
+}
+
+GVariant *MockBluez::onGetProperty(GDBusConnection */*pConnection*/, const gchar */*pSender*/, const gchar */*pObjectPath*/,
+	const gchar */*pInterfaceName*/, const gchar *pPropertyName, GError **ppError, gpointer pUserData)
+{
+	GVariant *pValue = static_cast<MockBluez *>(pUserData)->getAdapterProperty(pPropertyName);
+	if (nullptr == pValue)
+	{
+		g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, "Unknown property: %s", pPropertyName);
+	}
+
+	return pValue;
+}
+
+void MockBluez::onPropertiesChanged(GDBusConnection */*pConnection*/, const gchar */*pSender*/, const gchar */*pObjectPath*/,
+	const gchar */*pInterfaceName*/, const gchar */*pSignalName*/, GVariant */*pParameters*/, gpointer pUserData)
+{
+	static_cast<MockBluez *>(pUserData)->notificationsReceived.fetch_add(1, std::memory_order_acq_rel);
+}
+
+// Handles `org.bluez.GattManager1.RegisterApplication` by reading back the application's objects, as BlueZ does
+//
+// The reply to RegisterApplication is held until the application has answered our `GetManagedObjects` call.
+void MockBluez::registerApplication(const gchar *pSender, GVariant *pParameters, GDBusMethodInvocation *pInvocation)
+{
+	const gchar *pApplicationPath = nullptr;
+	g_variant_get(pParameters, "(&oa{sv})", &pApplicationPath, nullptr);
+
+	g_dbus_connection_call
+	(
+		pConnection,                                // GDBusConnection *connection
+		pSender,                                    // const gchar *bus_name
+		pApplicationPath,                           // const gchar *object_path
+		"org.freedesktop.DBus.ObjectManager",       // const gchar *interface_name
+		"GetManagedObjects",                        // const gchar *method_name
+		nullptr,                                    // GVariant *parameters
+		G_VARIANT_TYPE("(a{oa{sa{sv}}})"),          // const GVariantType *reply_type
+		G_DBUS_CALL_FLAGS_NONE,                     // GDBusCallFlags flags
+		-1,                                         // gint timeout_msec
+		nullptr,                                    // GCancellable *cancellable
+
+		// GAsyncReadyCallback callback
+		[] (GObject *pSourceObject, GAsyncResult *pAsyncResult, gpointer pUserData)
+		{
+			GDBusMethodInvocation *pInvocation = static_cast<GDBusMethodInvocation *>(pUserData);
+			MockBluez *pSelf = static_cast<MockBluez *>(g_dbus_method_invocation_get_user_data(pInvocation));
+
+			GError *pError = nullptr;
+			GVariant *pReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(pSourceObject), pAsyncResult, &pError);
+			if (nullptr == pReply)
+			{
+				g_dbus_method_invocation_return_dbus_error(pInvocation, "org.bluez.Error.Failed",
+					nullptr == pError ? "GetManagedObjects failed" : pError->message);
+				g_clear_error(&pError);
+				return;
+			}
+
+			GVariant *pObjects = g_variant_get_child_value(pReply, 0);
+			pSelf->managedObjectCount.store(static_cast<int>(g_variant_n_children(pObjects)), std::memory_order_release);
+			g_variant_unref(pObjects);
+			g_variant_unref(pReply);
+
+			pSelf->applicationsRegistered.fetch_add(1, std::memory_order_acq_rel);
+			g_dbus_method_invocation_return_value(pInvocation, nullptr);
+		},
+
+		pInvocation                                 // gpointer user_data
+	);
+}
+
+// Returns the value of one of our adapter's properties, or nullptr if there is no such property
+GVariant *MockBluez::getAdapterProperty(const std::string &propertyName) const
+{
+	if (propertyName == "Address") { return g_variant_new_string("00:00:00:00:00:01"); }
+	if (propertyName == "Name") { return g_variant_new_string("mock"); }
+	if (propertyName == "Alias") { return g_variant_new_string("mock"); }
+	if (propertyName == "Powered") { return g_variant_new_boolean(true); }
+	if (propertyName == "Discoverable") { return g_variant_new_boolean(false); }
+	if (propertyName == "Pairable") { return g_variant_new_boolean(false); }
+	return nullptr;
+}
+
+// Builds our reply to `org.freedesktop.DBus.ObjectManager.GetManagedObjects`
+GVariant *MockBluez::buildManagedObjects() const
+{
+	GVariantBuilder interfaceArray;
+	g_variant_builder_init(&interfaceArray, G_VARIANT_TYPE("a{sa{sv}}"));
+
+	for (GDBusInterfaceInfo **ppInterface = pAdapterNodeInfo->interfaces; nullptr != *ppInterface; ++ppInterface)
+	{
+		GVariantBuilder propertyArray;
+		g_variant_builder_init(&propertyArray, G_VARIANT_TYPE("a{sv}"));
+		for (GDBusPropertyInfo **ppProperty = (*ppInterface)->properties; nullptr != ppProperty && nullptr != *ppProperty; ++ppProperty)
+		{
+			g_variant_builder_add(&propertyArray, "{sv}", (*ppProperty)->name, getAdapterProperty((*ppProperty)->name));
+		}
+
+		g_variant_builder_add(&interfaceArray, "{sa{sv}}", (*ppInterface)->name, &propertyArray);
+	}
+
+	GVariantBuilder objectArray;
+	g_variant_builder_init(&objectArray, G_VARIANT_TYPE("a{oa{sa{sv}}}"));
+	g_variant_builder_add(&objectArray, "{oa{sa{sv}}}", kAdapterPath, &interfaceArray);
+	return g_variant_new("(a{oa{sa{sv}}})", &objectArray);
+}
+
+}; // namespace ggk
@@ -0,0 +1,105 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A stand-in for the parts of BlueZ that our server talks to over D-Bus, used by the benchmarks
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of MockBluez.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <gio/gio.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace ggk {
+
+struct MockBluez
+{
+	// The path of our one and only adapter
+	static const char * const kAdapterPath;
+
+	MockBluez();
+	~MockBluez();
+
+	// Claims the name "org.bluez" on `pConnection` and exports our adapter
+	//
+	// The connection should be a private connection to a bus we're free to squat on (typically the session bus.) All of our
+	// callbacks are made from the thread-default main context of the calling thread.
+	//
+	// Returns true on success; on failure, the reason is logged and there is nothing to clean up.
+	bool start(GDBusConnection *pConnection);
+
+	// Releases the name and unexports our objects
+	void stop();
+
+	// Returns the number of applications registered through `org.bluez.GattManager1.RegisterApplication`
+	int getApplicationsRegistered() const { return applicationsRegistered.load(std::memory_order_acquire); }
+
+	// Returns the number of objects reported by the most recently registered application's `GetManagedObjects` reply
+	int getManagedObjectCount() const { return managedObjectCount.load(std::memory_order_acquire); }
+
+	// Returns the number of characteristic PropertiesChanged signals (notifications) we've received from anybody on the bus
+	uint64_t getNotificationsReceived() const { return notificationsReceived.load(std::memory_order_acquire); }
+
+	// Resets the notification count
+	void resetNotificationsReceived() { notificationsReceived.store(0, std::memory_order_release); }
+
+private:
+
+	// Our D-Bus handlers
+	static void onMethodCall(GDBusConnection *pConnection, const gchar *pSender, const gchar *pObjectPath, const gchar *pInterfaceName,
+		const gchar *pMethodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData);
+	static GVariant *onGetProperty(GDBusConnection *pConnection, const gchar *pSender, const gchar *pObjectPath,
+		const gchar *pInterfaceName, const gchar *pPropertyName, GError **ppError, gpointer pUserData);
+	static void onPropertiesChanged(GDBusConnection *pConnection, const gchar *pSender, const gchar *pObjectPath,
+		const gchar *pInterfaceName, const gchar *pSignalName, GVariant *pParameters, gpointer pUserData);
+
+	// Handles `org.bluez.GattManager1.RegisterApplication` by reading back the application's objects, as BlueZ does
+	void registerApplication(const gchar *pSender, GVariant *pParameters, GDBusMethodInvocation *pInvocation);
+
+	// Returns the value of one of our adapter's properties, or nullptr if there is no such property
+	GVariant *getAdapterProperty(const std::string &propertyName) const;
+
+	// Builds our reply to `org.freedesktop.DBus.ObjectManager.GetManagedObjects`
+	GVariant *buildManagedObjects() const;
+
+	GDBusConnection *pConnection;
+	GDBusNodeInfo *pRootNodeInfo;
+	GDBusNodeInfo *pAdapterNodeInfo;
+	std::vector<guint> registeredObjectIds;
+	guint signalSubscriptionId;
+
+	std::atomic<int> applicationsRegistered;
+	std::atomic<int> managedObjectCount;
+	std::atomic<uint64_t> notificationsReceived;
+};
+
+}; // namespace ggk
@@ -41,7 +41,8 @@
 //
 //    To accomplish this, we need to build an XML description (called an 'Introspection' for the curious readers) of our DBus
 //    object hierarchy. The code for the XML generation starts in DBusObject.cpp (see `generateIntrospectionXML`) and carries on
-//    throughout the other DBus* files (and even a few Gatt* files).
+//    throughout the other DBus* files (and even a few Gatt* files). The parsed result is cached by each object (see
+//    `getIntrospectionNodeInfo`), so it is only built once no matter how many times we re-register with BlueZ.
 //
 // 2. We also need to describe ourselves as a Bluetooth citizen: The services we provide, our characteristics and descriptors.
 //
@@ -153,12 +154,64 @@
 //         (int, string, etc.) If you need to notify a custom return type, you can do so by building your own GVariant (which is a
 //         GLib construct) and using the `-Variant` form of the method.
 //
+//         Both forms do nothing unless a client has subscribed to the Characteristic (through BlueZ's StartNotify, which is
+//         handled automatically for Characteristics with the "notify" or "indicate" flag.) If building the new value is
+//         expensive, you can check `isNotifying` first and skip the work entirely.
+//
+//     setMinimumNotifyInterval
+//         This method (called within the description, alongside `onReadValue` and friends) limits how often change notifications
+//         are sent for a Characteristic. Notifications that arrive too quickly are held back, and only the latest value is sent
+//         once the interval has elapsed.
+//
+//     cacheReadValue
+//         This method (also called within the description) caches whatever the `onReadValue` handler returns for a given number
+//         of milliseconds, so that repeated reads (including the pieces of a long read) don't call the handler again. Posting an
+//         update for the Characteristic or Descriptor discards the cached value.
+//
+//     onAcquiredWrite and sendNotificationData
+//         For high-rate Characteristics, the "acquire-write" and "acquire-notify" flags let BlueZ move data over a socket rather
+//         than through D-Bus. Writes arrive at the `onAcquiredWrite` callback as raw bytes. While notifications are acquired,
+//         `sendChangeNotificationValue` writes to the socket automatically, and `sendNotificationData` writes raw bytes with no
+//         GVariant at all.
+//
+//     setNotifyFraming and sendFramedNotification
+//         Notifications can't be longer than the MTU allows. With `setNotifyFraming`, `sendFramedNotification` either splits a
+//         long value across several notifications or packs several short records into one, sized to the MTU BlueZ reported.
+//
+//     onReadValueAsync and onWriteValueAsync
+//         Handlers that do slow work (database or network I/O, for example) can use these in place of `onReadValue` and
+//         `onWriteValue`. They run on a worker thread instead of the main loop, and answer through an `AsyncReply` (`pReply`)
+//         that may be completed later from any thread. See the FareConnect account Characteristic below.
+//
+//     onAssembledWrite
+//         Used in place of `onWriteValue` for values that may be longer than a single write. The framework collects the
+//         fragments of a long write into a preallocated buffer (using each fragment's "offset" option) and calls the handler once
+//         with the complete value as `pData` and `length`. See the text string Characteristic below.
+//
+//     bulkTransferService
+//         Adds a complete service for streaming a file to or from a client (firmware images, log archives and so on), with a
+//         control characteristic and a data characteristic. Chunking to the MTU, flow control and resuming are all handled for
+//         you; just say which files to use in a `BulkTransferConfig`. See BulkTransfer.cpp for the protocol.
+//
+//     gattTable
+//         Services that don't need lambdas can instead be described by a constant table (see GattTable.h). The table's UUIDs,
+//         flags and nesting are all checked at compile time, and `gattTable` adds its services at that point in the chain. The
+//         Device Information service below is described this way.
+//
+// Services can also come and go while the server is running. `TheServer->addService()` adds a service beneath the root object
+// and calls a function of yours (a lambda works) with the new service so you can describe its characteristics as usual.
+// `TheServer->removeService()` takes one away again. Only the affected objects are registered with (or removed from) D-Bus, and
+// BlueZ is told about them through the ObjectManager's InterfacesAdded and InterfacesRemoved signals, so other services and
+// connected clients are not disturbed.
+//
 // For information about GVariants (what they are and how to work with them), see the GLib documentation at:
 //
 //     https://www.freedesktop.org/software/gstreamer-sdk/data/docs/latest/glib/glib-GVariantType.html
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include <algorithm>
+#include <condition_variable>
+#include <functional>
 
 #include "Server.h"
 #include "ServerUtils.h"
@@ -171,7 +224,12 @@
 #include "GattUuid.h"
 #include "GattCharacteristic.h"
 #include "GattDescriptor.h"
+#include "GattTable.h"
 #include "Logger.h"
+#include "Stats.h"
+#include "EventScheduler.h"
+#include "MainContext.h"
+#include "Init.h"
 
 namespace ggk {
 
@@ -186,11 +244,44 @@ namespace ggk {
 #endif
 
 // ---------------------------------------------------------------------------------------------------------------------------------
-// Globals
+// Static server tables
 // ---------------------------------------------------------------------------------------------------------------------------------
 
-// Our one and only server. It's global.
-std::shared_ptr<Server> TheServer = nullptr;
+// Characteristic: Manufacturer Name String (0x2A29) "ReadValue" method call
+static void readManufacturerName(const GattCharacteristic &self, GDBusConnection *pConnection, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData)
+{
+	self.methodReturnValue(pInvocation, "Acme Inc.", true);
+}
+
+// Characteristic: Model Number String (0x2A24) "ReadValue" method call
+static void readModelNumber(const GattCharacteristic &self, GDBusConnection *pConnection, const std::string &methodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, void *pUserData)
+{
+	self.methodReturnValue(pInvocation, "Marvin-PA", true);
+}
+
+// Service: Device Information (0x180A)
+//
+// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.service.device_information.xml
+static constexpr GattTableEntry kDeviceInformationTable[] =
+{
+	GattTable::service("device", "180A"),
+
+		// Characteristic: Manufacturer Name String (0x2A29)
+		//
+		// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.manufacturer_name_string.xml
+		GattTable::characteristic("mfgr_name", "2A29", GattTable::ERead, readManufacturerName),
+		GattTable::end(),
+
+		// Characteristic: Model Number String (0x2A24)
+		//
+		// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.model_number_string.xml
+		GattTable::characteristic("model_num", "2A24", GattTable::ERead, readModelNumber),
+		GattTable::end(),
+
+	GattTable::end(),
+};
+
+static_assert(GattTable::isWellFormed(kDeviceInformationTable), "kDeviceInformationTable is not well formed");
 
 // ---------------------------------------------------------------------------------------------------------------------------------
 // Object implementation
@@ -246,6 +337,10 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 	enableAdvertising = true;
 	enableBondable = false;
 
+	// Notification configuration - batch change notifications sent during the same main loop cycle (see
+	// `GattCharacteristic::sendChangeNotificationVariant()`)
+	enableNotificationBatching = true;
+
 	//
 	// Define the server
 	//
@@ -259,36 +354,8 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 
 	// Service: Device Information (0x180A)
 	//
-	// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.service.device_information.xml
-	.gattServiceBegin("device", "180A")
-
-		// Characteristic: Manufacturer Name String (0x2A29)
-		//
-		// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.manufacturer_name_string.xml
-		.gattCharacteristicBegin("mfgr_name", "2A29", {"read"})
-
-			// Standard characteristic "ReadValue" method call
-			.onReadValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
-			{
-				self.methodReturnValue(pInvocation, "Acme Inc.", true);
-			})
-
-		.gattCharacteristicEnd()
-
-		// Characteristic: Model Number String (0x2A24)
-		//
-		// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.model_number_string.xml
-		.gattCharacteristicBegin("model_num", "2A24", {"read"})
-
-			// Standard characteristic "ReadValue" method call
-			.onReadValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
-			{
-				self.methodReturnValue(pInvocation, "Marvin-PA", true);
-			})
-
-		.gattCharacteristicEnd()
-
-	.gattServiceEnd()
+	// This service is described by a static table (see `kDeviceInformationTable` above)
+	.gattTable(kDeviceInformationTable, sizeof(kDeviceInformationTable) / sizeof(kDeviceInformationTable[0]))
 
 	// Battery Service (0x180F)
 	//
@@ -296,10 +363,9 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 	//
 	//     https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.service.battery_service.xml
 	//
-	// We also handle updates to the battery level from inside the server (see onUpdatedValue). There is an external method
-	// (see main.cpp) that updates our battery level and posts an update using ggkPushUpdateQueue. Those updates are used
-	// to notify us that our value has changed, which translates into a call to `onUpdatedValue` from the idleFunc (see
-	// Init.cpp).
+	// The battery level lives in the data store (see DataStore.cpp) rather than going through the data getter. The application
+	// (see standalone.cpp) publishes a new level with `ggkPublish()`, which queues an update for this characteristic directly.
+	// That translates into a call to `onUpdatedValue` from the update processor (see Init.cpp).
 	.gattServiceBegin("battery", "180F")
 
 		// Characteristic: Battery Level (0x2A19)
@@ -307,10 +373,13 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 		// See: https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.battery_level.xml
 		.gattCharacteristicBegin("level", "2A19", {"read", "notify"})
 
+			// Keep our value in the "battery/level" data slot (a single byte)
+			.bindDataSlot("battery/level", 1)
+
 			// Standard characteristic "ReadValue" method call
 			.onReadValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
 			{
-				uint8_t batteryLevel = self.getDataValue<uint8_t>("battery/level", 0);
+				uint8_t batteryLevel = self.getSlotValue<uint8_t>(0);
 				self.methodReturnValue(pInvocation, batteryLevel, true);
 			})
 
@@ -322,7 +391,7 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 			// We can handle updates in any way we wish, but the most common use is to send a change notification.
 			.onUpdatedValue(CHARACTERISTIC_UPDATED_VALUE_CALLBACK_LAMBDA
 			{
-				uint8_t batteryLevel = self.getDataValue<uint8_t>("battery/level", 0);
+				uint8_t batteryLevel = self.getSlotValue<uint8_t>(0);
 				self.sendChangeNotificationValue(pConnection, batteryLevel);
 				return true;
 			})
@@ -340,7 +409,8 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 	//
 	// This showcases the use of events (see the call to .onEvent() below) for periodic actions. In this case, the action
 	// taken is to update time every tick. This probably isn't a good idea for a production service, but it has been quite
-	// useful for testing to ensure we're connected and updating.
+	// useful for testing to ensure we're connected and updating. For events that need to fire more often than once a second,
+	// use .onEventMS(), which takes a period in milliseconds.
 	.gattServiceBegin("time", "1805")
 
 		// Characteristic: Current Time (0x2A2B)
@@ -387,13 +457,16 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
                 // What is the right characteristic?
 		.gattCharacteristicBegin("account", "2ac3", {"write"})
 
-			// Standard characteristic "WriteValue" method call
-			.onWriteValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+			// Characteristic "WriteValue" method call, made on a worker thread so that handling the account doesn't stall the
+			// main loop
+			.onWriteValueAsync(CHARACTERISTIC_ASYNC_METHOD_CALLBACK_LAMBDA
 			{
-                                // 
 				GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
 				std::string account = Utils::stringFromGVariantByteArray(pAyBuffer);
-                                std::cout << account << "\n";
+				g_variant_unref(pAyBuffer);
+				std::cout << account << "\n";
+
+				pReply->returnVariant(nullptr);
 			})
 
 		.gattCharacteristicEnd()
@@ -416,12 +489,12 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 				self.methodReturnValue(pInvocation, pTextString, true);
 			})
 
-			// Standard characteristic "WriteValue" method call
-			.onWriteValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
+			// Characteristic "WriteValue" method call, with long writes reassembled for us
+			.onAssembledWrite(CHARACTERISTIC_ASSEMBLED_WRITE_CALLBACK_LAMBDA
 			{
 				// Update the text string value
-				GVariant *pAyBuffer = g_variant_get_child_value(pParameters, 0);
-				self.setDataPointer("text/string", Utils::stringFromGVariantByteArray(pAyBuffer).c_str());
+				std::string text(reinterpret_cast<const char *>(pData), length);
+				self.setDataPointer("text/string", text.c_str());
 
 				// Since all of these methods (onReadValue, onWriteValue, onUpdateValue) are all part of the same
 				// Characteristic interface (which just so happens to be the same interface passed into our self
@@ -507,6 +580,9 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 		// Characteristic: CPU Count (custom: 0000B002-1E3D-FAD4-74E2-97A033F1BFEE)
 		.gattCharacteristicBegin("count", "0000B002-1E3D-FAD4-74E2-97A033F1BFEE", {"read"})
 
+			// The CPU count doesn't change, so there's no need to look it up on every read
+			.cacheReadValue(60 * 1000)
+
 			// Standard characteristic "ReadValue" method call
 			.onReadValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
 			{
@@ -534,6 +610,10 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 		// Characteristic: CPU Model (custom: 0000B003-1E3D-FAD4-74E2-97A033F1BFEE)
 		.gattCharacteristicBegin("model", "0000B003-1E3D-FAD4-74E2-97A033F1BFEE", {"read"})
 
+			// The model string can be longer than a single read, so BlueZ may read it in pieces. Caching it means we build it
+			// once and serve every piece from the same value.
+			.cacheReadValue(60 * 1000)
+
 			// Standard characteristic "ReadValue" method call
 			.onReadValue(CHARACTERISTIC_METHOD_CALLBACK_LAMBDA
 			{
@@ -598,6 +678,7 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 
 	// Get a reference to the new object as it resides in the list
 	DBusObject &objectManager = objects.back();
+	pObjectManager = &objectManager;
 
 	// Create an interface of the standard type 'org.freedesktop.DBus.ObjectManager'
 	//
@@ -615,6 +696,24 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 	{
 		ServerUtils::getManagedObjects(pInvocation);
 	});
+
+	// Alongside the object manager, we publish our performance counters (see Stats.cpp) so they can be collected from a running
+	// system. This is a plain D-Bus interface, not a GATT one, so BlueZ never sees it.
+	auto statsInterface = std::make_shared<DBusInterface>(objectManager, "com.gobbledegook.Stats");
+	objectManager.addInterface(statsInterface);
+	statsInterface->addMethod("GetStats", pInArgs, "a{st}", INTERFACE_METHOD_CALLBACK_LAMBDA
+	{
+		g_dbus_method_invocation_return_value(pInvocation, g_variant_new("(@a{st})", TheStats.toVariant()));
+	});
+
+	// Our server description is complete, so we can now freeze it (trimming any spare capacity) and index it
+	for (DBusObject &object : objects)
+	{
+		object.compact(Instance::current().bLowMemory);
+	}
+
+	buildInterfaceIndex();
+	trimCaches();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------
@@ -623,59 +722,324 @@ Server::Server(const std::string &serviceName, const std::string &advertisingNam
 
 // Find a D-Bus interface within the given D-Bus object
 //
+// This is a single probe into our interface index (see `buildInterfaceIndex()`) and does not allocate.
+//
 // If the interface was found, it is returned, otherwise nullptr is returned
-std::shared_ptr<const DBusInterface> Server::findInterface(const DBusObjectPath &objectPath, const std::string &interfaceName) const
+std::shared_ptr<const DBusInterface> Server::findInterface(const StringKey &objectPath, const StringKey &interfaceName) const
+{
+	auto iter = interfaceIndex.find(InterfaceKey(objectPath, interfaceName));
+	return iter == interfaceIndex.end() ? nullptr : iter->second.pInterface;
+}
+
+// Find and call a D-Bus method within the given D-Bus object on the given D-Bus interface
+//
+// If the method was called, this method returns true, otherwise false. There is no result from the method call itself.
+bool Server::callMethod(const StringKey &objectPath, const StringKey &interfaceName, const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
+{
+	auto iter = interfaceIndex.find(InterfaceKey(objectPath, interfaceName));
+	if (iter == interfaceIndex.end())
+	{
+		return false;
+	}
+
+	return iter->second.pInterface->callMethod(methodName, pConnection, pParameters, pInvocation, pUserData);
+}
+
+// Find a GATT Property within the given D-Bus object on the given D-Bus interface
+//
+// If the property was found, it is returned, otherwise nullptr is returned
+const GattProperty *Server::findProperty(const StringKey &objectPath, const StringKey &interfaceName, const StringKey &propertyName) const
+{
+	auto iter = interfaceIndex.find(InterfaceKey(objectPath, interfaceName));
+	if (iter == interfaceIndex.end() || nullptr == iter->second.pGattInterface)
+	{
+		return nullptr;
+	}
+
+	return iter->second.pGattInterface->findProperty(propertyName);
+}
+
+// Find a GATT characteristic by its UUID
+//
+// This is a single probe into our UUID index (see `buildInterfaceIndex()`) and does not allocate. If more than one
+// characteristic shares the UUID, the first one in the server description is returned.
+//
+// If the characteristic was found, it is returned, otherwise nullptr is returned
+const GattCharacteristic *Server::findCharacteristic(const GattUuid &uuid) const
+{
+	auto iter = characteristicIndex.find(uuid);
+	return iter == characteristicIndex.end() ? nullptr : iter->second;
+}
+
+// Builds the flat (object path, interface name) index used by `findInterface()`, `callMethod()` and `findProperty()`, along
+// with the UUID index used by `findCharacteristic()`
+//
+// The constructor calls this once the server description is complete. It must be called again if the object hierarchy is
+// modified after construction, otherwise those changes will not be found.
+void Server::buildInterfaceIndex()
 {
+	interfaceIndex.clear();
+	characteristicIndex.clear();
+
 	for (const DBusObject &object : objects)
 	{
-		std::shared_ptr<const DBusInterface> pInterface = object.findInterface(objectPath, interfaceName);
-		if (pInterface != nullptr)
+		indexObject(object);
+	}
+
+	LOG_DEBUG("Indexed " << interfaceIndex.size() << " interfaces");
+}
+
+// Recursively adds an object and its children to the interface index
+void Server::indexObject(const DBusObject &object)
+{
+	// The keys in our index reference the full path stored on the object, which stays put for the life of the description
+	const DBusObjectPath &path = object.getPath();
+
+	for (const std::shared_ptr<DBusInterface> &pInterface : object.getInterfaces())
+	{
+		IndexedInterface entry;
+		entry.pInterface = pInterface;
+		entry.pGattInterface = nullptr;
+
+		// Only GATT interfaces carry properties
+		std::string interfaceType = pInterface->getInterfaceType();
+		if (interfaceType == GattService::kInterfaceType ||
+			interfaceType == GattCharacteristic::kInterfaceType ||
+			interfaceType == GattDescriptor::kInterfaceType)
 		{
-			return pInterface;
+			entry.pGattInterface = static_cast<const GattInterface *>(pInterface.get());
 		}
+
+		if (interfaceType == GattCharacteristic::kInterfaceType)
+		{
+			characteristicIndex.emplace(entry.pGattInterface->getUuid(), static_cast<const GattCharacteristic *>(pInterface.get()));
+		}
+
+		// If the same interface appears twice at a path, the first one wins (this matches the order of a tree search)
+		interfaceIndex.emplace(InterfaceKey(StringKey(path), StringKey(pInterface->getName())), entry);
 	}
 
-	return nullptr;
+	for (const DBusObject &child : object.getChildren())
+	{
+		indexObject(child);
+	}
 }
 
-// Find and call a D-Bus method within the given D-Bus object on the given D-Bus interface
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Memory footprint
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Releases what the low-memory profile doesn't keep (see `Instance::setLowMemory()`), then measures the server description
+// and its caches for `ggkGetMemoryStats()`
 //
-// If the method was called, this method returns true, otherwise false. There is no result from the method call itself.
-bool Server::callMethod(const DBusObjectPath &objectPath, const std::string &interfaceName, const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const
+// This must be called from the thread that owns the description: the server thread, once it is running. It is called when
+// the description is built, once our objects are registered and after each `GetManagedObjects` reply.
+//
+// BlueZ reads our introspection and managed objects when we register and then only if it restarts, so the low-memory profile
+// doesn't keep them around in between; they are rebuilt if they are needed again.
+void Server::trimCaches() const
 {
+	Instance &instance = Instance::current();
+	if (instance.bLowMemory)
+	{
+		for (const DBusObject &object : objects)
+		{
+			object.releaseCaches();
+		}
+
+		if (nullptr != instance.pCachedManagedObjects)
+		{
+			g_variant_unref(instance.pCachedManagedObjects);
+			instance.pCachedManagedObjects = nullptr;
+		}
+	}
+
+	size_t descriptionBytes = sizeof(Server) + Utils::hashTableMemoryUsage(interfaceIndex) + Utils::hashTableMemoryUsage(characteristicIndex) +
+		retiredInterfaces.capacity() * sizeof(std::shared_ptr<DBusInterface>);
+	size_t introspectionBytes = 0;
+	size_t managedObjectsBytes = Utils::memoryUsage(instance.pCachedManagedObjects);
+
 	for (const DBusObject &object : objects)
 	{
-		if (object.callMethod(objectPath, interfaceName, methodName, pConnection, pParameters, pInvocation, pUserData))
+		descriptionBytes += sizeof(DBusObject) + object.getMemoryUsage();
+		object.getCacheMemoryUsage(introspectionBytes, managedObjectsBytes);
+	}
+
+	for (const std::shared_ptr<DBusInterface> &pInterface : retiredInterfaces)
+	{
+		descriptionBytes += pInterface->getMemoryUsage();
+	}
+
+	instance.serverDescriptionBytes.store(descriptionBytes, std::memory_order_relaxed);
+	instance.introspectionCacheBytes.store(introspectionBytes, std::memory_order_relaxed);
+	instance.managedObjectsCacheBytes.store(managedObjectsBytes, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// Runtime changes
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// A call made on the server's thread on behalf of another thread (see `runOnServerThread()`)
+struct ServerThreadCall
+{
+	ServerThreadCall(std::function<bool()> function) : function(function), started(false), abandoned(false), done(false), result(false) {}
+
+	std::function<bool()> function;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool started;
+	bool abandoned;
+	bool done;
+	bool result;
+};
+
+// Runs `function` on the server's thread and waits for it to return, returning its result
+//
+// If we're already on the server's thread, or the server hasn't been started (so nothing else is looking at the description),
+// the function is simply called. Returns false without calling it if the server is shutting down.
+static bool runOnServerThread(std::function<bool()> function)
+{
+	if (ggkGetServerRunState() > ERunning)
+	{
+		Logger::warn("Unable to change the server description while the server is shutting down");
+		return false;
+	}
+
+	if (ggkGetServerRunState() == EUninitialized || MainContext::isOwner())
+	{
+		return function();
+	}
+
+	// The call is shared with the idle handler, since if the server stops before running it, we give up and leave it behind
+	std::shared_ptr<ServerThreadCall> pCall = std::make_shared<ServerThreadCall>(function);
+	MainContext::addIdle([](gpointer pUserData) -> gboolean
+	{
+		std::unique_ptr<std::shared_ptr<ServerThreadCall> > pHolder(static_cast<std::shared_ptr<ServerThreadCall> *>(pUserData));
+		ServerThreadCall &call = **pHolder;
+
+		{
+			std::lock_guard<std::mutex> lock(call.mutex);
+			if (call.abandoned) { return G_SOURCE_REMOVE; }
+			call.started = true;
+		}
+
+		bool result = call.function();
+
+		std::lock_guard<std::mutex> lock(call.mutex);
+		call.result = result;
+		call.done = true;
+		call.condition.notify_all();
+		return G_SOURCE_REMOVE;
+	}, new std::shared_ptr<ServerThreadCall>(pCall));
+
+	std::unique_lock<std::mutex> lock(pCall->mutex);
+	while (!pCall->done)
+	{
+		pCall->condition.wait_for(lock, std::chrono::milliseconds(100));
+		if (!pCall->done && !pCall->started && ggkGetServerRunState() > ERunning)
 		{
-			return true;
+			pCall->abandoned = true;
+			Logger::warn("The server stopped before the server description could be changed");
+			return false;
 		}
 	}
 
-	return false;
+	return pCall->result;
 }
 
-// Find a GATT Property within the given D-Bus object on the given D-Bus interface
+// Adds a GATT service at `pathElement` beneath our root object, calling `describe` to fill it in
 //
-// If the property was found, it is returned, otherwise nullptr is returned
-const GattProperty *Server::findProperty(const DBusObjectPath &objectPath, const std::string &interfaceName, const std::string &propertyName) const
+// Returns false if there is already a service at that path, the server is shutting down or the service could not be
+// registered with D-Bus.
+bool Server::addService(const std::string &pathElement, const GattUuid &uuid, ServiceDescriber describe, void *pUserData)
 {
-	std::shared_ptr<const DBusInterface> pInterface = findInterface(objectPath, interfaceName);
+	return runOnServerThread([&]() { return addServiceNow(pathElement, uuid, describe, pUserData); });
+}
 
-	// Try each of the GattInterface types that support properties?
-	if (std::shared_ptr<const GattInterface> pGattInterface = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattInterface))
+// Removes the GATT service at `pathElement` beneath our root object, along with everything beneath it
+//
+// This works for services from the constructor as well as those added with `addService()`.
+//
+// Returns false if there is no service at that path or the server is shutting down.
+bool Server::removeService(const std::string &pathElement)
+{
+	return runOnServerThread([&]() { return removeServiceNow(pathElement); });
+}
+
+// The part of `addService()` that runs on the server's thread
+bool Server::addServiceNow(const std::string &pathElement, const GattUuid &uuid, ServiceDescriber describe, void *pUserData)
+{
+	DBusObject &root = objects.front();
+	if (nullptr != root.findChild(DBusObjectPath(pathElement)))
 	{
-		return pGattInterface->findProperty(propertyName);
+		Logger::warn(SSTR << "Unable to add service '" << pathElement << "': a service already exists at that path");
+		return false;
 	}
-	else if (std::shared_ptr<const GattService> pGattInterface = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattService))
+
+	DBusObject *pObject = nullptr;
 	{
-		return pGattInterface->findProperty(propertyName);
+		std::unique_lock<std::mutex> lock = lockDescription();
+
+		GattService &service = root.gattServiceBegin(pathElement, uuid);
+		if (nullptr != describe)
+		{
+			describe(service, pUserData);
+		}
+
+		pObject = &service.getOwner();
+		pObject->compact(Instance::current().bLowMemory);
+		buildInterfaceIndex();
+	}
+
+	// Only the new objects are registered; everything else stays as it is
+	if (!registerObjectSubtree(*pObject))
+	{
+		Logger::error(SSTR << "Unable to register service '" << pObject->getPath() << "' with D-Bus");
+
+		std::unique_lock<std::mutex> lock = lockDescription();
+		pObject->retire(retiredInterfaces);
+		buildInterfaceIndex();
+		return false;
+	}
+
+	if (objectsRegistered())
+	{
+		ServerUtils::emitInterfacesAdded(getBusConnection(), *pObjectManager, *pObject);
+	}
+
+	TheEventScheduler.refresh();
+
+	Logger::info(SSTR << "Added service '" << pObject->getPath() << "'");
+	return true;
+}
+
+// The part of `removeService()` that runs on the server's thread
+bool Server::removeServiceNow(const std::string &pathElement)
+{
+	DBusObject *pObject = objects.front().findChild(DBusObjectPath(pathElement));
+	if (nullptr == pObject)
+	{
+		Logger::warn(SSTR << "Unable to remove service '" << pathElement << "': there is no service at that path");
+		return false;
 	}
-	else if (std::shared_ptr<const GattCharacteristic> pGattInterface = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic))
+
+	// Announce the removal while the interfaces are still there to be named
+	if (objectsRegistered())
 	{
-		return pGattInterface->findProperty(propertyName);
+		ServerUtils::emitInterfacesRemoved(getBusConnection(), *pObjectManager, *pObject);
+		unregisterObjectSubtree(*pObject);
 	}
 
-	return nullptr;
+	{
+		std::unique_lock<std::mutex> lock = lockDescription();
+		pObject->retire(retiredInterfaces);
+		buildInterfaceIndex();
+	}
+
+	TheEventScheduler.refresh();
+
+	Logger::info(SSTR << "Removed service '" << pObject->getPath() << "'");
+	return true;
 }
 
 }; // namespace ggk
@@ -38,11 +38,15 @@
 #include <gio/gio.h>
 #include <string>
 #include <vector>
-#include <list>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "../include/Gobbledegook.h"
 #include "DBusObject.h"
+#include "StringKey.h"
+#include "GattUuid.h"
+#include "Instance.h"
 
 namespace ggk {
 
@@ -51,7 +55,9 @@ namespace ggk {
 //
 
 struct GattProperty;
+struct GattService;
 struct GattCharacteristic;
+struct GattInterface;
 struct DBusInterface;
 struct DBusObjectPath;
 
@@ -66,7 +72,7 @@ struct Server
 	//
 
 	// Our server is a collection of D-Bus objects
-	typedef std::list<DBusObject> Objects;
+	typedef DBusObject::ChildList Objects;
 
 	//
 	// Accessors
@@ -90,6 +96,12 @@ struct Server
 	// Returns the requested setting the bondable state (true = enabled, false = disabled)
 	bool getEnableBondable() const { return enableBondable; }
 
+	// Returns the requested setting for change notification batching (true = enabled, false = disabled)
+	//
+	// When enabled, change notifications sent during one main loop cycle are held and sent together at the end of the cycle. See
+	// `GattCharacteristic::sendChangeNotificationVariant()` for details.
+	bool getEnableNotificationBatching() const { return enableNotificationBatching; }
+
 	// Returns our registered data getter
 	GGKServerDataGetter getDataGetter() const { return dataGetter; }
 
@@ -172,26 +184,121 @@ struct Server
 	// Utilitarian
 	//
 
-	// Find and call a D-Bus method within the given D-Bus object on the given D-Bus interface
+	// Find a D-Bus interface within the given D-Bus object
 	//
-	// If the method was called, this method returns true, otherwise false.  There is no result from the method call itself.
-	std::shared_ptr<const DBusInterface> findInterface(const DBusObjectPath &objectPath, const std::string &interfaceName) const;
+	// This is a single probe into our interface index (see `buildInterfaceIndex()`) and does not allocate.
+	//
+	// If the interface was found, it is returned, otherwise nullptr is returned
+	std::shared_ptr<const DBusInterface> findInterface(const StringKey &objectPath, const StringKey &interfaceName) const;
 
-	// Find a D-Bus method within the given D-Bus object on the given D-Bus interface
+	// Find and call a D-Bus method within the given D-Bus object on the given D-Bus interface
 	//
-	// If the method was found, it is returned, otherwise nullptr is returned
-	bool callMethod(const DBusObjectPath &objectPath, const std::string &interfaceName, const std::string &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
+	// If the method was called, this method returns true, otherwise false.  There is no result from the method call itself.
+	bool callMethod(const StringKey &objectPath, const StringKey &interfaceName, const StringKey &methodName, GDBusConnection *pConnection, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData) const;
 
 	// Find a GATT Property within the given D-Bus object on the given D-Bus interface
 	//
 	// If the property was found, it is returned, otherwise nullptr is returned
-	const GattProperty *findProperty(const DBusObjectPath &objectPath, const std::string &interfaceName, const std::string &propertyName) const;
+	const GattProperty *findProperty(const StringKey &objectPath, const StringKey &interfaceName, const StringKey &propertyName) const;
+
+	// Find a GATT characteristic by its UUID
+	//
+	// This is a single probe into our UUID index (see `buildInterfaceIndex()`) and does not allocate. If more than one
+	// characteristic shares the UUID, the first one in the server description is returned.
+	//
+	// If the characteristic was found, it is returned, otherwise nullptr is returned
+	const GattCharacteristic *findCharacteristic(const GattUuid &uuid) const;
+
+	// Builds the flat (object path, interface name) index used by `findInterface()`, `callMethod()` and `findProperty()`, along
+	// with the UUID index used by `findCharacteristic()`
+	//
+	// The constructor calls this once the server description is complete. It must be called again if the object hierarchy is
+	// modified after construction, otherwise those changes will not be found.
+	void buildInterfaceIndex();
+
+	//
+	// Memory footprint
+	//
+
+	// Releases what the low-memory profile doesn't keep (see `Instance::setLowMemory()`), then measures the server description
+	// and its caches for `ggkGetMemoryStats()`
+	//
+	// This must be called from the thread that owns the description: the server thread, once it is running. It is called when
+	// the description is built, once our objects are registered and after each `GetManagedObjects` reply.
+	void trimCaches() const;
+
+	//
+	// Runtime changes
+	//
+	// Services can be added to and removed from the description while the server is running. Only the objects being added or
+	// removed are registered or unregistered with D-Bus, and our ObjectManager announces them with InterfacesAdded and
+	// InterfacesRemoved, so the other services (and the clients using them) are left alone.
+	//
+	// These may be called from any thread. The change is made on the server's thread and the call waits for it to finish.
+	//
+
+	// Describes a service being added at runtime (see `addService()`)
+	//
+	// The service has already been created; this adds its characteristics and descriptors using the usual description methods.
+	// The description is locked while this runs, so it must not call back into the server (such as
+	// `ggkNofifyUpdatedCharacteristic()`.)
+	typedef void (*ServiceDescriber)(GattService &service, void *pUserData);
+
+	// Adds a GATT service at `pathElement` beneath our root object, calling `describe` to fill it in
+	//
+	// Returns false if there is already a service at that path, the server is shutting down or the service could not be
+	// registered with D-Bus.
+	bool addService(const std::string &pathElement, const GattUuid &uuid, ServiceDescriber describe, void *pUserData = nullptr);
+
+	// Removes the GATT service at `pathElement` beneath our root object, along with everything beneath it
+	//
+	// This works for services from the constructor as well as those added with `addService()`.
+	//
+	// Returns false if there is no service at that path or the server is shutting down.
+	bool removeService(const std::string &pathElement);
+
+	// Locks the description against runtime changes
+	//
+	// Changes are only made on the server's thread, so the server's own lookups don't need this. Code on other threads that
+	// searches or walks the description (such as `ggkNofifyUpdatedCharacteristic()`) holds it while doing so.
+	std::unique_lock<std::mutex> lockDescription() const { return std::unique_lock<std::mutex>(descriptionMutex); }
 
 private:
 
+	// An entry in our interface index
+	//
+	// We resolve the GATT interface (if any) at index time so that property lookups don't need to query the interface type.
+	struct IndexedInterface
+	{
+		std::shared_ptr<const DBusInterface> pInterface;
+		const GattInterface *pGattInterface;
+	};
+
+	// Recursively adds an object and its children to the interface index
+	void indexObject(const DBusObject &object);
+
+	// The parts of `addService()` and `removeService()` that run on the server's thread
+	bool addServiceNow(const std::string &pathElement, const GattUuid &uuid, ServiceDescriber describe, void *pUserData);
+	bool removeServiceNow(const std::string &pathElement);
+
 	// Our server's objects
 	Objects objects;
 
+	// The object that implements our ObjectManager (announces services added and removed at runtime)
+	DBusObject *pObjectManager;
+
+	// Interfaces of removed services (see `DBusObject::retire()`)
+	DBusObject::InterfaceList retiredInterfaces;
+
+	// Held while the description is being changed at runtime (see `lockDescription()`)
+	mutable std::mutex descriptionMutex;
+
+	// Flat index from (object path, interface name) to interface
+	std::unordered_map<InterfaceKey, IndexedInterface, InterfaceKey::Hash> interfaceIndex;
+
+	// Index from UUID to characteristic
+	std::unordered_map<GattUuid, const GattCharacteristic *, GattUuid::Hash> characteristicIndex;
+
 	// BR/EDR requested state
 	bool enableBREDR;
 
@@ -207,6 +314,9 @@ private:
 	// Bondable requested state
 	bool enableBondable;
 
+	// Change notification batching requested state
+	bool enableNotificationBatching;
+
 	// The getter callback that is responsible for returning current server data that is shared over Bluetooth
 	GGKServerDataGetter dataGetter;
 
@@ -243,7 +353,7 @@ private:
 	std::string serviceName;
 };
 
-// Our one and only server. It's a global.
-extern std::shared_ptr<Server> TheServer;
+// The server description of the current instance (see Instance.cpp)
+#define TheServer (ggk::Instance::current().server)
 
 }; // namespace ggk
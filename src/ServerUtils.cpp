@@ -46,11 +46,91 @@
 #include "GattCharacteristic.h"
 #include "GattDescriptor.h"
 #include "Server.h"
+#include "Instance.h"
 #include "Logger.h"
 #include "Utils.h"
 
 namespace ggk {
 
+// Adds the properties of a GATT interface to an interface array (a{sa{sv}}) for the `GetManagedObjects` reply
+//
+// Each entry takes a reference to the property's own value (see GattProperty.cpp), so nothing is marshalled here.
+static void addManagedInterface(const GattInterface &interface, GVariantBuilder *pInterfaceArray)
+{
+	if (interface.getProperties().empty())
+	{
+		return;
+	}
+
+	GVariantBuilder propertyArray;
+	g_variant_builder_init(&propertyArray, G_VARIANT_TYPE("a{sv}"));
+	for (const GattProperty &property : interface.getProperties())
+	{
+		LOG_DEBUG("      Property " << property.getName());
+		g_variant_builder_add
+		(
+			&propertyArray,
+			"{sv}",
+			property.getName().c_str(),
+			property.getValue()
+		);
+	}
+
+	g_variant_builder_add
+	(
+		pInterfaceArray,
+		"{sa{sv}}",
+		interface.getName().c_str(),
+		&propertyArray
+	);
+}
+
+// Builds the entry (`{oa{sa{sv}}}`) for a single object in the `GetManagedObjects` reply
+//
+// Returns a floating reference to the entry, or nullptr if the object has nothing to report.
+static GVariant *buildManagedObjectEntry(const DBusObject &object, const DBusObjectPath &path)
+{
+	if (object.getInterfaces().empty())
+	{
+		return nullptr;
+	}
+
+	LOG_DEBUG("  Object: " << path);
+
+	GVariantBuilder interfaceArray;
+	g_variant_builder_init(&interfaceArray, G_VARIANT_TYPE("a{sa{sv}}"));
+	for (const std::shared_ptr<DBusInterface> &pInterface : object.getInterfaces())
+	{
+		// We walk the interfaces by reference and cast the interface itself, so there is no shared_ptr traffic here
+		const std::string interfaceType = pInterface->getInterfaceType();
+		LOG_DEBUG("  + Interface (type: " << interfaceType << ")");
+
+		if (interfaceType == GattService::kInterfaceType)
+		{
+			LOG_DEBUG("    GATT Service interface: " << pInterface->getName());
+			addManagedInterface(static_cast<const GattService &>(*pInterface), &interfaceArray);
+		}
+		else if (interfaceType == GattCharacteristic::kInterfaceType)
+		{
+			LOG_DEBUG("    GATT Characteristic interface: " << pInterface->getName());
+			addManagedInterface(static_cast<const GattCharacteristic &>(*pInterface), &interfaceArray);
+		}
+		else if (interfaceType == GattDescriptor::kInterfaceType)
+		{
+			LOG_DEBUG("    GATT Descriptor interface: " << pInterface->getName());
+			addManagedInterface(static_cast<const GattDescriptor &>(*pInterface), &interfaceArray);
+		}
+		else
+		{
+			Logger::error(SSTR << "    Unknown interface type");
+			g_variant_builder_clear(&interfaceArray);
+			return nullptr;
+		}
+	}
+
+	return g_variant_new("{oa{sa{sv}}}", path.c_str(), &interfaceArray);
+}
+
 // Adds an object to the tree of managed objects as returned from the `GetManagedObjects` method call from the D-Bus interface
 // `org.freedesktop.DBus.ObjectManager`.
 //
@@ -66,142 +146,125 @@ namespace ggk {
 //     the empty dict is returned.
 //
 //     (a{oa{sa{sv}}})
-static void addManagedObjectsNode(const DBusObject &object, const DBusObjectPath &basePath, GVariantBuilder *pObjectArray)
+//
+// Each object's entry is cached on the object itself, so only objects that have changed since the last call are rebuilt.
+static void addManagedObjectsNode(const DBusObject &object, GVariantBuilder *pObjectArray)
 {
 	if (!object.isPublished())
 	{
 		return;
 	}
 
-	if (!object.getInterfaces().empty())
+	const DBusObjectPath &path = object.getPath();
+
+	if (!object.isManagedObjectEntryValid())
 	{
-		DBusObjectPath path = basePath + object.getPathNode();
-		Logger::debug(SSTR << "  Object: " << path);
+		object.setManagedObjectEntry(buildManagedObjectEntry(object, path));
+	}
 
-		GVariantBuilder *pInterfaceArray = g_variant_builder_new(G_VARIANT_TYPE_ARRAY);
-		for (std::shared_ptr<const DBusInterface> pInterface : object.getInterfaces())
-		{
-			Logger::debug(SSTR << "  + Interface (type: " << pInterface->getInterfaceType() << ")");
+	if (GVariant *pEntry = object.getManagedObjectEntry())
+	{
+		g_variant_builder_add_value(pObjectArray, pEntry);
+	}
 
-			if (std::shared_ptr<const GattService> pService = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattService))
-			{
-				if (!pService->getProperties().empty())
-				{
-					Logger::debug(SSTR << "    GATT Service interface: " << pService->getName());
+	for (const DBusObject &child : object.getChildren())
+	{
+		addManagedObjectsNode(child, pObjectArray);
+	}
 
-					GVariantBuilder *pPropertyArray = g_variant_builder_new(G_VARIANT_TYPE_ARRAY);
-					for (const GattProperty &property : pService->getProperties())
-					{
-						Logger::debug(SSTR << "      Property " << property.getName());
-						g_variant_builder_add
-						(
-							pPropertyArray,
-							"{sv}",
-							property.getName().c_str(),
-							property.getValue()
-						);
-					}
+	object.setManagedObjectsSubtreeValid();
+}
 
-					g_variant_builder_add
-					(
-						pInterfaceArray,
-						"{sa{sv}}",
-						pService->getName().c_str(),
-						pPropertyArray
-					);
-				}
-			}
-			else if (std::shared_ptr<const GattCharacteristic> pCharacteristic = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattCharacteristic))
-			{
-				if (!pCharacteristic->getProperties().empty())
-				{
-					Logger::debug(SSTR << "    GATT Characteristic interface: " << pCharacteristic->getName());
+// Builds the response to the method call `GetManagedObjects` from the D-Bus interface `org.freedesktop.DBus.ObjectManager`
+//
+// Each instance caches its reply and reuses it until one of our objects changes (see `DBusObject::invalidateManagedObjects()`),
+// at which point only the entries for the changed objects are rebuilt. The low-memory profile releases the cache once the reply
+// is on its way (see `Server::trimCaches()`.)
+void ServerUtils::getManagedObjects(GDBusMethodInvocation *pInvocation)
+{
+	LOG_DEBUG("Reporting managed objects");
 
-					GVariantBuilder *pPropertyArray = g_variant_builder_new(G_VARIANT_TYPE_ARRAY);
-					for (const GattProperty &property : pCharacteristic->getProperties())
-					{
-						Logger::debug(SSTR << "      Property " << property.getName());
-						g_variant_builder_add
-						(
-							pPropertyArray,
-							"{sv}",
-							property.getName().c_str(),
-							property.getValue()
-						);
-					}
+	GVariant *&pCachedManagedObjects = Instance::current().pCachedManagedObjects;
 
-					g_variant_builder_add
-					(
-						pInterfaceArray,
-						"{sa{sv}}",
-						pCharacteristic->getName().c_str(),
-						pPropertyArray
-					);
-				}
-			}
-			else if (std::shared_ptr<const GattDescriptor> pDescriptor = TRY_GET_CONST_INTERFACE_OF_TYPE(pInterface, GattDescriptor))
-			{
-				if (!pDescriptor->getProperties().empty())
-				{
-					Logger::debug(SSTR << "    GATT Descriptor interface: " << pDescriptor->getName());
+	bool cacheValid = nullptr != pCachedManagedObjects;
+	for (const DBusObject &object : TheServer->getObjects())
+	{
+		if (object.isPublished() && !object.isManagedObjectsSubtreeValid())
+		{
+			cacheValid = false;
+		}
+	}
 
-					GVariantBuilder *pPropertyArray = g_variant_builder_new(G_VARIANT_TYPE_ARRAY);
-					for (const GattProperty &property : pDescriptor->getProperties())
-					{
-						Logger::debug(SSTR << "      Property " << property.getName());
-						g_variant_builder_add
-						(
-							pPropertyArray,
-							"{sv}",
-							property.getName().c_str(),
-							property.getValue()
-						);
-					}
+	if (!cacheValid)
+	{
+		GVariantBuilder objectArray;
+		g_variant_builder_init(&objectArray, G_VARIANT_TYPE("a{oa{sa{sv}}}"));
+		for (const DBusObject &object : TheServer->getObjects())
+		{
+			addManagedObjectsNode(object, &objectArray);
+		}
 
-					g_variant_builder_add
-					(
-						pInterfaceArray,
-						"{sa{sv}}",
-						pDescriptor->getName().c_str(),
-						pPropertyArray
-					);
-				}
-			}
-			else
-			{
-				Logger::error(SSTR << "    Unknown interface type");
-				return;
-			}
+		if (nullptr != pCachedManagedObjects)
+		{
+			g_variant_unref(pCachedManagedObjects);
 		}
 
-		g_variant_builder_add
-		(
-			pObjectArray,
-			"{oa{sa{sv}}}",
-			path.c_str(),
-			pInterfaceArray
-		);
+		pCachedManagedObjects = g_variant_ref_sink(g_variant_new("(a{oa{sa{sv}}})", &objectArray));
+	}
+
+	g_dbus_method_invocation_return_value(pInvocation, pCachedManagedObjects);
+	TheServer->trimCaches();
+}
+
+// Emits `InterfacesAdded` from `objectManager` for `object` and each of its children that has interfaces
+//
+// Each signal carries the same interfaces and properties that the object's entry in the `GetManagedObjects` reply does.
+void ServerUtils::emitInterfacesAdded(GDBusConnection *pConnection, DBusObject &objectManager, const DBusObject &object)
+{
+	if (!object.isPublished())
+	{
+		return;
+	}
+
+	if (GVariant *pEntry = buildManagedObjectEntry(object, object.getPath()))
+	{
+		g_variant_ref_sink(pEntry);
+		GVariant *pInterfaces = g_variant_get_child_value(pEntry, 1);
+		objectManager.emitSignal(pConnection, "org.freedesktop.DBus.ObjectManager", "InterfacesAdded", g_variant_new("(o@a{sa{sv}})", object.getPath().c_str(), pInterfaces));
+		g_variant_unref(pInterfaces);
+		g_variant_unref(pEntry);
 	}
 
 	for (const DBusObject &child : object.getChildren())
 	{
-		addManagedObjectsNode(child, basePath + object.getPathNode(), pObjectArray);
+		emitInterfacesAdded(pConnection, objectManager, child);
 	}
 }
 
-// Builds the response to the method call `GetManagedObjects` from the D-Bus interface `org.freedesktop.DBus.ObjectManager`
-void ServerUtils::getManagedObjects(GDBusMethodInvocation *pInvocation)
+// Emits `InterfacesRemoved` from `objectManager` for `object` and each of its children that has interfaces
+void ServerUtils::emitInterfacesRemoved(GDBusConnection *pConnection, DBusObject &objectManager, const DBusObject &object)
 {
-	Logger::debug(SSTR << "Reporting managed objects");
+	if (!object.isPublished())
+	{
+		return;
+	}
 
-	GVariantBuilder *pObjectArray = g_variant_builder_new(G_VARIANT_TYPE_ARRAY);
-	for (const DBusObject &object : TheServer->getObjects())
+	if (!object.getInterfaces().empty())
 	{
-		addManagedObjectsNode(object, DBusObjectPath(""), pObjectArray);
+		GVariantBuilder nameArray;
+		g_variant_builder_init(&nameArray, G_VARIANT_TYPE("as"));
+		for (const std::shared_ptr<DBusInterface> &pInterface : object.getInterfaces())
+		{
+			g_variant_builder_add(&nameArray, "s", pInterface->getName().c_str());
+		}
+
+		objectManager.emitSignal(pConnection, "org.freedesktop.DBus.ObjectManager", "InterfacesRemoved", g_variant_new("(oas)", object.getPath().c_str(), &nameArray));
 	}
 
-	GVariant *pParams = g_variant_new("(a{oa{sa{sv}}})", pObjectArray);
-	g_dbus_method_invocation_return_value(pInvocation, pParams);
+	for (const DBusObject &child : object.getChildren())
+	{
+		emitInterfacesRemoved(pConnection, objectManager, child);
+	}
 }
 
 // WARNING: Hacky code - don't count on this working properly on all systems
@@ -227,10 +290,12 @@ std::string ServerUtils::getCpuInfo(int16_t &cpuCount)
 		if (cpuInfo.is_open())
 		{
 			std::string line;
+			std::regex processorRegex("^processor.*: [0-9].*$", std::regex::ECMAScript);
+			std::regex modelRegex("^model name.*: (.*)$", std::regex::ECMAScript);
+
 			while(getline(cpuInfo, line))
 			{
 				// Count the processors
-				std::regex processorRegex("^processor.*: [0-9].*$", std::regex::ECMAScript);
 				std::smatch processorMatch;
 
 				if (std::regex_search(line, processorMatch, processorRegex))
@@ -241,7 +306,6 @@ std::string ServerUtils::getCpuInfo(int16_t &cpuCount)
 				// Extract the first model name we find
 				if (cachedModel.empty())
 				{
-					std::regex modelRegex("^model name.*: (.*)$", std::regex::ECMAScript);
 					std::smatch modelMatch;
 					if (std::regex_search(line, modelMatch, modelRegex))
 					{
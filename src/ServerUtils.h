@@ -39,11 +39,21 @@
 
 namespace ggk {
 
+struct DBusObject;
+
 struct ServerUtils
 {
 	// Builds the response to the method call `GetManagedObjects` from the D-Bus interface `org.freedesktop.DBus.ObjectManager`
 	static void getManagedObjects(GDBusMethodInvocation *pInvocation);
 
+	// Emits `InterfacesAdded` from `objectManager` for `object` and each of its children that has interfaces
+	//
+	// Each signal carries the same interfaces and properties that the object's entry in the `GetManagedObjects` reply does.
+	static void emitInterfacesAdded(GDBusConnection *pConnection, DBusObject &objectManager, const DBusObject &object);
+
+	// Emits `InterfacesRemoved` from `objectManager` for `object` and each of its children that has interfaces
+	static void emitInterfacesRemoved(GDBusConnection *pConnection, DBusObject &objectManager, const DBusObject &object);
+
 	// WARNING: Hacky code - don't count on this working properly on all systems
 	//
 	// This routine will attempt to parse /proc/cpuinfo to return the CPU count/model. Results are cached on the first call, with
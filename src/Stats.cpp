@@ -0,0 +1,249 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Performance counters and latency histograms for the server's hot paths
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// The server keeps a small set of counters and histograms (see `Stats`) that cover the paths we care most about:
+//
+//     * D-Bus method call and property get latency, measured from the moment a request reaches us until our handler returns.
+//       Each method also keeps its own latency histogram (see `DBusMethod::getLatency()`.)
+//
+//     * Update queue activity: updates queued, coalesced and dropped, the deepest the queue has been and how long updates wait
+//       in the queue before they are processed.
+//
+//     * Change notifications sent, coalesced (replaced by a newer value while held back) and dropped.
+//
+//     * HCI management command round-trip times and timeouts.
+//
+//     * Main loop stalls. A probe is scheduled to run every `kStallProbeIntervalMS` and the amount by which it runs late is
+//       recorded. A main loop that is never blocked records (nearly) zero every time.
+//
+// Every counter is a relaxed atomic and every histogram has a fixed set of power-of-two buckets, so recording a sample costs a
+// few atomic increments and never takes a lock. Because of that, a snapshot taken while samples are being recorded may not add
+// up exactly (a histogram's count may be one ahead of its buckets, for example.)
+//
+// Applications read the counters with `ggkGetStats()`. They are also published on D-Bus, from the `GetStats` method of the
+// `com.gobbledegook.Stats` interface on our root object, so they can be collected from a running system without rebuilding.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <string.h>
+#include <string>
+
+#include "Stats.h"
+#include "UpdateQueue.h"
+
+namespace ggk {
+
+// Our one and only set of stats. It's a global.
+Stats TheStats;
+
+//
+// LatencyHistogram
+//
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+// Histograms live inside copyable objects (such as `DBusMethod`), so they copy their current values
+LatencyHistogram::LatencyHistogram(const LatencyHistogram &other)
+{
+	*this = other;
+}
+
+LatencyHistogram &LatencyHistogram::operator =(const LatencyHistogram &other)
+{
+	count.store(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	totalMicroseconds.store(other.totalMicroseconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	maxMicroseconds.store(other.maxMicroseconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	for (int i = 0; i < kBucketCount; ++i)
+	{
+		buckets[i].store(other.buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	return *this;
+}
+
+// Records a single sample
+void LatencyHistogram::record(int64_t microseconds)
+{
+	uint64_t value = microseconds > 0 ? static_cast<uint64_t>(microseconds) : 0;
+
+	// Bucket n holds values under 2^n, which is simply the number of significant bits in the value
+	int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+	if (bucket >= kBucketCount)
+	{
+		bucket = kBucketCount - 1;
+	}
+
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	totalMicroseconds.fetch_add(value, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	Stats::updateMaximum(maxMicroseconds, value);
+}
+
+// Copies the current values into `pHistogram`
+//
+// While samples are being recorded, the copy is only a snapshot, so its fields may not add up exactly.
+void LatencyHistogram::snapshot(GGKHistogram *pHistogram) const
+{
+	pHistogram->count = count.load(std::memory_order_relaxed);
+	pHistogram->totalMicroseconds = totalMicroseconds.load(std::memory_order_relaxed);
+	pHistogram->maxMicroseconds = maxMicroseconds.load(std::memory_order_relaxed);
+	for (int i = 0; i < kBucketCount; ++i)
+	{
+		pHistogram->buckets[i] = buckets[i].load(std::memory_order_relaxed);
+	}
+}
+
+// Discards all samples
+void LatencyHistogram::reset()
+{
+	count.store(0, std::memory_order_relaxed);
+	totalMicroseconds.store(0, std::memory_order_relaxed);
+	maxMicroseconds.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < kBucketCount; ++i)
+	{
+		buckets[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+//
+// Stats
+//
+
+Stats::Stats()
+{
+	reset();
+}
+
+// Raises `maximum` to `value`, if `value` is larger
+void Stats::updateMaximum(std::atomic<uint64_t> &maximum, uint64_t value)
+{
+	uint64_t current = maximum.load(std::memory_order_relaxed);
+	while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+// Copies the current values into `pStats`
+void Stats::snapshot(GGKStats *pStats) const
+{
+	memset(pStats, 0, sizeof(GGKStats));
+
+	methodCallLatency.snapshot(&pStats->methodCallLatency);
+	propertyGetLatency.snapshot(&pStats->propertyGetLatency);
+
+	pStats->updatesQueued = updatesQueued.load(std::memory_order_relaxed);
+	pStats->updatesCoalesced = updatesCoalesced.load(std::memory_order_relaxed);
+	pStats->updatesDropped = updatesDropped.load(std::memory_order_relaxed);
+	pStats->updateQueueDepth = TheUpdateQueue.size();
+	pStats->updateQueueMaxDepth = updateQueueMaxDepth.load(std::memory_order_relaxed);
+	updateQueueLatency.snapshot(&pStats->updateQueueLatency);
+
+	pStats->notificationsSent = notificationsSent.load(std::memory_order_relaxed);
+	pStats->notificationsCoalesced = notificationsCoalesced.load(std::memory_order_relaxed);
+	pStats->notificationsDropped = notificationsDropped.load(std::memory_order_relaxed);
+
+	hciCommandLatency.snapshot(&pStats->hciCommandLatency);
+	pStats->hciCommandTimeouts = hciCommandTimeouts.load(std::memory_order_relaxed);
+
+	mainLoopStall.snapshot(&pStats->mainLoopStall);
+}
+
+// Resets all counters and histograms
+//
+// The per-method histograms (see `DBusMethod::getLatency()`) belong to their methods and are not affected.
+void Stats::reset()
+{
+	methodCallLatency.reset();
+	propertyGetLatency.reset();
+
+	updatesQueued.store(0, std::memory_order_relaxed);
+	updatesCoalesced.store(0, std::memory_order_relaxed);
+	updatesDropped.store(0, std::memory_order_relaxed);
+	updateQueueMaxDepth.store(0, std::memory_order_relaxed);
+	updateQueueLatency.reset();
+
+	notificationsSent.store(0, std::memory_order_relaxed);
+	notificationsCoalesced.store(0, std::memory_order_relaxed);
+	notificationsDropped.store(0, std::memory_order_relaxed);
+
+	hciCommandLatency.reset();
+	hciCommandTimeouts.store(0, std::memory_order_relaxed);
+
+	mainLoopStall.reset();
+}
+
+// Adds a histogram's values to a dictionary builder, with names prefixed by `pName`
+static void addHistogram(GVariantBuilder *pBuilder, const char *pName, const GGKHistogram &histogram)
+{
+	std::string name = pName;
+	g_variant_builder_add(pBuilder, "{st}", (name + ".count").c_str(), static_cast<guint64>(histogram.count));
+	g_variant_builder_add(pBuilder, "{st}", (name + ".totalMicroseconds").c_str(), static_cast<guint64>(histogram.totalMicroseconds));
+	g_variant_builder_add(pBuilder, "{st}", (name + ".maxMicroseconds").c_str(), static_cast<guint64>(histogram.maxMicroseconds));
+	for (int i = 0; i < GGK_STATS_HISTOGRAM_BUCKETS; ++i)
+	{
+		g_variant_builder_add(pBuilder, "{st}", (name + ".bucket" + std::to_string(i)).c_str(), static_cast<guint64>(histogram.buckets[i]));
+	}
+}
+
+// Returns the current values as a dictionary of name/value pairs (a{st}), for our D-Bus stats interface
+//
+// The result is a floating reference.
+GVariant *Stats::toVariant() const
+{
+	GGKStats stats;
+	snapshot(&stats);
+
+	GVariantBuilder builder;
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+
+	addHistogram(&builder, "methodCallLatency", stats.methodCallLatency);
+	addHistogram(&builder, "propertyGetLatency", stats.propertyGetLatency);
+
+	g_variant_builder_add(&builder, "{st}", "updatesQueued", static_cast<guint64>(stats.updatesQueued));
+	g_variant_builder_add(&builder, "{st}", "updatesCoalesced", static_cast<guint64>(stats.updatesCoalesced));
+	g_variant_builder_add(&builder, "{st}", "updatesDropped", static_cast<guint64>(stats.updatesDropped));
+	g_variant_builder_add(&builder, "{st}", "updateQueueDepth", static_cast<guint64>(stats.updateQueueDepth));
+	g_variant_builder_add(&builder, "{st}", "updateQueueMaxDepth", static_cast<guint64>(stats.updateQueueMaxDepth));
+	addHistogram(&builder, "updateQueueLatency", stats.updateQueueLatency);
+
+	g_variant_builder_add(&builder, "{st}", "notificationsSent", static_cast<guint64>(stats.notificationsSent));
+	g_variant_builder_add(&builder, "{st}", "notificationsCoalesced", static_cast<guint64>(stats.notificationsCoalesced));
+	g_variant_builder_add(&builder, "{st}", "notificationsDropped", static_cast<guint64>(stats.notificationsDropped));
+
+	addHistogram(&builder, "hciCommandLatency", stats.hciCommandLatency);
+	g_variant_builder_add(&builder, "{st}", "hciCommandTimeouts", static_cast<guint64>(stats.hciCommandTimeouts));
+
+	addHistogram(&builder, "mainLoopStall", stats.mainLoopStall);
+
+	return g_variant_builder_end(&builder);
+}
+
+}; // namespace ggk
@@ -0,0 +1,151 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Performance counters and latency histograms for the server's hot paths
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Stats.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "../include/Gobbledegook.h"
+
+namespace ggk {
+
+// A fixed-bucket histogram of durations, in microseconds
+//
+// Bucket 0 counts samples under 1us, and each bucket after that doubles the limit (bucket `n` counts samples under 2^n us.) The
+// last bucket counts everything else. Recording is lock-free and may be done from any thread.
+struct LatencyHistogram
+{
+	static const int kBucketCount = GGK_STATS_HISTOGRAM_BUCKETS;
+
+	LatencyHistogram();
+
+	// Histograms live inside copyable objects (such as `DBusMethod`), so they copy their current values
+	LatencyHistogram(const LatencyHistogram &other);
+	LatencyHistogram &operator =(const LatencyHistogram &other);
+
+	// Records a single sample
+	void record(int64_t microseconds);
+
+	// Copies the current values into `pHistogram`
+	//
+	// While samples are being recorded, the copy is only a snapshot, so its fields may not add up exactly.
+	void snapshot(GGKHistogram *pHistogram) const;
+
+	// Discards all samples
+	void reset();
+
+private:
+
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> totalMicroseconds;
+	std::atomic<uint64_t> maxMicroseconds;
+	std::atomic<uint64_t> buckets[kBucketCount];
+};
+
+// Records the time from its construction to its destruction in a histogram
+struct LatencyTimer
+{
+	LatencyTimer(LatencyHistogram &histogram) : histogram(histogram), startTime(g_get_monotonic_time()) {}
+	~LatencyTimer() { histogram.record(g_get_monotonic_time() - startTime); }
+
+private:
+
+	LatencyHistogram &histogram;
+	int64_t startTime;
+};
+
+struct Stats
+{
+	Stats();
+
+	// Copies the current values into `pStats`
+	void snapshot(GGKStats *pStats) const;
+
+	// Resets all counters and histograms
+	//
+	// The per-method histograms (see `DBusMethod::getLatency()`) belong to their methods and are not affected.
+	void reset();
+
+	// Returns the current values as a dictionary of name/value pairs (a{st}), for our D-Bus stats interface
+	//
+	// The result is a floating reference.
+	GVariant *toVariant() const;
+
+	// Raises `maximum` to `value`, if `value` is larger
+	static void updateMaximum(std::atomic<uint64_t> &maximum, uint64_t value);
+
+	//
+	// D-Bus dispatch
+	//
+
+	LatencyHistogram methodCallLatency;
+	LatencyHistogram propertyGetLatency;
+
+	//
+	// Update queue
+	//
+
+	std::atomic<uint64_t> updatesQueued;
+	std::atomic<uint64_t> updatesCoalesced;
+	std::atomic<uint64_t> updatesDropped;
+	std::atomic<uint64_t> updateQueueMaxDepth;
+	LatencyHistogram updateQueueLatency;
+
+	//
+	// Notifications
+	//
+
+	std::atomic<uint64_t> notificationsSent;
+	std::atomic<uint64_t> notificationsCoalesced;
+	std::atomic<uint64_t> notificationsDropped;
+
+	//
+	// HCI
+	//
+
+	std::atomic<uint64_t> hciCommandTimeouts;
+	LatencyHistogram hciCommandLatency;
+
+	//
+	// Main loop
+	//
+
+	LatencyHistogram mainLoopStall;
+};
+
+// Our one and only set of stats. It's a global.
+extern Stats TheStats;
+
+}; // namespace ggk
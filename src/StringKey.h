@@ -0,0 +1,133 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A non-owning, hashable reference to a string, used as the key type for our lookup tables.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Our D-Bus callbacks (see Init.cpp) receive object paths, interface names, method names and property names as plain C strings.
+// Converting these into std::string (or DBusObjectPath) objects just to search for a match costs us a heap allocation for nearly
+// every lookup. A StringKey simply points at the characters of an existing string, so it can be built from a C string or a
+// std::string for free and used to probe a hash table without allocating.
+//
+// Since a StringKey does not own its characters, any StringKey that is stored as a key inside a table must reference a string
+// that outlives the table entry. In practice, we point these at the names stored within our methods, properties and interfaces,
+// all of which live for the lifetime of the server description.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <string.h>
+#include <string>
+#include <ostream>
+
+#include "DBusObjectPath.h"
+
+namespace ggk {
+
+struct StringKey
+{
+	// Construct a key referencing a C string
+	inline StringKey(const char *pString) : pString(pString ? pString : ""), length(pString ? strlen(pString) : 0) {}
+
+	// Construct a key referencing the contents of a std::string
+	inline StringKey(const std::string &string) : pString(string.c_str()), length(string.length()) {}
+
+	// Construct a key referencing the contents of a DBusObjectPath
+	inline StringKey(const DBusObjectPath &path) : pString(path.c_str()), length(path.toString().length()) {}
+
+	// Returns the referenced characters (not guaranteed to be null-terminated beyond `getLength()` characters)
+	inline const char *data() const { return pString; }
+
+	// Returns the number of characters referenced by this key
+	inline size_t getLength() const { return length; }
+
+	// Returns an owning copy of the referenced string
+	inline std::string toString() const { return std::string(pString, length); }
+
+	// Tests two keys for equality, returning true if the referenced strings are identical
+	inline bool operator ==(const StringKey &rhs) const
+	{
+		return length == rhs.length && 0 == memcmp(pString, rhs.pString, length);
+	}
+
+	// Returns a hash (FNV-1a) of the referenced string
+	//
+	// The optional `seed` allows multiple keys to be combined into a single hash (see `InterfaceKey`)
+	inline size_t hash(size_t seed = kHashBasis) const
+	{
+		size_t result = seed;
+		for (size_t i = 0; i < length; ++i)
+		{
+			result ^= static_cast<unsigned char>(pString[i]);
+			result *= kHashPrime;
+		}
+		return result;
+	}
+
+	// Hash functor for use with std::unordered_map
+	struct Hash
+	{
+		inline size_t operator()(const StringKey &key) const { return key.hash(); }
+	};
+
+private:
+
+	static constexpr size_t kHashBasis = sizeof(size_t) == 8 ? static_cast<size_t>(14695981039346656037ULL) : 2166136261U;
+	static constexpr size_t kHashPrime = sizeof(size_t) == 8 ? static_cast<size_t>(1099511628211ULL) : 16777619U;
+
+	const char *pString;
+	size_t length;
+};
+
+// Streaming support for our StringKey (useful for our logging mechanism)
+inline std::ostream& operator<<(std::ostream &os, const StringKey &key)
+{
+	os.write(key.data(), key.getLength());
+	return os;
+}
+
+// A composite (object path, interface name) key used to locate an interface with a single hash probe
+struct InterfaceKey
+{
+	inline InterfaceKey(const StringKey &path, const StringKey &interfaceName) : path(path), interfaceName(interfaceName) {}
+
+	// Tests two keys for equality, returning true if both the paths and the interface names are identical
+	inline bool operator ==(const InterfaceKey &rhs) const
+	{
+		return path == rhs.path && interfaceName == rhs.interfaceName;
+	}
+
+	// Hash functor for use with std::unordered_map
+	struct Hash
+	{
+		inline size_t operator()(const InterfaceKey &key) const { return key.interfaceName.hash(key.path.hash()); }
+	};
+
+	StringKey path;
+	StringKey interfaceName;
+};
+
+}; // namespace ggk
@@ -31,14 +31,12 @@
 // regular basis or performing other periodic tasks. One example usage might be checking the battery level every 60 seconds and if
 // it has changed since the last update, send out a notification to subscribers.
 //
-// The frequency at which events fire is dependent upon two values: the driving timer's tick frequency multiplied by the tick
-// freuency of the TickEvent itself.
+// Each TickEvent has a period, in milliseconds. Events are added to the server description with either `onEvent()`, which takes
+// a period in ticks (one tick is `kTickPeriodMS`, or one second), or `onEventMS()`, which takes a period in milliseconds for
+// things like sensor streams that need to update more often than once a second.
 //
-// The tick event's frequency is set when a tick event is added via the `onEvent()` method to the server description.
-//
-// The driving timer's frequency is a one-second-resolution low-frequency timer with a default of one second. To modify this, see
-// `kPeriodicTimerFrequencySeconds` at the top of Init.cpp. Note that the periodic timer (which drives tick events) is intentionally
-// a low-frequency timer. Higher frequency timers would lend themselves to using more battery on both, the server and client.
+// TickEvents don't time themselves. Once the server is registered with BlueZ, the EventScheduler (see EventScheduler.cpp) collects
+// every event in the server description and fires each one as its period elapses.
 //
 // When using a TickEvent, be careful not to demand too much of your client. Notifiations that are too frequent may place undue
 // stress on their battery to receive and process the updates.
@@ -73,12 +71,12 @@ struct TickEvent
 	// A tick event callback, which is called whenever the TickEvent fires
 	typedef void (*Callback)(const DBusInterface &self, const TickEvent &event, GDBusConnection *pConnection, void *pUserData);
 
-	// Construct a TickEvent that will fire after a specified 'tickFrequency' number of ticks of the periodic timer.
-	//
-	// Note that the actual time between a callback's execution is the event's 'tickFrequency' multiplied by the time between each
-	// periodic timer tick.
-	TickEvent(const DBusInterface *pOwner, int tickFrequency, Callback callback, void *pUserData)
-	: pOwner(pOwner), elapsedTicks(0), tickFrequency(tickFrequency), callback(callback), pUserData(pUserData)
+	// The length of a single tick, used for events added with a tick frequency (see `onEvent()`)
+	static const int kTickPeriodMS = 1000;
+
+	// Construct a TickEvent that will fire every `periodMS` milliseconds
+	TickEvent(const DBusInterface *pOwner, int periodMS, Callback callback, void *pUserData)
+	: pOwner(pOwner), periodMS(periodMS), callback(callback), pUserData(pUserData)
 	{
 	}
 
@@ -86,17 +84,16 @@ struct TickEvent
 	// Accessors
 	//
 
-	// Returns the elapsed ticks since the last event firing
-	int getElapsedTicks() const { return elapsedTicks; }
-
-	// Sets the elapsed ticks since the last event firing
-	void setElapsedTicks(int elapsed) { elapsedTicks = elapsed; }
+	// Returns the owner of this TickEvent
+	const DBusInterface *getOwner() const { return pOwner; }
 
-	// Returns the tick frequency between schedule tick events
-	int getTickFrequency() const { return tickFrequency; }
+	// Returns the period between firings of this TickEvent, in milliseconds
+	int getPeriodMS() const { return periodMS; }
 
-	// Sets the tick frequency between schedule tick events
-	void setTickFrequency(int frequency) { tickFrequency = frequency; }
+	// Sets the period between firings of this TickEvent, in milliseconds
+	//
+	// The new period takes effect the next time events are scheduled (see EventScheduler.cpp)
+	void setPeriodMS(int period) { periodMS = period; }
 
 	// Returns the user data pointer associated to this TickEvent
 	void *getUserData() { return pUserData; }
@@ -111,29 +108,19 @@ struct TickEvent
 	void setCallback(Callback callback) { this->callback = callback; }
 
 	//
-	// Tick management
+	// Firing
 	//
 
-	// Perform a single tick of a TickEvent
-	//
-	// A TickEvent is ticked each time the periodic timer fires. The TickEvent only fires after `tickFrequency` ticks. As a result,
-	// the `callback` is only called after a period of time equal to the time between firings of the periodic timer, multiplied by
-	// `tickFrequency`.
+	// Fires the TickEvent, calling its callback with the owner cast to its concrete type T
 	//
-	// Returns true if event fires, false otherwise
+	// This is called by the EventScheduler each time the event's period elapses.
 	template<typename T>
-	void tick(const DBusObjectPath &path, GDBusConnection *pConnection, void *pUserData) const
+	void fire(const DBusObjectPath &path, GDBusConnection *pConnection, void *pUserData) const
 	{
-		elapsedTicks += 1;
-		if (elapsedTicks >= tickFrequency)
+		if (nullptr != callback)
 		{
-			if (nullptr != callback)
-			{
-				Logger::debug(SSTR << "Ticking at path '" << path << "'");
-				callback(*static_cast<const T *>(pOwner), *this, pConnection, pUserData);
-			}
-
-			elapsedTicks = 0;
+			LOG_DEBUG("Ticking at path '" << path << "'");
+			callback(*static_cast<const T *>(pOwner), *this, pConnection, pUserData);
 		}
 	}
 
@@ -144,8 +131,7 @@ private:
 	//
 
 	const DBusInterface *pOwner;
-	mutable int elapsedTicks;
-	int tickFrequency;
+	int periodMS;
 	Callback callback;
 	void *pUserData;
 };
@@ -0,0 +1,437 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A recorder for the HCI events and D-Bus requests that reach the server, and a reader for the traces it writes.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Problems like notification storms or bursts of slow ReadValue calls depend on the exact timing of what a real central does,
+// which is hard to reproduce at a desk. A trace captures that traffic so it can be replayed later, without a radio (see
+// replay.cpp):
+//
+//     * Every management event read from the HCI socket (see `HciAdapter::runEventThread()`.) Events that carry keys from
+//       pairing have the key material blanked out, so a trace is safe to pass around.
+//
+//     * Every D-Bus method call, property get and property set that reaches our objects (see `onMethodCall()` and friends in
+//       Init.cpp), along with the sender and any parameters.
+//
+// Recording is off unless `ggkStartTrace()` is called, and while it's off the only cost on the hot paths is a relaxed load of a
+// flag. While it's on, each record costs a buffered write under a mutex.
+//
+// The file is compact and binary: a four byte magic number and a version, followed by the records. Each record is a type byte,
+// the microseconds since the trace started (eight bytes) and the length of the payload (four bytes), all little-endian,
+// followed by the payload itself. An HCI event's payload is the packet. A D-Bus request's payload is the sender, object path,
+// interface and member name, then the value's type string (each as a two byte length followed by the characters), followed by
+// the value in GVariant's little-endian serialized form.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "Trace.h"
+#include "HciAdapter.h"
+#include "Mgmt.h"
+#include "Logger.h"
+
+namespace ggk {
+
+// Our one and only trace recorder. It's a global.
+TraceRecorder TheTraceRecorder;
+
+// The file's magic number and version
+static const uint8_t kMagic[4] = { 'G', 'G', 'K', 'T' };
+static const uint8_t kVersion = 1;
+
+// The size of a record header: type, timestamp and payload length
+static const size_t kRecordHeaderSize = 1 + 8 + 4;
+
+// The largest payload we'll accept when reading, which is far more than any single event or request should need
+static const uint32_t kMaxPayloadSize = 16 * 1024 * 1024;
+
+// Appends `value` to `buffer` as `byteCount` little-endian bytes
+static void appendLittleEndian(std::vector<uint8_t> &buffer, uint64_t value, int byteCount)
+{
+	for (int i = 0; i < byteCount; ++i)
+	{
+		buffer.push_back(static_cast<uint8_t>(value >> (i * 8)));
+	}
+}
+
+// Reads `byteCount` little-endian bytes from `pData`
+static uint64_t readLittleEndian(const uint8_t *pData, int byteCount)
+{
+	uint64_t value = 0;
+	for (int i = byteCount - 1; i >= 0; --i)
+	{
+		value = (value << 8) | pData[i];
+	}
+	return value;
+}
+
+// Appends a string to `buffer` as a two byte length followed by its characters (longer strings are cut short)
+static void appendString(std::vector<uint8_t> &buffer, const char *pString)
+{
+	size_t length = nullptr == pString ? 0 : strlen(pString);
+	if (length > 0xffff)
+	{
+		length = 0xffff;
+	}
+
+	appendLittleEndian(buffer, length, 2);
+	buffer.insert(buffer.end(), pString, pString + length);
+}
+
+// Reads a string written by `appendString()` at `offset` within `payload`, advancing `offset` past it
+//
+// Returns false if the payload is too short.
+static bool readString(const std::vector<uint8_t> &payload, size_t &offset, std::string &string)
+{
+	if (offset + 2 > payload.size())
+	{
+		return false;
+	}
+
+	size_t length = static_cast<size_t>(readLittleEndian(payload.data() + offset, 2));
+	offset += 2;
+	if (offset + length > payload.size())
+	{
+		return false;
+	}
+
+	string.assign(reinterpret_cast<const char *>(payload.data() + offset), length);
+	offset += length;
+	return true;
+}
+
+// Blanks out the key material in the events that carry it
+static void blankKeys(std::vector<uint8_t> &packet)
+{
+	if (packet.size() < sizeof(HciAdapter::HciHeader))
+	{
+		return;
+	}
+
+	uint16_t eventCode = static_cast<uint16_t>(readLittleEndian(packet.data(), 2));
+	if (eventCode == Mgmt::ENewLongTermKeyEvent && packet.size() >= sizeof(HciAdapter::NewLongTermKeyEvent))
+	{
+		size_t keyOffset = offsetof(HciAdapter::NewLongTermKeyEvent, key);
+		memset(packet.data() + keyOffset + offsetof(HciAdapter::LongTermKey, ediv), 0,
+			sizeof(HciAdapter::LongTermKey) - offsetof(HciAdapter::LongTermKey, ediv));
+	}
+	else if (eventCode == Mgmt::ENewIdentityResolvingKeyEvent && packet.size() >= sizeof(HciAdapter::NewIdentityResolvingKeyEvent))
+	{
+		size_t keyOffset = offsetof(HciAdapter::NewIdentityResolvingKeyEvent, key);
+		memset(packet.data() + keyOffset + offsetof(HciAdapter::IdentityResolvingKey, value), 0, sizeof(HciAdapter::IdentityResolvingKey::value));
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// TraceRecord
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Returns the recorded parameters (or property value) as a floating GVariant, or nullptr if there are none
+//
+// The serialized data is validated, so a damaged trace can't produce a malformed value.
+GVariant *TraceRecord::createValue() const
+{
+	if (valueType.empty() || !g_variant_type_string_is_valid(valueType.c_str()))
+	{
+		return nullptr;
+	}
+
+	GBytes *pBytes = g_bytes_new(valueData.data(), valueData.size());
+	GVariant *pValue = g_variant_new_from_bytes(G_VARIANT_TYPE(valueType.c_str()), pBytes, FALSE);
+	g_bytes_unref(pBytes);
+
+	if (G_BYTE_ORDER == G_BIG_ENDIAN)
+	{
+		GVariant *pSwapped = g_variant_byteswap(pValue);
+		g_variant_unref(g_variant_ref_sink(pValue));
+		pValue = pSwapped;
+	}
+
+	return pValue;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// TraceRecorder
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+TraceRecorder::TraceRecorder()
+: recording(false), pFile(nullptr), startTime(0)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	stop();
+}
+
+// Starts recording to the file at `path`, replacing anything that is already there
+//
+// If we were already recording, the previous trace is finished first.
+//
+// Returns true on success, otherwise false
+bool TraceRecorder::start(const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	closeFile();
+
+	pFile = fopen(path.c_str(), "wb");
+	if (nullptr == pFile)
+	{
+		Logger::error(SSTR << "Unable to start a trace in '" << path << "': " << strerror(errno));
+		return false;
+	}
+
+	if (fwrite(kMagic, sizeof(kMagic), 1, pFile) != 1 || fwrite(&kVersion, sizeof(kVersion), 1, pFile) != 1)
+	{
+		Logger::error(SSTR << "Unable to write to trace '" << path << "'");
+		closeFile();
+		return false;
+	}
+
+	startTime = g_get_monotonic_time();
+	recording.store(true, std::memory_order_relaxed);
+
+	Logger::info(SSTR << "Recording a trace to '" << path << "'");
+	return true;
+}
+
+// Finishes the current trace (if any), writing out anything still buffered
+void TraceRecorder::stop()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	closeFile();
+}
+
+// Records an event packet read from the HCI socket
+void TraceRecorder::recordHciEvent(const uint8_t *pPacket, size_t length)
+{
+	if (!isRecording())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	scratch.assign(pPacket, pPacket + length);
+	blankKeys(scratch);
+	writeRecord(TraceRecord::EHciEvent, scratch);
+}
+
+// Records a D-Bus method call and its parameters
+void TraceRecorder::recordMethodCall(const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pMethodName, GVariant *pParameters)
+{
+	recordRequest(TraceRecord::EMethodCall, pSender, pObjectPath, pInterfaceName, pMethodName, pParameters);
+}
+
+// Records a D-Bus property get
+void TraceRecorder::recordGetProperty(const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pPropertyName)
+{
+	recordRequest(TraceRecord::EGetProperty, pSender, pObjectPath, pInterfaceName, pPropertyName, nullptr);
+}
+
+// Records a D-Bus property set and the new value
+void TraceRecorder::recordSetProperty(const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pPropertyName, GVariant *pValue)
+{
+	recordRequest(TraceRecord::ESetProperty, pSender, pObjectPath, pInterfaceName, pPropertyName, pValue);
+}
+
+// Records a D-Bus request of the given type
+void TraceRecorder::recordRequest(TraceRecord::Type type, const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pMemberName, GVariant *pValue)
+{
+	if (!isRecording())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	scratch.clear();
+	appendString(scratch, pSender);
+	appendString(scratch, pObjectPath);
+	appendString(scratch, pInterfaceName);
+	appendString(scratch, pMemberName);
+	appendString(scratch, nullptr == pValue ? nullptr : g_variant_get_type_string(pValue));
+
+	if (nullptr != pValue)
+	{
+		// Values are stored little-endian, whatever the host
+		GVariant *pStored = G_BYTE_ORDER == G_BIG_ENDIAN ? g_variant_byteswap(pValue) : g_variant_ref(pValue);
+		size_t offset = scratch.size();
+		scratch.resize(offset + g_variant_get_size(pStored));
+		g_variant_store(pStored, scratch.data() + offset);
+		g_variant_unref(pStored);
+	}
+
+	writeRecord(type, scratch);
+}
+
+// Writes a record with the given payload to the file
+//
+// The caller must hold `mutex`.
+void TraceRecorder::writeRecord(TraceRecord::Type type, const std::vector<uint8_t> &payload)
+{
+	// We may have stopped while waiting for the lock
+	if (nullptr == pFile)
+	{
+		return;
+	}
+
+	uint8_t header[kRecordHeaderSize];
+	uint64_t timestamp = static_cast<uint64_t>(g_get_monotonic_time() - startTime);
+	header[0] = static_cast<uint8_t>(type);
+	for (int i = 0; i < 8; ++i) { header[1 + i] = static_cast<uint8_t>(timestamp >> (i * 8)); }
+	for (int i = 0; i < 4; ++i) { header[9 + i] = static_cast<uint8_t>(payload.size() >> (i * 8)); }
+
+	if (fwrite(header, sizeof(header), 1, pFile) != 1 || (!payload.empty() && fwrite(payload.data(), payload.size(), 1, pFile) != 1))
+	{
+		Logger::error("Unable to write to the trace; recording has stopped");
+		closeFile();
+	}
+}
+
+// Closes the file (the caller must hold `mutex`)
+void TraceRecorder::closeFile()
+{
+	recording.store(false, std::memory_order_relaxed);
+	if (nullptr != pFile)
+	{
+		fclose(pFile);
+		pFile = nullptr;
+		Logger::info("Trace recording stopped");
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+// TraceReader
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+TraceReader::TraceReader()
+: pFile(nullptr), truncated(false)
+{
+}
+
+TraceReader::~TraceReader()
+{
+	if (nullptr != pFile)
+	{
+		fclose(pFile);
+	}
+}
+
+// Opens the trace at `path`
+//
+// Returns false if the file can't be read or is not a trace, otherwise true
+bool TraceReader::open(const std::string &path)
+{
+	if (nullptr != pFile)
+	{
+		fclose(pFile);
+	}
+	truncated = false;
+
+	pFile = fopen(path.c_str(), "rb");
+	if (nullptr == pFile)
+	{
+		Logger::error(SSTR << "Unable to open trace '" << path << "': " << strerror(errno));
+		return false;
+	}
+
+	uint8_t header[sizeof(kMagic) + 1];
+	if (fread(header, sizeof(header), 1, pFile) != 1 || memcmp(header, kMagic, sizeof(kMagic)) != 0 || header[sizeof(kMagic)] != kVersion)
+	{
+		Logger::error(SSTR << "'" << path << "' is not a trace (or is from an unsupported version)");
+		fclose(pFile);
+		pFile = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+// Reads the next record into `record`
+//
+// Returns false at the end of the trace. If the trace ends part-way through a record (as it would if the process that was
+// recording it died), that record is dropped and `isTruncated()` returns true.
+bool TraceReader::next(TraceRecord &record)
+{
+	if (nullptr == pFile)
+	{
+		return false;
+	}
+
+	for (;;)
+	{
+		uint8_t header[kRecordHeaderSize];
+		size_t headerBytes = fread(header, 1, sizeof(header), pFile);
+		if (headerBytes != sizeof(header))
+		{
+			truncated = headerBytes != 0;
+			return false;
+		}
+
+		uint32_t payloadSize = static_cast<uint32_t>(readLittleEndian(header + 9, 4));
+		if (payloadSize > kMaxPayloadSize)
+		{
+			truncated = true;
+			return false;
+		}
+
+		payload.resize(payloadSize);
+		if (payloadSize != 0 && fread(payload.data(), payloadSize, 1, pFile) != 1)
+		{
+			truncated = true;
+			return false;
+		}
+
+		record.type = static_cast<TraceRecord::Type>(header[0]);
+		record.timestampUS = static_cast<int64_t>(readLittleEndian(header + 1, 8));
+
+		if (record.type == TraceRecord::EHciEvent)
+		{
+			record.packet = payload;
+			return true;
+		}
+
+		if (record.type == TraceRecord::EMethodCall || record.type == TraceRecord::EGetProperty || record.type == TraceRecord::ESetProperty)
+		{
+			size_t offset = 0;
+			if (readString(payload, offset, record.sender) && readString(payload, offset, record.objectPath)
+				&& readString(payload, offset, record.interfaceName) && readString(payload, offset, record.memberName)
+				&& readString(payload, offset, record.valueType))
+			{
+				record.valueData.assign(payload.begin() + offset, payload.end());
+				return true;
+			}
+		}
+
+		// Skip anything we don't understand (newer record types, or a record that doesn't parse)
+		LOG_DEBUG("Skipping an unreadable trace record of type " << static_cast<int>(header[0]));
+	}
+}
+
+}; // namespace ggk
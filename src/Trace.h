@@ -0,0 +1,175 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A recorder for the HCI events and D-Bus requests that reach the server, and a reader for the traces it writes.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of Trace.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ggk {
+
+// A single entry in a trace
+struct TraceRecord
+{
+	enum Type
+	{
+		EHciEvent = 1,
+		EMethodCall = 2,
+		EGetProperty = 3,
+		ESetProperty = 4
+	};
+
+	TraceRecord() : type(EHciEvent), timestampUS(0) {}
+
+	Type type;
+
+	// Microseconds from the start of the trace
+	int64_t timestampUS;
+
+	// For HCI events: the event packet, exactly as it was read from the HCI socket (with any keys blanked out)
+	std::vector<uint8_t> packet;
+
+	// For D-Bus requests: who it came from, what it was for and the method parameters (or the new property value)
+	//
+	// The value is kept in its serialized form, along with its type string. See `createValue()`.
+	std::string sender;
+	std::string objectPath;
+	std::string interfaceName;
+	std::string memberName;
+	std::string valueType;
+	std::vector<uint8_t> valueData;
+
+	// Returns the recorded parameters (or property value) as a floating GVariant, or nullptr if there are none
+	//
+	// The serialized data is validated, so a damaged trace can't produce a malformed value.
+	GVariant *createValue() const;
+};
+
+struct TraceRecorder
+{
+	TraceRecorder();
+	~TraceRecorder();
+
+	// Starts recording to the file at `path`, replacing anything that is already there
+	//
+	// If we were already recording, the previous trace is finished first.
+	//
+	// Returns true on success, otherwise false
+	bool start(const std::string &path);
+
+	// Finishes the current trace (if any), writing out anything still buffered
+	void stop();
+
+	// Returns true while we are recording
+	//
+	// This is a single relaxed load, so callers on hot paths check it before gathering anything to record.
+	bool isRecording() const { return recording.load(std::memory_order_relaxed); }
+
+	//
+	// Recording
+	//
+	// These may be called from any thread. They do nothing if we aren't recording.
+	//
+
+	// Records an event packet read from the HCI socket
+	void recordHciEvent(const uint8_t *pPacket, size_t length);
+
+	// Records a D-Bus method call and its parameters
+	void recordMethodCall(const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pMethodName, GVariant *pParameters);
+
+	// Records a D-Bus property get
+	void recordGetProperty(const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pPropertyName);
+
+	// Records a D-Bus property set and the new value
+	void recordSetProperty(const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pPropertyName, GVariant *pValue);
+
+private:
+
+	// Records a D-Bus request of the given type
+	void recordRequest(TraceRecord::Type type, const char *pSender, const char *pObjectPath, const char *pInterfaceName, const char *pMemberName, GVariant *pValue);
+
+	// Writes a record with the given payload to the file
+	//
+	// The caller must hold `mutex`.
+	void writeRecord(TraceRecord::Type type, const std::vector<uint8_t> &payload);
+
+	// Closes the file (the caller must hold `mutex`)
+	void closeFile();
+
+	std::atomic<bool> recording;
+
+	// Guards everything below (records arrive from both the HCI event thread and the server thread)
+	std::mutex mutex;
+	FILE *pFile;
+	int64_t startTime;
+
+	// Reused for each record's payload, so recording doesn't allocate once it's warmed up
+	std::vector<uint8_t> scratch;
+};
+
+// Reads the records of a trace written by `TraceRecorder`
+struct TraceReader
+{
+	TraceReader();
+	~TraceReader();
+
+	// Opens the trace at `path`
+	//
+	// Returns false if the file can't be read or is not a trace, otherwise true
+	bool open(const std::string &path);
+
+	// Reads the next record into `record`
+	//
+	// Returns false at the end of the trace. If the trace ends part-way through a record (as it would if the process that was
+	// recording it died), that record is dropped and `isTruncated()` returns true.
+	bool next(TraceRecord &record);
+
+	// Returns true if the trace ended part-way through a record
+	bool isTruncated() const { return truncated; }
+
+private:
+
+	FILE *pFile;
+	bool truncated;
+	std::vector<uint8_t> payload;
+};
+
+// Our one and only trace recorder. It's a global.
+extern TraceRecorder TheTraceRecorder;
+
+}; // namespace ggk
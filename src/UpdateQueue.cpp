@@ -0,0 +1,504 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The queue of pending data updates that connects the application's threads to our GLib main loop.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Applications notify us of updated data by calling `ggkNofifyUpdatedCharacteristic()` (or one of its siblings) from their own
+// threads. The update is processed later, on the GLib main loop thread (see `processUpdate()` in Init.cpp.) This queue is how those
+// threads meet.
+//
+// Since application threads may push updates at a high rate, the queue is built to stay out of their way:
+//
+//     * Entries are interfaces that have already been resolved (via the server's interface index) at the time they were pushed,
+//       so the main loop never needs to parse or look anything up.
+//
+//     * The queue is a bounded ring buffer where each cell carries a sequence number (this is the well-known bounded queue
+//       design by Dmitry Vyukov.) Producers claim a cell with a single compare-and-swap, so no thread ever takes a lock.
+//
+//     * Pushes are coalesced. Each interface carries a pending flag that is set when it enters the queue and cleared when it
+//       leaves. Pushing an interface that is already pending does nothing, since the pending entry will already cause the latest
+//       value to be processed. As a result, an interface can only ever occupy one cell, and a rapidly changing value can never
+//       grow the queue.
+//
+// Because of the coalescing, the queue only needs as many cells as there are interfaces that might be updated at the same time.
+// If more than that are pending, the queue is full and something has to give. By default the new update is refused
+// (`EUpdateDropNewest`), which keeps the updates that have waited longest. With `EUpdateDropOldest` (see `ggkSetUpdateQueue()`),
+// the producer instead drops the update at the front of the queue to make room, which favors fresh data. Either way, each
+// dropped update is counted in `Stats::updatesDropped`.
+//
+// A batch of updates (see `pushBatch()`) claims a run of cells with a single compare-and-swap. The cells are filled last to first,
+// so the consumer, which takes cells in order, sees either none of the batch or all of it.
+//
+// The consumer doesn't poll the queue. Instead, it watches an eventfd (see `openWakeup()`) that is signaled when an entry is
+// added. Producers only write to the eventfd when no wakeup is already outstanding, so a burst of updates costs a single
+// syscall. Skipping the write is only safe if the consumer, having cleared the outstanding flag, is sure to see the entry the
+// producer stored before finding the flag set. The release and acquire orderings on the cells don't promise that on their own
+// (each side stores one location and then loads the other), so both sides put a full fence between their store and their load.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <new>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "UpdateQueue.h"
+#include "DBusInterface.h"
+#include "Logger.h"
+#include "Stats.h"
+
+namespace ggk {
+
+// Allocates (and frees) a queue with the alignment its members ask for, which `new` doesn't do for us in C++11 (each instance
+// allocates its own, see Instance.cpp)
+void *UpdateQueue::operator new(size_t size)
+{
+	void *pMemory = nullptr;
+	if (0 != posix_memalign(&pMemory, alignof(UpdateQueue), size))
+	{
+		throw std::bad_alloc();
+	}
+
+	return pMemory;
+}
+
+void UpdateQueue::operator delete(void *pMemory)
+{
+	free(pMemory);
+}
+
+// Construct a queue able to hold `capacity` pending interfaces, which drops updates according to `dropPolicy` once it's full
+//
+// The capacity is rounded up to the next power of two.
+UpdateQueue::UpdateQueue(size_t capacity, GGKUpdateDropPolicy dropPolicy)
+: dropPolicy(dropPolicy), enqueuePos(0), dequeuePos(0), wakeupFd(-1), wakeupPending(false)
+{
+	size_t roundedCapacity = 2;
+	while (roundedCapacity < capacity)
+	{
+		roundedCapacity <<= 1;
+	}
+
+	cells = std::vector<Cell>(roundedCapacity);
+	mask = roundedCapacity - 1;
+
+	for (size_t i = 0; i < roundedCapacity; ++i)
+	{
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+		cells[i].pInterface = nullptr;
+		cells[i].pushTime = 0;
+	}
+}
+
+// Closes the wakeup file descriptor, if it was opened
+//
+// The queue belongs to its instance, which is only destroyed once its server has stopped and the main loop's watch on the
+// descriptor has been removed (see `uninit()`), so nobody is left to push or listen.
+UpdateQueue::~UpdateQueue()
+{
+	int fd = wakeupFd.exchange(-1, std::memory_order_acq_rel);
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+}
+
+// Adds an interface to the back of the queue
+//
+// If the interface is already pending in the queue, this call is coalesced with the existing entry and does nothing. If the
+// queue is full, the drop policy decides whether this update or the oldest pending one is dropped.
+//
+// This method is lock-free and may be called from any thread.
+//
+// Returns true if the interface is pending (whether newly added or coalesced), or false if the queue is full (and the drop
+// policy is `EUpdateDropNewest`.)
+bool UpdateQueue::push(const DBusInterface *pInterface)
+{
+	// If it's already in the queue, we're done
+	if (!pInterface->markUpdatePending())
+	{
+		TheStats.updatesCoalesced.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	Cell *pCell = nullptr;
+	size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		pCell = &cells[pos & mask];
+		size_t sequence = pCell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+		// The cell is free for this lap; try to claim it
+		if (diff == 0)
+		{
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+
+		// The cell still holds an entry from the previous lap, so we're full
+		else if (diff < 0)
+		{
+			if (dropPolicy == EUpdateDropOldest && dropOldest())
+			{
+				pos = enqueuePos.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			pInterface->clearUpdatePending();
+			TheStats.updatesDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// Another producer beat us to it
+		else
+		{
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	pCell->pInterface = pInterface;
+	pCell->pushTime = g_get_monotonic_time();
+	pCell->sequence.store(pos + 1, std::memory_order_release);
+
+	// The consumer may already have moved past our entry, in which case the depth we'd compute is meaningless
+	TheStats.updatesQueued.fetch_add(1, std::memory_order_relaxed);
+	intptr_t depth = static_cast<intptr_t>(pos + 1) - static_cast<intptr_t>(dequeuePos.load(std::memory_order_relaxed));
+	if (depth > 0)
+	{
+		Stats::updateMaximum(TheStats.updateQueueMaxDepth, static_cast<uint64_t>(depth));
+	}
+
+	wakeup();
+	return true;
+}
+
+// Adds a batch of interfaces to the back of the queue, all at once
+//
+// Interfaces that are already pending are coalesced, as with `push()`. The rest are added with a single claim on the queue,
+// become visible to the consumer together and cost (at most) a single wakeup.
+//
+// This method is lock-free and may be called from any thread.
+//
+// When the queue doesn't have room for the batch and the drop policy is `EUpdateDropOldest`, pending updates are dropped from
+// the front of the queue until it does.
+//
+// Returns true if every interface is pending, or false if the queue doesn't have room for the batch (in which case none of
+// the batch's new entries are added.)
+bool UpdateQueue::pushBatch(const DBusInterface *const *ppInterfaces, size_t count)
+{
+	// Each producer thread keeps its own scratch list, so a batch doesn't cost an allocation once the list has grown to fit
+	static thread_local std::vector<const DBusInterface *> entries;
+	entries.clear();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (ppInterfaces[i]->markUpdatePending())
+		{
+			entries.push_back(ppInterfaces[i]);
+		}
+		else
+		{
+			TheStats.updatesCoalesced.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	size_t entryCount = entries.size();
+	if (entryCount == 0)
+	{
+		return true;
+	}
+
+	// Claim a run of cells; every one of them must be free for this lap
+	size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	bool full = entryCount > cells.size();
+	while (!full)
+	{
+		intptr_t diff = 0;
+		for (size_t i = 0; i < entryCount && diff == 0; ++i)
+		{
+			size_t sequence = cells[(pos + i) & mask].sequence.load(std::memory_order_acquire);
+			diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + i);
+		}
+
+		if (diff == 0)
+		{
+			if (enqueuePos.compare_exchange_weak(pos, pos + entryCount, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			if (dropPolicy == EUpdateDropOldest && dropOldest())
+			{
+				pos = enqueuePos.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			full = true;
+		}
+		else
+		{
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	if (full)
+	{
+		for (const DBusInterface *pInterface : entries)
+		{
+			pInterface->clearUpdatePending();
+		}
+
+		TheStats.updatesDropped.fetch_add(entryCount, std::memory_order_relaxed);
+		return false;
+	}
+
+	// Fill the cells last to first, so the first cell (the one the consumer is waiting on) completes the batch
+	int64_t now = g_get_monotonic_time();
+	for (size_t i = entryCount; i-- > 0;)
+	{
+		Cell &cell = cells[(pos + i) & mask];
+		cell.pInterface = entries[i];
+		cell.pushTime = now;
+		cell.sequence.store(pos + i + 1, std::memory_order_release);
+	}
+
+	TheStats.updatesQueued.fetch_add(entryCount, std::memory_order_relaxed);
+	intptr_t depth = static_cast<intptr_t>(pos + entryCount) - static_cast<intptr_t>(dequeuePos.load(std::memory_order_relaxed));
+	if (depth > 0)
+	{
+		Stats::updateMaximum(TheStats.updateQueueMaxDepth, static_cast<uint64_t>(depth));
+	}
+
+	wakeup();
+	return true;
+}
+
+// Removes and returns the interface at the front of the queue, or nullptr if the queue is empty
+//
+// Once an interface is removed from the queue, it may be pushed again. This method is lock-free.
+const DBusInterface *UpdateQueue::pop()
+{
+	return take(true);
+}
+
+// Removes and returns the interface at the front of the queue, or nullptr if the queue is empty
+//
+// Entries that are processed have their time in the queue recorded (see `Stats::updateQueueLatency`); dropped ones don't.
+const DBusInterface *UpdateQueue::take(bool recordLatency)
+{
+	Cell *pCell = nullptr;
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		pCell = &cells[pos & mask];
+		size_t sequence = pCell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+		// The cell holds an entry for this lap; try to take it
+		if (diff == 0)
+		{
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+
+		// Nothing has been written here yet, so we're empty
+		else if (diff < 0)
+		{
+			return nullptr;
+		}
+
+		// Another consumer beat us to it
+		else
+		{
+			pos = dequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	const DBusInterface *pInterface = pCell->pInterface;
+	if (recordLatency)
+	{
+		TheStats.updateQueueLatency.record(g_get_monotonic_time() - pCell->pushTime);
+	}
+	pCell->sequence.store(pos + mask + 1, std::memory_order_release);
+
+	// Clear the pending flag before the update is processed, so that any update that arrives while we process this one is not
+	// lost
+	pInterface->clearUpdatePending();
+	return pInterface;
+}
+
+// Drops the oldest pending update to make room for a newer one
+//
+// Returns true if an update was dropped, or false if the queue was emptied in the meantime.
+bool UpdateQueue::dropOldest()
+{
+	if (nullptr == take(false))
+	{
+		return false;
+	}
+
+	TheStats.updatesDropped.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+// Returns the interface at the front of the queue without removing it, or nullptr if the queue is empty
+const DBusInterface *UpdateQueue::peek() const
+{
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	const Cell &cell = cells[pos & mask];
+	if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+	{
+		return nullptr;
+	}
+
+	return cell.pInterface;
+}
+
+// Returns the number of pending interfaces
+//
+// While other threads are pushing or popping this is only a snapshot, so it should be considered approximate.
+size_t UpdateQueue::size() const
+{
+	size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+	size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+	return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+// Returns true if there are no pending interfaces
+bool UpdateQueue::empty() const
+{
+	return size() == 0;
+}
+
+// Removes all pending interfaces
+void UpdateQueue::clear()
+{
+	while (nullptr != pop())
+	{
+	}
+}
+
+//
+// Consumer wakeup
+//
+
+// Opens the eventfd that is signaled when updates are added to the queue
+//
+// The eventfd is opened once and stays open for the life of the queue (so that a producer can never write to a descriptor that
+// has been closed and reused while the server runs.) Calling this method again simply returns the existing descriptor.
+//
+// Returns the file descriptor, or -1 on failure.
+int UpdateQueue::openWakeup()
+{
+	int fd = wakeupFd.load(std::memory_order_acquire);
+	if (fd >= 0)
+	{
+		return fd;
+	}
+
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0)
+	{
+		Logger::error(SSTR << "Unable to create update queue eventfd (errno " << errno << ")");
+		return -1;
+	}
+
+	int expected = -1;
+	if (!wakeupFd.compare_exchange_strong(expected, fd, std::memory_order_acq_rel))
+	{
+		// Someone else opened it first
+		close(fd);
+		return expected;
+	}
+
+	// Anything already waiting in the queue needs a wakeup
+	if (!empty())
+	{
+		wakeup();
+	}
+
+	return fd;
+}
+
+// Signals the wakeup file descriptor, unless a wakeup is already outstanding
+//
+// This is called automatically whenever `push()` adds an entry to the queue. It is safe to call from any thread.
+void UpdateQueue::wakeup()
+{
+	// Order the entry we just stored before our check of the flag (see the discussion at the top of this file)
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (wakeupPending.exchange(true, std::memory_order_seq_cst))
+	{
+		return;
+	}
+
+	int fd = wakeupFd.load(std::memory_order_acquire);
+	if (fd < 0)
+	{
+		// Nobody is listening yet; `openWakeup()` will signal for anything that's waiting
+		wakeupPending.store(false, std::memory_order_release);
+		return;
+	}
+
+	uint64_t one = 1;
+	if (write(fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN)
+	{
+		Logger::warn(SSTR << "Unable to signal update queue eventfd (errno " << errno << ")");
+	}
+}
+
+// Consumes an outstanding wakeup
+//
+// The consumer should call this before draining the queue, so that entries pushed while it drains will signal again.
+void UpdateQueue::acknowledgeWakeup()
+{
+	int fd = wakeupFd.load(std::memory_order_acquire);
+	if (fd >= 0)
+	{
+		uint64_t count = 0;
+		if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		{
+			Logger::warn(SSTR << "Unable to read update queue eventfd (errno " << errno << ")");
+		}
+	}
+
+	wakeupPending.store(false, std::memory_order_seq_cst);
+
+	// Order clearing the flag before the drain's loads of the cells, so that a producer that still saw the flag set has its entry
+	// seen by the drain that follows
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+}; // namespace ggk
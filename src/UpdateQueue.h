@@ -0,0 +1,191 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// The queue of pending data updates that connects the application's threads to our GLib main loop.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of UpdateQueue.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "Instance.h"
+
+namespace ggk {
+
+struct DBusInterface;
+
+struct UpdateQueue
+{
+	// The number of interfaces that may be pending at once in each instance's queue
+	static const size_t kDefaultCapacity = 1024;
+
+	// The capacity used by the low-memory profile (see `Instance::setLowMemory()`)
+	static const size_t kLowMemoryCapacity = 64;
+
+	// The largest capacity that may be configured (see `ggkSetUpdateQueue()`)
+	static const size_t kMaxCapacity = 64 * 1024;
+
+	// Construct a queue able to hold `capacity` pending interfaces, which drops updates according to `dropPolicy` once it's full
+	//
+	// The capacity is rounded up to the next power of two.
+	explicit UpdateQueue(size_t capacity, GGKUpdateDropPolicy dropPolicy = EUpdateDropNewest);
+
+	// Closes the wakeup file descriptor, if it was opened
+	//
+	// The queue belongs to its instance, which is only destroyed once its server has stopped and the main loop's watch on the
+	// descriptor has been removed (see `uninit()`), so nobody is left to push or listen.
+	~UpdateQueue();
+
+	// Allocates (and frees) a queue with the alignment its members ask for, which `new` doesn't do for us in C++11 (each instance
+	// allocates its own, see Instance.cpp)
+	static void *operator new(size_t size);
+	static void operator delete(void *pMemory);
+
+	// Adds an interface to the back of the queue
+	//
+	// If the interface is already pending in the queue, this call is coalesced with the existing entry and does nothing. If the
+	// queue is full, the drop policy decides whether this update or the oldest pending one is dropped.
+	//
+	// This method is lock-free and may be called from any thread.
+	//
+	// Returns true if the interface is pending (whether newly added or coalesced), or false if the queue is full (and the drop
+	// policy is `EUpdateDropNewest`.)
+	bool push(const DBusInterface *pInterface);
+
+	// Adds a batch of interfaces to the back of the queue, all at once
+	//
+	// Interfaces that are already pending are coalesced, as with `push()`. The rest are added with a single claim on the queue,
+	// become visible to the consumer together and cost (at most) a single wakeup.
+	//
+	// This method is lock-free and may be called from any thread.
+	//
+	// When the queue doesn't have room for the batch and the drop policy is `EUpdateDropOldest`, pending updates are dropped from
+	// the front of the queue until it does.
+	//
+	// Returns true if every interface is pending, or false if the queue doesn't have room for the batch (in which case none of
+	// the batch's new entries are added.)
+	bool pushBatch(const DBusInterface *const *ppInterfaces, size_t count);
+
+	// Removes and returns the interface at the front of the queue, or nullptr if the queue is empty
+	//
+	// Once an interface is removed from the queue, it may be pushed again. This method is lock-free.
+	const DBusInterface *pop();
+
+	// Returns the interface at the front of the queue without removing it, or nullptr if the queue is empty
+	const DBusInterface *peek() const;
+
+	// Returns the number of pending interfaces
+	//
+	// While other threads are pushing or popping this is only a snapshot, so it should be considered approximate.
+	size_t size() const;
+
+	// Returns true if there are no pending interfaces
+	bool empty() const;
+
+	// Removes all pending interfaces
+	void clear();
+
+	// Returns the number of interfaces the queue can hold
+	size_t getCapacity() const { return cells.size(); }
+
+	// Returns the policy used when the queue is full
+	GGKUpdateDropPolicy getDropPolicy() const { return dropPolicy; }
+
+	// Returns the number of bytes of memory used by the queue (see `ggkGetMemoryStats()`)
+	size_t getMemoryUsage() const { return sizeof(*this) + cells.capacity() * sizeof(Cell); }
+
+	//
+	// Consumer wakeup
+	//
+
+	// Opens the eventfd that is signaled when updates are added to the queue
+	//
+	// The eventfd is opened once and stays open for the life of the queue (so that a producer can never write to a descriptor that
+	// has been closed and reused while the server runs.) Calling this method again simply returns the existing descriptor.
+	//
+	// Returns the file descriptor, or -1 on failure.
+	int openWakeup();
+
+	// Returns the wakeup file descriptor, or -1 if it has not been opened
+	int getWakeupFd() const { return wakeupFd.load(std::memory_order_acquire); }
+
+	// Signals the wakeup file descriptor, unless a wakeup is already outstanding
+	//
+	// This is called automatically whenever `push()` adds an entry to the queue. It is safe to call from any thread.
+	void wakeup();
+
+	// Consumes an outstanding wakeup
+	//
+	// The consumer should call this before draining the queue, so that entries pushed while it drains will signal again.
+	void acknowledgeWakeup();
+
+private:
+
+	// Removes and returns the interface at the front of the queue, or nullptr if the queue is empty
+	//
+	// Entries that are processed have their time in the queue recorded (see `Stats::updateQueueLatency`); dropped ones don't.
+	const DBusInterface *take(bool recordLatency);
+
+	// Drops the oldest pending update to make room for a newer one
+	//
+	// Returns true if an update was dropped, or false if the queue was emptied in the meantime.
+	bool dropOldest();
+
+	// The storage for a single entry in our ring buffer
+	//
+	// The sequence number tracks which lap of the ring this cell belongs to and whether it currently holds an entry.
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		const DBusInterface *pInterface;
+
+		// When the entry was pushed (see `Stats::updateQueueLatency`)
+		int64_t pushTime;
+	};
+
+	std::vector<Cell> cells;
+	size_t mask;
+	GGKUpdateDropPolicy dropPolicy;
+
+	// Producers and the consumer each only touch their own position; keep them on separate cache lines
+	alignas(64) std::atomic<size_t> enqueuePos;
+	alignas(64) std::atomic<size_t> dequeuePos;
+
+	// Our wakeup eventfd and whether it has been signaled since the consumer last acknowledged it
+	std::atomic<int> wakeupFd;
+	std::atomic<bool> wakeupPending;
+};
+
+// The update queue of the current instance (see Instance.cpp)
+#define TheUpdateQueue (*ggk::Instance::current().pUpdateQueue)
+
+}; // namespace ggk
@@ -361,17 +361,40 @@ GVariant *Utils::gvariantFromByteArray(const std::string &str)
 }
 
 // Returns an array of bytes ("ay") with the contents of the input array of unsigned 8-bit values
+//
+// The bytes are copied once, directly into the GVariant's storage.
 GVariant *Utils::gvariantFromByteArray(const guint8 *pBytes, int count)
 {
-	GBytes *pGbytes = g_bytes_new(pBytes, count);
-	return g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING, pGbytes, count);
+	return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, pBytes, count, sizeof(guint8));
 }
 
 // Returns an array of bytes ("ay") with the contents of the input array of unsigned 8-bit values
-GVariant *Utils::gvariantFromByteArray(const std::vector<guint8> bytes)
+GVariant *Utils::gvariantFromByteArray(const std::vector<guint8> &bytes)
+{
+	return gvariantFromByteArray(bytes.data(), bytes.size());
+}
+
+// Returns an array of bytes ("ay") that takes ownership of the input array's storage rather than copying it
+GVariant *Utils::gvariantFromByteArray(std::vector<guint8> &&bytes)
+{
+	std::vector<guint8> *pOwned = new std::vector<guint8>(std::move(bytes));
+	GBytes *pBytes = g_bytes_new_with_free_func(pOwned->data(), pOwned->size(), [](gpointer pUserData)
+	{
+		delete static_cast<std::vector<guint8> *>(pUserData);
+	}, pOwned);
+
+	GVariant *pVariant = gvariantFromBytes(pBytes);
+	g_bytes_unref(pBytes);
+	return pVariant;
+}
+
+// Returns an array of bytes ("ay") that references the contents of a GBytes buffer without copying it
+//
+// The GVariant holds its own reference to the buffer, so the caller keeps (and must eventually release) its reference. The
+// buffer must not be modified while any GVariant refers to it (GBytes are immutable by contract.)
+GVariant *Utils::gvariantFromBytes(GBytes *pBytes)
 {
-	GBytes *pGbytes = g_bytes_new(bytes.data(), bytes.size());
-	return g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING, pGbytes, bytes.size());
+	return g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING, pBytes, TRUE);
 }
 
 // Returns an array of bytes ("ay") containing a single unsigned 8-bit value
@@ -44,6 +44,7 @@
 #include <gio/gio.h>
 #include <vector>
 #include <string>
+#include <type_traits>
 #include <endian.h>
 
 #include "DBusObjectPath.h"
@@ -148,10 +149,32 @@ struct Utils
 	static GVariant *gvariantFromByteArray(const std::string &str);
 
 	// Returns an array of bytes ("ay") with the contents of the input array of unsigned 8-bit values
+	//
+	// The bytes are copied once, directly into the GVariant's storage.
 	static GVariant *gvariantFromByteArray(const guint8 *pBytes, int count);
 
 	// Returns an array of bytes ("ay") with the contents of the input array of unsigned 8-bit values
-	static GVariant *gvariantFromByteArray(const std::vector<guint8> bytes);
+	static GVariant *gvariantFromByteArray(const std::vector<guint8> &bytes);
+
+	// Returns an array of bytes ("ay") that takes ownership of the input array's storage rather than copying it
+	static GVariant *gvariantFromByteArray(std::vector<guint8> &&bytes);
+
+	// Returns an array of bytes ("ay") that references the contents of a GBytes buffer without copying it
+	//
+	// The GVariant holds its own reference to the buffer, so the caller keeps (and must eventually release) its reference. The
+	// buffer must not be modified while any GVariant refers to it (GBytes are immutable by contract.)
+	static GVariant *gvariantFromBytes(GBytes *pBytes);
+
+	// Returns an array of bytes ("ay") containing the in-memory representation of a plain (trivially copyable) value
+	//
+	// This is useful for packed structures that are sent over the air as-is. The value is copied once, directly into the
+	// GVariant's storage.
+	template<typename T>
+	static GVariant *gvariantFromPlainValue(const T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "gvariantFromPlainValue requires a trivially copyable type");
+		return gvariantFromByteArray(reinterpret_cast<const guint8 *>(&value), sizeof(T));
+	}
 
 	// Returns an array of bytes ("ay") containing a single unsigned 8-bit value
 	static GVariant *gvariantFromByteArray(const guint8 data);
@@ -211,6 +234,28 @@ struct Utils
 
 	// Convert a 32-bit value from host format to HCI format
 	static uint32_t endianToHci(uint32_t value) {return htole32(value);}
+
+	// -----------------------------------------------------------------------------------------------------------------------------
+	// Memory accounting (see `ggkGetMemoryStats()`)
+	//
+	// These estimate what each structure has allocated beyond its own size. They can't see the allocator's overhead, so they
+	// undercount a little, but they are cheap and good enough to budget with.
+	// -----------------------------------------------------------------------------------------------------------------------------
+
+	// Returns the number of bytes a string has allocated for its text (nothing, if the text fits within the string itself)
+	static size_t memoryUsage(const std::string &str) { return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0; }
+
+	// Returns the number of bytes a GVariant holds for its value (or 0 for nullptr)
+	static size_t memoryUsage(GVariant *pVariant) { return nullptr == pVariant ? 0 : g_variant_get_size(pVariant); }
+
+	// Returns the number of bytes a hash table (such as an `std::unordered_map`) has allocated for its buckets and entries
+	//
+	// Each entry is stored in its own node, along with a link to the next node and (typically) its hash.
+	template<typename T>
+	static size_t hashTableMemoryUsage(const T &table)
+	{
+		return table.bucket_count() * sizeof(void *) + table.size() * (sizeof(typename T::value_type) + 2 * sizeof(void *));
+	}
 };
 
 }; // namespace ggk
\ No newline at end of file
@@ -0,0 +1,218 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A small, bounded pool of worker threads for handlers that would otherwise block our GLib main loop.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// Every D-Bus method call, property access, notification and timer runs on our one GLib main loop thread. That's what keeps the
+// server simple, but it also means a handler that does something slow (database or network I/O, for example) stalls everything
+// else behind it.
+//
+// Handlers registered with `GattCharacteristic::onReadValueAsync()` or `onWriteValueAsync()` run on this pool instead. They are
+// handed an `AsyncReply` (see AsyncReply.h) which owns the method invocation and may be completed from any thread; the reply
+// itself is always sent from the main loop (see `invokeOnMainContext()`.)
+//
+// The pool is bounded in both directions: a fixed number of threads, and a fixed number of jobs waiting for one. When the queue
+// is full, new jobs are refused rather than queued without limit, so a client hammering a slow characteristic gets an error back
+// instead of growing our memory and its own latency. The threads are started on the first job, so servers that never use async
+// handlers never create them.
+//
+// Each server instance has a pool of its own, whose threads work with that instance (see Instance.cpp.) The pool is stopped when
+// the server shuts down. Jobs that are running are allowed to finish; jobs still waiting are discarded.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <glib.h>
+
+#include "WorkerPool.h"
+#include "Logger.h"
+#include "MainContext.h"
+
+namespace ggk {
+
+// Construct the pool for `owner`, which its threads work with (see `InstanceScope`)
+WorkerPool::WorkerPool(Instance &owner)
+: owner(owner), threadCount(kDefaultThreadCount), maxPendingJobs(kDefaultMaxPendingJobs), stopping(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+// Sets the number of worker threads and the number of jobs that may wait for one
+//
+// This may only be done while the pool is stopped. Returns false if the pool is running or a value is out of range.
+bool WorkerPool::configure(int newThreadCount, int newMaxPendingJobs)
+{
+	if (newThreadCount < 1 || newThreadCount > 64 || newMaxPendingJobs < 1)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!threads.empty())
+	{
+		return false;
+	}
+
+	threadCount = newThreadCount;
+	maxPendingJobs = static_cast<size_t>(newMaxPendingJobs);
+	return true;
+}
+
+// Queues a job to be run on one of the worker threads, starting the workers if they aren't already running
+//
+// This method may be called from any thread. Returns false if the queue is full or the pool is stopping, in which case the job
+// is not run (and is destroyed before this method returns.)
+bool WorkerPool::submit(Job job)
+{
+	bool wasStopping = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wasStopping = stopping;
+		if (!stopping && jobs.size() < maxPendingJobs)
+		{
+			if (threads.empty())
+			{
+				LOG_DEBUG("Starting " << threadCount << " worker thread(s)");
+				for (int i = 0; i < threadCount; ++i)
+				{
+					threads.push_back(std::thread(&WorkerPool::run, this));
+				}
+			}
+
+			jobs.push_back(std::move(job));
+			jobAvailable.notify_one();
+			return true;
+		}
+	}
+
+	// The refused job is destroyed when we return, outside of our lock (its destructor may well queue a reply)
+	Logger::warn(SSTR << "Worker pool is " << (wasStopping ? "stopping" : "full") << "; refusing job");
+	return false;
+}
+
+// Stops the worker threads, waiting for jobs already in progress to finish
+//
+// Jobs still waiting for a worker are discarded. The pool may be started again by submitting another job.
+void WorkerPool::stop()
+{
+	std::vector<std::thread> stoppingThreads;
+	std::deque<Job> discardedJobs;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (threads.empty())
+		{
+			return;
+		}
+
+		stopping = true;
+		stoppingThreads.swap(threads);
+		discardedJobs.swap(jobs);
+		jobAvailable.notify_all();
+	}
+
+	for (std::thread &thread : stoppingThreads)
+	{
+		thread.join();
+	}
+
+	if (!discardedJobs.empty())
+	{
+		Logger::warn(SSTR << "Discarding " << discardedJobs.size() << " unstarted worker job(s)");
+	}
+	discardedJobs.clear();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stopping = false;
+}
+
+// Returns the number of jobs waiting for a worker
+size_t WorkerPool::getPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return jobs.size();
+}
+
+// Runs `job` on our GLib main loop thread
+//
+// If called from the main loop thread, the job runs immediately. Otherwise it runs on the next main loop iteration. This is
+// how work done on a worker thread gets its results back into the server.
+void WorkerPool::invokeOnMainContext(Job job)
+{
+	invokeOnMainContext(MainContext::get(), std::move(job));
+}
+
+// Runs `job` on the thread that iterates `pContext`
+//
+// Use this from threads that may not have the right instance selected (see `AsyncReply`), with the context captured while
+// they did.
+void WorkerPool::invokeOnMainContext(GMainContext *pContext, Job job)
+{
+	g_main_context_invoke_full
+	(
+		pContext,                       // GMainContext *context
+		G_PRIORITY_DEFAULT,             // gint priority
+		[] (gpointer pUserData) -> gboolean
+		{
+			(*static_cast<Job *>(pUserData))();
+			return G_SOURCE_REMOVE;
+		},
+		new Job(std::move(job)),        // gpointer data
+		[] (gpointer pUserData)         // GDestroyNotify notify
+		{
+			delete static_cast<Job *>(pUserData);
+		}
+	);
+}
+
+// The body of each worker thread
+void WorkerPool::run()
+{
+	InstanceScope scope(owner);
+
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+}; // namespace ggk
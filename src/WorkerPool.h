@@ -0,0 +1,113 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// A small, bounded pool of worker threads for handlers that would otherwise block our GLib main loop.
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// See the discussion at the top of WorkerPool.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Instance.h"
+
+namespace ggk {
+
+struct WorkerPool
+{
+	// A unit of work
+	typedef std::function<void()> Job;
+
+	// The number of worker threads used unless configured otherwise
+	static const int kDefaultThreadCount = 2;
+
+	// The number of jobs that may wait for a worker unless configured otherwise
+	static const int kDefaultMaxPendingJobs = 64;
+
+	// Construct the pool for `owner`, which its threads work with (see `InstanceScope`)
+	explicit WorkerPool(Instance &owner);
+	~WorkerPool();
+
+	// Sets the number of worker threads and the number of jobs that may wait for one
+	//
+	// This may only be done while the pool is stopped. Returns false if the pool is running or a value is out of range.
+	bool configure(int threadCount, int maxPendingJobs);
+
+	// Queues a job to be run on one of the worker threads, starting the workers if they aren't already running
+	//
+	// This method may be called from any thread. Returns false if the queue is full or the pool is stopping, in which case the job
+	// is not run (and is destroyed before this method returns.)
+	bool submit(Job job);
+
+	// Stops the worker threads, waiting for jobs already in progress to finish
+	//
+	// Jobs still waiting for a worker are discarded. The pool may be started again by submitting another job.
+	void stop();
+
+	// Returns the number of jobs waiting for a worker
+	size_t getPendingCount() const;
+
+	// Runs `job` on our GLib main loop thread
+	//
+	// If called from the main loop thread, the job runs immediately. Otherwise it runs on the next main loop iteration. This is
+	// how work done on a worker thread gets its results back into the server.
+	static void invokeOnMainContext(Job job);
+
+	// Runs `job` on the thread that iterates `pContext`
+	//
+	// Use this from threads that may not have the right instance selected (see `AsyncReply`), with the context captured while
+	// they did.
+	static void invokeOnMainContext(GMainContext *pContext, Job job);
+
+private:
+
+	// The body of each worker thread
+	void run();
+
+	Instance &owner;
+	int threadCount;
+	size_t maxPendingJobs;
+
+	mutable std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::deque<Job> jobs;
+	std::vector<std::thread> threads;
+	bool stopping;
+};
+
+// The worker pool of the current instance (see Instance.cpp)
+#define TheWorkerPool (*ggk::Instance::current().pWorkerPool)
+
+}; // namespace ggk
@@ -0,0 +1,717 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Micro-benchmarks for the hot paths of the server
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// This program builds the server description from Server.cpp and measures the code that runs for every update, notification
+// and D-Bus request, without a Bluetooth controller or a running BlueZ:
+//
+//     * `find_interface`             Server::findInterface() over every interface in the description (and a miss)
+//     * `update_queue`               ggkPushUpdateQueue() from 1, 2 and 4 producer threads, drained by ggkPopUpdateQueue()
+//     * `introspection_xml`          DBusObject::generateIntrospectionXML() for every object
+//     * `introspection_parse`        Parsing that XML, which is what a cold registration pays
+//     * `gvariant_from_byte_array`   Utils::gvariantFromByteArray() for a range of value sizes
+//     * `memory_default`             ggkGetMemoryStats() for the description, in the default and low-memory profiles
+//       `memory_low`                 (this reports bytes rather than timing anything)
+//
+// If a session bus is available, we also claim "org.bluez" on it with a mock (see MockBluez.cpp), export our objects and measure:
+//
+//     * `get_managed_objects`        The GetManagedObjects round trip, with the reply cached (warm) and rebuilt (cold)
+//     * `register_application`       The RegisterApplication round trip, which includes the mock reading back our objects
+//     * `notifications`              PropertiesChanged emission rate, and the rate at which the mock receives them
+//
+// To keep the numbers repeatable, run it on a private bus:
+//
+//     dbus-run-session -- ./benchmarks
+//
+// Results are written to stdout as JSON, one object per line, so they can be collected and compared by scripts. Every line has
+// at least "benchmark", "iterations" and "ns_per_op"; other fields depend on the benchmark. Use `--iterations <n>` to change
+// the base iteration count and `--filter <text>` to only run benchmarks whose names contain the given text.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../include/Gobbledegook.h"
+#include "Server.h"
+#include "ServerUtils.h"
+#include "DBusObject.h"
+#include "DBusInterface.h"
+#include "GattCharacteristic.h"
+#include "GattProperty.h"
+#include "GattUuid.h"
+#include "Stats.h"
+#include "Utils.h"
+#include "Instance.h"
+#include "MainContext.h"
+#include "MockBluez.h"
+
+using namespace ggk;
+
+//
+// Results
+//
+
+typedef std::vector<std::pair<std::string, double>> Extras;
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t baseIterations = 100000;
+static std::string filter;
+
+// Returns true if the benchmark with the given name should be run
+static bool selected(const char *pName)
+{
+	return filter.empty() || strstr(pName, filter.c_str()) != nullptr;
+}
+
+// Returns the nanoseconds elapsed since `start`
+static double elapsedNanoseconds(Clock::time_point start)
+{
+	return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+// Writes a single result as a line of JSON
+static void report(const char *pName, uint64_t iterations, double nanoseconds, const Extras &extras = Extras())
+{
+	printf("{\"benchmark\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.1f", pName, static_cast<unsigned long long>(iterations),
+		iterations == 0 ? 0.0 : nanoseconds / static_cast<double>(iterations));
+
+	for (const auto &extra : extras)
+	{
+		printf(",\"%s\":%.1f", extra.first.c_str(), extra.second);
+	}
+
+	printf("}\n");
+	fflush(stdout);
+}
+
+// Writes a line explaining why a benchmark was skipped
+static void reportSkipped(const char *pName, const char *pReason)
+{
+	printf("{\"benchmark\":\"%s\",\"skipped\":\"%s\"}\n", pName, pReason);
+	fflush(stdout);
+}
+
+//
+// The server description
+//
+// The description's callbacks are never called with real data here, so the accessors have nothing to offer.
+//
+
+static const void *dataGetter(const char */*pName*/)
+{
+	return nullptr;
+}
+
+static int dataSetter(const char */*pName*/, const void */*pData*/)
+{
+	return 0;
+}
+
+// Collects the (path, interface name) of every interface in the description
+static void collectInterfaces(const DBusObject &object, std::vector<std::pair<std::string, std::string>> &interfaces)
+{
+	std::string path = object.getPath().toString();
+	for (const std::shared_ptr<DBusInterface> &pInterface : object.getInterfaces())
+	{
+		interfaces.push_back(std::make_pair(path, pInterface->getName()));
+	}
+
+	for (const DBusObject &child : object.getChildren())
+	{
+		collectInterfaces(child, interfaces);
+	}
+}
+
+// Collects every object in the description
+static void collectObjects(const DBusObject &object, std::vector<const DBusObject *> &objects)
+{
+	objects.push_back(&object);
+	for (const DBusObject &child : object.getChildren())
+	{
+		collectObjects(child, objects);
+	}
+}
+
+//
+// Benchmarks that don't need a bus
+//
+
+static void benchFindInterface(const std::vector<std::pair<std::string, std::string>> &interfaces)
+{
+	if (!selected("find_interface")) { return; }
+
+	uint64_t iterations = baseIterations * 10;
+	uint64_t found = 0;
+
+	Clock::time_point start = Clock::now();
+	for (uint64_t i = 0; i < iterations; ++i)
+	{
+		const auto &entry = interfaces[i % interfaces.size()];
+		found += TheServer->findInterface(entry.first, entry.second) != nullptr ? 1 : 0;
+	}
+	report("find_interface", iterations, elapsedNanoseconds(start), {{"interfaces", interfaces.size()}, {"found", found}});
+
+	std::string missingPath = "/com/gobbledegook/no/such/object";
+	std::string missingName = "org.bluez.GattCharacteristic1";
+	found = 0;
+
+	start = Clock::now();
+	for (uint64_t i = 0; i < iterations; ++i)
+	{
+		found += TheServer->findInterface(missingPath, missingName) != nullptr ? 1 : 0;
+	}
+	report("find_interface_miss", iterations, elapsedNanoseconds(start), {{"found", found}});
+}
+
+static void benchUpdateQueue(const std::vector<std::pair<std::string, std::string>> &interfaces, int producerCount)
+{
+	std::string name = "update_queue_" + std::to_string(producerCount) + "p";
+	if (!selected(name.c_str())) { return; }
+
+	ggkUpdateQueueClear();
+	uint64_t coalescedBefore = TheStats.updatesCoalesced.load();
+	uint64_t droppedBefore = TheStats.updatesDropped.load();
+
+	uint64_t pushesPerProducer = baseIterations / producerCount;
+	std::atomic<int> producersRunning(producerCount);
+	std::atomic<uint64_t> pushFailures(0);
+	std::atomic<uint64_t> pops(0);
+
+	Clock::time_point start = Clock::now();
+
+	// A single consumer drains the queue the way an application would, until the producers are done and the queue is empty
+	std::thread consumer([&]()
+	{
+		char element[256];
+		for (;;)
+		{
+			int result = ggkPopUpdateQueue(element, sizeof(element), 0);
+			if (result == 1)
+			{
+				pops.fetch_add(1, std::memory_order_relaxed);
+			}
+			else if (producersRunning.load(std::memory_order_acquire) == 0 && ggkUpdateQueueIsEmpty())
+			{
+				break;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	// Each producer updates its own share of the interfaces, so producers don't coalesce with each other
+	std::vector<std::thread> producers;
+	for (int producer = 0; producer < producerCount; ++producer)
+	{
+		producers.push_back(std::thread([&, producer]()
+		{
+			size_t index = producer;
+			for (uint64_t i = 0; i < pushesPerProducer; ++i)
+			{
+				const auto &entry = interfaces[index];
+				if (0 == ggkPushUpdateQueue(entry.first.c_str(), entry.second.c_str()))
+				{
+					pushFailures.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				index += producerCount;
+				if (index >= interfaces.size())
+				{
+					index = producer % interfaces.size();
+				}
+			}
+
+			producersRunning.fetch_sub(1, std::memory_order_acq_rel);
+		}));
+	}
+
+	for (std::thread &producer : producers)
+	{
+		producer.join();
+	}
+	consumer.join();
+
+	double nanoseconds = elapsedNanoseconds(start);
+	uint64_t pushes = pushesPerProducer * producerCount;
+	report(name.c_str(), pushes, nanoseconds,
+	{
+		{"producers", producerCount},
+		{"pushes_per_sec", pushes * 1e9 / nanoseconds},
+		{"pops", pops.load()},
+		{"coalesced", TheStats.updatesCoalesced.load() - coalescedBefore},
+		{"dropped", TheStats.updatesDropped.load() - droppedBefore},
+		{"failed", pushFailures.load()},
+		{"max_depth", TheStats.updateQueueMaxDepth.load()}
+	});
+}
+
+static void benchIntrospection()
+{
+	uint64_t iterations = baseIterations / 100 + 1;
+
+	if (selected("introspection_xml"))
+	{
+		size_t bytes = 0;
+		Clock::time_point start = Clock::now();
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			bytes = 0;
+			for (const DBusObject &object : TheServer->getObjects())
+			{
+				bytes += object.generateIntrospectionXML().length();
+			}
+		}
+		report("introspection_xml", iterations, elapsedNanoseconds(start), {{"bytes", bytes}});
+	}
+
+	if (selected("introspection_parse"))
+	{
+		std::vector<std::string> documents;
+		for (const DBusObject &object : TheServer->getObjects())
+		{
+			documents.push_back(object.generateIntrospectionXML());
+		}
+
+		Clock::time_point start = Clock::now();
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			for (const std::string &xml : documents)
+			{
+				GDBusNodeInfo *pNode = g_dbus_node_info_new_for_xml(xml.c_str(), nullptr);
+				if (nullptr != pNode)
+				{
+					g_dbus_node_info_unref(pNode);
+				}
+			}
+		}
+		report("introspection_parse", iterations, elapsedNanoseconds(start), {{"documents", documents.size()}});
+	}
+}
+
+static void benchGVariantFromByteArray()
+{
+	if (!selected("gvariant_from_byte_array")) { return; }
+
+	// A single byte (ex: battery level), a default-MTU payload, a 2M PHY/DLE payload and the largest attribute value
+	static const size_t kSizes[] = { 1, 20, 244, 512 };
+	std::vector<guint8> buffer(512, 0x5a);
+
+	for (size_t size : kSizes)
+	{
+		uint64_t iterations = baseIterations * 2;
+		Clock::time_point start = Clock::now();
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			GVariant *pVariant = g_variant_ref_sink(Utils::gvariantFromByteArray(buffer.data(), static_cast<int>(size)));
+			g_variant_unref(pVariant);
+		}
+
+		std::string name = "gvariant_from_byte_array_" + std::to_string(size);
+		report(name.c_str(), iterations, elapsedNanoseconds(start), {{"bytes", size}});
+	}
+}
+
+// Reports the memory used by the current instance
+static void reportMemory(const char *pName)
+{
+	GGKMemoryStats stats;
+	ggkGetMemoryStats(&stats);
+	report(pName, 1, 0,
+		{{"server_description", stats.serverDescription}, {"introspection_cache", stats.introspectionCache},
+		 {"managed_objects_cache", stats.managedObjectsCache}, {"update_queue", stats.updateQueue},
+		 {"data_store", stats.dataStore}, {"characteristic_handles", stats.characteristicHandles},
+		 {"hci_buffers", stats.hciBuffers}, {"total", stats.total}});
+}
+
+static void benchMemory()
+{
+	if (!selected("memory")) { return; }
+
+	// The default instance holds the description the other benchmarks use
+	TheServer->trimCaches();
+	reportMemory("memory_default");
+
+	// The same description, built in a fresh instance in the low-memory profile
+	Instance instance;
+	InstanceScope scope(instance);
+	instance.setLowMemory(true);
+	TheServer = std::make_shared<Server>("gobbledegook", "Gobbledegook", "Gobbledegook", dataGetter, dataSetter);
+	reportMemory("memory_low");
+	TheServer = nullptr;
+}
+
+//
+// Benchmarks that run over a bus
+//
+// Our objects and the mock BlueZ are both served from a main loop on a thread of their own, while the benchmarks make blocking
+// calls from the main thread through separate connections. This is the same arrangement as a real deployment: the server's
+// main loop answers while somebody else waits on the bus.
+//
+
+// Our object handlers, which dispatch to the server just like the handlers in Init.cpp
+static void onMethodCall(GDBusConnection *pConnection, const gchar */*pSender*/, const gchar *pObjectPath, const gchar *pInterfaceName,
+	const gchar *pMethodName, GVariant *pParameters, GDBusMethodInvocation *pInvocation, gpointer pUserData)
+{
+	if (!TheServer->callMethod(pObjectPath, pInterfaceName, pMethodName, pConnection, pParameters, pInvocation, pUserData))
+	{
+		g_dbus_method_invocation_return_dbus_error(pInvocation, "org.freedesktop.DBus.Error.UnknownMethod", "Method not found");
+	}
+}
+
+static GVariant *onGetProperty(GDBusConnection *pConnection, const gchar *pSender, const gchar *pObjectPath, const gchar *pInterfaceName,
+	const gchar *pPropertyName, GError **ppError, gpointer pUserData)
+{
+	const GattProperty *pProperty = TheServer->findProperty(pObjectPath, pInterfaceName, pPropertyName);
+	if (nullptr != pProperty && pProperty->isImmutable() && nullptr != pProperty->getValue())
+	{
+		return pProperty->getValueReference();
+	}
+
+	if (nullptr == pProperty || !pProperty->getGetterFunc())
+	{
+		g_set_error(ppError, G_IO_ERROR, G_IO_ERROR_FAILED, "Property not found: %s", pPropertyName);
+		return nullptr;
+	}
+
+	return pProperty->getGetterFunc()(pConnection, pSender, pObjectPath, pInterfaceName, pPropertyName, ppError, pUserData);
+}
+
+// Registers a node and its children on `pConnection`, adding the registration ids to `ids`
+static bool registerNode(GDBusConnection *pConnection, GDBusNodeInfo *pNode, const std::string &path, std::vector<guint> &ids)
+{
+	static GDBusInterfaceVTable interfaceVtable;
+	interfaceVtable.method_call = onMethodCall;
+	interfaceVtable.get_property = onGetProperty;
+	interfaceVtable.set_property = nullptr;
+
+	for (GDBusInterfaceInfo **ppInterface = pNode->interfaces; nullptr != *ppInterface; ++ppInterface)
+	{
+		guint id = g_dbus_connection_register_object(pConnection, path.c_str(), *ppInterface, &interfaceVtable, nullptr, nullptr, nullptr);
+		if (0 == id)
+		{
+			return false;
+		}
+		ids.push_back(id);
+	}
+
+	for (GDBusNodeInfo **ppChild = pNode->nodes; nullptr != *ppChild; ++ppChild)
+	{
+		std::string childPath = (path == "/" ? "" : path) + "/" + (*ppChild)->path;
+		if (!registerNode(pConnection, *ppChild, childPath, ids))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Opens a private connection to the bus at `address`
+static GDBusConnection *connect(const gchar *pAddress)
+{
+	GDBusConnectionFlags flags = static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+	return g_dbus_connection_new_for_address_sync(pAddress, flags, nullptr, nullptr, nullptr);
+}
+
+// Calls `GetManagedObjects` on our application
+static bool callGetManagedObjects(GDBusConnection *pConnection, const gchar *pApplicationName)
+{
+	GVariant *pReply = g_dbus_connection_call_sync(pConnection, pApplicationName, "/", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects",
+		nullptr, G_VARIANT_TYPE("(a{oa{sa{sv}}})"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+	if (nullptr == pReply)
+	{
+		return false;
+	}
+
+	g_variant_unref(pReply);
+	return true;
+}
+
+static void benchGetManagedObjects(GDBusConnection *pClientConnection, const gchar *pApplicationName, const std::vector<const DBusObject *> &objects)
+{
+	if (!selected("get_managed_objects")) { return; }
+
+	uint64_t iterations = baseIterations / 100 + 1;
+	uint64_t failures = 0;
+
+	Clock::time_point start = Clock::now();
+	for (uint64_t i = 0; i < iterations; ++i)
+	{
+		failures += callGetManagedObjects(pClientConnection, pApplicationName) ? 0 : 1;
+	}
+	report("get_managed_objects_warm", iterations, elapsedNanoseconds(start), {{"failures", failures}});
+
+	// Discarding every cached entry forces the full reply to be rebuilt, as it is the first time BlueZ asks
+	failures = 0;
+	double nanoseconds = 0;
+	for (uint64_t i = 0; i < iterations; ++i)
+	{
+		for (const DBusObject *pObject : objects)
+		{
+			const_cast<DBusObject *>(pObject)->invalidateManagedObjects();
+		}
+
+		start = Clock::now();
+		failures += callGetManagedObjects(pClientConnection, pApplicationName) ? 0 : 1;
+		nanoseconds += elapsedNanoseconds(start);
+	}
+	report("get_managed_objects_cold", iterations, nanoseconds, {{"objects", objects.size()}, {"failures", failures}});
+}
+
+static void benchRegisterApplication(GDBusConnection *pApplicationConnection, MockBluez &bluez)
+{
+	if (!selected("register_application")) { return; }
+
+	uint64_t iterations = baseIterations / 100 + 1;
+	int registeredBefore = bluez.getApplicationsRegistered();
+
+	Clock::time_point start = Clock::now();
+	for (uint64_t i = 0; i < iterations; ++i)
+	{
+		g_auto(GVariantBuilder) builder;
+		g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+		GVariant *pReply = g_dbus_connection_call_sync(pApplicationConnection, "org.bluez", MockBluez::kAdapterPath, "org.bluez.GattManager1",
+			"RegisterApplication", g_variant_new("(oa{sv})", "/", &builder), nullptr, G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+		if (nullptr != pReply)
+		{
+			g_variant_unref(pReply);
+		}
+	}
+
+	report("register_application", iterations, elapsedNanoseconds(start),
+	{
+		{"registered", bluez.getApplicationsRegistered() - registeredBefore},
+		{"objects", bluez.getManagedObjectCount()}
+	});
+}
+
+// Shared between the benchmark thread and the main loop while sending notifications
+struct NotificationRun
+{
+	GDBusConnection *pConnection;
+	const GattCharacteristic *pCharacteristic;
+	uint64_t count;
+	double emitNanoseconds;
+	std::atomic<bool> done;
+};
+
+static void benchNotifications(GDBusConnection *pApplicationConnection, MockBluez &bluez)
+{
+	if (!selected("notifications")) { return; }
+
+	// The battery level is a single-byte notifying characteristic in the standard server description
+	const GattCharacteristic *pCharacteristic = TheServer->findCharacteristic(GattUuid("2A19"));
+	if (nullptr == pCharacteristic)
+	{
+		reportSkipped("notifications", "no battery level characteristic in the server description");
+		return;
+	}
+
+	NotificationRun run;
+	run.pConnection = pApplicationConnection;
+	run.pCharacteristic = pCharacteristic;
+	run.count = baseIterations / 10 + 1;
+	run.emitNanoseconds = 0;
+	run.done = false;
+
+	pCharacteristic->setNotifying(true);
+	bluez.resetNotificationsReceived();
+	uint64_t sentBefore = TheStats.notificationsSent.load();
+
+	// Notifications must be sent from the main loop. We flush after each one so batching doesn't fold them together.
+	g_main_context_invoke(MainContext::get(), [](gpointer pUserData) -> gboolean
+	{
+		NotificationRun *pRun = static_cast<NotificationRun *>(pUserData);
+		Clock::time_point start = Clock::now();
+		for (uint64_t i = 0; i < pRun->count; ++i)
+		{
+			pRun->pCharacteristic->sendChangeNotificationValue(pRun->pConnection, static_cast<uint8_t>(i));
+			GattCharacteristic::flushBatchedChangeNotifications();
+		}
+		g_dbus_connection_flush_sync(pRun->pConnection, nullptr, nullptr);
+		pRun->emitNanoseconds = elapsedNanoseconds(start);
+		pRun->done.store(true, std::memory_order_release);
+		return G_SOURCE_REMOVE;
+	}, &run);
+
+	Clock::time_point start = Clock::now();
+	while (!run.done.load(std::memory_order_acquire))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// Give the mock a moment to receive everything we sent
+	while (bluez.getNotificationsReceived() < run.count && elapsedNanoseconds(start) < 10e9)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	double deliverNanoseconds = elapsedNanoseconds(start);
+
+	pCharacteristic->setNotifying(false);
+
+	uint64_t delivered = bluez.getNotificationsReceived();
+	report("notifications", run.count, run.emitNanoseconds,
+	{
+		{"emitted_per_sec", run.count * 1e9 / run.emitNanoseconds},
+		{"sent", TheStats.notificationsSent.load() - sentBefore},
+		{"delivered", delivered},
+		{"delivered_per_sec", delivered * 1e9 / deliverNanoseconds}
+	});
+}
+
+static void runBusBenchmarks(const std::vector<const DBusObject *> &objects)
+{
+	gchar *pAddress = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+	GDBusConnection *pApplicationConnection = nullptr == pAddress ? nullptr : connect(pAddress);
+	GDBusConnection *pBluezConnection = nullptr == pAddress ? nullptr : connect(pAddress);
+	GDBusConnection *pClientConnection = nullptr == pAddress ? nullptr : connect(pAddress);
+	g_free(pAddress);
+
+	MockBluez bluez;
+	std::vector<guint> ids;
+	bool ready = nullptr != pApplicationConnection && nullptr != pBluezConnection && nullptr != pClientConnection;
+
+	// Register everything against the server's main context, just as the server thread does (see MainContext.cpp)
+	g_main_context_push_thread_default(MainContext::get());
+
+	if (!ready)
+	{
+		reportSkipped("bus", "no session bus (try running under dbus-run-session)");
+	}
+	else if (!bluez.start(pBluezConnection))
+	{
+		reportSkipped("bus", "unable to own org.bluez on the session bus");
+		ready = false;
+	}
+	else
+	{
+		for (const DBusObject &object : TheServer->getObjects())
+		{
+			GDBusNodeInfo *pNode = object.getIntrospectionNodeInfo();
+			ready = ready && nullptr != pNode && registerNode(pApplicationConnection, pNode, pNode->path, ids);
+		}
+
+		if (!ready)
+		{
+			reportSkipped("bus", "unable to register our objects");
+		}
+	}
+
+	g_main_context_pop_thread_default(MainContext::get());
+
+	// Both the mock and our objects were registered with the server's main context, which this loop serves
+	GMainLoop *pLoop = g_main_loop_new(MainContext::get(), FALSE);
+	std::thread loopThread([pLoop]() { g_main_loop_run(pLoop); });
+
+	if (ready)
+	{
+		const gchar *pApplicationName = g_dbus_connection_get_unique_name(pApplicationConnection);
+		benchGetManagedObjects(pClientConnection, pApplicationName, objects);
+		benchRegisterApplication(pApplicationConnection, bluez);
+		benchNotifications(pApplicationConnection, bluez);
+	}
+
+	for (guint id : ids)
+	{
+		g_dbus_connection_unregister_object(pApplicationConnection, id);
+	}
+	bluez.stop();
+
+	g_main_loop_quit(pLoop);
+	loopThread.join();
+	g_main_loop_unref(pLoop);
+
+	for (GDBusConnection *pConnection : { pApplicationConnection, pBluezConnection, pClientConnection })
+	{
+		if (nullptr != pConnection)
+		{
+			g_dbus_connection_close_sync(pConnection, nullptr, nullptr);
+			g_object_unref(pConnection);
+		}
+	}
+}
+
+int main(int argc, char **ppArgv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = ppArgv[i];
+		if (arg == "--iterations" && i + 1 < argc)
+		{
+			baseIterations = strtoull(ppArgv[++i], nullptr, 10);
+		}
+		else if (arg == "--filter" && i + 1 < argc)
+		{
+			filter = ppArgv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--iterations <n>] [--filter <text>]\n", ppArgv[0]);
+			return -1;
+		}
+	}
+
+	if (baseIterations < 100)
+	{
+		baseIterations = 100;
+	}
+
+	// We build the server directly rather than via `ggkStart()`, since we don't want the adapter configuration or BlueZ
+	TheServer = std::make_shared<Server>("gobbledegook", "Gobbledegook", "Gobbledegook", dataGetter, dataSetter);
+
+	std::vector<std::pair<std::string, std::string>> interfaces;
+	std::vector<const DBusObject *> objects;
+	for (const DBusObject &object : TheServer->getObjects())
+	{
+		collectInterfaces(object, interfaces);
+		collectObjects(object, objects);
+	}
+
+	benchFindInterface(interfaces);
+	benchUpdateQueue(interfaces, 1);
+	benchUpdateQueue(interfaces, 2);
+	benchUpdateQueue(interfaces, 4);
+	benchIntrospection();
+	benchGVariantFromByteArray();
+	benchMemory();
+	runBusBenchmarks(objects);
+
+	TheServer = nullptr;
+	return 0;
+}
@@ -0,0 +1,395 @@
+// Copyright 2017 Paul Nettle.
+//
+// This file is part of Gobbledegook.
+//
+// Gobbledegook is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Gobbledegook is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gobbledegook.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// >>
+// >>>  INSIDE THIS FILE
+// >>
+//
+// Replays a recorded trace through the server, for profiling and benchmarking without a radio
+//
+// >>
+// >>>  DISCUSSION
+// >>
+//
+// A trace (see Trace.cpp, and `ggkStartTrace()` or the standalone server's `-t` option) holds the management events and D-Bus
+// requests a real server received. This program builds the server description from Server.cpp and feeds the trace back into it:
+//
+//     * HCI events are handed to `HciAdapter::processEvent()`, the same code the HCI event thread runs for each packet it reads.
+//
+//     * D-Bus requests are sent from a client connection to our objects, which are exported on the session bus with the server's
+//       own dispatch vtable (see `getInterfaceVtable()` in Init.cpp), so they arrive through `onMethodCall()`, `onGetProperty()`
+//       and `onSetProperty()` just as BlueZ's would. Replies are collected asynchronously, so a burst of slow requests overlaps
+//       the way it did when it was recorded.
+//
+// By default, records are replayed at the pace they were recorded. Use `--max-speed` to send them back to back (with up to
+// kMaxOutstandingCalls requests in flight), which is the way to find out how much load the server can take. Object paths in
+// the trace include the service name the server was started with, so pass `--service <name>` if it wasn't "gobbledegook".
+//
+// The single result is written to stdout as a line of JSON, in the same shape as the benchmarks (see benchmarks.cpp.) If there
+// is no session bus, only the HCI events are replayed, so run it on a private bus to replay everything:
+//
+//     dbus-run-session -- ./replay --max-speed trace.ggkt
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/Gobbledegook.h"
+#include "Server.h"
+#include "DBusObject.h"
+#include "HciAdapter.h"
+#include "Stats.h"
+#include "MainContext.h"
+#include "Init.h"
+#include "Trace.h"
+
+using namespace ggk;
+
+// The most requests we'll have waiting for a reply at once
+static const int kMaxOutstandingCalls = 64;
+
+// The size of the buffer HCI events are replayed from (the same size as the HCI socket's receive buffer)
+static const size_t kEventBufferSize = 64 * 1024;
+
+// What we've replayed so far
+struct ReplayState
+{
+	ReplayState() : hciEvents(0), methodCalls(0), propertyGets(0), propertySets(0), errors(0), skipped(0), outstanding(0) {}
+
+	uint64_t hciEvents;
+	uint64_t methodCalls;
+	uint64_t propertyGets;
+	uint64_t propertySets;
+	uint64_t errors;
+	uint64_t skipped;
+	int outstanding;
+};
+
+//
+// The server description
+//
+// A replay has no application behind it, so the accessors have nothing to offer.
+//
+
+static const void *dataGetter(const char */*pName*/)
+{
+	return nullptr;
+}
+
+static int dataSetter(const char */*pName*/, const void */*pData*/)
+{
+	return 0;
+}
+
+//
+// The bus
+//
+
+// Registers a node and its children on `pConnection` with the server's dispatch vtable, adding the registration ids to `ids`
+static bool registerNode(GDBusConnection *pConnection, GDBusNodeInfo *pNode, const std::string &path, std::vector<guint> &ids)
+{
+	for (GDBusInterfaceInfo **ppInterface = pNode->interfaces; nullptr != *ppInterface; ++ppInterface)
+	{
+		guint id = g_dbus_connection_register_object(pConnection, path.c_str(), *ppInterface, getInterfaceVtable(), nullptr, nullptr, nullptr);
+		if (0 == id)
+		{
+			return false;
+		}
+		ids.push_back(id);
+	}
+
+	for (GDBusNodeInfo **ppChild = pNode->nodes; nullptr != *ppChild; ++ppChild)
+	{
+		std::string childPath = (path == "/" ? "" : path) + "/" + (*ppChild)->path;
+		if (!registerNode(pConnection, *ppChild, childPath, ids))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Opens a private connection to the bus at `address`
+static GDBusConnection *connect(const gchar *pAddress)
+{
+	GDBusConnectionFlags flags = static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+	return g_dbus_connection_new_for_address_sync(pAddress, flags, nullptr, nullptr, nullptr);
+}
+
+// Collects the reply to a replayed request
+static void onReply(GObject *pSource, GAsyncResult *pResult, gpointer pUserData)
+{
+	ReplayState &state = *static_cast<ReplayState *>(pUserData);
+	--state.outstanding;
+
+	GError *pError = nullptr;
+	GVariant *pReply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(pSource), pResult, &pError);
+	if (nullptr == pReply)
+	{
+		++state.errors;
+		g_clear_error(&pError);
+		return;
+	}
+
+	g_variant_unref(pReply);
+}
+
+// Sends a recorded D-Bus request to our application
+//
+// Returns false if the record can't be replayed (a property set without a value, or parameters of the wrong shape.)
+static bool sendRequest(GDBusConnection *pConnection, const gchar *pApplicationName, const TraceRecord &record, ReplayState &state)
+{
+	GVariant *pValue = record.createValue();
+	const char *pInterfaceName = record.interfaceName.c_str();
+	const char *pMemberName = record.memberName.c_str();
+	GVariant *pParameters = nullptr;
+
+	if (record.type == TraceRecord::EMethodCall)
+	{
+		// Method parameters are always a tuple (even an empty one)
+		if (nullptr != pValue && !g_variant_is_of_type(pValue, G_VARIANT_TYPE_TUPLE))
+		{
+			g_variant_unref(g_variant_ref_sink(pValue));
+			return false;
+		}
+		pParameters = pValue;
+	}
+	else if (record.type == TraceRecord::EGetProperty)
+	{
+		if (nullptr != pValue)
+		{
+			g_variant_unref(g_variant_ref_sink(pValue));
+		}
+		pParameters = g_variant_new("(ss)", pInterfaceName, pMemberName);
+		pInterfaceName = "org.freedesktop.DBus.Properties";
+		pMemberName = "Get";
+	}
+	else
+	{
+		if (nullptr == pValue)
+		{
+			return false;
+		}
+		pParameters = g_variant_new("(ssv)", pInterfaceName, pMemberName, pValue);
+		pInterfaceName = "org.freedesktop.DBus.Properties";
+		pMemberName = "Set";
+	}
+
+	g_dbus_connection_call(pConnection, pApplicationName, record.objectPath.c_str(), pInterfaceName, pMemberName, pParameters, nullptr,
+		G_DBUS_CALL_FLAGS_NONE, -1, nullptr, onReply, &state);
+	++state.outstanding;
+	return true;
+}
+
+// Waits until `dueTime` (a monotonic time) has passed and fewer than `maxOutstanding` requests are waiting for a reply, collecting
+// replies as they arrive
+static void waitUntil(GMainContext *pContext, gint64 dueTime, int maxOutstanding, ReplayState &state)
+{
+	for (;;)
+	{
+		while (g_main_context_iteration(pContext, FALSE)) {}
+
+		gint64 remaining = dueTime - g_get_monotonic_time();
+		if (remaining <= 0 && state.outstanding < maxOutstanding)
+		{
+			return;
+		}
+
+		// With the window full we can block, since a reply (or a timeout) is on its way
+		if (state.outstanding >= maxOutstanding)
+		{
+			g_main_context_iteration(pContext, TRUE);
+		}
+		else
+		{
+			g_usleep(static_cast<gulong>(remaining < 1000 ? remaining : 1000));
+		}
+	}
+}
+
+int main(int argc, char **ppArgv)
+{
+	std::string tracePath;
+	std::string serviceName = "gobbledegook";
+	bool maxSpeed = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = ppArgv[i];
+		if (arg == "--max-speed")
+		{
+			maxSpeed = true;
+		}
+		else if (arg == "--service" && i + 1 < argc)
+		{
+			serviceName = ppArgv[++i];
+		}
+		else if (tracePath.empty() && arg.compare(0, 2, "--") != 0)
+		{
+			tracePath = arg;
+		}
+		else
+		{
+			tracePath.clear();
+			break;
+		}
+	}
+
+	if (tracePath.empty())
+	{
+		fprintf(stderr, "Usage: %s [--max-speed] [--service <name>] <trace file>\n", ppArgv[0]);
+		return -1;
+	}
+
+	TraceReader reader;
+	if (!reader.open(tracePath))
+	{
+		fprintf(stderr, "Unable to read trace '%s'\n", tracePath.c_str());
+		return -1;
+	}
+
+	// We build the server directly rather than via `ggkStart()`, since we don't want the adapter configuration or BlueZ
+	TheServer = std::make_shared<Server>(serviceName, serviceName, serviceName, dataGetter, dataSetter);
+
+	gchar *pAddress = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+	GDBusConnection *pApplicationConnection = nullptr == pAddress ? nullptr : connect(pAddress);
+	GDBusConnection *pClientConnection = nullptr == pAddress ? nullptr : connect(pAddress);
+	g_free(pAddress);
+
+	// Our objects are served from the server's main context on a thread of their own, just as they are in a real deployment
+	std::vector<guint> ids;
+	bool busReady = nullptr != pApplicationConnection && nullptr != pClientConnection;
+	g_main_context_push_thread_default(MainContext::get());
+	for (const DBusObject &object : TheServer->getObjects())
+	{
+		GDBusNodeInfo *pNode = busReady ? object.getIntrospectionNodeInfo() : nullptr;
+		busReady = nullptr != pNode && registerNode(pApplicationConnection, pNode, pNode->path, ids);
+	}
+	g_main_context_pop_thread_default(MainContext::get());
+
+	if (!busReady)
+	{
+		fprintf(stderr, "No session bus (try running under dbus-run-session); only HCI events will be replayed\n");
+	}
+
+	GMainLoop *pLoop = g_main_loop_new(MainContext::get(), FALSE);
+	std::thread loopThread([pLoop]() { g_main_loop_run(pLoop); });
+
+	// Replies to our requests are dispatched on our own context, which we iterate while we wait
+	GMainContext *pClientContext = g_main_context_new();
+	g_main_context_push_thread_default(pClientContext);
+
+	const gchar *pApplicationName = busReady ? g_dbus_connection_get_unique_name(pApplicationConnection) : nullptr;
+	std::vector<uint8_t> eventBuffer(kEventBufferSize);
+	ReplayState state;
+	TraceRecord record;
+	int64_t traceMicroseconds = 0;
+	TheStats.reset();
+
+	gint64 startTime = g_get_monotonic_time();
+	while (reader.next(record))
+	{
+		traceMicroseconds = record.timestampUS;
+		waitUntil(pClientContext, maxSpeed ? 0 : startTime + record.timestampUS, kMaxOutstandingCalls, state);
+
+		if (record.type == TraceRecord::EHciEvent)
+		{
+			// Events are parsed in place, so give them a buffer as large as the socket's (any bytes past the packet are zero)
+			size_t length = std::min(record.packet.size(), eventBuffer.size());
+			memset(eventBuffer.data(), 0, eventBuffer.size());
+			memcpy(eventBuffer.data(), record.packet.data(), length);
+			HciAdapter::getInstance().processEvent(eventBuffer.data(), length);
+			++state.hciEvents;
+		}
+		else if (!busReady || !sendRequest(pClientConnection, pApplicationName, record, state))
+		{
+			++state.skipped;
+		}
+		else if (record.type == TraceRecord::EMethodCall)
+		{
+			++state.methodCalls;
+		}
+		else if (record.type == TraceRecord::EGetProperty)
+		{
+			++state.propertyGets;
+		}
+		else
+		{
+			++state.propertySets;
+		}
+	}
+
+	// Collect the last of the replies
+	waitUntil(pClientContext, 0, 1, state);
+	double elapsedNanoseconds = static_cast<double>(g_get_monotonic_time() - startTime) * 1000.0;
+
+	if (reader.isTruncated())
+	{
+		fprintf(stderr, "The trace ends part-way through a record; the rest of it was ignored\n");
+	}
+
+	GGKStats stats;
+	TheStats.snapshot(&stats);
+	uint64_t replayed = state.hciEvents + state.methodCalls + state.propertyGets + state.propertySets;
+	printf("{\"benchmark\":\"replay\",\"iterations\":%llu,\"ns_per_op\":%.1f", static_cast<unsigned long long>(replayed),
+		replayed == 0 ? 0.0 : elapsedNanoseconds / static_cast<double>(replayed));
+	printf(",\"max_speed\":%d,\"trace_ms\":%.1f,\"elapsed_ms\":%.1f", maxSpeed ? 1 : 0, traceMicroseconds / 1000.0, elapsedNanoseconds / 1e6);
+	printf(",\"hci_events\":%llu,\"method_calls\":%llu,\"property_gets\":%llu,\"property_sets\":%llu,\"errors\":%llu,\"skipped\":%llu",
+		static_cast<unsigned long long>(state.hciEvents), static_cast<unsigned long long>(state.methodCalls),
+		static_cast<unsigned long long>(state.propertyGets), static_cast<unsigned long long>(state.propertySets),
+		static_cast<unsigned long long>(state.errors), static_cast<unsigned long long>(state.skipped));
+	printf(",\"method_call_avg_us\":%.1f,\"method_call_max_us\":%llu,\"property_get_avg_us\":%.1f,\"property_get_max_us\":%llu",
+		stats.methodCallLatency.count == 0 ? 0.0 : static_cast<double>(stats.methodCallLatency.totalMicroseconds) / stats.methodCallLatency.count,
+		stats.methodCallLatency.maxMicroseconds,
+		stats.propertyGetLatency.count == 0 ? 0.0 : static_cast<double>(stats.propertyGetLatency.totalMicroseconds) / stats.propertyGetLatency.count,
+		stats.propertyGetLatency.maxMicroseconds);
+	printf(",\"notifications_sent\":%llu}\n", stats.notificationsSent);
+	fflush(stdout);
+
+	g_main_context_pop_thread_default(pClientContext);
+
+	for (guint id : ids)
+	{
+		g_dbus_connection_unregister_object(pApplicationConnection, id);
+	}
+
+	g_main_loop_quit(pLoop);
+	loopThread.join();
+	g_main_loop_unref(pLoop);
+
+	for (GDBusConnection *pConnection : { pApplicationConnection, pClientConnection })
+	{
+		if (nullptr != pConnection)
+		{
+			g_dbus_connection_close_sync(pConnection, nullptr, nullptr);
+			g_object_unref(pConnection);
+		}
+	}
+	g_main_context_unref(pClientContext);
+
+	TheServer = nullptr;
+	return 0;
+}
@@ -46,6 +46,10 @@
 //         whose data has been updated. This will trigger your server's `onUpdatedValue()` method, which can perform whatever
 //         actions are needed such as sending out a change notification (or in BlueZ parlance, a "PropertiesChanged" signal.)
 //
+//         Values that change often can instead live in the server's data store. Register a slot with `ggkRegisterDataSlot()` and
+//         publish new values to it with `ggkPublish()`. This skips the named lookups entirely and, for slots bound to a
+//         characteristic, also triggers that characteristic's `onUpdatedValue()`. We do this for the battery level below.
+//
 // * A stand-alone application SHOULD:
 //
 //     * Shutdown the server before termination
@@ -120,8 +124,9 @@ static const int kMaxAsyncInitTimeoutMS = 30 * 1000;
 // Server data values
 //
 
-// The battery level ("battery/level") reported by the server (see Server.cpp)
+// The battery level reported by the server, which we publish to the "battery/level" data slot (see Server.cpp)
 static uint8_t serverDataBatteryLevel = 78;
+static int batteryLevelSlot = -1;
 
 // The text string ("text/string") used by our custom text string service (see Server.cpp)
 static std::string serverDataTextString = "Hello, world!";
@@ -193,11 +198,7 @@ const void *dataGetter(const char *pName)
 
 	std::string strName = pName;
 
-	if (strName == "battery/level")
-	{
-		return &serverDataBatteryLevel;
-	}
-	else if (strName == "text/string")
+	if (strName == "text/string")
 	{
 		return serverDataTextString.c_str();
 	}
@@ -227,13 +228,7 @@ int dataSetter(const char *pName, const void *pData)
 
 	std::string strName = pName;
 
-	if (strName == "battery/level")
-	{
-		serverDataBatteryLevel = *static_cast<const uint8_t *>(pData);
-		LogDebug((std::string("Server data: battery level set to ") + std::to_string(serverDataBatteryLevel)).c_str());
-		return 1;
-	}
-	else if (strName == "text/string")
+	if (strName == "text/string")
 	{
 		serverDataTextString = static_cast<const char *>(pData);
 		LogDebug((std::string("Server data: text string set to '") + serverDataTextString + "'").c_str());
@@ -251,6 +246,8 @@ int dataSetter(const char *pName, const void *pData)
 
 int main(int argc, char **ppArgv)
 {
+	std::string traceFile;
+
 	// A basic command-line parser
 	for (int i = 1; i < argc; ++i)
 	{
@@ -267,11 +264,21 @@ int main(int argc, char **ppArgv)
 		{
 			logLevel = Debug;
 		}
+		else if (arg == "-a" && i + 1 < argc)
+		{
+			// Serve on this adapter (may be repeated to serve on several adapters at once)
+			ggkAddAdapter(ppArgv[++i], "", "");
+		}
+		else if (arg == "-t" && i + 1 < argc)
+		{
+			// Record a trace of the server's traffic (this can be replayed later with the replay program)
+			traceFile = ppArgv[++i];
+		}
 		else
 		{
 			LogFatal((std::string("Unknown parameter: '") + arg + "'").c_str());
 			LogFatal("");
-			LogFatal("Usage: standalone [-q | -v | -d]");
+			LogFatal("Usage: standalone [-q | -v | -d] [-a <adapter> ...] [-t <trace file>]");
 			return -1;
 		}
 	}
@@ -290,6 +297,16 @@ int main(int argc, char **ppArgv)
 	ggkLogRegisterAlways(LogAlways);
 	ggkLogRegisterTrace(LogTrace);
 
+	// Start recording our trace, if we were asked to
+	if (!traceFile.empty() && !ggkStartTrace(traceFile.c_str()))
+	{
+		return -1;
+	}
+
+	// Register our battery level's data slot and give it its initial value
+	batteryLevelSlot = ggkRegisterDataSlot("battery/level", sizeof(serverDataBatteryLevel));
+	ggkPublish(batteryLevelSlot, &serverDataBatteryLevel, sizeof(serverDataBatteryLevel));
+
 	// Start the server's ascync processing
 	//
 	// This starts the server on a thread and begins the initialization process
@@ -312,7 +329,7 @@ int main(int argc, char **ppArgv)
 		std::this_thread::sleep_for(std::chrono::seconds(15));
 
 		serverDataBatteryLevel = std::max(serverDataBatteryLevel - 1, 0);
-		ggkNofifyUpdatedCharacteristic("/com/gobbledegook/battery/level");
+		ggkPublish(batteryLevelSlot, &serverDataBatteryLevel, sizeof(serverDataBatteryLevel));
 	}
 
 	// Wait for the server to come to a complete stop (CTRL-C from the command line)